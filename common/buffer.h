@@ -82,6 +82,11 @@ struct iovec;
 #define	BUFFER_SEGMENT_CACHE_LIMIT	(0)
 #endif
 
+/*
+ * The largest block size Buffer::transform can gather across BufferSegments.
+ */
+#define	BUFFER_TRANSFORM_BLOCK_MAX	(64)
+
 typedef	unsigned buffer_segment_size_t;
 
 /*
@@ -458,6 +463,14 @@ public:
 		return (equal(seg->data(), seg->length()));
 	}
 
+	/*
+	 * The number of BufferSegments kept for reuse.
+	 */
+	static size_t cached(void)
+	{
+		return (segment_cache.size());
+	}
+
 private:
 	static std::deque<BufferSegment *> segment_cache;
 };
@@ -1568,6 +1581,101 @@ public:
 		trim(length_ - len);
 	}
 
+	/*
+	 * Replace the contents of this Buffer with the output of a function
+	 * f(dst, src, len) run over them, in runs whose lengths are multiples
+	 * of block_size, as a block cipher needs.  BufferSegments which are
+	 * held exclusively are transformed in place (dst == src); shared ones
+	 * are transformed into new BufferSegments.  Blocks which straddle
+	 * BufferSegments are gathered into a bounce block and scattered back.
+	 *
+	 * Returns false, leaving the contents undefined, if f does.
+	 */
+	template<typename F>
+	bool transform(F& f, unsigned block_size = 1)
+	{
+		struct piece {
+			uint8_t *dst_;
+			unsigned len_;
+		} pieces[BUFFER_TRANSFORM_BLOCK_MAX];
+		uint8_t block[BUFFER_TRANSFORM_BLOCK_MAX];
+		unsigned npieces = 0;
+		unsigned have = 0;
+
+		ASSERT("/buffer", block_size != 0);
+		ASSERT("/buffer", block_size <= BUFFER_TRANSFORM_BLOCK_MAX);
+		ASSERT("/buffer", length_ % block_size == 0);
+
+		segment_list_t::iterator it;
+		for (it = data_.begin(); it != data_.end(); ++it) {
+			BufferSegment *seg = *it;
+			const uint8_t *src = seg->data();
+			unsigned len = seg->length();
+			uint8_t *dst;
+
+			if (seg->exclusive()) {
+				dst = seg->head();
+			} else {
+				BufferSegment *copy = BufferSegment::create();
+				copy->set_length(len);
+				dst = copy->head();
+				*it = copy;
+			}
+
+			unsigned off = 0;
+			if (have != 0) {
+				unsigned take = block_size - have;
+				if (take > len)
+					take = len;
+				memcpy(block + have, src, take);
+				pieces[npieces].dst_ = dst;
+				pieces[npieces].len_ = take;
+				npieces++;
+				have += take;
+				off = take;
+
+				if (have == block_size) {
+					if (!f(block, block, block_size)) {
+						if (*it != seg)
+							seg->unref();
+						return (false);
+					}
+
+					unsigned i, o;
+					for (i = 0, o = 0; i < npieces; i++) {
+						memcpy(pieces[i].dst_, block + o, pieces[i].len_);
+						o += pieces[i].len_;
+					}
+					npieces = 0;
+					have = 0;
+				}
+			}
+
+			unsigned run = (len - off) - ((len - off) % block_size);
+			if (run != 0 && !f(dst + off, src + off, run)) {
+				if (*it != seg)
+					seg->unref();
+				return (false);
+			}
+			off += run;
+
+			if (off != len) {
+				ASSERT("/buffer", have == 0);
+				memcpy(block, src + off, len - off);
+				pieces[0].dst_ = dst + off;
+				pieces[0].len_ = len - off;
+				npieces = 1;
+				have = len - off;
+			}
+
+			if (*it != seg)
+				seg->unref();
+		}
+		ASSERT("/buffer", have == 0);
+
+		return (true);
+	}
+
 	/*
 	 * Split this Buffer into a vector of Buffers at each occurrance of the
 	 * specified separator character sep.
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	COMMON_HISTOGRAM_H
+#define	COMMON_HISTOGRAM_H
+
+/*
+ * Each power of two is split into this many buckets, as a power of two, so
+ * each value is kept to within 1/8th of itself.
+ */
+#define	HISTOGRAM_SUB_BITS	(3)
+#define	HISTOGRAM_SUB_BUCKETS	(1u << HISTOGRAM_SUB_BITS)
+#define	HISTOGRAM_BUCKETS	((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * A log-linear histogram, in the manner of HdrHistogram, of 64-bit values,
+ * typically durations in nanoseconds.
+ *
+ * Recording is a handful of instructions and never allocates, so it can be
+ * done for every callback run.  Only one thread may record into a given
+ * histogram, but any may read it; a reader racing with the writer may see
+ * the count and the buckets disagree by the value being recorded, which is
+ * of no consequence for reporting.
+ */
+class Histogram {
+	uintmax_t buckets_[HISTOGRAM_BUCKETS];
+	uintmax_t count_;
+	uintmax_t sum_;
+	uintmax_t max_;
+public:
+	Histogram(void)
+	: count_(0),
+	  sum_(0),
+	  max_(0)
+	{
+		unsigned i;
+		for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+			buckets_[i] = 0;
+	}
+
+	~Histogram()
+	{ }
+
+	void record(uintmax_t value)
+	{
+		buckets_[index(value)]++;
+		count_++;
+		sum_ += value;
+		if (value > max_)
+			max_ = value;
+	}
+
+	uintmax_t count(void) const
+	{
+		return (count_);
+	}
+
+	uintmax_t sum(void) const
+	{
+		return (sum_);
+	}
+
+	uintmax_t max(void) const
+	{
+		return (max_);
+	}
+
+	/*
+	 * How many values recorded were below the limit.  Exact when the limit
+	 * is a power of two, and otherwise may count some values just above
+	 * the limit.
+	 */
+	uintmax_t count_below(uintmax_t limit) const
+	{
+		uintmax_t count = 0;
+		unsigned i;
+		for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+			if (lower(i) >= limit)
+				break;
+			count += buckets_[i];
+		}
+		return (count);
+	}
+
+	/*
+	 * The value which the given percentage of values recorded were at or
+	 * below, to within the precision of the buckets.
+	 */
+	uintmax_t percentile(double percent) const
+	{
+		if (count_ == 0)
+			return (0);
+
+		uintmax_t target = (uintmax_t)((percent / 100.0) * (double)count_ + 0.5);
+		if (target == 0)
+			target = 1;
+
+		uintmax_t count = 0;
+		unsigned i;
+		for (i = 0; i + 1 < HISTOGRAM_BUCKETS; i++) {
+			count += buckets_[i];
+			if (count >= target)
+				return (std::min(lower(i + 1) - 1, max_));
+		}
+		return (max_);
+	}
+
+private:
+	static unsigned index(uintmax_t value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+			return (value);
+
+		unsigned msb;
+#if defined(__GNUC__)
+		msb = 63 - __builtin_clzll(value);
+#else
+		for (msb = 63; (value >> msb) == 0; msb--)
+			continue;
+#endif
+		unsigned shift = msb - HISTOGRAM_SUB_BITS;
+		unsigned sub = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+		return (((shift + 1) << HISTOGRAM_SUB_BITS) + sub);
+	}
+
+	static uintmax_t lower(unsigned i)
+	{
+		if (i < HISTOGRAM_SUB_BUCKETS)
+			return (i);
+
+		unsigned shift = (i >> HISTOGRAM_SUB_BITS) - 1;
+		unsigned sub = i & (HISTOGRAM_SUB_BUCKETS - 1);
+		return ((uintmax_t)(HISTOGRAM_SUB_BUCKETS + sub) << shift);
+	}
+};
+
+#endif /* !COMMON_HISTOGRAM_H */
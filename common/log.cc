@@ -35,61 +35,84 @@
 #include <list>
 #include <sstream>
 
+#include <common/thread/atomic.h>
+
+/*
+ * Each place a message is logged from may log at most LOG_RATE_BURST
+ * messages in LOG_RATE_SECONDS; any more are counted and dropped, and the
+ * count is added to the next message from there to be logged.  Places are
+ * told apart by function and line, hashed into LOG_RATE_SITES slots, so
+ * rarely two may share a limit.  Messages which are critical or worse are
+ * never dropped.
+ */
+#define	LOG_RATE_SITES		(1024)
+#define	LOG_RATE_SECONDS	(1)
+#define	LOG_RATE_BURST		(100)
+
+/*
+ * The limit cached for a handle which no mask matches.
+ */
+#define	LOG_MASK_ALL		(0xff)
+
 struct LogMask {
+	std::string string_;
 	regex_t regex_;
 	enum Log::Priority priority_;
+	bool removed_;
+};
+
+struct LogRateSite {
+	Atomic<uintmax_t> second_;
+	Atomic<unsigned> count_;
+	Atomic<unsigned> suppressed_;
 };
 
 static std::list<LogMask> log_masks;
+static volatile uintmax_t log_mask_generation = 1;
+
+static LogRateSite log_rate_sites[LOG_RATE_SITES];
 
+static LogQueue *volatile log_queue;
+
+static unsigned log_mask_limit(const std::string&);
+static bool log_rate_limit(const char *, unsigned, uintmax_t, unsigned *);
 #ifdef	USE_SYSLOG
 static int syslog_priority(const Log::Priority&);
 #endif
 static std::ostream& operator<< (std::ostream&, const Log::Priority&);
-static std::ostream& operator<< (std::ostream&, const struct timeval&);
+
+/*
+ * The masks are only evaluated for a handle when they have changed since it
+ * was last logged to; after that, a masked message costs a comparison.
+ */
+bool
+Log::enabled(const LogHandle& handle, const Priority& priority)
+{
+	uintmax_t generation = log_mask_generation;
+	uintmax_t cached = handle.mask_;
+	unsigned limit;
+
+	if ((cached >> 8) == generation) {
+		limit = cached & 0xff;
+	} else {
+		limit = log_mask_limit(handle.string_);
+		handle.mask_ = (generation << 8) | limit;
+	}
+
+	return ((unsigned)priority <= limit);
+}
 
 void
 Log::log(const Priority& priority, const LogHandle& handle,
-	 const std::string& message)
+	 const std::string& message, const char *function, unsigned line)
 {
-	std::list<LogMask>::const_iterator it;
-	std::string handle_string = (std::string)handle;
-
 	/*
 	 * XXX
 	 * Skip this all if we're in a HALT or NOTREACHED, since we can
 	 * generate those here.  Critical logs cannot ever be masked, right?
 	 */
-	for (it = log_masks.begin(); it != log_masks.end(); ++it) {
-		const LogMask& mask = *it;
-		int rv;
-
-		rv = regexec(&mask.regex_, handle_string.c_str(), 0, NULL, 0);
-		switch (rv) {
-		case 0:
-			if (priority <= mask.priority_)
-				goto done;
-			return;
-		case REG_NOMATCH:
-			continue;
-		default:
-			HALT("/log") << "Could not match regex: " << rv;
-			return;
-		}
-		NOTREACHED("/log");
-	}
-
-done:
-#ifdef	USE_SYSLOG
-	std::string syslog_message;
-
-	syslog_message += "[";
-	syslog_message += (std::string)handle;
-	syslog_message += "] ";
-	syslog_message += message;
-
-	syslog(syslog_priority(priority), "%s", syslog_message.c_str());
-#endif
+	if (!enabled(handle, priority))
+		return;
 
 	struct timeval now;
 	int rv;
@@ -98,10 +121,36 @@ done:
 	if (rv == -1)
 		memset(&now, 0, sizeof now);
 
-	std::cerr << now << " [" << handle_string << "] " <<
-		priority << ": " <<
-		message <<
-		std::endl;
+	unsigned suppressed = 0;
+	if (function != NULL && priority > Critical) {
+		if (!log_rate_limit(function, line, now.tv_sec, &suppressed))
+			return;
+	}
+
+	LogRecord record(now.tv_sec, now.tv_usec, priority, handle, message);
+	if (suppressed != 0) {
+		std::ostringstream str;
+		str << " (" << suppressed << " more suppressed)";
+		record.message_ += str.str();
+	}
+
+	LogQueue *queue = log_queue;
+	if (queue != NULL) {
+		/*
+		 * Anything this serious may be followed by a halt, so write
+		 * out what came before it, and then it, right away.
+		 */
+		if (priority <= Critical) {
+			queue->flush();
+		} else {
+			LogRecord *queued = new LogRecord(record);
+			if (queue->enqueue(queued))
+				return;
+			delete queued;
+		}
+	}
+
+	write(record);
 }
 
 bool
@@ -113,13 +162,126 @@ Log::mask(const std::string& handle_regex, const Log::Priority& priority)
 		      REG_NOSUB | REG_EXTENDED) != 0) {
 		return (false);
 	}
+	mask.string_ = handle_regex;
 	mask.priority_ = priority;
+	mask.removed_ = false;
 
 	log_masks.push_back(mask);
+	log_mask_generation++;
 
 	return (true);
 }
 
+/*
+ * Masks are only marked as removed, and never taken out of the list, since
+ * other threads may be looking through it.
+ */
+bool
+Log::unmask(const std::string& handle_regex)
+{
+	std::list<LogMask>::reverse_iterator it;
+
+	for (it = log_masks.rbegin(); it != log_masks.rend(); ++it) {
+		LogMask& mask = *it;
+
+		if (mask.removed_ || mask.string_ != handle_regex)
+			continue;
+
+		mask.removed_ = true;
+		log_mask_generation++;
+
+		return (true);
+	}
+
+	return (false);
+}
+
+void
+Log::queue(LogQueue *queue)
+{
+	log_queue = queue;
+}
+
+void
+Log::write(const LogRecord& record)
+{
+#ifdef	USE_SYSLOG
+	std::string syslog_message;
+
+	syslog_message += "[";
+	syslog_message += record.handle_;
+	syslog_message += "] ";
+	syslog_message += record.message_;
+
+	syslog(syslog_priority(record.priority_), "%s", syslog_message.c_str());
+#endif
+
+	char buf[40];
+
+	snprintf(buf, sizeof buf, "%ju.%06u", record.seconds_,
+		 record.microseconds_);
+
+	std::cerr << buf << " [" << record.handle_ << "] " <<
+		record.priority_ << ": " <<
+		record.message_ <<
+		std::endl;
+}
+
+/*
+ * The least important priority the first mask matching a handle lets
+ * through.
+ */
+static unsigned
+log_mask_limit(const std::string& handle_string)
+{
+	std::list<LogMask>::const_iterator it;
+
+	for (it = log_masks.begin(); it != log_masks.end(); ++it) {
+		const LogMask& mask = *it;
+		int rv;
+
+		if (mask.removed_)
+			continue;
+
+		rv = regexec(&mask.regex_, handle_string.c_str(), 0, NULL, 0);
+		switch (rv) {
+		case 0:
+			return (mask.priority_);
+		case REG_NOMATCH:
+			continue;
+		default:
+			HALT("/log") << "Could not match regex: " << rv;
+			return (LOG_MASK_ALL);
+		}
+		NOTREACHED("/log");
+	}
+
+	return (LOG_MASK_ALL);
+}
+
+/*
+ * Whether the message from the given place may be logged this second.  The
+ * first message in a new interval collects the count of those dropped in
+ * the last.
+ */
+static bool
+log_rate_limit(const char *function, unsigned line, uintmax_t second, unsigned *suppressedp)
+{
+	uintptr_t key = (uintptr_t)function + line * 2654435761u;
+	LogRateSite *site = &log_rate_sites[(key ^ (key >> 10)) % LOG_RATE_SITES];
+
+	uintmax_t last = site->second_.load();
+	if (second >= last + LOG_RATE_SECONDS && site->second_.cmpset(last, second)) {
+		site->count_.mask(0);
+		*suppressedp = site->suppressed_.mask(0);
+	}
+
+	if (site->count_.add(1) < LOG_RATE_BURST)
+		return (true);
+	site->suppressed_.add(1);
+	return (false);
+}
+
 #ifdef	USE_SYSLOG
 static int
 syslog_priority(const Log::Priority& priority)
@@ -176,13 +338,3 @@ operator<< (std::ostream& os, const Log::Priority& priority)
 		return (os);
 	}
 }
-
-static std::ostream&
-operator<< (std::ostream& os, const struct timeval& tv)
-{
-	char buf[20];
-
-	snprintf(buf, sizeof buf, "%u.%06u", (unsigned)tv.tv_sec,
-		 (unsigned)tv.tv_usec);
-	return (os << buf);
-}
@@ -52,14 +52,26 @@ public:
 };
 
 class LogHandle {
+	friend class Log;
+
 	std::string string_;
+
+	/*
+	 * What the masks allow for this handle, as found by Log::enabled the
+	 * last time they were evaluated, and which set of masks that was.
+	 * Zero until they first are.  This is a single word so that it may be
+	 * updated without locking by whichever thread logs.
+	 */
+	mutable uintmax_t mask_;
 public:
 	LogHandle(const char *s)
-	: string_(s)
+	: string_(s),
+	  mask_(0)
 	{ }
 
 	LogHandle(const std::string& s)
-	: string_(s)
+	: string_(s),
+	  mask_(0)
 	{ }
 
 	~LogHandle()
@@ -75,10 +87,14 @@ public:
 	{
 		LogHandle appended = *this;
 		appended.string_ += x;
+		appended.mask_ = 0;
 		return (appended);
 	}
 };
 
+struct LogRecord;
+class LogQueue;
+
 class Log {
 public:
 	enum Priority {
@@ -105,13 +121,17 @@ public:
 private:
 	LogHandle handle_;
 	Priority priority_;
+	const char *function_;
+	unsigned line_;
 	std::ostringstream str_;
 	bool pending_;
 	bool halted_;
 public:
-	Log(const LogHandle& handle, const Priority& priority, const std::string function)
+	Log(const LogHandle& handle, const Priority& priority, const char *function, unsigned line = 0)
 	: handle_(handle),
 	  priority_(priority),
+	  function_(function),
+	  line_(line),
 	  str_(),
 	  pending_(false),
 	  halted_(false)
@@ -163,30 +183,94 @@ public:
 	{
 		if (!pending_)
 			return;
-		Log::log(priority_, handle_, str_.str());
+		Log::log(priority_, handle_, str_.str(), function_, line_);
 	}
 
-	static void log(const Priority&, const LogHandle&, const std::string&);
+	static bool enabled(const LogHandle&, const Priority&);
+	static void log(const Priority&, const LogHandle&, const std::string&, const char * = NULL, unsigned = 0);
 	static bool mask(const std::string&, const Priority&);
+	static bool unmask(const std::string&);
+
+	static void queue(LogQueue *);
+	static void write(const LogRecord&);
+};
+
+/*
+ * A message which has passed the masks and rate limits, as it is handed to
+ * a LogQueue to be written out later.
+ */
+struct LogRecord {
+	uintmax_t seconds_;
+	unsigned microseconds_;
+	Log::Priority priority_;
+	std::string handle_;
+	std::string message_;
+
+	LogRecord(uintmax_t seconds, unsigned microseconds, const Log::Priority& priority, const std::string& handle, const std::string& message)
+	: seconds_(seconds),
+	  microseconds_(microseconds),
+	  priority_(priority),
+	  handle_(handle),
+	  message_(message)
+	{ }
+
+	~LogRecord()
+	{ }
+};
+
+/*
+ * Somewhere for the threads that log to leave their messages, to be written
+ * out by another, so that they need not wait on the terminal or syslog.
+ *
+ * A queue takes ownership of each record it accepts; one it refuses is
+ * written out by the thread logging it.  Flushing writes everything queued
+ * so far from the calling thread, and is done before a message which is
+ * likely to be the last, such as one which halts.
+ */
+class LogQueue {
+protected:
+	LogQueue(void)
+	{ }
+
+public:
+	virtual ~LogQueue()
+	{ }
+
+	virtual bool enqueue(LogRecord *) = 0;
+	virtual void flush(void) = 0;
 };
 
+/*
+ * Messages less important than this are compiled out entirely.  Builds which
+ * never want debugging messages may set it to Log::Info, for instance.
+ */
+#if !defined(LOG_PRIORITY_LIMIT)
+#define	LOG_PRIORITY_LIMIT	Log::Debug
+#endif
+
+/*
+ * Only build a message if it is going to be logged.  Nothing to the right of
+ * a masked message is evaluated.
+ */
+#define	LOG(log, priority)							for (bool log_enabled_ = (priority) <= LOG_PRIORITY_LIMIT &&					 Log::enabled((log), (priority));		     log_enabled_; log_enabled_ = false)					Log((log), (priority), __PRETTY_FUNCTION__, __LINE__)
+
 	/* A panic condition.  */
-#define	EMERGENCY(log)	Log(log, Log::Emergency, __PRETTY_FUNCTION__)
+#define	EMERGENCY(log)	Log(log, Log::Emergency, __PRETTY_FUNCTION__, __LINE__)
 	/* A condition that should be corrected immediately.  */
-#define	ALERT(log)	Log(log, Log::Alert, __PRETTY_FUNCTION__)
+#define	ALERT(log)	LOG(log, Log::Alert)
 	/* Critical condition.  */
-#define	CRITICAL(log)	Log(log, Log::Critical, __PRETTY_FUNCTION__)
+#define	CRITICAL(log)	LOG(log, Log::Critical)
 	/* Errors.  */
-#define	ERROR(log)	Log(log, Log::Error, __PRETTY_FUNCTION__)
+#define	ERROR(log)	LOG(log, Log::Error)
 	/* Warnings.  */
-#define	WARNING(log)	Log(log, Log::Warning, __PRETTY_FUNCTION__)
+#define	WARNING(log)	LOG(log, Log::Warning)
 	/* Conditions that are not error conditions, but may need handled.  */
-#define	NOTICE(log)	Log(log, Log::Notice, __PRETTY_FUNCTION__)
+#define	NOTICE(log)	LOG(log, Log::Notice)
 	/* Informational.  */
-#define	INFO(log)	Log(log, Log::Info, __PRETTY_FUNCTION__)
+#define	INFO(log)	LOG(log, Log::Info)
 	/* Debugging information.  */
 #if !defined(NDEBUG)
-#define	DEBUG(log)	Log(log, Log::Debug, __PRETTY_FUNCTION__)
+#define	DEBUG(log)	LOG(log, Log::Debug)
 #else
 #define	DEBUG(log)	LogNull()
 #endif
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include <common/buffer.h>
+#include <common/test.h>
+
+#define	TRANSFORM_LENGTH	(4 * BUFFER_SEGMENT_SIZE + 96)
+
+/*
+ * Lengths to cut data into BufferSegments with, chosen so that blocks of
+ * every size tried straddle BufferSegments, some of them more than two.
+ */
+static const unsigned segment_lengths[] = {
+	1, 5, 13, 64, 100, 7, 2, 1000, 31, 3, 130, 1,
+};
+
+/*
+ * A stand-in for a block cipher: each byte of a block comes out mixed with
+ * the sum of the whole block and with the number of blocks before it, so a
+ * block which was split, reordered or scattered back to the wrong place
+ * gives the wrong answer.
+ */
+class BlockMixer {
+	unsigned block_size_;
+	unsigned blocks_;
+	unsigned fail_after_;
+public:
+	bool bad_length_;
+	unsigned in_place_;
+	unsigned copied_;
+
+	BlockMixer(unsigned block_size, unsigned fail_after = 0)
+	: block_size_(block_size),
+	  blocks_(0),
+	  fail_after_(fail_after),
+	  bad_length_(false),
+	  in_place_(0),
+	  copied_(0)
+	{ }
+
+	bool operator() (uint8_t *dst, const uint8_t *src, unsigned len)
+	{
+		unsigned i, off;
+
+		if (len == 0 || len % block_size_ != 0)
+			bad_length_ = true;
+		if (dst == src)
+			in_place_++;
+		else
+			copied_++;
+
+		for (off = 0; off < len; off += block_size_) {
+			if (fail_after_ != 0 && blocks_ == fail_after_)
+				return (false);
+
+			uint8_t sum = 0;
+			for (i = 0; i < block_size_; i++)
+				sum += src[off + i];
+			for (i = 0; i < block_size_; i++)
+				dst[off + i] = src[off + i] ^ (uint8_t)(sum + blocks_ + i);
+			blocks_++;
+		}
+		return (true);
+	}
+};
+
+/*
+ * Append len bytes of data to buf as BufferSegments of the lengths above.
+ */
+static void
+append_segments(Buffer *buf, const uint8_t *data, unsigned len)
+{
+	unsigned i;
+
+	for (i = 0; len != 0; i++) {
+		unsigned seglen = segment_lengths[i % (sizeof segment_lengths / sizeof segment_lengths[0])];
+		if (seglen > len)
+			seglen = len;
+
+		BufferSegment *seg = BufferSegment::create(data, seglen);
+		buf->append(seg);
+		seg->unref();
+
+		data += seglen;
+		len -= seglen;
+	}
+}
+
+static std::vector<const uint8_t *>
+segment_data(const Buffer& buf)
+{
+	std::vector<const uint8_t *> vec;
+
+	Buffer::SegmentIterator iter = buf.segments();
+	while (!iter.end()) {
+		vec.push_back((*iter)->data());
+		iter.next();
+	}
+	return (vec);
+}
+
+int
+main(void)
+{
+	TestGroup g("/test/buffer/transform1", "Buffer::transform #1");
+
+	uint8_t data[TRANSFORM_LENGTH];
+	unsigned i;
+
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random();
+
+	static const unsigned block_sizes[] = { 1, 3, 8, 16, 48, BUFFER_TRANSFORM_BLOCK_MAX };
+	for (i = 0; i < sizeof block_sizes / sizeof block_sizes[0]; i++) {
+		unsigned block_size = block_sizes[i];
+		unsigned len = sizeof data - (sizeof data % block_size);
+
+		uint8_t expected[sizeof data];
+		BlockMixer reference(block_size);
+		reference(expected, data, len);
+		Buffer expected_buf(expected, len);
+
+		/*
+		 * Full BufferSegments, whose length block sizes of 3 and 48
+		 * do not divide.
+		 */
+		{
+			Buffer buf(data, len);
+			std::vector<const uint8_t *> before = segment_data(buf);
+
+			BlockMixer mixer(block_size);
+			{
+				Test _(g, "Transform contiguous BufferSegments.", buf.transform(mixer, block_size));
+			}
+			{
+				Test _(g, "Only whole blocks given to f.", !mixer.bad_length_);
+			}
+			{
+				Test _(g, "Expected output from contiguous BufferSegments.", buf.equal(&expected_buf));
+			}
+			{
+				Test _(g, "Exclusive BufferSegments transformed in place.", mixer.copied_ == 0 && segment_data(buf) == before);
+			}
+		}
+
+		/*
+		 * Short BufferSegments, which most blocks straddle, and which
+		 * must go through the bounce block.
+		 */
+		{
+			Buffer buf;
+			append_segments(&buf, data, len);
+			std::vector<const uint8_t *> before = segment_data(buf);
+
+			BlockMixer mixer(block_size);
+			{
+				Test _(g, "Transform short BufferSegments.", buf.transform(mixer, block_size));
+			}
+			{
+				Test _(g, "Only whole blocks given to f.", !mixer.bad_length_);
+			}
+			{
+				Test _(g, "Expected output from short BufferSegments.", buf.equal(&expected_buf));
+			}
+			{
+				Test _(g, "Short BufferSegments transformed in place.", mixer.copied_ == 0 && segment_data(buf) == before);
+			}
+		}
+
+		/*
+		 * Shared BufferSegments between exclusive ones, with blocks
+		 * straddling the boundaries between them.  The shared ones
+		 * must be copied, leaving the other holder's data alone.
+		 */
+		{
+			unsigned head = 2 * BUFFER_SEGMENT_SIZE / 3;
+			unsigned middle = len / 2;
+
+			Buffer shared;
+			append_segments(&shared, data + head, middle);
+			Buffer original(data + head, middle);
+
+			Buffer buf;
+			append_segments(&buf, data, head);
+			size_t exclusive_head = segment_data(buf).size();
+			buf.append(shared);
+			append_segments(&buf, data + head + middle, len - (head + middle));
+			std::vector<const uint8_t *> before = segment_data(buf);
+
+			BlockMixer mixer(block_size);
+			{
+				Test _(g, "Transform mixed BufferSegments.", buf.transform(mixer, block_size));
+			}
+			{
+				Test _(g, "Only whole blocks given to f.", !mixer.bad_length_);
+			}
+			{
+				Test _(g, "Expected output from mixed BufferSegments.", buf.equal(&expected_buf));
+			}
+			{
+				Test _(g, "Shared data left alone.", shared.equal(&original));
+			}
+
+			std::vector<const uint8_t *> after = segment_data(buf);
+			std::vector<const uint8_t *> shared_data = segment_data(shared);
+			bool in_place = after.size() == before.size();
+			bool copied = in_place;
+			unsigned j;
+			for (j = 0; in_place && j < after.size(); j++) {
+				if (j >= exclusive_head && j < exclusive_head + shared_data.size()) {
+					if (after[j] == before[j])
+						copied = false;
+				} else {
+					if (after[j] != before[j])
+						in_place = false;
+				}
+			}
+			{
+				Test _(g, "Exclusive BufferSegments transformed in place.", in_place);
+			}
+			{
+				Test _(g, "Shared BufferSegments copied.", copied && mixer.copied_ != 0);
+			}
+		}
+
+		/*
+		 * A failure from f is passed on, and shared data is still left
+		 * alone.
+		 */
+		if (len / block_size > 2) {
+			Buffer shared;
+			append_segments(&shared, data, len);
+			Buffer original(data, len);
+
+			Buffer buf(shared);
+			BlockMixer mixer(block_size, len / block_size / 2);
+			{
+				Test _(g, "Failure from f returned.", !buf.transform(mixer, block_size));
+			}
+			{
+				Test _(g, "Shared data left alone after failure.", shared.equal(&original));
+			}
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/histogram.h>
+#include <common/test.h>
+
+int
+main(void)
+{
+	TestGroup g("/test/histogram1", "Histogram #1");
+
+	{
+		Histogram h;
+		{
+			Test _(g, "Empty histogram has no samples.");
+			if (h.count() == 0 && h.sum() == 0 && h.max() == 0)
+				_.pass();
+		}
+		{
+			Test _(g, "Empty histogram has no percentiles.");
+			if (h.percentile(50.0) == 0)
+				_.pass();
+		}
+	}
+
+	{
+		Histogram h;
+		uintmax_t v;
+		for (v = 0; v < 8; v++)
+			h.record(v);
+		{
+			Test _(g, "Small values are kept exactly.");
+			if (h.percentile(50.0) == 3 && h.percentile(100.0) == 7)
+				_.pass();
+		}
+		{
+			Test _(g, "Count, sum and maximum of small values.");
+			if (h.count() == 8 && h.sum() == 28 && h.max() == 7)
+				_.pass();
+		}
+	}
+
+	{
+		Histogram h;
+		uintmax_t v;
+		for (v = 1; v <= 100000; v++)
+			h.record(v * 1000);
+		{
+			Test _(g, "Median within one bucket.");
+			uintmax_t p = h.percentile(50.0);
+			if (p >= 50000000 && p <= 50000000 + 50000000 / 8)
+				_.pass();
+		}
+		{
+			Test _(g, "99th percentile within one bucket.");
+			uintmax_t p = h.percentile(99.0);
+			if (p >= 99000000 && p <= 99000000 + 99000000 / 8)
+				_.pass();
+		}
+		{
+			Test _(g, "100th percentile is the maximum.");
+			if (h.percentile(100.0) == 100000000 && h.max() == 100000000)
+				_.pass();
+		}
+		{
+			Test _(g, "Counting below a power of two is exact.");
+			if (h.count_below(1 << 20) == 1048 &&
+			    h.count_below(1 << 10) == 1)
+				_.pass();
+		}
+		{
+			Test _(g, "Counting below anything larger counts everything.");
+			if (h.count_below(~(uintmax_t)0) == 100000)
+				_.pass();
+		}
+	}
+
+	{
+		Histogram h;
+		h.record(~(uintmax_t)0);
+		h.record((uintmax_t)1 << 63);
+		{
+			Test _(g, "Largest values are recorded.");
+			if (h.count() == 2 && h.max() == ~(uintmax_t)0 &&
+			    h.percentile(100.0) == ~(uintmax_t)0)
+				_.pass();
+		}
+	}
+}
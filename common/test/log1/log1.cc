@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+class TestLogQueue : public LogQueue {
+public:
+	unsigned records_;
+	unsigned flushes_;
+
+	TestLogQueue(void)
+	: records_(0),
+	  flushes_(0)
+	{ }
+
+	~TestLogQueue()
+	{ }
+
+	bool enqueue(LogRecord *record)
+	{
+		if (record->handle_ == "/test/log1/rate")
+			records_++;
+		delete record;
+		return (true);
+	}
+
+	void flush(void)
+	{
+		flushes_++;
+	}
+};
+
+static unsigned evaluated;
+
+static unsigned
+evaluate(void)
+{
+	return (++evaluated);
+}
+
+int
+main(void)
+{
+	TestGroup g("/test/log1", "Log #1");
+
+	LogHandle quiet("/test/log1/quiet");
+	LogHandle other("/test/log1/other");
+
+	{
+		Test _(g, "Everything is logged without masks.");
+		if (Log::enabled(quiet, Log::Debug) && Log::enabled(other, Log::Debug))
+			_.pass();
+	}
+
+	Log::mask("^/test/log1/quiet", Log::Error);
+	{
+		Test _(g, "A mask applies to the handles it matches.");
+		if (!Log::enabled(quiet, Log::Info) && Log::enabled(quiet, Log::Error))
+			_.pass();
+	}
+	{
+		Test _(g, "A mask leaves other handles alone.");
+		if (Log::enabled(other, Log::Debug))
+			_.pass();
+	}
+
+	Log::mask("^/test/log1/other", Log::Info);
+	{
+		Test _(g, "A new mask applies to a handle already logged to.");
+		if (!Log::enabled(other, Log::Debug) && Log::enabled(other, Log::Info))
+			_.pass();
+	}
+	{
+		Test _(g, "An appended handle is matched anew.");
+		LogHandle appended = other + "/appended";
+		if (!Log::enabled(appended, Log::Debug) && Log::enabled(appended, Log::Info))
+			_.pass();
+	}
+
+	INFO(quiet) << evaluate();
+	{
+		Test _(g, "A masked message is not built.");
+		if (evaluated == 0)
+			_.pass();
+	}
+
+	TestLogQueue queue;
+	Log::queue(&queue);
+	unsigned i;
+	for (i = 0; i < 1000; i++)
+		INFO("/test/log1/rate") << i;
+	Log::queue(NULL);
+	{
+		Test _(g, "A flood from one place is limited.");
+		if (queue.records_ != 0 && queue.records_ < 1000)
+			_.pass();
+	}
+	{
+		Test _(g, "Routine messages are queued without flushing.");
+		if (queue.flushes_ == 0)
+			_.pass();
+	}
+
+	return (0);
+}
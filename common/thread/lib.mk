@@ -2,6 +2,7 @@ VPATH+=	${TOPDIR}/common/thread
 
 THREAD_MODEL=	posix
 
+SRCS+=	log_thread.cc
 SRCS+=	mutex_${THREAD_MODEL}.cc
 SRCS+=	sleep_queue_${THREAD_MODEL}.cc
 SRCS+=	thread_${THREAD_MODEL}.cc
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include <common/thread/atomic.h>
+#include <common/thread/log_thread.h>
+#include <common/time/time.h>
+
+struct LogThread::Ring {
+	LogThread *owner_;
+	Atomic<unsigned> head_;
+	Atomic<unsigned> tail_;
+	LogRecord *records_[LOG_THREAD_RING_SIZE];
+
+	Ring(LogThread *owner)
+	: owner_(owner),
+	  head_(0),
+	  tail_(0),
+	  records_()
+	{ }
+};
+
+__thread LogThread::Ring *LogThread::thread_ring_;
+
+static bool log_record_before(const LogRecord *, const LogRecord *);
+
+LogThread::LogThread(void)
+: WorkerThread("LogThread"),
+  log_("/log/thread"),
+  write_mtx_("LogThread"),
+  rings_()
+{
+	Log::queue(this);
+}
+
+LogThread::~LogThread()
+{
+	Log::queue(NULL);
+
+	ScopedLock _(&write_mtx_);
+	drain();
+
+	std::vector<Ring *>::iterator it;
+	for (it = rings_.begin(); it != rings_.end(); ++it)
+		delete *it;
+	rings_.clear();
+}
+
+bool
+LogThread::enqueue(LogRecord *record)
+{
+	if (Thread::self() == this)
+		return (false);
+
+	Ring *ring = thread_ring();
+	if (ring == NULL)
+		return (false);
+
+	unsigned head = ring->head_.load();
+	if (head - ring->tail_.load() == LOG_THREAD_RING_SIZE) {
+		flush();
+		ASSERT(log_, head == ring->tail_.load());
+	}
+
+	ring->records_[head % LOG_THREAD_RING_SIZE] = record;
+
+	/*
+	 * A full barrier, so the record is seen before the new head is.
+	 */
+	ring->head_.add(1);
+
+	if (head - ring->tail_.load() + 1 == LOG_THREAD_RING_SIZE / 2)
+		submit();
+
+	return (true);
+}
+
+void
+LogThread::flush(void)
+{
+	if (Thread::self() == this)
+		return;
+
+	ScopedLock _(&write_mtx_);
+	drain();
+}
+
+/*
+ * The ring of the calling thread, made when it first logs.
+ */
+LogThread::Ring *
+LogThread::thread_ring(void)
+{
+	Ring *ring = thread_ring_;
+	if (ring != NULL && ring->owner_ == this)
+		return (ring);
+
+	ScopedLock _(&mtx_);
+	if (stop_)
+		return (NULL);
+	ring = new Ring(this);
+	rings_.push_back(ring);
+	thread_ring_ = ring;
+
+	return (ring);
+}
+
+/*
+ * Write out everything in the rings, oldest first.
+ */
+void
+LogThread::drain(void)
+{
+	ASSERT_LOCK_OWNED(log_, &write_mtx_);
+
+	std::vector<LogRecord *> records;
+	std::vector<std::pair<Ring *, unsigned> > heads;
+
+	{
+		ScopedLock _(&mtx_);
+		std::vector<Ring *>::const_iterator it;
+		for (it = rings_.begin(); it != rings_.end(); ++it) {
+			Ring *ring = *it;
+
+			/*
+			 * A full barrier, so the records are seen once the
+			 * head which covers them is.
+			 */
+			unsigned head = ring->head_.add(0);
+			unsigned tail;
+			for (tail = ring->tail_.load(); tail != head; tail++)
+				records.push_back(ring->records_[tail % LOG_THREAD_RING_SIZE]);
+			heads.push_back(std::make_pair(ring, head));
+		}
+	}
+
+	std::stable_sort(records.begin(), records.end(), log_record_before);
+
+	std::vector<LogRecord *>::iterator rit;
+	for (rit = records.begin(); rit != records.end(); ++rit) {
+		Log::write(**rit);
+		delete *rit;
+	}
+
+	std::vector<std::pair<Ring *, unsigned> >::iterator hit;
+	for (hit = heads.begin(); hit != heads.end(); ++hit)
+		hit->first->tail_.store(hit->second);
+}
+
+void
+LogThread::work(void)
+{
+	ScopedLock _(&write_mtx_);
+	drain();
+}
+
+void
+LogThread::wait(void)
+{
+	NanoTime deadline = NanoTime::current_time();
+	deadline.nanoseconds_ += LOG_THREAD_INTERVAL_MS * 1000 * 1000;
+	if (deadline.nanoseconds_ >= 1000000000) {
+		deadline.seconds_++;
+		deadline.nanoseconds_ -= 1000000000;
+	}
+	sleepq_.wait(&deadline);
+
+	pending_ = true;
+}
+
+/*
+ * Once stopped, leave the threads to write their own messages, and write
+ * out whatever they left before that.
+ *
+ * XXX
+ * A thread which was already adding a record when we stopped may leave it
+ * behind; it is written out when we are destroyed.
+ */
+void
+LogThread::final(void)
+{
+	Log::queue(NULL);
+
+	ScopedLock _(&write_mtx_);
+	drain();
+}
+
+static bool
+log_record_before(const LogRecord *a, const LogRecord *b)
+{
+	if (a->seconds_ == b->seconds_)
+		return (a->microseconds_ < b->microseconds_);
+	return (a->seconds_ < b->seconds_);
+}
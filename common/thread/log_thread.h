@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	COMMON_THREAD_LOG_THREAD_H
+#define	COMMON_THREAD_LOG_THREAD_H
+
+#include <vector>
+
+#include <common/thread/thread.h>
+
+/*
+ * How many records each thread may have waiting to be written, and how long
+ * the writer sleeps between looking for them, in milliseconds.
+ */
+#define	LOG_THREAD_RING_SIZE	(1024)
+#define	LOG_THREAD_INTERVAL_MS	(100)
+
+/*
+ * Writes out log messages on behalf of the other threads, which leave them
+ * in rings of their own and go on without waiting.  Each ring has only one
+ * thread adding to it and is only emptied with write_mtx_ held, so neither
+ * side need lock to use it.
+ *
+ * A thread which finds its ring full empties every ring itself, so that no
+ * messages are lost and those from any one thread stay in order.  Messages
+ * logged by this thread, and any logged once it has stopped, are written
+ * out straight away.
+ */
+class LogThread : public WorkerThread, public LogQueue {
+	struct Ring;
+
+	static __thread Ring *thread_ring_;
+
+	LogHandle log_;
+	Mutex write_mtx_;
+	std::vector<Ring *> rings_;
+public:
+	LogThread(void);
+	~LogThread();
+
+	bool enqueue(LogRecord *);
+	void flush(void);
+
+private:
+	Ring *thread_ring(void);
+	void drain(void);
+
+	void work(void);
+	void wait(void);
+	void final(void);
+};
+
+#endif /* !COMMON_THREAD_LOG_THREAD_H */
@@ -47,6 +47,11 @@ public:
 	void join(void);
 	void start(void);
 
+	const std::string& name(void) const
+	{
+		return (name_);
+	}
+
 	virtual void main(void) = 0;
 	virtual void stop(void) = 0;
 
@@ -40,6 +40,14 @@ struct NanoTime {
 	  nanoseconds_(src.nanoseconds_)
 	{ }
 
+	NanoTime& operator= (const NanoTime& src)
+	{
+		seconds_ = src.seconds_;
+		nanoseconds_ = src.nanoseconds_;
+
+		return (*this);
+	}
+
 	bool operator< (const NanoTime& b) const
 	{
 		if (seconds_ == b.seconds_)
@@ -96,6 +104,11 @@ struct NanoTime {
 		return (*this);
 	}
 
+	uintmax_t total_nanoseconds(void) const
+	{
+		return (seconds_ * 1000000000 + nanoseconds_);
+	}
+
 	static NanoTime current_time(void);
 };
 
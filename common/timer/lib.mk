@@ -1,3 +1,8 @@
 VPATH+=	${TOPDIR}/common/timer
 
 SRCS+=	timer.cc
+
+ifeq "${OSNAME}" "Linux"
+# Required for clock_gettime(3).
+LDADD+=		-lrt
+endif
@@ -28,6 +28,7 @@
 #include <config/config_exporter.h>
 #include <config/config_object.h>
 #include <config/config_type.h>
+#include <config/config_type_pointer.h>
 
 bool
 Config::activate(const std::string& oname)
@@ -38,7 +39,13 @@ Config::activate(const std::string& oname)
 	}
 
 	ConfigObject *co = object_map_[oname];
-	return (co->activate());
+	if (!co->activate())
+		return (false);
+
+	if (std::find(active_.begin(), active_.end(), co) == active_.end())
+		active_.push_back(co);
+
+	return (true);
 }
 
 bool
@@ -119,6 +126,194 @@ Config::set(const std::string& oname, const std::string& mname,
 	return (true);
 }
 
+/*
+ * Bring this configuration into line with another, which has been parsed but
+ * not activated, and the names of the objects it would activate, in order.
+ *
+ * Objects which are the same in both, down to everything they refer to, are
+ * left running.  Objects which are new or changed are taken from the other
+ * configuration, which is left empty, and have their members set, so that
+ * references among them and to kept objects are resolved here.  Only once
+ * all of that has worked are the objects they replace deactivated, in the
+ * reverse of the order they were activated in, and the new ones activated.
+ *
+ * If any fails to activate, those already activated are deactivated again
+ * and the old objects are put back and activated once more, so a failed
+ * reload leaves the running configuration as it was.  Objects which have
+ * been active are retired rather than freed, since connections may still
+ * be using them.
+ */
+bool
+Config::reload(Config *next, const std::deque<std::string>& activations)
+{
+	std::map<std::string, ConfigObject *>::iterator it;
+	std::deque<ConfigObject *>::const_iterator dit;
+	std::deque<ConfigObject *>::const_reverse_iterator rit;
+	std::deque<std::string>::const_iterator ait;
+	std::set<ConfigObject *>::const_iterator tit;
+	object_field_string_map_t::const_iterator fsit;
+
+	std::set<std::string> active;
+	for (dit = active_.begin(); dit != active_.end(); ++dit)
+		active.insert((*dit)->name_);
+	std::set<std::string> next_active(activations.begin(), activations.end());
+
+	std::set<std::string> keep;
+	for (it = object_map_.begin(); it != object_map_.end(); ++it) {
+		ConfigObject *nco = next->lookup(it->first);
+		if (nco == NULL)
+			continue;
+
+		std::set<const ConfigObject *> seen, next_seen;
+		if (signature(it->second, active, seen) != next->signature(nco, next_active, next_seen))
+			continue;
+		keep.insert(it->first);
+	}
+
+	std::map<std::string, ConfigObject *> previous_objects(object_map_);
+	object_field_string_map_t previous_field_strings(field_strings_map_);
+
+	std::map<std::string, ConfigObject *> replaced;
+	it = object_map_.begin();
+	while (it != object_map_.end()) {
+		ConfigObject *co = it->second;
+		if (keep.find(it->first) != keep.end()) {
+			++it;
+			continue;
+		}
+
+		object_field_string_map_t::iterator fsrit;
+		fsrit = field_strings_map_.lower_bound(object_field_string_map_t::key_type(co, ""));
+		while (fsrit != field_strings_map_.end() && fsrit->first.first == co)
+			field_strings_map_.erase(fsrit++);
+
+		replaced[it->first] = co;
+		object_map_.erase(it++);
+	}
+
+	/*
+	 * Take every object which is not being kept, and free the other
+	 * configuration's copies of those being kept.
+	 */
+	std::set<ConfigObject *> taken;
+	for (it = next->object_map_.begin(); it != next->object_map_.end(); ++it) {
+		ConfigObject *nco = it->second;
+		if (keep.find(it->first) != keep.end()) {
+			delete nco->instance_;
+			delete nco;
+			continue;
+		}
+
+		nco->config_ = this;
+		object_map_[it->first] = nco;
+		taken.insert(nco);
+	}
+	next->object_map_.clear();
+
+	for (fsit = next->field_strings_map_.begin(); fsit != next->field_strings_map_.end(); ++fsit) {
+		ConfigObject *co = fsit->first.first;
+		if (taken.find(co) == taken.end())
+			continue;
+		if (co->set(fsit->first.second, fsit->second)) {
+			field_strings_map_[fsit->first] = fsit->second;
+			continue;
+		}
+
+		ERROR(log_) << "Member (" << fsit->first.second << ") in object (" << co->name_ << ") could not be set on reload.";
+		next->field_strings_map_.clear();
+
+		/*
+		 * Nothing has been deactivated yet, and the new objects
+		 * have never been active, so they can simply go.
+		 */
+		object_map_.swap(previous_objects);
+		field_strings_map_.swap(previous_field_strings);
+		for (tit = taken.begin(); tit != taken.end(); ++tit) {
+			delete (*tit)->instance_;
+			delete *tit;
+		}
+		return (false);
+	}
+	next->field_strings_map_.clear();
+
+	std::deque<ConfigObject *> previous_active(active_);
+
+	for (rit = previous_active.rbegin(); rit != previous_active.rend(); ++rit) {
+		ConfigObject *co = *rit;
+		if (keep.find(co->name_) != keep.end())
+			continue;
+		INFO(log_) << "Deactivating object (" << co->name_ << ")";
+		co->deactivate();
+	}
+
+	std::deque<ConfigObject *> still_active;
+	for (dit = active_.begin(); dit != active_.end(); ++dit) {
+		if (keep.find((*dit)->name_) != keep.end())
+			still_active.push_back(*dit);
+	}
+	active_.swap(still_active);
+
+	for (tit = taken.begin(); tit != taken.end(); ++tit) {
+		ConfigObject *co = *tit;
+
+		std::map<std::string, ConfigObject *>::const_iterator rpit;
+		rpit = replaced.find(co->name_);
+		if (rpit == replaced.end() || rpit->second->class_ != co->class_)
+			continue;
+		co->instance_->inherit(rpit->second->instance_);
+	}
+
+	for (ait = activations.begin(); ait != activations.end(); ++ait) {
+		if (keep.find(*ait) != keep.end())
+			continue;
+		INFO(log_) << "Activating object (" << *ait << ")";
+		if (!activate(*ait)) {
+			ERROR(log_) << "Object (" << *ait << ") activation failed on reload.";
+			break;
+		}
+	}
+
+	if (ait == activations.end()) {
+		std::map<std::string, ConfigObject *>::const_iterator rpit;
+		for (rpit = replaced.begin(); rpit != replaced.end(); ++rpit)
+			retired_.push_back(rpit->second);
+		return (true);
+	}
+
+	/*
+	 * Take down what of the new configuration came up, in reverse, and
+	 * bring back what it replaced, in the order it was first activated.
+	 */
+	for (rit = active_.rbegin(); rit != active_.rend(); ++rit) {
+		ConfigObject *co = *rit;
+		if (taken.find(co) == taken.end())
+			continue;
+		INFO(log_) << "Deactivating object (" << co->name_ << ")";
+		co->deactivate();
+	}
+
+	for (tit = taken.begin(); tit != taken.end(); ++tit)
+		retired_.push_back(*tit);
+
+	object_map_.swap(previous_objects);
+	field_strings_map_.swap(previous_field_strings);
+
+	active_.clear();
+	for (dit = previous_active.begin(); dit != previous_active.end(); ++dit) {
+		ConfigObject *co = *dit;
+		if (keep.find(co->name_) == keep.end()) {
+			INFO(log_) << "Reactivating object (" << co->name_ << ")";
+			if (!co->activate()) {
+				ERROR(log_) << "Object (" << co->name_ << ") could not be reactivated.";
+				continue;
+			}
+		}
+		active_.push_back(co);
+	}
+
+	return (false);
+}
+
 void
 Config::import(ConfigClass *cc)
 {
@@ -136,3 +331,41 @@ Config::marshall(ConfigExporter *exp) const
 	for (it = object_map_.begin(); it != object_map_.end(); ++it)
 		exp->object(it->second, it->first);
 }
+
+/*
+ * Everything which determines how an object behaves once activated: its
+ * class, whether it is active, the values of its members and, in turn,
+ * those of the objects they refer to.
+ */
+std::string
+Config::signature(const ConfigObject *co, const std::set<std::string>& active, std::set<const ConfigObject *>& seen) const
+{
+	std::string sig = co->class_->name_ + " " + co->name_;
+
+	if (seen.find(co) != seen.end())
+		return (sig);
+	seen.insert(co);
+
+	if (active.find(co->name_) != active.end())
+		sig += " active";
+
+	object_field_string_map_t::const_iterator fsit;
+	fsit = field_strings_map_.lower_bound(object_field_string_map_t::key_type(const_cast<ConfigObject *>(co), ""));
+	while (fsit != field_strings_map_.end() && fsit->first.first == co) {
+		const std::string& mname = fsit->first.second;
+
+		sig += " " + mname + "=" + fsit->second;
+
+		std::map<std::string, const ConfigClassMember *>::const_iterator mit;
+		mit = co->class_->members_.find(mname);
+		if (mit != co->class_->members_.end() &&
+		    mit->second->type() == &config_type_pointer) {
+			ConfigObject *target = lookup(fsit->second);
+			if (target != NULL)
+				sig += " (" + signature(target, active, seen) + ")";
+		}
+		++fsit;
+	}
+
+	return (sig);
+}
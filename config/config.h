@@ -26,7 +26,9 @@
 #ifndef	CONFIG_CONFIG_H
 #define	CONFIG_CONFIG_H
 
+#include <deque>
 #include <map>
+#include <set>
 
 class ConfigClass;
 class ConfigClassInstance;
@@ -40,12 +42,17 @@ class Config {
 	std::map<std::string, ConfigClass *> class_map_;
 	std::map<std::string, ConfigObject *> object_map_;
 	object_field_string_map_t field_strings_map_;
+	std::deque<ConfigObject *> active_;
+	std::deque<ConfigObject *> retired_;
 
 public:
 	Config(void)
 	: log_("/config"),
 	  class_map_(),
-	  object_map_()
+	  object_map_(),
+	  field_strings_map_(),
+	  active_(),
+	  retired_()
 	{ }
 
 	~Config()
@@ -60,6 +67,8 @@ public:
 	bool create(const std::string&, const std::string&);
 	bool set(const std::string&, const std::string&, const std::string&);
 
+	bool reload(Config *, const std::deque<std::string>&);
+
 	void import(ConfigClass *);
 
 	void marshall(ConfigExporter *) const;
@@ -73,6 +82,9 @@ public:
 			return (NULL);
 		return (omit->second);
 	}
+
+private:
+	std::string signature(const ConfigObject *, const std::set<std::string>&, std::set<const ConfigObject *>&) const;
 };
 
 #endif /* !CONFIG_CONFIG_H */
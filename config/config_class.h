@@ -48,6 +48,21 @@ public:
 	{ }
 
 	virtual bool activate(const ConfigObject *) = 0;
+
+	/*
+	 * Undo activation when the object is removed or changed on reload.
+	 * Anything already handed out (e.g. to connections) must keep
+	 * working, as the instance is never freed.
+	 */
+	virtual void deactivate(const ConfigObject *)
+	{ }
+
+	/*
+	 * Take over what is worth keeping from the instance this one
+	 * replaces on reload, before being activated.
+	 */
+	virtual void inherit(const ConfigClassInstance *)
+	{ }
 };
 
 class ConfigClassMember {
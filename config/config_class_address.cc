@@ -23,6 +23,8 @@
  * SUCH DAMAGE.
  */
 
+#include <limits.h>
+
 #include <config/config_class.h>
 #include <config/config_class_address.h>
 
@@ -31,6 +33,32 @@ ConfigClassAddress config_class_address;
 bool
 ConfigClassAddress::Instance::activate(const ConfigObject *)
 {
+	if (send_buffer_ < 0 || send_buffer_ > INT_MAX ||
+	    receive_buffer_ < 0 || receive_buffer_ > INT_MAX ||
+	    notsent_lowat_ < 0 || notsent_lowat_ > INT_MAX) {
+		ERROR("/config/class/address") << "Socket buffer sizes must be between 0 and " << INT_MAX << ".";
+		return (false);
+	}
+
+	if (nodelay_ < 0 || nodelay_ > 1 || quickack_ < 0 || quickack_ > 1 ||
+	    keepalive_ < 0 || keepalive_ > 1) {
+		ERROR("/config/class/address") << "Socket flags must be 0 or 1.";
+		return (false);
+	}
+
+	if (keepalive_idle_ < 0 || keepalive_idle_ > INT_MAX ||
+	    keepalive_interval_ < 0 || keepalive_interval_ > INT_MAX ||
+	    keepalive_count_ < 0 || keepalive_count_ > INT_MAX) {
+		ERROR("/config/class/address") << "Keepalive settings must be between 0 and " << INT_MAX << ".";
+		return (false);
+	}
+
+	if (keepalive_ == 0 &&
+	    (keepalive_idle_ != 0 || keepalive_interval_ != 0 || keepalive_count_ != 0)) {
+		ERROR("/config/class/address") << "Keepalive settings given without keepalive.";
+		return (false);
+	}
+
 	switch (family_) {
 	case SocketAddressFamilyIP:
 	case SocketAddressFamilyIPv4:
@@ -46,6 +74,13 @@ ConfigClassAddress::Instance::activate(const ConfigObject *)
 			ERROR("/config/class/address") << "Unix domain socket has host and/or port field set, which is only valid for IP sockets.";
 			return (false);
 		}
+		if (nodelay_ != 0 || congestion_control_ != "" ||
+		    notsent_lowat_ != 0 || quickack_ != 0 ||
+		    keepalive_idle_ != 0 || keepalive_interval_ != 0 ||
+		    keepalive_count_ != 0) {
+			ERROR("/config/class/address") << "Unix domain socket has TCP options set, which are only valid for IP sockets.";
+			return (false);
+		}
 		return (true);
 
 	default:
@@ -53,3 +88,22 @@ ConfigClassAddress::Instance::activate(const ConfigObject *)
 		return (false);
 	}
 }
+
+SocketOptions
+ConfigClassAddress::Instance::options(void) const
+{
+	SocketOptions options;
+
+	options.nodelay_ = nodelay_ != 0;
+	options.send_buffer_ = send_buffer_;
+	options.receive_buffer_ = receive_buffer_;
+	options.congestion_control_ = congestion_control_;
+	options.notsent_lowat_ = notsent_lowat_;
+	options.quickack_ = quickack_ != 0;
+	options.keepalive_ = keepalive_ != 0;
+	options.keepalive_idle_ = keepalive_idle_;
+	options.keepalive_interval_ = keepalive_interval_;
+	options.keepalive_count_ = keepalive_count_;
+
+	return (options);
+}
@@ -27,8 +27,11 @@
 #define	CONFIG_CONFIG_CLASS_ADDRESS_H
 
 #include <config/config_type_address_family.h>
+#include <config/config_type_int.h>
 #include <config/config_type_string.h>
 
+#include <io/socket/socket_options.h>
+
 class ConfigClassAddress : public ConfigClass {
 public:
 	struct Instance : public ConfigClassInstance {
@@ -37,15 +40,38 @@ public:
 		std::string port_;
 		std::string path_;
 
+		intmax_t nodelay_;
+		intmax_t send_buffer_;
+		intmax_t receive_buffer_;
+		std::string congestion_control_;
+		intmax_t notsent_lowat_;
+		intmax_t quickack_;
+		intmax_t keepalive_;
+		intmax_t keepalive_idle_;
+		intmax_t keepalive_interval_;
+		intmax_t keepalive_count_;
+
 		Instance(void)
 		: family_(SocketAddressFamilyUnspecified),
 		  host_(""),
 		  port_(""),
-		  path_("")
+		  path_(""),
+		  nodelay_(0),
+		  send_buffer_(0),
+		  receive_buffer_(0),
+		  congestion_control_(""),
+		  notsent_lowat_(0),
+		  quickack_(0),
+		  keepalive_(0),
+		  keepalive_idle_(0),
+		  keepalive_interval_(0),
+		  keepalive_count_(0)
 		{
 		}
 
 		bool activate(const ConfigObject *);
+
+		SocketOptions options(void) const;
 	};
 
 	ConfigClassAddress(const std::string& xname = "address")
@@ -55,6 +81,17 @@ public:
 		add_member("host", &config_type_string, &Instance::host_);
 		add_member("port", &config_type_string, &Instance::port_); /* XXX enum?  */
 		add_member("path", &config_type_string, &Instance::path_);
+
+		add_member("nodelay", &config_type_int, &Instance::nodelay_);
+		add_member("send_buffer", &config_type_int, &Instance::send_buffer_);
+		add_member("receive_buffer", &config_type_int, &Instance::receive_buffer_);
+		add_member("congestion_control", &config_type_string, &Instance::congestion_control_);
+		add_member("notsent_lowat", &config_type_int, &Instance::notsent_lowat_);
+		add_member("quickack", &config_type_int, &Instance::quickack_);
+		add_member("keepalive", &config_type_int, &Instance::keepalive_);
+		add_member("keepalive_idle", &config_type_int, &Instance::keepalive_idle_);
+		add_member("keepalive_interval", &config_type_int, &Instance::keepalive_interval_);
+		add_member("keepalive_count", &config_type_int, &Instance::keepalive_count_);
 	}
 
 	~ConfigClassAddress()
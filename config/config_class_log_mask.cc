@@ -38,3 +38,10 @@ ConfigClassLogMask::Instance::activate(const ConfigObject *)
 
 	return (true);
 }
+
+void
+ConfigClassLogMask::Instance::deactivate(const ConfigObject *)
+{
+	if (!Log::unmask(regex_))
+		ERROR("/config/class/logmask") << "Could not remove log mask.";
+}
@@ -35,6 +35,7 @@ class ConfigClassLogMask : public ConfigClass {
 		Log::Priority mask_;
 
 		bool activate(const ConfigObject *);
+		void deactivate(const ConfigObject *);
 	};
 public:
 	ConfigClassLogMask(void)
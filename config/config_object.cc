@@ -33,6 +33,12 @@ ConfigObject::activate(void) const
 	return (instance_->activate(this));
 }
 
+void
+ConfigObject::deactivate(void) const
+{
+	instance_->deactivate(this);
+}
+
 void
 ConfigObject::marshall(ConfigExporter *exp) const
 {
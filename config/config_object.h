@@ -50,6 +50,7 @@ struct ConfigObject {
 	}
 
 	bool activate(void) const;
+	void deactivate(void) const;
 	void marshall(ConfigExporter *) const;
 	bool set(const std::string&, const std::string&);
 };
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+#include <config/config.h>
+#include <config/config_class.h>
+#include <config/config_object.h>
+#include <config/config_type_int.h>
+#include <config/config_type_pointer.h>
+
+class TestConfigClassNode : public ConfigClass {
+public:
+	struct Instance : public ConfigClassInstance {
+		intmax_t value_;
+		ConfigObject *next_;
+
+		bool active_;
+		const ConfigClassInstance *inherited_;
+
+		Instance(void)
+		: value_(0),
+		  next_(NULL),
+		  active_(false),
+		  inherited_(NULL)
+		{ }
+
+		bool activate(const ConfigObject *)
+		{
+			if (value_ < 0)
+				return (false);
+			active_ = true;
+			return (true);
+		}
+
+		void deactivate(const ConfigObject *)
+		{
+			active_ = false;
+		}
+
+		void inherit(const ConfigClassInstance *old)
+		{
+			inherited_ = old;
+		}
+	};
+
+	TestConfigClassNode(void)
+	: ConfigClass("test-config-node", new ConstructorFactory<ConfigClassInstance, Instance>)
+	{
+		add_member("value", &config_type_int, &Instance::value_);
+		add_member("next", &config_type_pointer, &Instance::next_);
+	}
+
+	~TestConfigClassNode()
+	{ }
+};
+
+static TestConfigClassNode test_config_class_node;
+
+static Config *
+config_create(std::deque<std::string>& activations, const char *nodes[][3])
+{
+	Config *config = new Config();
+	config->import(&test_config_class_node);
+
+	unsigned i;
+	for (i = 0; nodes[i][0] != NULL; i++) {
+		if (!config->create("test-config-node", nodes[i][0]))
+			return (NULL);
+		if (!config->set(nodes[i][0], "value", nodes[i][1]))
+			return (NULL);
+		if (nodes[i][2] != NULL &&
+		    !config->set(nodes[i][0], "next", nodes[i][2]))
+			return (NULL);
+		activations.push_back(nodes[i][0]);
+	}
+	return (config);
+}
+
+static TestConfigClassNode::Instance *
+instance(const Config *config, const std::string& oname)
+{
+	ConfigObject *co = config->lookup(oname);
+	if (co == NULL)
+		return (NULL);
+	return (dynamic_cast<TestConfigClassNode::Instance *>(co->instance_));
+}
+
+int
+main(void)
+{
+	static const char *nodes1[][3] = {
+		{ "a",	"1",	NULL },
+		{ "b",	"2",	"a" },
+		{ "c",	"3",	NULL },
+		{ NULL,	NULL,	NULL }
+	};
+	static const char *nodes2[][3] = {
+		{ "a",	"1",	NULL },
+		{ "b",	"2",	"a" },
+		{ "c",	"4",	NULL },
+		{ "d",	"5",	"c" },
+		{ NULL,	NULL,	NULL }
+	};
+	static const char *nodes3[][3] = {
+		{ "a",	"6",	NULL },
+		{ "b",	"2",	"a" },
+		{ "c",	"4",	NULL },
+		{ "d",	"5",	"c" },
+		{ NULL,	NULL,	NULL }
+	};
+	static const char *nodes4[][3] = {
+		{ "a",	"9",	NULL },
+		{ "b",	"2",	"a" },
+		{ "c",	"-1",	NULL },
+		{ NULL,	NULL,	NULL }
+	};
+
+	TestGroup g("/test/config/reload1", "Config reload #1");
+
+	std::deque<std::string> activations;
+	Config *config = config_create(activations, nodes1);
+	{
+		Test _(g, "Create configuration.");
+		if (config != NULL)
+			_.pass();
+	}
+	{
+		Test _(g, "Activate configuration.");
+		std::deque<std::string>::const_iterator it;
+		for (it = activations.begin(); it != activations.end(); ++it) {
+			if (!config->activate(*it))
+				break;
+		}
+		if (it == activations.end())
+			_.pass();
+	}
+
+	TestConfigClassNode::Instance *a = instance(config, "a");
+	TestConfigClassNode::Instance *b = instance(config, "b");
+	TestConfigClassNode::Instance *c = instance(config, "c");
+
+	activations.clear();
+	Config *next = config_create(activations, nodes2);
+	{
+		Test _(g, "Reload with one object changed and one added.");
+		if (next != NULL && config->reload(next, activations))
+			_.pass();
+	}
+	delete next;
+	{
+		Test _(g, "Unchanged objects are kept.");
+		if (instance(config, "a") == a && a->active_ &&
+		    instance(config, "b") == b && b->active_ &&
+		    b->next_ == config->lookup("a"))
+			_.pass();
+	}
+	{
+		Test _(g, "Changed object is replaced.");
+		TestConfigClassNode::Instance *nc = instance(config, "c");
+		if (!c->active_ && nc != c && nc->active_ &&
+		    nc->value_ == 4 && nc->inherited_ == c)
+			_.pass();
+	}
+	{
+		Test _(g, "New object refers to the running configuration.");
+		TestConfigClassNode::Instance *d = instance(config, "d");
+		if (d != NULL && d->active_ && d->inherited_ == NULL &&
+		    d->next_ == config->lookup("c") &&
+		    d->next_->config_ == config)
+			_.pass();
+	}
+
+	c = instance(config, "c");
+	TestConfigClassNode::Instance *d = instance(config, "d");
+
+	activations.clear();
+	next = config_create(activations, nodes3);
+	{
+		Test _(g, "Reload with an object which others refer to changed.");
+		if (next != NULL && config->reload(next, activations))
+			_.pass();
+	}
+	delete next;
+	{
+		Test _(g, "Objects referring to a changed object are replaced.");
+		TestConfigClassNode::Instance *nb = instance(config, "b");
+		if (!a->active_ && !b->active_ &&
+		    nb != b && nb->active_ && nb->next_ == config->lookup("a"))
+			_.pass();
+	}
+	{
+		Test _(g, "Objects which do not refer to it are kept.");
+		if (instance(config, "c") == c && c->active_ &&
+		    instance(config, "d") == d && d->active_)
+			_.pass();
+	}
+
+	a = instance(config, "a");
+	b = instance(config, "b");
+
+	activations.clear();
+	next = config_create(activations, nodes4);
+	{
+		Test _(g, "Fail to activate a bad object after others on reload.");
+		if (next != NULL && !config->reload(next, activations))
+			_.pass();
+	}
+	delete next;
+	{
+		Test _(g, "Failed reload restores the running configuration.");
+		if (instance(config, "a") == a && a->active_ &&
+		    instance(config, "b") == b && b->active_ &&
+		    instance(config, "c") == c && c->active_ &&
+		    instance(config, "d") == d && d->active_ &&
+		    b->next_ == config->lookup("a") &&
+		    d->next_ == config->lookup("c"))
+			_.pass();
+	}
+}
@@ -78,6 +78,8 @@ operator<< (std::ostream& os, CryptoEncryption::Algorithm algorithm)
 		return (os << "IDEA");
 	case CryptoEncryption::RC4:
 		return (os << "RC4");
+	case CryptoEncryption::ChaCha20:
+		return (os << "ChaCha20");
 	}
 	NOTREACHED("/crypto/encryption");
 }
@@ -90,6 +92,8 @@ operator<< (std::ostream& os, CryptoEncryption::Mode mode)
 		return (os << "CBC");
 	case CryptoEncryption::CTR:
 		return (os << "CTR");
+	case CryptoEncryption::GCM:
+		return (os << "GCM");
 	case CryptoEncryption::Stream:
 		return (os << "Stream");
 	}
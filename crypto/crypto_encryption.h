@@ -42,11 +42,13 @@ namespace CryptoEncryption {
 		CAST,
 		IDEA,
 		RC4,
+		ChaCha20,
 	};
 
 	enum Mode {
 		CBC,
 		CTR,
+		GCM,
 		Stream,
 	};
 	typedef	std::pair<Algorithm, Mode> Cipher;
@@ -73,9 +75,36 @@ namespace CryptoEncryption {
 
 		virtual bool initialize(Operation, const Buffer *, const Buffer *) = 0;
 
-		virtual bool cipher(Buffer *, const Buffer *) = 0;
+		/*
+		 * The input is consumed, and is encrypted or decrypted in place
+		 * where its BufferSegments are not shared.
+		 */
+		virtual bool cipher(Buffer *, Buffer *) = 0;
 
 		virtual Action *submit(Buffer *, EventCallback *) = 0;
+
+		/*
+		 * AEAD modes encrypt and authenticate in a single pass.  They
+		 * take a nonce with each message rather than chaining, and
+		 * authenticate (but do not encrypt) some additional data along
+		 * with it.  seal() appends the tag to the ciphertext; open()
+		 * expects it there, and fails if it does not match.  Like
+		 * cipher(), both consume their input.
+		 */
+		virtual unsigned tag_size(void) const
+		{
+			return (0);
+		}
+
+		virtual bool seal(Buffer *, const Buffer *, const Buffer *, Buffer *)
+		{
+			return (false);
+		}
+
+		virtual bool open(Buffer *, const Buffer *, const Buffer *, Buffer *)
+		{
+			return (false);
+		}
 	};
 
 	class Method {
@@ -25,28 +25,67 @@
 
 #include <openssl/aes.h>
 #include <openssl/evp.h>
+#include <openssl/modes.h>
 
 #include <common/factory.h>
 
 #include <crypto/crypto_encryption.h>
+#include <crypto/crypto_thread.h>
 
 namespace {
+	/*
+	 * Runs an EVP cipher over each run of a Buffer::transform.
+	 */
+	struct EVPTransform {
+		EVP_CIPHER_CTX *ctx_;
+
+		EVPTransform(EVP_CIPHER_CTX *ctx)
+		: ctx_(ctx)
+		{ }
+
+		bool operator() (uint8_t *dst, const uint8_t *src, size_t len)
+		{
+			return (EVP_Cipher(ctx_, dst, src, len) != 0);
+		}
+	};
+
+	/*
+	 * Runs an AEAD EVP cipher over each run of a Buffer::transform, for
+	 * which the output is always as long as the input.
+	 */
+	struct EVPUpdateTransform {
+		EVP_CIPHER_CTX *ctx_;
+
+		EVPUpdateTransform(EVP_CIPHER_CTX *ctx)
+		: ctx_(ctx)
+		{ }
+
+		bool operator() (uint8_t *dst, const uint8_t *src, size_t len)
+		{
+			int outlen;
+			if (EVP_CipherUpdate(ctx_, dst, &outlen, src, len) == 0)
+				return (false);
+			return ((size_t)outlen == len);
+		}
+	};
+
 	class SessionEVP : public CryptoEncryption::Session {
 		LogHandle log_;
 		const EVP_CIPHER *cipher_;
-		EVP_CIPHER_CTX ctx_;
+		EVP_CIPHER_CTX *ctx_;
 	public:
 		SessionEVP(const EVP_CIPHER *xcipher)
 		: log_("/crypto/encryption/session/openssl"),
 		  cipher_(xcipher),
-		  ctx_()
+		  ctx_(EVP_CIPHER_CTX_new())
 		{
-			EVP_CIPHER_CTX_init(&ctx_);
+			if (ctx_ == NULL)
+				HALT(log_) << "Could not allocate cipher context.";
 		}
 
 		~SessionEVP()
 		{
-			EVP_CIPHER_CTX_cleanup(&ctx_);
+			EVP_CIPHER_CTX_free(ctx_);
 		}
 
 		unsigned block_size(void) const
@@ -95,48 +134,60 @@ namespace {
 			uint8_t ivdata[iv->length()];
 			iv->copyout(ivdata, sizeof ivdata);
 
-			int rv = EVP_CipherInit(&ctx_, cipher_, keydata, ivdata, enc);
+			int rv = EVP_CipherInit(ctx_, cipher_, keydata, ivdata, enc);
 			if (rv == 0)
 				return (false);
 
 			return (true);
 		}
 
-		bool cipher(Buffer *out, const Buffer *in)
+		bool cipher(Buffer *out, Buffer *in)
 		{
-			/*
-			 * We process a single, large, linear byte buffer here rather
-			 * than going a BufferSegment at a time, even though the byte
-			 * buffer is less efficient than some alternatives, because
-			 * there are padding and buffering implications if each
-			 * BufferSegment's length is not modular to the block size.
-			 */
-			uint8_t indata[in->length()];
-			in->copyout(indata, sizeof indata);
+			unsigned block_size = EVP_CIPHER_block_size(cipher_);
+			if (in->length() % block_size != 0)
+				return (false);
 
-			uint8_t outdata[sizeof indata];
-			int rv = EVP_Cipher(&ctx_, outdata, indata, sizeof indata);
-			if (rv == 0)
+			EVPTransform f(ctx_);
+			if (!in->transform(f, block_size))
 				return (false);
-			out->append(outdata, sizeof outdata);
+			in->moveout(out);
 			return (true);
 		}
 
 		Action *submit(Buffer *in, EventCallback *cb)
 		{
-			Buffer out;
-			if (!cipher(&out, in)) {
-				in->clear();
-				cb->param(Event::Error);
-				return (cb->schedule());
-			}
-			in->clear();
-			cb->param(Event(Event::Done, out));
-			return (cb->schedule());
+			return (CryptoThread::submit(this, &SessionEVP::cipher, in, cb));
 		}
 	};
 
 	class SessionAES128CTR : public CryptoEncryption::Session {
+		/*
+		 * Temporaries for CRYPTO_ctr128_encrypt.
+		 *
+		 * Their values only need to persist if we aren't using block-sized
+		 * runs, which we are.  We could just use AES_ctr128_inc and do
+		 * the crypt operation by hand here.
+		 */
+		struct CTRTransform {
+			const AES_KEY *key_;
+			uint8_t *iv_;
+			uint8_t counterbuf_[AES_BLOCK_SIZE]; /* Will be initialized if countern_==0.  */
+			unsigned countern_;
+
+			CTRTransform(const AES_KEY *key, uint8_t *iv)
+			: key_(key),
+			  iv_(iv),
+			  counterbuf_(),
+			  countern_(0)
+			{ }
+
+			bool operator() (uint8_t *dst, const uint8_t *src, size_t len)
+			{
+				CRYPTO_ctr128_encrypt(src, dst, len, key_, iv_, counterbuf_, &countern_, (block128_f)AES_encrypt);
+				return (true);
+			}
+		};
+
 		LogHandle log_;
 		AES_KEY key_;
 		uint8_t iv_[AES_BLOCK_SIZE];
@@ -190,48 +241,190 @@ namespace {
 			return (true);
 		}
 
-		bool cipher(Buffer *out, const Buffer *in)
+		bool cipher(Buffer *out, Buffer *in)
 		{
 			ASSERT(log_, in->length() % AES_BLOCK_SIZE == 0);
 
-			/*
-			 * Temporaries for AES_ctr128_encrypt.
-			 *
-			 * Their values only need to persist if we aren't using block-sized
-			 * buffers, which we are.  We could just use AES_ctr128_inc and do
-			 * the crypt operation by hand here.
-			 */
-			uint8_t counterbuf[AES_BLOCK_SIZE]; /* Will be initialized if countern==0.  */
-			unsigned countern = 0;
-
-			/*
-			 * We process a single, large, linear byte buffer here rather
-			 * than going a BufferSegment at a time, even though the byte
-			 * buffer is less efficient than some alternatives, because
-			 * there are padding and buffering implications if each
-			 * BufferSegment's length is not modular to the block size.
-			 */
-			uint8_t indata[in->length()];
-			in->copyout(indata, sizeof indata);
-
-			uint8_t outdata[sizeof indata];
-			AES_ctr128_encrypt(indata, outdata, sizeof indata, &key_, iv_, counterbuf, &countern);
-
-			out->append(outdata, sizeof outdata);
+			CTRTransform f(&key_, iv_);
+			if (!in->transform(f, AES_BLOCK_SIZE))
+				return (false);
+			in->moveout(out);
+			return (true);
+		}
+
+		Action *submit(Buffer *in, EventCallback *cb)
+		{
+			return (CryptoThread::submit(this, &SessionAES128CTR::cipher, in, cb));
+		}
+	};
+
+	/*
+	 * AES in Galois/Counter Mode.  Encryption and GHASH are done in one
+	 * pass by OpenSSL, which uses AES-NI and carry-less multiply where
+	 * the CPU has them.
+	 */
+	class SessionAESGCM : public CryptoEncryption::Session {
+		LogHandle log_;
+		const EVP_CIPHER *cipher_;
+		EVP_CIPHER_CTX *ctx_;
+		CryptoEncryption::Operation operation_;
+	public:
+		SessionAESGCM(const EVP_CIPHER *xcipher)
+		: log_("/crypto/encryption/session/openssl"),
+		  cipher_(xcipher),
+		  ctx_(EVP_CIPHER_CTX_new()),
+		  operation_(CryptoEncryption::Encrypt)
+		{
+			if (ctx_ == NULL)
+				HALT(log_) << "Could not allocate cipher context.";
+		}
+
+		~SessionAESGCM()
+		{
+			EVP_CIPHER_CTX_free(ctx_);
+		}
+
+		unsigned block_size(void) const
+		{
+			return (AES_BLOCK_SIZE);
+		}
+
+		unsigned key_size(void) const
+		{
+			return (EVP_CIPHER_key_length(cipher_));
+		}
+
+		unsigned iv_size(void) const
+		{
+			return (EVP_CIPHER_iv_length(cipher_));
+		}
+
+		unsigned tag_size(void) const
+		{
+			return (AES_BLOCK_SIZE);
+		}
+
+		Session *clone(void) const
+		{
+			return (new SessionAESGCM(cipher_));
+		}
+
+		/*
+		 * The IV is supplied as the nonce to each seal() or open().
+		 */
+		bool initialize(CryptoEncryption::Operation operation, const Buffer *key, const Buffer *)
+		{
+			if (key->length() < (size_t)EVP_CIPHER_key_length(cipher_))
+				return (false);
+
+			int enc;
+			switch (operation) {
+			case CryptoEncryption::Encrypt:
+				enc = 1;
+				break;
+			case CryptoEncryption::Decrypt:
+				enc = 0;
+				break;
+			default:
+				return (false);
+			}
+			operation_ = operation;
+
+			uint8_t keydata[key->length()];
+			key->copyout(keydata, sizeof keydata);
+
+			if (EVP_CipherInit_ex(ctx_, cipher_, NULL, keydata, NULL, enc) == 0)
+				return (false);
+
 			return (true);
 		}
 
+		bool cipher(Buffer *, Buffer *)
+		{
+			ERROR(log_) << "GCM can only be used to seal or open messages.";
+			return (false);
+		}
+
 		Action *submit(Buffer *in, EventCallback *cb)
 		{
-			Buffer out;
-			if (!cipher(&out, in)) {
-				in->clear();
-				cb->param(Event::Error);
-				return (cb->schedule());
+			return (CryptoThread::submit(this, &SessionAESGCM::cipher, in, cb));
+		}
+
+		bool seal(Buffer *out, const Buffer *nonce, const Buffer *aad, Buffer *in)
+		{
+			ASSERT(log_, operation_ == CryptoEncryption::Encrypt);
+
+			if (!start(nonce, aad))
+				return (false);
+
+			EVPUpdateTransform f(ctx_);
+			if (!in->transform(f))
+				return (false);
+
+			uint8_t tag[AES_BLOCK_SIZE];
+			int finlen;
+			if (EVP_CipherFinal_ex(ctx_, tag, &finlen) == 0)
+				return (false);
+			ASSERT(log_, finlen == 0);
+
+			if (EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_GET_TAG, sizeof tag, tag) == 0)
+				return (false);
+
+			in->moveout(out);
+			out->append(tag, sizeof tag);
+			return (true);
+		}
+
+		bool open(Buffer *out, const Buffer *nonce, const Buffer *aad, Buffer *in)
+		{
+			ASSERT(log_, operation_ == CryptoEncryption::Decrypt);
+
+			if (in->length() < AES_BLOCK_SIZE)
+				return (false);
+
+			if (!start(nonce, aad))
+				return (false);
+
+			uint8_t tag[AES_BLOCK_SIZE];
+			in->copyout(tag, in->length() - sizeof tag, sizeof tag);
+			in->trim(sizeof tag);
+			if (EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_TAG, sizeof tag, tag) == 0)
+				return (false);
+
+			EVPUpdateTransform f(ctx_);
+			if (!in->transform(f))
+				return (false);
+
+			int finlen;
+			if (EVP_CipherFinal_ex(ctx_, tag, &finlen) <= 0)
+				return (false);
+
+			in->moveout(out);
+			return (true);
+		}
+
+	private:
+		bool start(const Buffer *nonce, const Buffer *aad)
+		{
+			if (nonce->length() != (size_t)EVP_CIPHER_iv_length(cipher_))
+				return (false);
+
+			uint8_t ivdata[nonce->length()];
+			nonce->copyout(ivdata, sizeof ivdata);
+
+			if (EVP_CipherInit_ex(ctx_, NULL, NULL, NULL, ivdata, -1) == 0)
+				return (false);
+
+			if (aad != NULL && !aad->empty()) {
+				uint8_t aaddata[aad->length()];
+				aad->copyout(aaddata, sizeof aaddata);
+
+				int outlen;
+				if (EVP_CipherUpdate(ctx_, NULL, &outlen, aaddata, sizeof aaddata) == 0)
+					return (false);
 			}
-			in->clear();
-			cb->param(Event(Event::Done, out));
-			return (cb->schedule());
+
+			return (true);
 		}
 	};
 
@@ -259,6 +452,9 @@ namespace {
 			factory<SessionAES128CTR> aes128ctr_factory;
 			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::AES128, CryptoEncryption::CTR), aes128ctr_factory());
 #endif
+			factory<SessionAESGCM> aesgcm_factory;
+			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::AES128, CryptoEncryption::GCM), aesgcm_factory(EVP_aes_128_gcm()));
+			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::AES256, CryptoEncryption::GCM), aesgcm_factory(EVP_aes_256_gcm()));
 #ifndef	OPENSSL_NO_BF
 			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::Blowfish, CryptoEncryption::CBC), evp_factory(EVP_bf_cbc()));
 #endif
@@ -269,6 +465,9 @@ namespace {
 			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::IDEA, CryptoEncryption::CBC), evp_factory(EVP_idea_cbc()));
 #endif
 			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::RC4, CryptoEncryption::Stream), evp_factory(EVP_rc4()));
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA)
+			cipher_map_.enter(CryptoEncryption::Cipher(CryptoEncryption::ChaCha20, CryptoEncryption::Stream), evp_factory(EVP_chacha20()));
+#endif
 
 			/* XXX Register.  */
 		}
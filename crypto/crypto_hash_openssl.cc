@@ -29,6 +29,7 @@
 #include <common/factory.h>
 
 #include <crypto/crypto_hash.h>
+#include <crypto/crypto_thread.h>
 
 namespace {
 	class InstanceEVP : public CryptoHash::Instance {
@@ -45,19 +46,25 @@ namespace {
 
 		virtual bool hash(Buffer *out, const Buffer *in)
 		{
-			/*
-			 * We process a single, large, linear byte buffer here rather
-			 * than going a BufferSegment at a time, even though the byte
-			 * buffer is less efficient than some alternatives, because
-			 * there are padding and buffering implications if each
-			 * BufferSegment's length is not modular to the block size.
-			 */
-			uint8_t indata[in->length()];
-			in->copyout(indata, sizeof indata);
+			EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+			if (ctx == NULL)
+				return (false);
+
+			bool ok = EVP_DigestInit_ex(ctx, algorithm_, NULL) != 0;
+
+			Buffer::SegmentIterator iter = in->segments();
+			while (ok && !iter.end()) {
+				const BufferSegment *seg = *iter;
+				ok = EVP_DigestUpdate(ctx, seg->data(), seg->length()) != 0;
+				iter.next();
+			}
 
 			uint8_t macdata[EVP_MD_size(algorithm_)];
 			unsigned maclen;
-			if (!EVP_Digest(indata, sizeof indata, macdata, &maclen, algorithm_, NULL))
+			if (ok)
+				ok = EVP_DigestFinal_ex(ctx, macdata, &maclen) != 0;
+			EVP_MD_CTX_destroy(ctx);
+			if (!ok)
 				return (false);
 			ASSERT(log_, maclen == sizeof macdata);
 			out->append(macdata, maclen);
@@ -66,15 +73,7 @@ namespace {
 
 		Action *submit(Buffer *in, EventCallback *cb)
 		{
-			Buffer out;
-			if (!hash(&out, in)) {
-				in->clear();
-				cb->param(Event::Error);
-				return (cb->schedule());
-			}
-			in->clear();
-			cb->param(Event(Event::Done, out));
-			return (cb->schedule());
+			return (CryptoThread::submit(this, &InstanceEVP::hash, in, cb));
 		}
 	};
 
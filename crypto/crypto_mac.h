@@ -39,6 +39,7 @@ namespace CryptoMAC {
 		SHA256,
 		SHA512,
 		RIPEMD160,
+		Poly1305,
 	};
 
 	class Instance {
@@ -29,8 +29,24 @@
 #include <common/factory.h>
 
 #include <crypto/crypto_mac.h>
+#include <crypto/crypto_thread.h>
 
 namespace {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	HMAC_CTX *HMAC_CTX_new(void)
+	{
+		HMAC_CTX *ctx = new HMAC_CTX;
+		HMAC_CTX_init(ctx);
+		return (ctx);
+	}
+
+	void HMAC_CTX_free(HMAC_CTX *ctx)
+	{
+		HMAC_CTX_cleanup(ctx);
+		delete ctx;
+	}
+#endif
+
 	class InstanceEVP : public CryptoMAC::Instance {
 		LogHandle log_;
 		const EVP_MD *algorithm_;
@@ -71,19 +87,25 @@ namespace {
 
 		bool mac(Buffer *out, const Buffer *in)
 		{
-			/*
-			 * We process a single, large, linear byte buffer here rather
-			 * than going a BufferSegment at a time, even though the byte
-			 * buffer is less efficient than some alternatives, because
-			 * there are padding and buffering implications if each
-			 * BufferSegment's length is not modular to the block size.
-			 */
-			uint8_t indata[in->length()];
-			in->copyout(indata, sizeof indata);
+			HMAC_CTX *ctx = HMAC_CTX_new();
+			if (ctx == NULL)
+				return (false);
+
+			bool ok = HMAC_Init_ex(ctx, key_, key_length_, algorithm_, NULL) != 0;
+
+			Buffer::SegmentIterator iter = in->segments();
+			while (ok && !iter.end()) {
+				const BufferSegment *seg = *iter;
+				ok = HMAC_Update(ctx, seg->data(), seg->length()) != 0;
+				iter.next();
+			}
 
 			uint8_t macdata[EVP_MD_size(algorithm_)];
 			unsigned maclen;
-			if (HMAC(algorithm_, key_, key_length_, indata, sizeof indata, macdata, &maclen) == NULL)
+			if (ok)
+				ok = HMAC_Final(ctx, macdata, &maclen) != 0;
+			HMAC_CTX_free(ctx);
+			if (!ok)
 				return (false);
 			ASSERT(log_, maclen == sizeof macdata);
 			out->append(macdata, maclen);
@@ -92,17 +114,94 @@ namespace {
 
 		Action *submit(Buffer *in, EventCallback *cb)
 		{
-			Buffer out;
-			if (!mac(&out, in)) {
-				in->clear();
-				cb->param(Event::Error);
-				return (cb->schedule());
+			return (CryptoThread::submit(this, &InstanceEVP::mac, in, cb));
+		}
+	};
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(OPENSSL_NO_POLY1305)
+	/*
+	 * Poly1305 is a one-time authenticator rather than an HMAC, so it
+	 * is keyed through EVP_PKEY and expects a fresh key per message.
+	 */
+	class InstancePoly1305 : public CryptoMAC::Instance {
+		LogHandle log_;
+		uint8_t key_[32];
+		size_t key_length_;
+	public:
+		InstancePoly1305(void)
+		: log_("/crypto/mac/instance/openssl"),
+		  key_(),
+		  key_length_(0)
+		{ }
+
+		~InstancePoly1305()
+		{ }
+
+		unsigned size(void) const
+		{
+			return (16);
+		}
+
+		Instance *clone(void) const
+		{
+			ASSERT(log_, key_length_ == 0);
+			return (new InstancePoly1305());
+		}
+
+		bool initialize(const Buffer *key)
+		{
+			if (key->length() != sizeof key_)
+				return (false);
+
+			key->copyout(key_, sizeof key_);
+			key_length_ = sizeof key_;
+
+			return (true);
+		}
+
+		bool mac(Buffer *out, const Buffer *in)
+		{
+			if (key_length_ == 0)
+				return (false);
+
+			EVP_PKEY *pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_POLY1305, NULL, key_, key_length_);
+			if (pkey == NULL)
+				return (false);
+
+			EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+			if (ctx == NULL) {
+				EVP_PKEY_free(pkey);
+				return (false);
+			}
+
+			uint8_t macdata[16];
+			size_t maclen = sizeof macdata;
+			bool ok = EVP_DigestSignInit(ctx, NULL, NULL, NULL, pkey) == 1;
+
+			Buffer::SegmentIterator iter = in->segments();
+			while (ok && !iter.end()) {
+				const BufferSegment *seg = *iter;
+				ok = EVP_DigestSignUpdate(ctx, seg->data(), seg->length()) == 1;
+				iter.next();
 			}
-			in->clear();
-			cb->param(Event(Event::Done, out));
-			return (cb->schedule());
+
+			if (ok)
+				ok = EVP_DigestSignFinal(ctx, macdata, &maclen) == 1;
+			EVP_MD_CTX_free(ctx);
+			EVP_PKEY_free(pkey);
+			if (!ok)
+				return (false);
+			ASSERT(log_, maclen == sizeof macdata);
+			out->append(macdata, maclen);
+			return (true);
+		}
+
+		Action *submit(Buffer *in, EventCallback *cb)
+		{
+			return (CryptoThread::submit(this, &InstancePoly1305::mac, in, cb));
 		}
 	};
+#endif
 
 	class MethodOpenSSL : public CryptoMAC::Method {
 		LogHandle log_;
@@ -121,6 +220,10 @@ namespace {
 			algorithm_map_.enter(CryptoMAC::SHA256, evp_factory(EVP_sha256()));
 			algorithm_map_.enter(CryptoMAC::SHA512, evp_factory(EVP_sha512()));
 			algorithm_map_.enter(CryptoMAC::RIPEMD160, evp_factory(EVP_ripemd160()));
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(OPENSSL_NO_POLY1305)
+			factory<InstancePoly1305> poly1305_factory;
+			algorithm_map_.enter(CryptoMAC::Poly1305, poly1305_factory());
+#endif
 
 			/* XXX Register.  */
 		}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+
+#include <sstream>
+
+#include <crypto/crypto_thread.h>
+
+#include <event/event_system.h>
+
+CryptoThread::CryptoThread(unsigned n)
+: WorkerThread("CryptoThread"),
+  log_("/crypto/thread"),
+  queue_(),
+  inflight_(NULL),
+  inflight_done_("CryptoThread", &mtx_)
+{
+	std::ostringstream os;
+	os << n;
+	log_ = log_ + "/" + os.str();
+}
+
+Action *
+CryptoThread::schedule(Request *r)
+{
+	mtx_.lock();
+	queue_.push_back(r);
+	mtx_.unlock();
+
+	WorkerThread::submit();
+
+	return (cancellation(this, &CryptoThread::cancel, r));
+}
+
+/*
+ * Requests are only ever cancelled from the EventThread, but they may be
+ * cancelled while we are working on them.  The operation is then using the
+ * object it was submitted for, which our caller may free as soon as we
+ * return, so wait for it to finish.
+ */
+void
+CryptoThread::cancel(Request *r)
+{
+	ScopedLock _(&mtx_);
+
+	if (r->callback_ == NULL) {
+		ASSERT(log_, r->action_ != NULL);
+		r->action_->cancel();
+		r->action_ = NULL;
+
+		delete r;
+		return;
+	}
+
+	delete r->callback_;
+	r->callback_ = NULL;
+
+	if (inflight_ == r) {
+		while (inflight_ == r)
+			inflight_done_.wait();
+		delete r;
+		return;
+	}
+
+	std::deque<Request *>::iterator it;
+	for (it = queue_.begin(); it != queue_.end(); ++it) {
+		if (*it != r)
+			continue;
+		queue_.erase(it);
+		delete r;
+		return;
+	}
+
+	NOTREACHED(log_);
+}
+
+void
+CryptoThread::work(void)
+{
+	mtx_.lock();
+	while (!queue_.empty()) {
+		Request *r = queue_.front();
+		queue_.pop_front();
+		inflight_ = r;
+		mtx_.unlock();
+
+		Buffer out;
+		bool ok = r->operation_->perform(&out, &r->input_);
+		r->input_.clear();
+
+		mtx_.lock();
+		inflight_ = NULL;
+		if (r->callback_ == NULL) {
+			inflight_done_.signal();
+			continue;
+		}
+
+		if (ok)
+			r->callback_->param(Event(Event::Done, out));
+		else
+			r->callback_->param(Event::Error);
+		r->action_ = r->callback_->schedule();
+		r->callback_ = NULL;
+	}
+	mtx_.unlock();
+}
+
+CryptoThread *
+CryptoThread::thread(const void *key)
+{
+	static std::vector<CryptoThread *> pool;
+
+	if (pool.empty()) {
+		long ncpu = ::sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpu < 1)
+			ncpu = 1;
+
+		while (pool.size() < (size_t)ncpu) {
+			CryptoThread *td = new CryptoThread(pool.size());
+			td->start();
+
+			EventSystem::instance()->thread_wait(td);
+
+			pool.push_back(td);
+		}
+	}
+
+	/*
+	 * Objects are aligned, so the low bits of their addresses carry no
+	 * information; mix them into the high bits and use those.
+	 */
+	uint64_t hash = (uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ull;
+	return (pool[(hash >> 32) % pool.size()]);
+}
+
+Action *
+CryptoThread::submit(const void *key, Operation *operation, Buffer *in, EventCallback *cb)
+{
+	Request *r = new Request(operation, cb);
+	in->moveout(&r->input_);
+
+	return (thread(key)->schedule(r));
+}
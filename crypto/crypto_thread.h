@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	CRYPTO_CRYPTO_THREAD_H
+#define	CRYPTO_CRYPTO_THREAD_H
+
+#include <deque>
+#include <vector>
+
+#include <common/thread/thread.h>
+
+#include <event/event_callback.h>
+
+/*
+ * CryptoThreads run cryptographic operations off of the EventThread, and
+ * schedule their callbacks back on it.
+ *
+ * Operations submitted for the same object (an encryption Session or a MAC
+ * Instance, say) always run on the same CryptoThread, and so one at a time
+ * and in the order they were submitted, which chained ciphers rely on.
+ * Different objects are spread across a pool of CryptoThreads, one for each
+ * CPU.
+ */
+class CryptoThread : public WorkerThread {
+public:
+	class Operation {
+	protected:
+		Operation(void)
+		{ }
+
+	public:
+		virtual ~Operation()
+		{ }
+
+		/*
+		 * The input belongs to the Operation, which may transform it in
+		 * place rather than copying it.
+		 */
+		virtual bool perform(Buffer *, Buffer *) = 0;
+	};
+
+private:
+	template<typename T, typename I>
+	class ObjectOperation : public Operation {
+		typedef bool (T::*method_t)(Buffer *, I *);
+
+		T *obj_;
+		method_t method_;
+	public:
+		ObjectOperation(T *obj, method_t method)
+		: obj_(obj),
+		  method_(method)
+		{ }
+
+		~ObjectOperation()
+		{ }
+
+		bool perform(Buffer *out, Buffer *in)
+		{
+			return ((obj_->*method_)(out, in));
+		}
+	};
+
+	struct Request {
+		Operation *operation_;
+		Buffer input_;
+		EventCallback *callback_;
+		Action *action_;
+
+		Request(Operation *operation, EventCallback *cb)
+		: operation_(operation),
+		  input_(),
+		  callback_(cb),
+		  action_(NULL)
+		{ }
+
+		~Request()
+		{
+			delete operation_;
+		}
+	};
+
+	LogHandle log_;
+	std::deque<Request *> queue_;
+	Request *inflight_;
+	SleepQueue inflight_done_;
+
+	CryptoThread(unsigned);
+
+	~CryptoThread()
+	{ }
+
+	Action *schedule(Request *);
+	void cancel(Request *);
+
+	void work(void);
+
+	static CryptoThread *thread(const void *);
+public:
+	static Action *submit(const void *, Operation *, Buffer *, EventCallback *);
+
+	template<typename T, typename I>
+	static Action *submit(T *obj, bool (T::*method)(Buffer *, I *), Buffer *in, EventCallback *cb)
+	{
+		return (submit(obj, new ObjectOperation<T, I>(obj, method), in, cb));
+	}
+};
+
+#endif /* !CRYPTO_CRYPTO_THREAD_H */
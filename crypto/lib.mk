@@ -3,6 +3,7 @@ VPATH+=	${TOPDIR}/crypto
 SRCS+=	crypto_encryption.cc
 SRCS+=	crypto_hash.cc
 SRCS+=	crypto_mac.cc
+SRCS+=	crypto_thread.cc
 
 SRCS+=	crypto_encryption_openssl.cc
 SRCS+=	crypto_hash_openssl.cc
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+#include <crypto/crypto_encryption.h>
+
+/*
+ * Test Cases 3 and 4 from McGrew and Viega's GCM specification, as used in
+ * NIST's GCM validation: the same key, IV and plaintext, the second with
+ * some of the plaintext left off and additional data to authenticate.
+ */
+static const uint8_t gcm_key[] = {
+	0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+	0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+};
+
+static const uint8_t gcm_iv[] = {
+	0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
+	0xde, 0xca, 0xf8, 0x88,
+};
+
+static const uint8_t gcm_plaintext[] = {
+	0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
+	0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+	0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+	0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+	0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+	0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+	0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+	0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55,
+};
+
+static const uint8_t gcm_ciphertext[] = {
+	0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24,
+	0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+	0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0,
+	0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+	0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c,
+	0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+	0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97,
+	0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85,
+};
+
+static const uint8_t gcm_aad[] = {
+	0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+	0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+	0xab, 0xad, 0xda, 0xd2,
+};
+
+static const uint8_t gcm_tag3[] = {
+	0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6,
+	0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4,
+};
+
+static const uint8_t gcm_tag4[] = {
+	0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb,
+	0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47,
+};
+
+static void
+gcm_test(TestGroup& g, const Buffer& aad, size_t length, const uint8_t *tag)
+{
+	CryptoEncryption::Cipher cipher(CryptoEncryption::AES128, CryptoEncryption::GCM);
+	const CryptoEncryption::Method *method = CryptoEncryption::Method::method(cipher);
+	if (method == NULL)
+		HALT("/test/crypto/aes128-gcm/seal1") << "Could not find a suitable method.";
+
+	Buffer key(gcm_key, sizeof gcm_key);
+	Buffer nonce(gcm_iv, sizeof gcm_iv);
+
+	Buffer expected(gcm_ciphertext, length);
+	expected.append(tag, 16);
+
+	CryptoEncryption::Session *session = method->session(cipher);
+	{
+		Test _(g, "Session initialize for sealing.", session->initialize(CryptoEncryption::Encrypt, &key, NULL));
+	}
+
+	Buffer plaintext(gcm_plaintext, length);
+	Buffer sealed;
+	{
+		Test _(g, "Seal.", session->seal(&sealed, &nonce, &aad, &plaintext));
+	}
+	{
+		Test _(g, "Expected ciphertext and tag.", sealed.equal(&expected));
+	}
+	delete session;
+
+	session = method->session(cipher);
+	{
+		Test _(g, "Session initialize for opening.", session->initialize(CryptoEncryption::Decrypt, &key, NULL));
+	}
+
+	Buffer in(expected);
+	Buffer opened;
+	{
+		Test _(g, "Open.", session->open(&opened, &nonce, &aad, &in));
+	}
+	{
+		Test _(g, "Expected plaintext.", opened.equal(gcm_plaintext, length));
+	}
+
+	/*
+	 * Changing any bit of the ciphertext must make the tag wrong.
+	 */
+	uint8_t first;
+	expected.extract(&first);
+	expected.skip(1);
+	Buffer tampered;
+	tampered.append((uint8_t)(first ^ 0x01));
+	tampered.append(expected);
+	opened.clear();
+	{
+		Test _(g, "Tampered ciphertext refused.", !session->open(&opened, &nonce, &aad, &tampered));
+	}
+	delete session;
+}
+
+int
+main(void)
+{
+	TestGroup g("/test/crypto/aes128-gcm/seal1", "AES128-GCM Seal #1");
+
+	gcm_test(g, Buffer(), sizeof gcm_plaintext, gcm_tag3);
+	gcm_test(g, Buffer(gcm_aad, sizeof gcm_aad), sizeof gcm_plaintext - 4, gcm_tag4);
+
+	return (0);
+}
@@ -43,10 +43,19 @@ public:
 };
 
 class CallbackBase {
+	friend class CallbackThread;
+
 	CallbackScheduler *scheduler_;
+
+	/*
+	 * When the callback was scheduled, in nanoseconds, for measuring how
+	 * long it waits to be run.
+	 */
+	uintmax_t scheduled_;
 protected:
 	CallbackBase(CallbackScheduler *scheduler)
-	: scheduler_(scheduler)
+	: scheduler_(scheduler),
+	  scheduled_(0)
 	{ }
 
 public:
@@ -23,11 +23,22 @@
  * SUCH DAMAGE.
  */
 
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+#include <stdlib.h>
+
+#include <typeinfo>
+
+#include <common/time/time.h>
+
 #include <event/callback_thread.h>
 
 #include <event/event_callback.h>
 #include <event/event_system.h>
 
+std::set<CallbackThread *> CallbackThread::threads_;
+
 CallbackThread::CallbackThread(const std::string& name)
 : Thread(name),
   log_("/callback/thread/" + name),
@@ -35,8 +46,24 @@ CallbackThread::CallbackThread(const std::string& name)
   sleepq_(name, &mtx_),
   idle_(false),
   queue_(),
-  inflight_(NULL)
-{ }
+  inflight_(NULL),
+  histogram_mtx_(name + " histograms"),
+  queue_delay_(),
+  execution_(),
+  type_execution_()
+{
+	threads_.insert(this);
+}
+
+CallbackThread::~CallbackThread()
+{
+	threads_.erase(this);
+
+	std::map<const char *, Histogram *>::iterator it;
+	for (it = type_execution_.begin(); it != type_execution_.end(); ++it)
+		delete it->second;
+	type_execution_.clear();
+}
 
 /*
  * NB:
@@ -47,6 +74,8 @@ CallbackThread::CallbackThread(const std::string& name)
 Action *
 CallbackThread::schedule(CallbackBase *cb)
 {
+	cb->scheduled_ = NanoTime::current_time().total_nanoseconds();
+
 	mtx_.lock();
 	bool need_wakeup = queue_.empty();
 	queue_.push_back(cb);
@@ -112,6 +141,53 @@ CallbackThread::cancel(CallbackBase *cb)
 	NOTREACHED(log_);
 }
 
+/*
+ * The histogram of how long callbacks of a type take to run, by the name of
+ * their type.
+ */
+Histogram *
+CallbackThread::histogram(const char *type)
+{
+	std::map<const char *, Histogram *>::const_iterator it;
+
+	it = type_execution_.find(type);
+	if (it != type_execution_.end())
+		return (it->second);
+
+	ScopedLock _(&histogram_mtx_);
+	Histogram *h = new Histogram();
+	type_execution_[type] = h;
+	return (h);
+}
+
+/*
+ * A copy of the histograms of each type of callback, named in a way fit
+ * for people to read.
+ */
+std::map<std::string, Histogram>
+CallbackThread::type_execution(void)
+{
+	std::map<std::string, Histogram> histograms;
+
+	ScopedLock _(&histogram_mtx_);
+	std::map<const char *, Histogram *>::const_iterator it;
+	for (it = type_execution_.begin(); it != type_execution_.end(); ++it) {
+		std::string name(it->first);
+#if defined(__GNUC__)
+		int status;
+		char *demangled = abi::__cxa_demangle(it->first, NULL, NULL, &status);
+		if (demangled != NULL) {
+			if (status == 0)
+				name = demangled;
+			free(demangled);
+		}
+#endif
+		histograms[name] = *it->second;
+	}
+
+	return (histograms);
+}
+
 void
 CallbackThread::main(void)
 {
@@ -153,9 +229,18 @@ CallbackThread::main(void)
 			 * lockless move of the whole queue out at a time.  That
 			 * would avoid the serious lock overhead involved here.
 			 */
+			uintmax_t start = NanoTime::current_time().total_nanoseconds();
+			queue_delay_.record(start > cb->scheduled_ ? start - cb->scheduled_ : 0);
+
+			Histogram *type_execution = histogram(typeid(*cb).name());
+
 			cb->execute();
 			delete cb;
 
+			uintmax_t duration = NanoTime::current_time().total_nanoseconds() - start;
+			execution_.record(duration);
+			type_execution->record(duration);
+
 			mtx_.lock();
 			if (inflight_ != NULL)
 				HALT(log_) << "Callback not cancelled in execution.";
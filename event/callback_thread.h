@@ -27,6 +27,10 @@
 #define	EVENT_CALLBACK_THREAD_H
 
 #include <deque>
+#include <map>
+#include <set>
+
+#include <common/histogram.h>
 
 #include <common/thread/thread.h>
 
@@ -41,17 +45,50 @@ private:
 	bool idle_;
 	std::deque<CallbackBase *> queue_;
 	CallbackBase *inflight_;
+
+	/*
+	 * Only this thread records into the histograms; the lock is needed
+	 * only to add a histogram for a type of callback not seen before,
+	 * and by anyone looking at them.
+	 */
+	Mutex histogram_mtx_;
+	Histogram queue_delay_;
+	Histogram execution_;
+	std::map<const char *, Histogram *> type_execution_;
+
+	static std::set<CallbackThread *> threads_;
 public:
 	CallbackThread(const std::string&);
-
-	~CallbackThread()
-	{ }
+	~CallbackThread();
 
 	Action *schedule(CallbackBase *);
 
+	/*
+	 * How long callbacks waited to be run after being scheduled, and how
+	 * long they took to run, in nanoseconds.
+	 */
+	const Histogram *queue_delay(void) const
+	{
+		return (&queue_delay_);
+	}
+
+	const Histogram *execution(void) const
+	{
+		return (&execution_);
+	}
+
+	std::map<std::string, Histogram> type_execution(void);
+
+	static const std::set<CallbackThread *>& threads(void)
+	{
+		return (threads_);
+	}
+
 private:
 	void cancel(CallbackBase *);
 
+	Histogram *histogram(const char *);
+
 	void main(void);
 
 public:
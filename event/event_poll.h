@@ -28,6 +28,8 @@
 
 #include <map>
 
+#include <common/histogram.h>
+
 #include <common/thread/mutex.h>
 #include <common/thread/thread.h>
 
@@ -88,6 +90,8 @@ private:
 	poll_handler_map_t read_poll_;
 	poll_handler_map_t write_poll_;
 	EventPollState *state_;
+	Histogram wait_;
+	Histogram dispatch_;
 
 public:
 	EventPoll(void);
@@ -95,6 +99,20 @@ public:
 
 	Action *poll(const Type&, int, EventCallback *);
 
+	/*
+	 * How long each pass of the poll thread spent waiting for events, and
+	 * then handing them out, in nanoseconds.
+	 */
+	const Histogram *wait_time(void) const
+	{
+		return (&wait_);
+	}
+
+	const Histogram *dispatch_time(void) const
+	{
+		return (&dispatch_);
+	}
+
 private:
 	void cancel(const Type&, int);
 	void main(void);
@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include <common/buffer.h>
+#include <common/time/time.h>
 
 #include <event/event_callback.h>
 #include <event/event_poll.h>
@@ -44,7 +45,9 @@ EventPoll::EventPoll(void)
 : log_("/event/poll"),
   read_poll_(),
   write_poll_(),
-  state_(new EventPollState())
+  state_(new EventPollState()),
+  wait_(),
+  dispatch_()
 {
 	state_->ep_ = epoll_create(EPOLL_EVENT_COUNT);
 	ASSERT(log_, state_->ep_ != -1);
@@ -151,7 +154,10 @@ EventPoll::wait(int ms)
 	}
 
 	struct epoll_event eev[EPOLL_EVENT_COUNT];
+	uintmax_t start = NanoTime::current_time().total_nanoseconds();
 	int evcnt = ::epoll_wait(state_->ep_, eev, EPOLL_EVENT_COUNT, ms);
+	uintmax_t ready = NanoTime::current_time().total_nanoseconds();
+	wait_.record(ready - start);
 	if (evcnt == -1) {
 		if (errno == EINTR) {
 			INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
@@ -204,4 +210,6 @@ EventPoll::wait(int ms)
 			HALT(log_) << "Unexpected poll events: " << ev->events;
 		}
 	}
+
+	dispatch_.record(NanoTime::current_time().total_nanoseconds() - ready);
 }
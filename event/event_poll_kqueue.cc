@@ -29,6 +29,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <common/time/time.h>
+
 #include <event/event_callback.h>
 #include <event/event_poll.h>
 
@@ -44,7 +46,9 @@ EventPoll::EventPoll(void)
   mtx_("EventPoll"),
   read_poll_(),
   write_poll_(),
-  state_(new EventPollState())
+  state_(new EventPollState()),
+  wait_(),
+  dispatch_()
 {
 	state_->kq_ = kqueue();
 	ASSERT(log_, state_->kq_ != -1);
@@ -186,7 +190,10 @@ EventPoll::main(void)
 	struct kevent kev[kevcnt];
 
 	for (;;) {
+		uintmax_t start = NanoTime::current_time().total_nanoseconds();
 		int evcnt = kevent(state_->kq_, NULL, 0, kev, kevcnt, NULL);
+		uintmax_t ready = NanoTime::current_time().total_nanoseconds();
+		wait_.record(ready - start);
 		if (evcnt == -1) {
 			if (errno == EINTR) {
 				INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
@@ -245,6 +252,7 @@ EventPoll::main(void)
 			 */
 			poll_handler->callback(Event(Event::Done, ev->fflags));
 		}
+		dispatch_.record(NanoTime::current_time().total_nanoseconds() - ready);
 
 		if (stop_)
 			break;
@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include <common/buffer.h>
+#include <common/time/time.h>
 
 #include <event/event_callback.h>
 #include <event/event_poll.h>
@@ -37,7 +38,9 @@ EventPoll::EventPoll(void)
 : log_("/event/poll"),
   read_poll_(),
   write_poll_(),
-  state_(NULL)
+  state_(NULL),
+  wait_(),
+  dispatch_()
 {
 }
 
@@ -129,7 +132,10 @@ EventPoll::wait(int ms)
 		return;
 	}
 
+	uintmax_t start = NanoTime::current_time().total_nanoseconds();
 	int fdcnt = ::poll(fds, nfds, ms);
+	uintmax_t ready = NanoTime::current_time().total_nanoseconds();
+	wait_.record(ready - start);
 	if (fdcnt == -1) {
 		if (errno == EINTR) {
 			INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
@@ -179,4 +185,6 @@ EventPoll::wait(int ms)
 		}
 		poll_handler->callback(Event::Done);
 	}
+
+	dispatch_.record(NanoTime::current_time().total_nanoseconds() - ready);
 }
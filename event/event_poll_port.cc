@@ -32,6 +32,7 @@
 #include <unistd.h>
 
 #include <common/buffer.h>
+#include <common/time/time.h>
 
 #include <event/action.h>
 #include <event/callback.h>
@@ -42,7 +43,9 @@ EventPoll::EventPoll(void)
 : log_("/event/poll"),
   read_poll_(),
   write_poll_(),
-  port_(port_create())
+  port_(port_create()),
+  wait_(),
+  dispatch_()
 {
 	ASSERT(log_, port_ != -1);
 }
@@ -157,7 +160,10 @@ EventPoll::wait(int ms)
 
 	port_event_t pev[pevcnt];
 	unsigned evcnt = 1;
+	uintmax_t start = NanoTime::current_time().total_nanoseconds();
 	int rv = port_getn(port_, pev, pevcnt, &evcnt, ms == -1 ? NULL : &ts);
+	uintmax_t ready = NanoTime::current_time().total_nanoseconds();
+	wait_.record(ready - start);
 	if (rv == -1) {
 		if (errno == EINTR) {
 			INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
@@ -226,4 +232,6 @@ EventPoll::wait(int ms)
 			HALT(log_) << "Unexpected poll events: " << ev->portev_events;
 		}
 	}
+
+	dispatch_.record(NanoTime::current_time().total_nanoseconds() - ready);
 }
@@ -28,6 +28,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <common/time/time.h>
+
 #include <event/event_callback.h>
 #include <event/event_poll.h>
 
@@ -35,7 +37,9 @@ EventPoll::EventPoll(void)
 : log_("/event/poll"),
   read_poll_(),
   write_poll_(),
-  state_(NULL)
+  state_(NULL),
+  wait_(),
+  dispatch_()
 {
 }
 
@@ -141,7 +145,10 @@ EventPoll::wait(int ms)
 		tvp = &tv;
 	}
 
+	uintmax_t start = NanoTime::current_time().total_nanoseconds();
 	int fdcnt = ::select(maxfd + 1, &read_set, &write_set, NULL, tvp);
+	uintmax_t ready = NanoTime::current_time().total_nanoseconds();
+	wait_.record(ready - start);
 	if (fdcnt == -1) {
 		if (errno == EINTR) {
 			INFO(log_) << "Received interrupt, ceasing polling until stop handlers have run.";
@@ -168,4 +175,6 @@ EventPoll::wait(int ms)
 			fdcnt--;
 		}
 	}
+
+	dispatch_.record(NanoTime::current_time().total_nanoseconds() - ready);
 }
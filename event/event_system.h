@@ -72,6 +72,21 @@ public:
 		return (timeout_.timeout(ms, cb));
 	}
 
+	const Histogram *poll_wait_time(void) const
+	{
+		return (poll_.wait_time());
+	}
+
+	const Histogram *poll_dispatch_time(void) const
+	{
+		return (poll_.dispatch_time());
+	}
+
+	const Histogram *timeout_lateness(void) const
+	{
+		return (timeout_.lateness());
+	}
+
 	void thread_wait(Thread *td)
 	{
 		threads_.push_back(td);
@@ -79,14 +94,18 @@ public:
 
 	void start(void)
 	{
-		td_.start();
+		/*
+		 * Register every thread before starting any of them, so that
+		 * a stop() from a callback run early on the EventThread is
+		 * not missed by threads started after it.
+		 */
 		thread_wait(&td_);
-
-		poll_.start();
 		thread_wait(&poll_);
+		thread_wait(&timeout_);
 
+		td_.start();
+		poll_.start();
 		timeout_.start();
-		thread_wait(&timeout_);
 	}
 
 	void join(void)
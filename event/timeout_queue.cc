@@ -23,11 +23,12 @@
  * SUCH DAMAGE.
  */
 
+#include <common/thread/mutex.h>
+
 #include <common/time/time.h>
 
 #include <event/action.h>
 #include <event/callback.h>
-#include <event/callback_queue.h>
 #include <event/timeout_queue.h>
 
 Action *
@@ -37,34 +38,46 @@ TimeoutQueue::append(uintmax_t ms, SimpleCallback *cb)
 
 	deadline.seconds_ += ms / 1000;
 	deadline.nanoseconds_ += (ms % 1000) * 1000000;
-
-	CallbackQueue *queue = timeout_queue_[deadline];
-	if (queue == NULL) {
-		queue = new CallbackQueue();
-		timeout_queue_[deadline] = queue;
+	if (deadline.nanoseconds_ >= 1000000000) {
+		deadline.seconds_++;
+		deadline.nanoseconds_ -= 1000000000;
 	}
-	Action *a = queue->schedule(cb);
+
+	TimeoutAction *a = new TimeoutAction(this, deadline, cb);
+
+	ScopedLock _(&mtx_);
+	timeout_queue_.insert(timeout_map_t::value_type(deadline, a));
 	return (a);
 }
 
+/*
+ * Schedule the callbacks of every timeout which has expired.
+ */
 void
 TimeoutQueue::perform(void)
 {
-	timeout_map_t::iterator it = timeout_queue_.begin();
-	if (it == timeout_queue_.end())
-		return;
+	ScopedLock _(&mtx_);
 	NanoTime now = NanoTime::current_time();
-	if (it->first > now)
-		return;
-	CallbackQueue *queue = it->second;
-	timeout_queue_.erase(it);
-	queue->drain();
-	delete queue;
+	while (!timeout_queue_.empty()) {
+		timeout_map_t::iterator it = timeout_queue_.begin();
+		if (it->first > now)
+			break;
+		NanoTime late(now);
+		late -= it->first;
+		lateness_.record(late.total_nanoseconds());
+
+		TimeoutAction *a = it->second;
+		timeout_queue_.erase(it);
+
+		a->action_ = a->callback_->schedule();
+		a->callback_ = NULL;
+	}
 }
 
 bool
-TimeoutQueue::ready(void) const
+TimeoutQueue::ready(void)
 {
+	ScopedLock _(&mtx_);
 	timeout_map_t::const_iterator it = timeout_queue_.begin();
 	if (it == timeout_queue_.end())
 		return (false);
@@ -73,3 +86,34 @@ TimeoutQueue::ready(void) const
 		return (true);
 	return (false);
 }
+
+void
+TimeoutQueue::cancel(TimeoutAction *a)
+{
+	mtx_.lock();
+	if (a->action_ != NULL) {
+		Action *action = a->action_;
+		a->action_ = NULL;
+		mtx_.unlock();
+
+		action->cancel();
+		return;
+	}
+
+	std::pair<timeout_map_t::iterator, timeout_map_t::iterator> range =
+		timeout_queue_.equal_range(a->deadline_);
+	timeout_map_t::iterator it;
+	for (it = range.first; it != range.second; ++it) {
+		if (it->second != a)
+			continue;
+		timeout_queue_.erase(it);
+		mtx_.unlock();
+
+		delete a->callback_;
+		a->callback_ = NULL;
+		return;
+	}
+	mtx_.unlock();
+
+	NOTREACHED(log_);
+}
@@ -28,63 +28,110 @@
 
 #include <map>
 
+#include <common/histogram.h>
+
+#include <common/thread/mutex.h>
+
 #include <common/time/time.h>
 
+/*
+ * Timeouts are appended and cancelled from any thread, and performed from
+ * the TimeoutThread, so everything here is done under the queue's lock.
+ *
+ * A timeout which has been performed has had its callback scheduled, and
+ * cancelling it cancels that instead.  The callback may well run before
+ * perform() has finished with it, and cancel itself, which is why perform()
+ * holds the lock until it has.
+ */
 class TimeoutQueue {
-	typedef std::map<NanoTime, CallbackQueue *> timeout_map_t;
+	class TimeoutAction : public Cancellable {
+	public:
+		TimeoutQueue *const queue_;
+		NanoTime deadline_;
+		SimpleCallback *callback_;
+		Action *action_;
+
+		TimeoutAction(TimeoutQueue *queue, const NanoTime& deadline, SimpleCallback *callback)
+		: Cancellable(),
+		  queue_(queue),
+		  deadline_(deadline),
+		  callback_(callback),
+		  action_(NULL)
+		{ }
+
+		~TimeoutAction()
+		{
+			ASSERT("/event/timeout/queue/action", callback_ == NULL);
+			ASSERT("/event/timeout/queue/action", action_ == NULL);
+		}
+
+		void cancel(void)
+		{
+			queue_->cancel(this);
+		}
+	};
+
+	friend class TimeoutAction;
+
+	typedef std::multimap<NanoTime, TimeoutAction *> timeout_map_t;
 
 	LogHandle log_;
+	Mutex mtx_;
 	timeout_map_t timeout_queue_;
+	Histogram lateness_;
 public:
 	TimeoutQueue(void)
 	: log_("/event/timeout/queue"),
-	  timeout_queue_()
+	  mtx_("TimeoutQueue"),
+	  timeout_queue_(),
+	  lateness_()
 	{ }
 
 	~TimeoutQueue()
 	{
 		timeout_map_t::iterator it;
 
-		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it)
-			delete it->second;
+		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it) {
+			TimeoutAction *a = it->second;
+
+			delete a->callback_;
+			a->callback_ = NULL;
+		}
 		timeout_queue_.clear();
 	}
 
-	/* XXX Can't be const because CallbackQueue::empty can't be due to locking.  */
 	bool empty(void)
 	{
-		timeout_map_t::iterator it;
+		ScopedLock _(&mtx_);
+		return (timeout_queue_.empty());
+	}
 
-		/*
-		 * Since we allow elements within each CallbackQueue to be
-		 * cancelled, we must scan them.
-		 *
-		 * XXX
-		 * We really shouldn't allow this, even if it means we have
-		 * to specialize CallbackQueue for this purpose or add
-		 * virtual methods to it.  As it is, we can return true
-		 * for empty and for ready at the same time.  And in those
-		 * cases we have to call perform to garbage collect the
-		 * unused CallbackQueues.  We'll, quite conveniently,
-		 * never make that call.  Yikes.
-		 */
-		for (it = timeout_queue_.begin(); it != timeout_queue_.end(); ++it) {
-			if (it->second->empty())
-				continue;
+	bool deadline(NanoTime *deadline)
+	{
+		ScopedLock _(&mtx_);
+		if (timeout_queue_.empty())
 			return (false);
-		}
+		deadline->seconds_ = timeout_queue_.begin()->first.seconds_;
+		deadline->nanoseconds_ = timeout_queue_.begin()->first.nanoseconds_;
 		return (true);
 	}
 
-	NanoTime deadline(void) const
+	/*
+	 * How long after their deadlines timeouts were scheduled, in
+	 * nanoseconds.  Recorded by perform(), and so by whichever one thread
+	 * calls it.
+	 */
+	const Histogram *lateness(void) const
 	{
-		ASSERT(log_, !timeout_queue_.empty());
-		return (timeout_queue_.begin()->first);
+		return (&lateness_);
 	}
 
 	Action *append(uintmax_t, SimpleCallback *);
 	void perform(void);
-	bool ready(void) const;
+	bool ready(void);
+
+private:
+	void cancel(TimeoutAction *);
 };
 
 #endif /* !EVENT_TIMEOUT_QUEUE_H */
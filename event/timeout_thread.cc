@@ -45,35 +45,22 @@ TimeoutThread::TimeoutThread(void)
   timeout_queue_()
 { }
 
-/*
- * XXX
- * Locking?
- */
 void
 TimeoutThread::work(void)
 {
-	if (!timeout_queue_.empty()) {
-		/*
-		 * XXX
-		 * We need to manage the queue here and schedule the
-		 * callbacks in the main EventThread, not just
-		 * execute them in this thread directly.
-		 */
-		while (timeout_queue_.ready())
-			timeout_queue_.perform();
-	}
+	timeout_queue_.perform();
 }
 
 void
 TimeoutThread::wait(void)
 {
-	if (timeout_queue_.empty()) {
+	NanoTime deadline;
+	if (!timeout_queue_.deadline(&deadline)) {
 		WorkerThread::wait();
 		return;
 	}
-	NanoTime deadline = timeout_queue_.deadline();
 	sleepq_.wait(&deadline);
 
-	if (!pending_ && !timeout_queue_.empty() && timeout_queue_.ready())
+	if (!pending_ && timeout_queue_.ready())
 		pending_ = true;
 }
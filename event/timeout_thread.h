@@ -27,7 +27,7 @@
 #define	EVENT_TIMEOUT_THREAD_H
 
 #include <common/thread/thread.h>
-#include <event/callback_queue.h>
+#include <event/callback.h>
 #include <event/timeout_queue.h>
 
 class TimeoutThread : public WorkerThread {
@@ -46,6 +46,11 @@ public:
 		return (a);
 	}
 
+	const Histogram *lateness(void) const
+	{
+		return (timeout_queue_.lateness());
+	}
+
 private:
 	void work(void);
 	void wait(void);
@@ -135,6 +135,9 @@ IOSystem::close(int fd, Channel *owner, SimpleCallback *cb)
 	ASSERT(log_, h->write_callback_ == NULL);
 	ASSERT(log_, h->write_action_ == NULL);
 
+	ASSERT(log_, h->close_callback_ == NULL);
+	ASSERT(log_, h->close_action_ == NULL);
+
 	ASSERT(log_, h->fd_ != -1);
 
 	return (h->close_do(cb));
@@ -199,9 +202,15 @@ IOSystem::write(int fd, Channel *owner, off_t offset, Buffer *buffer, EventCallb
 
 	ASSERT(log_, h->write_callback_ == NULL);
 	ASSERT(log_, h->write_action_ == NULL);
-	ASSERT(log_, h->write_buffer_.empty());
 
 	ASSERT(log_, !buffer->empty());
+
+	if (h->coalesce_) {
+		ASSERT(log_, offset == -1);
+		return (h->write_behind(buffer, cb));
+	}
+
+	ASSERT(log_, h->write_buffer_.empty());
 	buffer->moveout(&h->write_buffer_);
 
 	h->write_offset_ = offset;
@@ -217,3 +226,27 @@ IOSystem::write(int fd, Channel *owner, off_t offset, Buffer *buffer, EventCallb
 	ASSERT(log_, h->write_callback_ == NULL);
 	return (a);
 }
+
+/*
+ * Shut down a socket.  If the write side is being shut down, this waits
+ * for anything written before to be sent first.
+ */
+Action *
+IOSystem::shutdown(int fd, Channel *owner, int how, EventCallback *cb)
+{
+	IOSystem::Handle *h;
+
+	mtx_.lock();
+	h = handle_map_[handle_key_t(fd, owner)];
+	ASSERT(log_, h != NULL);
+
+	ScopedLock _(&h->mtx_);
+	mtx_.unlock();
+
+	ASSERT(log_, h->shutdown_callback_ == NULL);
+	ASSERT(log_, h->shutdown_action_ == NULL);
+
+	ASSERT(log_, h->fd_ != -1);
+
+	return (h->shutdown_do(how, cb));
+}
@@ -45,6 +45,7 @@ class IOSystem {
 
 		int fd_;
 		Channel *owner_;
+		bool coalesce_;
 
 		off_t read_offset_;
 		size_t read_amount_;
@@ -56,11 +57,28 @@ class IOSystem {
 		Buffer write_buffer_;
 		EventCallback *write_callback_;
 		Action *write_action_;
+		int write_error_;
+		bool write_error_reported_;
+
+		Action *flush_action_;
+
+		SimpleCallback *close_callback_;
+		Action *close_action_;
+
+		int shutdown_how_;
+		EventCallback *shutdown_callback_;
+		Action *shutdown_action_;
 
 		Handle(CallbackScheduler *, int, Channel *);
 		~Handle();
 
 		Action *close_do(SimpleCallback *);
+		void close_cancel(void);
+		void close_fd(void);
+
+		Action *shutdown_do(int, EventCallback *);
+		void shutdown_cancel(void);
+		void shutdown_fd(void);
 
 		void read_callback(Event);
 		void read_cancel(void);
@@ -71,6 +89,15 @@ class IOSystem {
 		void write_cancel(void);
 		Action *write_do(void);
 		Action *write_schedule(void);
+
+		Action *write_behind(Buffer *, EventCallback *);
+		void write_release(void);
+
+		void flush_callback(void);
+		void flush_poll(Event);
+		void flush_do(void);
+		void flush_error(int);
+		void flush_complete(void);
 	};
 
 	/*
@@ -97,6 +124,7 @@ public:
 	Action *close(int, Channel *, SimpleCallback *);
 	Action *read(int, Channel *, off_t, size_t, EventCallback *);
 	Action *write(int, Channel *, off_t, Buffer *, EventCallback *);
+	Action *shutdown(int, Channel *, int, EventCallback *);
 
 	static IOSystem *instance(void)
 	{
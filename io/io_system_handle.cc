@@ -24,8 +24,10 @@
  */
 
 #include <sys/errno.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <common/limits.h>
@@ -37,12 +39,43 @@
 
 #define	IO_READ_BUFFER_SIZE	65536
 
+/*
+ * How much may be written to a stream socket and not yet sent before
+ * writers are made to wait.
+ */
+#define	IO_WRITE_BEHIND_LIMIT	131072
+
+/*
+ * Writes to stream sockets are coalesced.
+ *
+ * Our pipelines tend to produce output in many small pieces, frame headers
+ * and the like, and writing each as it comes means a system call and quite
+ * possibly a segment on the wire for each.  Instead, a write to a stream
+ * socket is added to what is waiting to be sent and completed at once, so
+ * that the writer may go on to produce more, and the data is sent by a
+ * flush run on the IO thread.  Whatever has been written by the time the
+ * flush runs, or while the socket is not writable, goes out in a single
+ * writev.  Once more than IO_WRITE_BEHIND_LIMIT is waiting, writes do not
+ * complete until it has drained below that.
+ *
+ * An error sending is reported to the next write, or the one waiting, or
+ * to a shutdown of the write side.  Closing or shutting down the write side
+ * waits for the data written before to be sent.  A close has no way to
+ * report an error, so an error which nobody has been told of by then is
+ * logged, as errors from close itself are.
+ *
+ * A flush is the unit of batching: each sends all that has been written
+ * since the last, and the stack is only told that more is to come
+ * (MSG_MORE) between the sendmsg calls of a flush too large for one.
+ */
+
 IOSystem::Handle::Handle(CallbackScheduler *scheduler, int fd, Channel *owner)
 : log_("/io/system/handle"),
   mtx_("IOSystem::Handle"),
   scheduler_(scheduler),
   fd_(fd),
   owner_(owner),
+  coalesce_(false),
   read_offset_(-1),
   read_amount_(0),
   read_buffer_(),
@@ -51,8 +84,22 @@ IOSystem::Handle::Handle(CallbackScheduler *scheduler, int fd, Channel *owner)
   write_offset_(-1),
   write_buffer_(),
   write_callback_(NULL),
-  write_action_(NULL)
-{ }
+  write_action_(NULL),
+  write_error_(0),
+  write_error_reported_(false),
+  flush_action_(NULL),
+  close_callback_(NULL),
+  close_action_(NULL),
+  shutdown_how_(0),
+  shutdown_callback_(NULL),
+  shutdown_action_(NULL)
+{
+	int type;
+	socklen_t typelen = sizeof type;
+	int rv = ::getsockopt(fd_, SOL_SOCKET, SO_TYPE, &type, &typelen);
+	if (rv == 0 && type == SOCK_STREAM)
+		coalesce_ = true;
+}
 
 IOSystem::Handle::~Handle()
 {
@@ -63,6 +110,14 @@ IOSystem::Handle::~Handle()
 
 	ASSERT(log_, write_action_ == NULL);
 	ASSERT(log_, write_callback_ == NULL);
+
+	ASSERT(log_, flush_action_ == NULL);
+
+	ASSERT(log_, close_action_ == NULL);
+	ASSERT(log_, close_callback_ == NULL);
+
+	ASSERT(log_, shutdown_action_ == NULL);
+	ASSERT(log_, shutdown_callback_ == NULL);
 }
 
 Action *
@@ -70,7 +125,66 @@ IOSystem::Handle::close_do(SimpleCallback *cb)
 {
 	ASSERT_LOCK_OWNED(log_, &mtx_);
 
+	if (!write_buffer_.empty()) {
+		ASSERT(log_, coalesce_);
+		ASSERT(log_, flush_action_ != NULL);
+
+		close_callback_ = cb;
+		return (cancellation(this, &IOSystem::Handle::close_cancel));
+	}
+
+	close_fd();
+	return (cb->schedule());
+}
+
+/*
+ * If the close is cancelled while data is still waiting to be sent, the
+ * data is dropped and the descriptor closed at once, since our owner is
+ * about to go away.
+ */
+void
+IOSystem::Handle::close_cancel(void)
+{
+	ScopedLock _(&mtx_);
+
+	if (close_action_ != NULL) {
+		ASSERT(log_, close_callback_ == NULL);
+
+		close_action_->cancel();
+		close_action_ = NULL;
+	}
+
+	if (close_callback_ != NULL) {
+		delete close_callback_;
+		close_callback_ = NULL;
+
+		if (flush_action_ != NULL) {
+			flush_action_->cancel();
+			flush_action_ = NULL;
+		}
+		write_buffer_.clear();
+
+		if (shutdown_callback_ != NULL) {
+			delete shutdown_callback_;
+			shutdown_callback_ = NULL;
+		}
+
+		close_fd();
+	}
+}
+
+void
+IOSystem::Handle::close_fd(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
 	ASSERT(log_, fd_ != -1);
+
+	if (write_error_ != 0 && !write_error_reported_) {
+		ERROR(log_) << "Data written before close was not sent: " << strerror(write_error_);
+		write_error_reported_ = true;
+	}
+
 	int rv = ::close(fd_);
 	if (rv == -1) {
 		/*
@@ -88,9 +202,79 @@ IOSystem::Handle::close_do(SimpleCallback *cb)
 		ERROR(log_) << "Close returned error: " << strerror(errno);
 	}
 	fd_ = -1;
+}
+
+Action *
+IOSystem::Handle::shutdown_do(int how, EventCallback *cb)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	if (how != SHUT_RD && !write_buffer_.empty()) {
+		ASSERT(log_, coalesce_);
+		ASSERT(log_, flush_action_ != NULL);
+
+		shutdown_how_ = how;
+		shutdown_callback_ = cb;
+		return (cancellation(this, &IOSystem::Handle::shutdown_cancel));
+	}
+
+	if (how != SHUT_RD && write_error_ != 0) {
+		write_error_reported_ = true;
+		cb->param(Event(Event::Error, write_error_));
+		return (cb->schedule());
+	}
+
+	int rv = ::shutdown(fd_, how);
+	if (rv == -1) {
+		cb->param(Event(Event::Error, errno));
+		return (cb->schedule());
+	}
+	cb->param(Event::Done);
 	return (cb->schedule());
 }
 
+void
+IOSystem::Handle::shutdown_cancel(void)
+{
+	ScopedLock _(&mtx_);
+
+	if (shutdown_action_ != NULL) {
+		ASSERT(log_, shutdown_callback_ == NULL);
+
+		shutdown_action_->cancel();
+		shutdown_action_ = NULL;
+	}
+
+	if (shutdown_callback_ != NULL) {
+		delete shutdown_callback_;
+		shutdown_callback_ = NULL;
+	}
+}
+
+/*
+ * Do a shutdown which was waiting for written data to be sent.
+ */
+void
+IOSystem::Handle::shutdown_fd(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, shutdown_callback_ != NULL);
+	ASSERT(log_, shutdown_action_ == NULL);
+
+	if (write_error_ != 0) {
+		write_error_reported_ = true;
+		shutdown_callback_->param(Event(Event::Error, write_error_));
+	} else {
+		int rv = ::shutdown(fd_, shutdown_how_);
+		if (rv == -1)
+			shutdown_callback_->param(Event(Event::Error, errno));
+		else
+			shutdown_callback_->param(Event::Done);
+	}
+	shutdown_action_ = shutdown_callback_->schedule();
+	shutdown_callback_ = NULL;
+}
+
 void
 IOSystem::Handle::read_callback(Event e)
 {
@@ -303,9 +487,10 @@ void
 IOSystem::Handle::write_cancel(void)
 {
 	ScopedLock _(&mtx_);
-	ASSERT(log_, write_action_ != NULL);
-	write_action_->cancel();
-	write_action_ = NULL;
+	if (write_action_ != NULL) {
+		write_action_->cancel();
+		write_action_ = NULL;
+	}
 
 	if (write_callback_ != NULL) {
 		delete write_callback_;
@@ -422,3 +607,183 @@ IOSystem::Handle::write_schedule(void)
 	Action *a = EventSystem::instance()->poll(EventPoll::Writable, fd_, cb);
 	return (a);
 }
+
+Action *
+IOSystem::Handle::write_behind(Buffer *buffer, EventCallback *cb)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, shutdown_callback_ == NULL);
+
+	if (write_error_ != 0) {
+		write_error_reported_ = true;
+		buffer->clear();
+		cb->param(Event(Event::Error, write_error_));
+		return (cb->schedule());
+	}
+
+	buffer->moveout(&write_buffer_);
+
+	if (flush_action_ == NULL) {
+		SimpleCallback *fcb = callback(scheduler_, this, &IOSystem::Handle::flush_callback);
+		flush_action_ = fcb->schedule();
+	}
+
+	if (write_buffer_.length() < IO_WRITE_BEHIND_LIMIT) {
+		cb->param(Event::Done);
+		return (cb->schedule());
+	}
+
+	write_callback_ = cb;
+	return (cancellation(this, &IOSystem::Handle::write_cancel));
+}
+
+/*
+ * Let a writer waiting for the data written before to drain go on.
+ */
+void
+IOSystem::Handle::write_release(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	if (write_callback_ == NULL)
+		return;
+	ASSERT(log_, write_action_ == NULL);
+
+	if (write_error_ != 0) {
+		write_error_reported_ = true;
+		write_callback_->param(Event(Event::Error, write_error_));
+	} else if (write_buffer_.length() < IO_WRITE_BEHIND_LIMIT)
+		write_callback_->param(Event::Done);
+	else
+		return;
+	write_action_ = write_callback_->schedule();
+	write_callback_ = NULL;
+}
+
+void
+IOSystem::Handle::flush_callback(void)
+{
+	ScopedLock _(&mtx_);
+	flush_action_->cancel();
+	flush_action_ = NULL;
+
+	flush_do();
+}
+
+void
+IOSystem::Handle::flush_poll(Event e)
+{
+	ScopedLock _(&mtx_);
+	flush_action_->cancel();
+	flush_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		DEBUG(log_) << "Poll returned error: " << e;
+		flush_error(e.error_ == 0 ? EIO : e.error_);
+		return;
+	default:
+		HALT(log_) << "Unexpected event: " << e;
+	}
+
+	flush_do();
+}
+
+/*
+ * Send as much as the socket will take.  Where more than IOV_MAX segments
+ * are waiting, all but the last sendmsg say there is more to come, so that
+ * the stack need not push out a short segment between them.  The last never
+ * does, so nothing is held back by the stack once a flush is done.
+ */
+void
+IOSystem::Handle::flush_do(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, flush_action_ == NULL);
+
+	while (!write_buffer_.empty()) {
+		struct iovec iov[IOV_MAX];
+		size_t iovcnt = write_buffer_.fill_iovec(iov, IOV_MAX);
+		ASSERT(log_, iovcnt != 0);
+
+		size_t iovlen = 0;
+		unsigned i;
+		for (i = 0; i < iovcnt; i++)
+			iovlen += iov[i].iov_len;
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovcnt;
+
+		int flags = 0;
+#if defined(MSG_MORE)
+		if (iovlen < write_buffer_.length())
+			flags |= MSG_MORE;
+#endif
+
+		ssize_t len = ::sendmsg(fd_, &msg, flags);
+		if (len == -1) {
+			switch (errno) {
+			case EAGAIN:
+				break;
+			default:
+				flush_error(errno);
+				return;
+			}
+			len = 0;
+		}
+
+		if (len != 0) {
+			write_buffer_.skip(len);
+			write_release();
+		}
+
+		if ((size_t)len < iovlen) {
+			EventCallback *cb = callback(scheduler_, this, &IOSystem::Handle::flush_poll);
+			flush_action_ = EventSystem::instance()->poll(EventPoll::Writable, fd_, cb);
+			return;
+		}
+	}
+
+	flush_complete();
+}
+
+void
+IOSystem::Handle::flush_error(int error)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+
+	DEBUG(log_) << "Dropping " << write_buffer_.length() << " bytes after write error: " << strerror(error);
+
+	write_error_ = error;
+	write_buffer_.clear();
+	write_release();
+
+	flush_complete();
+}
+
+/*
+ * Everything written has been sent, or dropped; do whatever was waiting
+ * for that.
+ */
+void
+IOSystem::Handle::flush_complete(void)
+{
+	ASSERT_LOCK_OWNED(log_, &mtx_);
+	ASSERT(log_, write_buffer_.empty());
+	ASSERT(log_, write_callback_ == NULL);
+
+	if (shutdown_callback_ != NULL)
+		shutdown_fd();
+
+	if (close_callback_ != NULL) {
+		ASSERT(log_, close_action_ == NULL);
+
+		close_fd();
+		close_action_ = close_callback_->schedule();
+		close_callback_ = NULL;
+	}
+}
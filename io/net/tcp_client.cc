@@ -29,9 +29,10 @@
 
 #include <io/net/tcp_client.h>
 
-TCPClient::TCPClient(SocketAddressFamily family)
+TCPClient::TCPClient(SocketAddressFamily family, const SocketOptions& options)
 : log_("/tcp/client"),
   family_(family),
+  options_(options),
   socket_(NULL),
   close_action_(NULL),
   connect_action_(NULL),
@@ -92,6 +93,8 @@ TCPClient::connect(const std::string& iface, const std::string& name, SocketEven
 		return (a);
 	}
 
+	socket_->set_options(options_);
+
 	EventCallback *cb = callback(this, &TCPClient::connect_complete);
 	connect_action_ = socket_->connect(name, cb);
 	connect_callback_ = ccb;
@@ -148,13 +151,20 @@ TCPClient::close_complete(void)
 Action *
 TCPClient::connect(SocketAddressFamily family, const std::string& name, SocketEventCallback *cb)
 {
-	TCPClient *tcp = new TCPClient(family);
+	TCPClient *tcp = new TCPClient(family, SocketOptions());
 	return (tcp->connect("", name, cb));
 }
 
 Action *
 TCPClient::connect(SocketAddressFamily family, const std::string& iface, const std::string& name, SocketEventCallback *cb)
 {
-	TCPClient *tcp = new TCPClient(family);
+	TCPClient *tcp = new TCPClient(family, SocketOptions());
 	return (tcp->connect(iface, name, cb));
 }
+
+Action *
+TCPClient::connect(SocketAddressFamily family, const std::string& name, const SocketOptions& options, SocketEventCallback *cb)
+{
+	TCPClient *tcp = new TCPClient(family, options);
+	return (tcp->connect("", name, cb));
+}
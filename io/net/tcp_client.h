@@ -31,6 +31,7 @@
 class TCPClient {
 	LogHandle log_;
 	SocketAddressFamily family_;
+	SocketOptions options_;
 	Socket *socket_;
 
 	Action *close_action_;
@@ -38,7 +39,7 @@ class TCPClient {
 	Action *connect_action_;
 	SocketEventCallback *connect_callback_;
 
-	TCPClient(SocketAddressFamily);
+	TCPClient(SocketAddressFamily, const SocketOptions&);
 	~TCPClient();
 
 	Action *connect(const std::string&, const std::string&, SocketEventCallback *);
@@ -50,6 +51,7 @@ class TCPClient {
 public:
 	static Action *connect(SocketAddressFamily, const std::string&, SocketEventCallback *);
 	static Action *connect(SocketAddressFamily, const std::string&, const std::string&, SocketEventCallback *);
+	static Action *connect(SocketAddressFamily, const std::string&, const SocketOptions&, SocketEventCallback *);
 };
 
 #endif /* !IO_NET_TCP_CLIENT_H */
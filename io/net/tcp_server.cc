@@ -23,15 +23,34 @@
  * SUCH DAMAGE.
  */
 
+#include <unistd.h>
+
 #include <event/event_callback.h>
 
 #include <io/socket/socket.h>
 
 #include <io/net/tcp_server.h>
 
+std::map<std::string, TCPServer *> TCPServer::listeners_;
+std::map<std::string, int> TCPServer::inherited_;
+
 TCPServer *
-TCPServer::listen(SocketAddressFamily family, const std::string& name)
+TCPServer::listen(SocketAddressFamily family, const std::string& name, const SocketOptions& options)
 {
+	std::map<std::string, int>::iterator it = inherited_.find(name);
+	if (it != inherited_.end()) {
+		Socket *socket = Socket::adopt(it->second);
+		if (socket == NULL) {
+			ERROR("/tcp/server") << "Unable to adopt inherited listener for: " << name;
+			return (NULL);
+		}
+		inherited_.erase(it);
+
+		socket->set_options(options);
+		INFO("/tcp/server") << "Inherited listener for: " << name;
+		return (new TCPServer(name, socket));
+	}
+
 	Socket *socket = Socket::create(family, SocketTypeStream, "tcp", name);
 	if (socket == NULL) {
 		ERROR("/tcp/server") << "Unable to create socket.";
@@ -46,10 +65,55 @@ TCPServer::listen(SocketAddressFamily family, const std::string& name)
 		ERROR("/tcp/server") << "Socket bind failed, leaking socket.";
 		return (NULL);
 	}
+	socket->set_options(options);
 	if (!socket->listen()) {
 		ERROR("/tcp/server") << "Socket listen failed, leaking socket.";
 		return (NULL);
 	}
-	TCPServer *server = new TCPServer(socket);
+	TCPServer *server = new TCPServer(name, socket);
 	return (server);
 }
+
+/*
+ * The descriptor of each listener, by the name it was asked to listen on.
+ */
+std::map<std::string, int>
+TCPServer::descriptors(void)
+{
+	std::map<std::string, TCPServer *>::const_iterator it;
+	std::map<std::string, int> fds;
+
+	for (it = listeners_.begin(); it != listeners_.end(); ++it)
+		fds[it->first] = it->second->socket_->descriptor();
+	return (fds);
+}
+
+/*
+ * Use the given listening descriptor, rather than a new socket, for the
+ * next listener on this name.
+ */
+void
+TCPServer::inherit(const std::string& name, int fd)
+{
+	std::map<std::string, int>::iterator it = inherited_.find(name);
+	if (it != inherited_.end()) {
+		ERROR("/tcp/server") << "Inherited two listeners for: " << name;
+		::close(it->second);
+	}
+	inherited_[name] = fd;
+}
+
+/*
+ * Close any inherited listeners nothing has asked for.
+ */
+void
+TCPServer::inherited_close(void)
+{
+	std::map<std::string, int>::const_iterator it;
+
+	for (it = inherited_.begin(); it != inherited_.end(); ++it) {
+		INFO("/tcp/server") << "Closing unused inherited listener for: " << it->first;
+		::close(it->second);
+	}
+	inherited_.clear();
+}
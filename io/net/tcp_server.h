@@ -26,20 +26,36 @@
 #ifndef	IO_NET_TCP_SERVER_H
 #define	IO_NET_TCP_SERVER_H
 
+#include <map>
+
 #include <io/socket/socket.h>
 
+/*
+ * Listeners are known by the name they were asked to listen on, so that
+ * they may be handed to another process, which takes them over in place of
+ * listening on that name itself.
+ */
 class TCPServer {
+	static std::map<std::string, TCPServer *> listeners_;
+	static std::map<std::string, int> inherited_;
+
 	LogHandle log_;
+	std::string name_;
 	Socket *socket_;
 
-	TCPServer(Socket *socket)
+	TCPServer(const std::string& name, Socket *socket)
 	: log_("/tcp/server"),
+	  name_(name),
 	  socket_(socket)
-	{ }
+	{
+		listeners_[name_] = this;
+	}
 
 public:
 	~TCPServer()
 	{
+		forget();
+
 		if (socket_ != NULL) {
 			delete socket_;
 			socket_ = NULL;
@@ -53,6 +69,8 @@ public:
 
 	Action *close(SimpleCallback *cb)
 	{
+		forget();
+
 		return (socket_->close(cb));
 	}
 
@@ -61,7 +79,22 @@ public:
 		return (socket_->getsockname());
 	}
 
-	static TCPServer *listen(SocketAddressFamily, const std::string&);
+private:
+	void forget(void)
+	{
+		std::map<std::string, TCPServer *>::iterator it;
+
+		it = listeners_.find(name_);
+		if (it != listeners_.end() && it->second == this)
+			listeners_.erase(it);
+	}
+
+public:
+	static TCPServer *listen(SocketAddressFamily, const std::string&, const SocketOptions& = SocketOptions());
+
+	static std::map<std::string, int> descriptors(void);
+	static void inherit(const std::string&, int);
+	static void inherited_close(void);
 };
 
 #endif /* !IO_NET_TCP_SERVER_H */
@@ -1,5 +1,6 @@
 VPATH+=	${TOPDIR}/io/pipe
 
+SRCS+=	pipe_chain.cc
 SRCS+=	pipe_link.cc
 SRCS+=	pipe_producer.cc
 SRCS+=	pipe_splice.cc
@@ -43,6 +43,14 @@ public:
 
 	virtual Action *input(Buffer *, EventCallback *) = 0;
 	virtual Action *output(EventCallback *) = 0;
+
+	/*
+	 * The number of bytes held in the Pipe, waiting for output.
+	 */
+	virtual size_t buffered(void) const
+	{
+		return (0);
+	}
 };
 
 #endif /* !IO_PIPE_PIPE_H */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_chain.h>
+#include <io/pipe/pipe_link.h>
+#include <io/pipe/pipe_producer.h>
+
+/*
+ * PipeChain passes data through a sequence of Pipes.  Adjacent
+ * PipeProducers are fused, so a Buffer runs through all of them in a single
+ * call frame; PipeLinks, with their round trips through the event system,
+ * are only used on either side of Pipes that are not PipeProducers.
+ *
+ * The Pipes are owned by the caller, and must outlive the PipeChain.
+ */
+
+PipeChain::PipeChain(const std::deque<Pipe *>& pipes)
+: log_("/pipe/chain"),
+  pipe_(NULL),
+  runs_(),
+  pipe_links_()
+{
+	std::deque<Pipe *>::const_iterator it;
+	std::deque<Pipe *> runs;
+
+	ASSERT(log_, !pipes.empty());
+
+	for (it = pipes.begin(); it != pipes.end(); ++it) {
+		Pipe *first = *it;
+		Pipe *last = first;
+
+		PipeProducer *producer = dynamic_cast<PipeProducer *>(first);
+		while (producer != NULL && it + 1 != pipes.end()) {
+			PipeProducer *next = dynamic_cast<PipeProducer *>(*(it + 1));
+			if (next == NULL)
+				break;
+
+			producer->fuse(next);
+			producer = next;
+
+			last = *++it;
+		}
+
+		if (first == last) {
+			runs.push_back(first);
+		} else {
+			Pipe *run = new Run(first, last);
+			runs_.push_back(run);
+
+			runs.push_back(run);
+		}
+	}
+
+	pipe_ = runs.front();
+	runs.pop_front();
+
+	while (!runs.empty()) {
+		pipe_ = new PipeLink(pipe_, runs.front());
+		pipe_links_.push_front(pipe_);
+
+		runs.pop_front();
+	}
+}
+
+PipeChain::~PipeChain()
+{
+	/*
+	 * Delete the PipeLinks first, since they may have actions running
+	 * internally.
+	 */
+	std::list<Pipe *>::iterator it;
+	while ((it = pipe_links_.begin()) != pipe_links_.end()) {
+		Pipe *pipe_link = *it;
+		pipe_links_.erase(it);
+
+		delete pipe_link;
+	}
+
+	while ((it = runs_.begin()) != runs_.end()) {
+		Pipe *run = *it;
+		runs_.erase(it);
+
+		delete run;
+	}
+}
+
+Action *
+PipeChain::input(Buffer *buf, EventCallback *cb)
+{
+	return (pipe_->input(buf, cb));
+}
+
+Action *
+PipeChain::output(EventCallback *cb)
+{
+	return (pipe_->output(cb));
+}
+
+size_t
+PipeChain::buffered(void) const
+{
+	return (pipe_->buffered());
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_PIPE_PIPE_CHAIN_H
+#define	IO_PIPE_PIPE_CHAIN_H
+
+#include <deque>
+#include <list>
+
+class PipeChain : public Pipe {
+	class Run : public Pipe {
+		Pipe *incoming_pipe_;
+		Pipe *outgoing_pipe_;
+	public:
+		Run(Pipe *incoming_pipe, Pipe *outgoing_pipe)
+		: incoming_pipe_(incoming_pipe),
+		  outgoing_pipe_(outgoing_pipe)
+		{ }
+
+		~Run()
+		{ }
+
+		Action *input(Buffer *buf, EventCallback *cb)
+		{
+			return (incoming_pipe_->input(buf, cb));
+		}
+
+		Action *output(EventCallback *cb)
+		{
+			return (outgoing_pipe_->output(cb));
+		}
+
+		size_t buffered(void) const
+		{
+			return (outgoing_pipe_->buffered());
+		}
+	};
+
+	LogHandle log_;
+
+	Pipe *pipe_;
+
+	std::list<Pipe *> runs_;
+	std::list<Pipe *> pipe_links_;
+public:
+	PipeChain(const std::deque<Pipe *>&);
+	~PipeChain();
+
+	Action *input(Buffer *, EventCallback *);
+	Action *output(EventCallback *);
+	size_t buffered(void) const;
+};
+
+#endif /* !IO_PIPE_PIPE_CHAIN_H */
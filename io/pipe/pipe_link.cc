@@ -81,6 +81,12 @@ PipeLink::output(EventCallback *cb)
 	return (outgoing_pipe_->output(cb));
 }
 
+size_t
+PipeLink::buffered(void) const
+{
+	return (incoming_pipe_->buffered() + outgoing_pipe_->buffered());
+}
+
 void
 PipeLink::pipe_splice_complete(Event e)
 {
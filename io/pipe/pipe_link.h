@@ -42,6 +42,7 @@ public:
 
 	Action *input(Buffer *, EventCallback *);
 	Action *output(EventCallback *);
+	size_t buffered(void) const;
 private:
 	void pipe_splice_complete(Event);
 };
@@ -30,6 +30,16 @@
 
 /*
  * PipeProducer is a pipe with a producer-consume API.
+ *
+ * A PipeProducer may be fused to another, in which case everything it
+ * produces is consumed by the next one immediately, in the same call frame,
+ * rather than being buffered for output() and carried over by a PipeLink.
+ *
+ * Input is not completed while more than the high watermark's worth of
+ * output is waiting to be taken, so that whoever is feeding us (a Splice
+ * reading from a socket, say) stops until output has drained to the low
+ * watermark.  For a fused run it is the last PipeProducer, the one which
+ * actually buffers output, that holds back input.
  */
 
 PipeProducer::PipeProducer(const LogHandle& log)
@@ -38,7 +48,12 @@ PipeProducer::PipeProducer(const LogHandle& log)
   output_action_(NULL),
   output_callback_(NULL),
   output_eos_(false),
-  error_(false)
+  error_(false),
+  high_watermark_(PIPE_PRODUCER_HIGH_WATERMARK),
+  low_watermark_(PIPE_PRODUCER_LOW_WATERMARK),
+  input_action_(NULL),
+  input_callback_(NULL),
+  fused_(NULL)
 {
 }
 
@@ -46,10 +61,31 @@ PipeProducer::~PipeProducer()
 {
 	ASSERT(log_, output_action_ == NULL);
 	ASSERT(log_, output_callback_ == NULL);
+	ASSERT(log_, input_action_ == NULL);
+	ASSERT(log_, input_callback_ == NULL);
 }
 
 Action *
 PipeProducer::input(Buffer *buf, EventCallback *cb)
+{
+	input_do(buf);
+
+	if (error_) {
+		cb->param(Event::Error);
+		return (cb->schedule());
+	}
+	cb->param(Event::Done);
+
+	PipeProducer *last = this;
+	while (last->fused_ != NULL)
+		last = last->fused_;
+	if (last->input_hold(cb))
+		return (cancellation(last, &PipeProducer::input_cancel));
+	return (cb->schedule());
+}
+
+void
+PipeProducer::input_do(Buffer *buf)
 {
 	if (!error_) {
 		/*
@@ -64,17 +100,72 @@ PipeProducer::input(Buffer *buf, EventCallback *cb)
 	} else {
 		buf->clear();
 	}
+}
 
-	if (error_)
-		cb->param(Event::Error);
-	else
-		cb->param(Event::Done);
-	return (cb->schedule());
+/*
+ * The PipeProducer fused to us has failed; pass the error along so that
+ * it reaches whoever is waiting on output.
+ */
+void
+PipeProducer::input_error(void)
+{
+	if (error_ || output_eos_)
+		return;
+	produce_error();
+}
+
+bool
+PipeProducer::input_hold(EventCallback *cb)
+{
+	if (error_ || high_watermark_ == 0)
+		return (false);
+	if (output_buffer_.length() < high_watermark_)
+		return (false);
+
+	ASSERT(log_, input_action_ == NULL);
+	ASSERT(log_, input_callback_ == NULL);
+	input_callback_ = cb;
+
+	return (true);
+}
+
+void
+PipeProducer::input_release(void)
+{
+	if (input_callback_ == NULL)
+		return;
+
+	if (error_) {
+		input_callback_->param(Event::Error);
+	} else if (output_buffer_.length() > low_watermark_) {
+		return;
+	}
+
+	ASSERT(log_, input_action_ == NULL);
+	input_action_ = input_callback_->schedule();
+	input_callback_ = NULL;
+}
+
+void
+PipeProducer::input_cancel(void)
+{
+	if (input_action_ != NULL) {
+		ASSERT(log_, input_callback_ == NULL);
+
+		input_action_->cancel();
+		input_action_ = NULL;
+	}
+
+	if (input_callback_ != NULL) {
+		delete input_callback_;
+		input_callback_ = NULL;
+	}
 }
 
 Action *
 PipeProducer::output(EventCallback *cb)
 {
+	ASSERT(log_, fused_ == NULL);
 	ASSERT(log_, output_action_ == NULL);
 	ASSERT(log_, output_callback_ == NULL);
 
@@ -116,6 +207,7 @@ PipeProducer::output_do(EventCallback *cb)
 	if (!output_buffer_.empty()) {
 		cb->param(Event(Event::Done, output_buffer_));
 		output_buffer_.clear();
+		input_release();
 		return (cb->schedule());
 	}
 
@@ -127,12 +219,61 @@ PipeProducer::output_do(EventCallback *cb)
 	return (NULL);
 }
 
+size_t
+PipeProducer::buffered(void) const
+{
+	return (output_buffer_.length());
+}
+
+/*
+ * A high watermark of 0 disables holding back input.
+ */
+void
+PipeProducer::set_watermarks(size_t low_watermark, size_t high_watermark)
+{
+	ASSERT(log_, low_watermark <= high_watermark);
+
+	low_watermark_ = low_watermark;
+	high_watermark_ = high_watermark;
+
+	input_release();
+}
+
+void
+PipeProducer::fuse(PipeProducer *next)
+{
+	ASSERT(log_, next != this);
+	ASSERT(log_, fused_ == NULL);
+	ASSERT(log_, output_action_ == NULL);
+	ASSERT(log_, output_callback_ == NULL);
+	ASSERT(log_, !output_eos_);
+	ASSERT(log_, !error_);
+	ASSERT(log_, input_callback_ == NULL);
+
+	fused_ = next;
+
+	if (!output_buffer_.empty()) {
+		Buffer buf;
+		output_buffer_.moveout(&buf);
+		fused_->input_do(&buf);
+	}
+}
+
 void
 PipeProducer::produce(Buffer *buf)
 {
 	ASSERT(log_, !error_);
 	ASSERT(log_, !output_eos_);
 
+	if (fused_ != NULL) {
+		if (buf->empty()) {
+			DEBUG(log_) << "Consider using produce_eos instead.";
+			output_eos_ = true;
+		}
+		fused_->input_do(buf);
+		return;
+	}
+
 	if (!buf->empty()) {
 		buf->moveout(&output_buffer_);
 	} else {
@@ -157,6 +298,16 @@ PipeProducer::produce_eos(Buffer *buf)
 	ASSERT(log_, !error_);
 	ASSERT(log_, !output_eos_);
 
+	if (fused_ != NULL) {
+		if (buf != NULL && !buf->empty())
+			fused_->input_do(buf);
+		output_eos_ = true;
+
+		Buffer eos;
+		fused_->input_do(&eos);
+		return;
+	}
+
 	if (buf != NULL && !buf->empty()) {
 		buf->moveout(&output_buffer_);
 	}
@@ -181,6 +332,12 @@ PipeProducer::produce_error(void)
 
 	error_ = true;
 	output_buffer_.clear();
+	input_release();
+
+	if (fused_ != NULL) {
+		fused_->input_error();
+		return;
+	}
 
 	if (output_callback_ != NULL) {
 		ASSERT(log_, output_action_ == NULL);
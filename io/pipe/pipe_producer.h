@@ -28,6 +28,13 @@
 
 class Action;
 
+/*
+ * Once this many bytes are waiting for output, input is not completed until
+ * output has drained to the low watermark.
+ */
+#define	PIPE_PRODUCER_HIGH_WATERMARK	(1024 * 1024)
+#define	PIPE_PRODUCER_LOW_WATERMARK	(256 * 1024)
+
 class PipeProducer : public Pipe {
 protected:
 	LogHandle log_;
@@ -39,6 +46,13 @@ private:
 	bool output_eos_;
 
 	bool error_;
+
+	size_t high_watermark_;
+	size_t low_watermark_;
+	Action *input_action_;
+	EventCallback *input_callback_;
+
+	PipeProducer *fused_;
 protected:
 	PipeProducer(const LogHandle&);
 	~PipeProducer();
@@ -47,10 +61,21 @@ protected:
 	Action *output(EventCallback *);
 
 private:
+	void input_do(Buffer *);
+	void input_error(void);
+	bool input_hold(EventCallback *);
+	void input_release(void);
+	void input_cancel(void);
+
 	void output_cancel(void);
 	Action *output_do(EventCallback *);
 
 public:
+	size_t buffered(void) const;
+	void set_watermarks(size_t, size_t);
+
+	void fuse(PipeProducer *);
+
 	void produce(Buffer *);
 	void produce_eos(Buffer * = NULL);
 	void produce_error(void);
@@ -45,8 +45,11 @@ Splice::Splice(const LogHandle& log, StreamChannel *source, Pipe *pipe, StreamCh
   input_action_(NULL),
   output_eos_(false),
   output_action_(NULL),
+  write_length_(0),
   write_action_(NULL),
-  shutdown_action_(NULL)
+  shutdown_action_(NULL),
+  read_bytes_(0),
+  written_bytes_(0)
 {
 	log_ = log + "/splice";
 
@@ -82,6 +85,21 @@ Splice::start(EventCallback *cb)
 	return (cancellation(this, &Splice::cancel));
 }
 
+/*
+ * The bytes which have been read but not yet written: those buffered in the
+ * Pipe and those in a write which has not completed.  Reads are not issued
+ * until the Pipe has taken the last, and it holds that back while too much
+ * is buffered, so this is bounded by the Pipe's high watermark plus however
+ * much one read may produce.
+ */
+size_t
+Splice::buffered(void) const
+{
+	if (pipe_ == NULL)
+		return (write_length_);
+	return (pipe_->buffered() + write_length_);
+}
+
 void
 Splice::cancel(void)
 {
@@ -181,6 +199,7 @@ Splice::read_complete(Event e)
 
 		read_eos_ = true;
 	}
+	read_bytes_ += e.buffer_.length();
 
 	if (pipe_ != NULL) {
 		ASSERT(log_, input_action_ == NULL);
@@ -194,6 +213,7 @@ Splice::read_complete(Event e)
 		}
 
 		ASSERT(log_, write_action_ == NULL);
+		write_length_ = e.buffer_.length();
 		EventCallback *cb = callback(this, &Splice::write_complete);
 		write_action_ = sink_->write(&e.buffer_, cb);
 	}
@@ -246,6 +266,7 @@ Splice::output_complete(Event e)
 	}
 
 	ASSERT(log_, write_action_ == NULL);
+	write_length_ = e.buffer_.length();
 	EventCallback *cb = callback(this, &Splice::write_complete);
 	write_action_ = sink_->write(&e.buffer_, cb);
 }
@@ -256,6 +277,10 @@ Splice::write_complete(Event e)
 	write_action_->cancel();
 	write_action_ = NULL;
 
+	if (e.type_ == Event::Done)
+		written_bytes_ += write_length_;
+	write_length_ = 0;
+
 	switch (e.type_) {
 	case Event::Done:
 		break;
@@ -43,15 +43,30 @@ class Splice {
 	Action *input_action_;
 	bool output_eos_;
 	Action *output_action_;
+	size_t write_length_;
 	Action *write_action_;
 	Action *shutdown_action_;
 
+	uintmax_t read_bytes_;
+	uintmax_t written_bytes_;
 public:
 	Splice(const LogHandle&, StreamChannel *, Pipe *, StreamChannel *);
 	~Splice();
 
 	Action *start(EventCallback *);
 
+	size_t buffered(void) const;
+
+	uintmax_t read_bytes(void) const
+	{
+		return (read_bytes_);
+	}
+
+	uintmax_t written_bytes(void) const
+	{
+		return (written_bytes_);
+	}
+
 private:
 	void cancel(void);
 	void complete(Event);
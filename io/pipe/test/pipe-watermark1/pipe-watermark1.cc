@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_chain.h>
+#include <io/pipe/pipe_null.h>
+
+#define	TEST_LOW_WATERMARK	(4096)
+#define	TEST_HIGH_WATERMARK	(16384)
+
+#define	TEST_OUTPUT_DELAY_MS	(250)
+
+static uint8_t data[65536];
+
+/*
+ * Puts more than the high watermark into a chain of PipeNulls and checks
+ * that input is not completed until output has been taken, which is only
+ * requested after a delay.
+ */
+class Tester {
+	LogHandle log_;
+	TestGroup group_;
+	Pipe *pipe_;
+	Action *input_action_;
+	Action *output_action_;
+	Action *timeout_action_;
+	Buffer buffer_;
+	bool output_started_;
+	bool eos_;
+public:
+	Tester(Pipe *pipe)
+	: log_("/tester"),
+	  group_("/test/io/pipe/watermark/tester", "Tester"),
+	  pipe_(pipe),
+	  input_action_(NULL),
+	  output_action_(NULL),
+	  timeout_action_(NULL),
+	  buffer_(),
+	  output_started_(false),
+	  eos_(false)
+	{
+		Buffer buf(data, sizeof data);
+
+		EventCallback *cb = callback(this, &Tester::input_complete);
+		input_action_ = pipe_->input(&buf, cb);
+
+		{
+			Test _(group_, "Input method consumed Buffer");
+			if (buf.empty())
+				_.pass();
+		}
+
+		{
+			Test _(group_, "Input is buffered");
+			if (pipe_->buffered() == sizeof data)
+				_.pass();
+		}
+
+		SimpleCallback *scb = callback(this, &Tester::timeout);
+		timeout_action_ = EventSystem::instance()->timeout(TEST_OUTPUT_DELAY_MS, scb);
+	}
+
+	~Tester()
+	{
+		{
+			Test _(group_, "No pending input action");
+			if (input_action_ == NULL)
+				_.pass();
+			else {
+				input_action_->cancel();
+				input_action_ = NULL;
+			}
+		}
+
+		{
+			Test _(group_, "No pending output action");
+			if (output_action_ == NULL)
+				_.pass();
+			else {
+				output_action_->cancel();
+				output_action_ = NULL;
+			}
+		}
+
+		{
+			Test _(group_, "No pending timeout");
+			if (timeout_action_ == NULL)
+				_.pass();
+			else {
+				timeout_action_->cancel();
+				timeout_action_ = NULL;
+			}
+		}
+
+		{
+			Test _(group_, "Got EOS");
+			if (eos_)
+				_.pass();
+		}
+
+		{
+			Test _(group_, "Got expected data");
+			if (buffer_.equal(data, sizeof data))
+				_.pass();
+		}
+
+		{
+			Test _(group_, "Nothing left buffered");
+			if (pipe_->buffered() == 0)
+				_.pass();
+		}
+	}
+
+	void input_complete(Event e)
+	{
+		input_action_->cancel();
+		input_action_ = NULL;
+
+		{
+			Test _(group_, "Expected input event");
+			if (e.type_ == Event::Done)
+				_.pass();
+		}
+
+		{
+			Test _(group_, "Input held until output started");
+			if (output_started_)
+				_.pass();
+		}
+	}
+
+	void timeout(void)
+	{
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+
+		output_started_ = true;
+
+		EventCallback *cb = callback(this, &Tester::output_complete);
+		output_action_ = pipe_->output(cb);
+	}
+
+	void output_complete(Event e)
+	{
+		output_action_->cancel();
+		output_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			buffer_.append(e.buffer_);
+			if (buffer_.length() == sizeof data) {
+				ASSERT(log_, input_action_ == NULL);
+
+				Buffer eos;
+				EventCallback *cb = callback(this, &Tester::input_complete);
+				input_action_ = pipe_->input(&eos, cb);
+			}
+			break;
+		case Event::EOS:
+			{
+				Test _(group_, "EOS Buffer is empty");
+				if (e.buffer_.empty())
+					_.pass();
+			}
+			eos_ = true;
+			EventSystem::instance()->stop();
+			return;
+		default:
+			{
+				Test _(group_, "Expected output event");
+			}
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		EventCallback *cb = callback(this, &Tester::output_complete);
+		output_action_ = pipe_->output(cb);
+	}
+};
+
+int
+main(void)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof data; i++)
+		data[i] = random() % 0xff;
+
+	PipeNull p0, p1;
+	p1.set_watermarks(TEST_LOW_WATERMARK, TEST_HIGH_WATERMARK);
+
+	std::deque<Pipe *> pipes;
+	pipes.push_back(&p0);
+	pipes.push_back(&p1);
+
+	PipeChain chain(pipes);
+	Tester tester(&chain);
+	event_main();
+}
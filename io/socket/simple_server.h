@@ -26,6 +26,8 @@
 #ifndef	IO_SOCKET_SIMPLE_SERVER_H
 #define	IO_SOCKET_SIMPLE_SERVER_H
 
+#include <set>
+
 #include <io/socket/socket.h>
 
 /*
@@ -35,22 +37,26 @@
  */
 template<typename L>
 class SimpleServer {
+	static std::set<SimpleServer *> servers_;
+
 	LogHandle log_;
 	L *server_;
 	Action *accept_action_;
 	Action *close_action_;
 	Action *stop_action_;
 public:
-	SimpleServer(LogHandle log, SocketAddressFamily family, const std::string& interface)
+	SimpleServer(LogHandle log, SocketAddressFamily family, const std::string& interface, const SocketOptions& options = SocketOptions())
 	: log_(log),
 	  server_(NULL),
 	  accept_action_(NULL),
 	  close_action_(NULL),
 	  stop_action_(NULL)
 	{
-		server_ = L::listen(family, interface);
-		if (server_ == NULL)
-			HALT(log_) << "Unable to create listener.";
+		server_ = L::listen(family, interface, options);
+		if (server_ == NULL) {
+			ERROR(log_) << "Unable to create listener.";
+			return;
+		}
 
 		INFO(log_) << "Listening on: " << server_->getsockname();
 
@@ -59,6 +65,8 @@ public:
 
 		SimpleCallback *scb = callback(this, &SimpleServer::stop);
 		stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+
+		servers_.insert(this);
 	}
 
 	virtual ~SimpleServer()
@@ -69,6 +77,15 @@ public:
 		ASSERT(log_, stop_action_ == NULL);
 	}
 
+	/*
+	 * Whether the listener could be created.  If not, nothing has been
+	 * started and the server may simply be deleted.
+	 */
+	bool listening(void) const
+	{
+		return (server_ != NULL);
+	}
+
 private:
 	void accept_complete(Event e, Socket *client)
 	{
@@ -112,6 +129,13 @@ private:
 		stop_action_->cancel();
 		stop_action_ = NULL;
 
+		close();
+	}
+
+	void close(void)
+	{
+		servers_.erase(this);
+
 		accept_action_->cancel();
 		accept_action_ = NULL;
 
@@ -121,7 +145,36 @@ private:
 		close_action_ = server_->close(cb);
 	}
 
+public:
+	/*
+	 * Stop accepting clients, and go away once the listener is closed.
+	 * Clients already accepted are left to carry on.
+	 */
+	void retire(void)
+	{
+		INFO(log_) << "Retiring listener on: " << server_->getsockname();
+
+		stop_action_->cancel();
+		stop_action_ = NULL;
+
+		close();
+	}
+
+	/*
+	 * Retire every server, e.g. before exiting once the clients are
+	 * done.
+	 */
+	static void retire_all(void)
+	{
+		while (!servers_.empty())
+			(*servers_.begin())->retire();
+	}
+
+private:
 	virtual void client_connected(Socket *) = 0;
 };
 
+template<typename L>
+std::set<SimpleServer<L> *> SimpleServer<L>::servers_;
+
 #endif /* !IO_SOCKET_SIMPLE_SERVER_H */
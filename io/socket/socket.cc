@@ -28,6 +28,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -38,6 +39,7 @@
 #include <event/event_callback.h>
 #include <event/event_system.h>
 
+#include <io/io_system.h>
 #include <io/socket/socket.h>
 
 /*
@@ -298,6 +300,7 @@ Socket::Socket(int fd, int domain, int socktype, int protocol)
   domain_(domain),
   socktype_(socktype),
   protocol_(protocol),
+  options_(),
   accept_action_(NULL),
   accept_callback_(NULL),
   connect_callback_(NULL),
@@ -414,6 +417,76 @@ Socket::listen(void)
 	return (true);
 }
 
+/*
+ * Failing to set an option is not fatal; the socket works, if not as well.
+ * Options this system lacks are reported and skipped.
+ */
+void
+Socket::set_options(const SocketOptions& options)
+{
+	options_ = options;
+
+	if (options_.send_buffer_ != 0)
+		setsockopt_int(SOL_SOCKET, SO_SNDBUF, options_.send_buffer_, "SO_SNDBUF");
+	if (options_.receive_buffer_ != 0)
+		setsockopt_int(SOL_SOCKET, SO_RCVBUF, options_.receive_buffer_, "SO_RCVBUF");
+	if (options_.keepalive_)
+		setsockopt_int(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+
+	if (domain_ == AF_UNIX || socktype_ != SOCK_STREAM)
+		return;
+
+	if (options_.nodelay_)
+		setsockopt_int(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+
+	if (options_.congestion_control_ != "") {
+#if defined(TCP_CONGESTION)
+		const std::string& cc = options_.congestion_control_;
+		int rv = setsockopt(fd_, IPPROTO_TCP, TCP_CONGESTION, cc.c_str(), cc.length());
+		if (rv == -1)
+			ERROR(log_) << "Could not setsockopt(TCP_CONGESTION, " << cc << "): " << strerror(errno);
+#else
+		ERROR(log_) << "Congestion control may not be set on this system.";
+#endif
+	}
+
+	if (options_.notsent_lowat_ != 0) {
+#if defined(TCP_NOTSENT_LOWAT)
+		setsockopt_int(IPPROTO_TCP, TCP_NOTSENT_LOWAT, options_.notsent_lowat_, "TCP_NOTSENT_LOWAT");
+#else
+		ERROR(log_) << "TCP_NOTSENT_LOWAT is not supported on this system.";
+#endif
+	}
+
+	/*
+	 * XXX
+	 * The system clears this again whenever it sees fit, so this only
+	 * takes care of the start of the connection.
+	 */
+	if (options_.quickack_) {
+#if defined(TCP_QUICKACK)
+		setsockopt_int(IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#else
+		ERROR(log_) << "TCP_QUICKACK is not supported on this system.";
+#endif
+	}
+
+	if (options_.keepalive_) {
+#if defined(TCP_KEEPIDLE)
+		if (options_.keepalive_idle_ != 0)
+			setsockopt_int(IPPROTO_TCP, TCP_KEEPIDLE, options_.keepalive_idle_, "TCP_KEEPIDLE");
+#endif
+#if defined(TCP_KEEPINTVL)
+		if (options_.keepalive_interval_ != 0)
+			setsockopt_int(IPPROTO_TCP, TCP_KEEPINTVL, options_.keepalive_interval_, "TCP_KEEPINTVL");
+#endif
+#if defined(TCP_KEEPCNT)
+		if (options_.keepalive_count_ != 0)
+			setsockopt_int(IPPROTO_TCP, TCP_KEEPCNT, options_.keepalive_count_, "TCP_KEEPCNT");
+#endif
+	}
+}
+
 Action *
 Socket::shutdown(bool shut_read, bool shut_write, EventCallback *cb)
 {
@@ -430,13 +503,7 @@ Socket::shutdown(bool shut_read, bool shut_write, EventCallback *cb)
 		return (NULL);
 	}
 
-	int rv = ::shutdown(fd_, how);
-	if (rv == -1) {
-		cb->param(Event(Event::Error, errno));
-		return (cb->schedule());
-	}
-	cb->param(Event::Done);
-	return (cb->schedule());
+	return (IOSystem::instance()->shutdown(fd_, this, how, cb));
 }
 
 std::string
@@ -507,6 +574,7 @@ Socket::accept_callback(Event e)
 	}
 
 	Socket *child = new Socket(s, domain_, socktype_, protocol_);
+	child->set_options(options_);
 	accept_callback_->param(Event::Done, child);
 	Action *a = accept_callback_->schedule();
 	accept_action_ = a;
@@ -577,6 +645,14 @@ Socket::connect_schedule(void)
 	return (a);
 }
 
+void
+Socket::setsockopt_int(int level, int name, int value, const char *what)
+{
+	int rv = setsockopt(fd_, level, name, &value, sizeof value);
+	if (rv == -1)
+		ERROR(log_) << "Could not setsockopt(" << what << ", " << value << "): " << strerror(errno);
+}
+
 Socket *
 Socket::create(SocketAddressFamily family, SocketType type, const std::string& protocol, const std::string& hint)
 {
@@ -687,3 +763,29 @@ Socket::create(SocketAddressFamily family, SocketType type, const std::string& p
 
 	return (new Socket(s, domainnum, typenum, protonum));
 }
+
+/*
+ * Take over a socket set up elsewhere, e.g. one passed to us by another
+ * process.
+ */
+Socket *
+Socket::adopt(int s)
+{
+	socket_address sa;
+	int typenum;
+	socklen_t typelen;
+
+	sa.addrlen_ = sizeof sa.addr_;
+	if (::getsockname(s, &sa.addr_.sockaddr_, &sa.addrlen_) == -1) {
+		ERROR("/socket") << "Could not get address of socket to adopt: " << strerror(errno);
+		return (NULL);
+	}
+
+	typelen = sizeof typenum;
+	if (::getsockopt(s, SOL_SOCKET, SO_TYPE, &typenum, &typelen) == -1) {
+		ERROR("/socket") << "Could not get type of socket to adopt: " << strerror(errno);
+		return (NULL);
+	}
+
+	return (new Socket(s, sa.addr_.sockaddr_.sa_family, typenum, 0));
+}
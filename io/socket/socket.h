@@ -31,6 +31,7 @@
 #include <event/typed_pair_callback.h>
 
 #include <io/stream_handle.h>
+#include <io/socket/socket_options.h>
 #include <io/socket/socket_types.h>
 
 typedef	class TypedPairCallback<Event, Socket *> SocketEventCallback;
@@ -40,6 +41,7 @@ class Socket : public StreamHandle {
 	int domain_;
 	int socktype_;
 	int protocol_;
+	SocketOptions options_;
 	Action *accept_action_;
 	SocketEventCallback *accept_callback_;
 	EventCallback *connect_callback_;
@@ -55,9 +57,16 @@ public:
 	bool listen(void);
 	Action *shutdown(bool, bool, EventCallback *);
 
+	void set_options(const SocketOptions&);
+
 	std::string getpeername(void) const;
 	std::string getsockname(void) const;
 
+	int descriptor(void) const
+	{
+		return (fd_);
+	}
+
 private:
 	void accept_callback(Event);
 	void accept_cancel(void);
@@ -67,7 +76,10 @@ private:
 	void connect_cancel(void);
 	Action *connect_schedule(void);
 
+	void setsockopt_int(int, int, int, const char *);
+
 public:
+	static Socket *adopt(int);
 	static Socket *create(SocketAddressFamily, SocketType, const std::string& = "", const std::string& = "");
 };
 
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	IO_SOCKET_SOCKET_OPTIONS_H
+#define	IO_SOCKET_SOCKET_OPTIONS_H
+
+/*
+ * Tuning for TCP sockets.  Zero, false or empty leaves the system default.
+ *
+ * Buffer sizes must be set before a connection is set up for the window
+ * scale to allow for them, so they are applied before connect and listen;
+ * everything is applied again to each accepted socket, since not every
+ * system has sockets inherit all of these from their listener.
+ */
+struct SocketOptions {
+	bool nodelay_;
+	int send_buffer_;
+	int receive_buffer_;
+	std::string congestion_control_;
+	int notsent_lowat_;
+	bool quickack_;
+	bool keepalive_;
+	int keepalive_idle_;
+	int keepalive_interval_;
+	int keepalive_count_;
+
+	SocketOptions(void)
+	: nodelay_(false),
+	  send_buffer_(0),
+	  receive_buffer_(0),
+	  congestion_control_(""),
+	  notsent_lowat_(0),
+	  quickack_(false),
+	  keepalive_(false),
+	  keepalive_idle_(0),
+	  keepalive_interval_(0),
+	  keepalive_count_(0)
+	{ }
+};
+
+#endif /* !IO_SOCKET_SOCKET_OPTIONS_H */
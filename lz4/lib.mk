@@ -0,0 +1,6 @@
+VPATH+=	${TOPDIR}/lz4
+
+SRCS+=	lz4_compress_pipe.cc
+SRCS+=	lz4_decompress_pipe.cc
+
+LDADD+=	-llz4
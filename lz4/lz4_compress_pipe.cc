@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+
+#include <lz4/lz4_compress_pipe.h>
+
+/*
+ * A streaming LZ4 frame compressor, for links where CPU rather than
+ * bandwidth is the constraint.  Blocks are linked so that matches may
+ * reach back into earlier blocks, and each Buffer consumed is followed by a
+ * flush.
+ *
+ * XXX
+ * LZ4F has no interface for writing into a caller's partial buffer, so
+ * output goes through a scratch buffer large enough for the worst case of
+ * a single segment and is then copied into the output Buffer.
+ */
+
+LZ4CompressPipe::LZ4CompressPipe(int level)
+: PipeProducer("/lz4/compress_pipe"),
+  cctx_(NULL),
+  preferences_(),
+  started_(false),
+  scratch_()
+{
+	LZ4F_errorCode_t error = LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION);
+	if (LZ4F_isError(error))
+		HALT(log_) << "Could not create compression context: " << LZ4F_getErrorName(error);
+
+	memset(&preferences_, 0, sizeof preferences_);
+	preferences_.frameInfo.blockSizeID = LZ4F_max64KB;
+	preferences_.frameInfo.blockMode = LZ4F_blockLinked;
+	preferences_.compressionLevel = level;
+
+	scratch_.resize(LZ4F_compressBound(BUFFER_SEGMENT_SIZE, &preferences_));
+	if (scratch_.size() < LZ4F_HEADER_SIZE_MAX)
+		scratch_.resize(LZ4F_HEADER_SIZE_MAX);
+}
+
+LZ4CompressPipe::~LZ4CompressPipe()
+{
+	if (cctx_ != NULL) {
+		LZ4F_freeCompressionContext(cctx_);
+		cctx_ = NULL;
+	}
+}
+
+void
+LZ4CompressPipe::consume(Buffer *in)
+{
+	Buffer out;
+	size_t len;
+
+	if (!started_) {
+		if (!begin(&out)) {
+			produce_error();
+			return;
+		}
+	}
+
+	if (in->empty()) {
+		len = LZ4F_compressEnd(cctx_, &scratch_[0], scratch_.size(), NULL);
+		if (LZ4F_isError(len)) {
+			ERROR(log_) << "LZ4F_compressEnd(): " << LZ4F_getErrorName(len);
+			produce_error();
+			return;
+		}
+		out.append(&scratch_[0], len);
+		produce_eos(&out);
+		return;
+	}
+
+	while (!in->empty()) {
+		const BufferSegment *seg = *in->segments();
+
+		len = LZ4F_compressUpdate(cctx_, &scratch_[0], scratch_.size(), seg->data(), seg->length(), NULL);
+		if (LZ4F_isError(len)) {
+			ERROR(log_) << "LZ4F_compressUpdate(): " << LZ4F_getErrorName(len);
+			produce_error();
+			return;
+		}
+		if (len != 0)
+			out.append(&scratch_[0], len);
+
+		in->skip(seg->length());
+	}
+
+	len = LZ4F_flush(cctx_, &scratch_[0], scratch_.size(), NULL);
+	if (LZ4F_isError(len)) {
+		ERROR(log_) << "LZ4F_flush(): " << LZ4F_getErrorName(len);
+		produce_error();
+		return;
+	}
+	if (len != 0)
+		out.append(&scratch_[0], len);
+
+	if (!out.empty())
+		produce(&out);
+}
+
+bool
+LZ4CompressPipe::begin(Buffer *out)
+{
+	ASSERT(log_, !started_);
+
+	size_t len = LZ4F_compressBegin(cctx_, &scratch_[0], scratch_.size(), &preferences_);
+	if (LZ4F_isError(len)) {
+		ERROR(log_) << "LZ4F_compressBegin(): " << LZ4F_getErrorName(len);
+		return (false);
+	}
+	out->append(&scratch_[0], len);
+	started_ = true;
+
+	return (true);
+}
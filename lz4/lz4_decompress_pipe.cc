@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+
+#include <lz4/lz4_decompress_pipe.h>
+
+LZ4DecompressPipe::LZ4DecompressPipe(void)
+: PipeProducer("/lz4/decompress_pipe"),
+  dctx_(NULL),
+  frame_complete_(true)
+{
+	LZ4F_errorCode_t error = LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION);
+	if (LZ4F_isError(error))
+		HALT(log_) << "Could not create decompression context: " << LZ4F_getErrorName(error);
+}
+
+LZ4DecompressPipe::~LZ4DecompressPipe()
+{
+	if (dctx_ != NULL) {
+		LZ4F_freeDecompressionContext(dctx_);
+		dctx_ = NULL;
+	}
+}
+
+void
+LZ4DecompressPipe::consume(Buffer *in)
+{
+	if (in->empty()) {
+		if (!frame_complete_) {
+			ERROR(log_) << "Stream ended in the middle of a frame.";
+			produce_error();
+			return;
+		}
+		produce_eos();
+		return;
+	}
+
+	Buffer out;
+	BufferSegment *seg = BufferSegment::create();
+	size_t used = 0;
+
+	while (!in->empty()) {
+		const BufferSegment *iseg = *in->segments();
+		const uint8_t *src = iseg->data();
+		size_t left = iseg->length();
+
+		for (;;) {
+			size_t dst_size = BUFFER_SEGMENT_SIZE - used;
+			size_t src_size = left;
+
+			size_t hint = LZ4F_decompress(dctx_, seg->head() + used, &dst_size, src, &src_size, NULL);
+			if (LZ4F_isError(hint)) {
+				ERROR(log_) << "LZ4F_decompress(): " << LZ4F_getErrorName(hint);
+				seg->unref();
+				produce_error();
+				return;
+			}
+			frame_complete_ = hint == 0;
+
+			used += dst_size;
+			src += src_size;
+			left -= src_size;
+
+			/*
+			 * If the output segment filled up there may be more
+			 * output buffered in the decompressor even when all of
+			 * the input has been consumed.
+			 */
+			if (used == BUFFER_SEGMENT_SIZE) {
+				seg->set_length(used);
+				out.append(seg);
+				seg->unref();
+
+				seg = BufferSegment::create();
+				used = 0;
+				continue;
+			}
+
+			if (left == 0)
+				break;
+		}
+
+		in->skip(iseg->length());
+	}
+
+	if (used != 0) {
+		seg->set_length(used);
+		out.append(seg);
+	}
+	seg->unref();
+
+	if (!out.empty())
+		produce(&out);
+}
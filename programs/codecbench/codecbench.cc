@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <common/buffer.h>
+#include <common/timer/timer.h>
+#include <common/uuid/uuid.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_link.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+
+#include "../wanproxy/wanproxy_codec.h"
+#include "../wanproxy/wanproxy_codec_pipe_pair.h"
+
+/*
+ * Pushes a corpus through a pair of WANProxyCodecPipePairs, as would be set
+ * up by a client and server WANProxy, and reports throughput and the ratio
+ * of bytes on the wire to bytes in.  The two ends have separate caches, so
+ * the cost of any ASK/LEARN exchange is included.
+ */
+
+#define	CODECBENCH_INPUT_SIZE	65536
+
+struct CodecBenchEnd {
+	WANProxyCodec codec_;
+
+	intmax_t outgoing_to_codec_bytes_;
+	intmax_t codec_to_outgoing_bytes_;
+	intmax_t incoming_to_codec_bytes_;
+	intmax_t codec_to_incoming_bytes_;
+
+	CodecBenchEnd(const std::string& name)
+	: codec_(),
+	  outgoing_to_codec_bytes_(0),
+	  codec_to_outgoing_bytes_(0),
+	  incoming_to_codec_bytes_(0),
+	  codec_to_incoming_bytes_(0)
+	{
+		codec_.name_ = name;
+		codec_.outgoing_to_codec_bytes_ = &outgoing_to_codec_bytes_;
+		codec_.codec_to_outgoing_bytes_ = &codec_to_outgoing_bytes_;
+		codec_.incoming_to_codec_bytes_ = &incoming_to_codec_bytes_;
+		codec_.codec_to_incoming_bytes_ = &codec_to_incoming_bytes_;
+	}
+
+	~CodecBenchEnd()
+	{
+		if (codec_.codec_ != NULL) {
+			delete codec_.codec_->cache();
+			delete codec_.codec_;
+			codec_.codec_ = NULL;
+		}
+	}
+
+	void xcodec(void)
+	{
+		UUID uuid;
+		uuid.generate();
+
+		XCodecCache *cache = new XCodecMemoryCache(uuid);
+		codec_.codec_ = new XCodec(cache);
+	}
+};
+
+class CodecBench {
+	LogHandle log_;
+	CodecBenchEnd *client_;
+	CodecBenchEnd *server_;
+	WANProxyCodecPipePair client_pair_;
+	WANProxyCodecPipePair server_pair_;
+	PipeLink forward_;
+	PipeLink reverse_;
+	Buffer corpus_;
+	Buffer input_;
+	Buffer output_;
+	bool input_eos_;
+	bool forward_eos_;
+	bool reverse_eos_;
+	Action *input_action_;
+	Action *reverse_input_action_;
+	Action *forward_action_;
+	Action *reverse_action_;
+	Timer timer_;
+public:
+	CodecBench(CodecBenchEnd *client, CodecBenchEnd *server, const Buffer& corpus)
+	: log_("/codecbench"),
+	  client_(client),
+	  server_(server),
+	  client_pair_(NULL, &client->codec_),
+	  server_pair_(&server->codec_, NULL),
+	  forward_(client_pair_.get_incoming(), server_pair_.get_incoming()),
+	  reverse_(server_pair_.get_outgoing(), client_pair_.get_outgoing()),
+	  corpus_(corpus),
+	  input_(corpus),
+	  output_(),
+	  input_eos_(false),
+	  forward_eos_(false),
+	  reverse_eos_(false),
+	  input_action_(NULL),
+	  reverse_input_action_(NULL),
+	  forward_action_(NULL),
+	  reverse_action_(NULL),
+	  timer_()
+	{
+		timer_.start();
+
+		EventCallback *fcb = callback(this, &CodecBench::forward_complete);
+		forward_action_ = forward_.output(fcb);
+
+		EventCallback *rcb = callback(this, &CodecBench::reverse_complete);
+		reverse_action_ = reverse_.output(rcb);
+
+		send();
+	}
+
+	~CodecBench()
+	{
+		ASSERT(log_, input_action_ == NULL);
+		ASSERT(log_, reverse_input_action_ == NULL);
+		ASSERT(log_, forward_action_ == NULL);
+		ASSERT(log_, reverse_action_ == NULL);
+	}
+
+private:
+	void send(void)
+	{
+		ASSERT(log_, input_action_ == NULL);
+		ASSERT(log_, !input_eos_);
+
+		Buffer buf;
+		if (input_.empty())
+			input_eos_ = true;
+		else
+			input_.moveout(&buf, std::min(input_.length(), (size_t)CODECBENCH_INPUT_SIZE));
+
+		EventCallback *cb = callback(this, &CodecBench::input_complete);
+		input_action_ = forward_.input(&buf, cb);
+	}
+
+	void input_complete(Event e)
+	{
+		input_action_->cancel();
+		input_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+
+		if (!input_eos_)
+			send();
+	}
+
+	void reverse_input_complete(Event e)
+	{
+		reverse_input_action_->cancel();
+		reverse_input_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+	}
+
+	void forward_complete(Event e)
+	{
+		forward_action_->cancel();
+		forward_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		case Event::EOS:
+			ASSERT(log_, e.buffer_.empty());
+			forward_eos_ = true;
+			finish();
+			return;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+
+		bool done = output_.length() == corpus_.length();
+		output_.append(e.buffer_);
+		if (!done && output_.length() >= corpus_.length()) {
+			timer_.stop();
+
+			if (!output_.equal(&corpus_))
+				HALT(log_) << "Output does not match corpus.";
+
+			/*
+			 * The far end has everything; have it shut down its
+			 * side as a server would once its client is done.
+			 */
+			Buffer eos;
+			EventCallback *icb = callback(this, &CodecBench::reverse_input_complete);
+			reverse_input_action_ = reverse_.input(&eos, icb);
+		}
+
+		EventCallback *cb = callback(this, &CodecBench::forward_complete);
+		forward_action_ = forward_.output(cb);
+	}
+
+	void reverse_complete(Event e)
+	{
+		reverse_action_->cancel();
+		reverse_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		case Event::EOS:
+			ASSERT(log_, e.buffer_.empty());
+			reverse_eos_ = true;
+			finish();
+			return;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+			return;
+		}
+
+		EventCallback *cb = callback(this, &CodecBench::reverse_complete);
+		reverse_action_ = reverse_.output(cb);
+	}
+
+	void finish(void)
+	{
+		if (!forward_eos_ || !reverse_eos_)
+			return;
+
+		if (!output_.equal(&corpus_))
+			HALT(log_) << "Output does not match corpus.";
+
+		report();
+
+		EventSystem::instance()->stop();
+	}
+
+	void report(void)
+	{
+		uintmax_t microseconds = timer_.sample();
+		intmax_t inbytes = client_->incoming_to_codec_bytes_;
+		intmax_t outbytes = client_->codec_to_outgoing_bytes_;
+		intmax_t backbytes = server_->codec_to_incoming_bytes_;
+
+		INFO(log_) << inbytes << " bytes in, " << outbytes << " bytes on the wire, " << backbytes << " bytes back.";
+		if (inbytes <= outbytes) {
+			INFO(log_) << "bloat ratio 1:" << ((float)outbytes / inbytes) << " (" << ((float)inbytes / outbytes) << ":1)";
+		} else {
+			INFO(log_) << "compression ratio 1:" << ((float)outbytes / inbytes) << " (" << ((float)inbytes / outbytes) << ":1)";
+		}
+		if (client_pair_.compressor_bypass_count() != 0)
+			INFO(log_) << client_pair_.compressor_bypass_bytes() << " bytes bypassed compression in " << client_pair_.compressor_bypass_count() << " windows.";
+		if (microseconds != 0)
+			INFO(log_) << microseconds << " microseconds, " << ((float)inbytes / microseconds) << " MB/s.";
+	}
+};
+
+static bool fill(int, Buffer *);
+static void usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	WANProxyConfigCompressor compressor;
+	unsigned bypass, level, window_log;
+	bool verbose, xcodec;
+	int ch;
+
+	compressor = WANProxyConfigCompressorNone;
+	bypass = 0;
+	level = 0;
+	window_log = 0;
+	verbose = false;
+	xcodec = false;
+
+	while ((ch = getopt(argc, argv, "?b:c:l:vw:x")) != -1) {
+		switch (ch) {
+		case 'b':
+			bypass = atoi(optarg);
+			break;
+		case 'c':
+			if (strcmp(optarg, "zlib") == 0)
+				compressor = WANProxyConfigCompressorZlib;
+			else if (strcmp(optarg, "zstd") == 0)
+				compressor = WANProxyConfigCompressorZstd;
+			else if (strcmp(optarg, "lz4") == 0)
+				compressor = WANProxyConfigCompressorLZ4;
+			else
+				usage();
+			break;
+		case 'l':
+			level = atoi(optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'w':
+			window_log = atoi(optarg);
+			break;
+		case 'x':
+			xcodec = true;
+			break;
+		case '?':
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (compressor == WANProxyConfigCompressorNone && (level != 0 || window_log != 0))
+		usage();
+	if (compressor != WANProxyConfigCompressorZstd && window_log != 0)
+		usage();
+	if (compressor != WANProxyConfigCompressorZlib && bypass != 0)
+		usage();
+	if (bypass > 99)
+		usage();
+
+	if (verbose) {
+		Log::mask(".?", Log::Debug);
+	} else {
+		Log::mask(".?", Log::Info);
+	}
+
+	Buffer corpus;
+	if (argc == 0) {
+		while (fill(STDIN_FILENO, &corpus))
+			continue;
+	} else {
+		while (argc--) {
+			const char *file = *argv++;
+
+			int ifd = open(file, O_RDONLY);
+			ASSERT("/codecbench", ifd != -1);
+			while (fill(ifd, &corpus))
+				continue;
+			close(ifd);
+		}
+	}
+	if (corpus.empty())
+		HALT("/codecbench") << "Empty corpus.";
+
+	CodecBenchEnd client("client"), server("server");
+	if (xcodec) {
+		client.xcodec();
+		server.xcodec();
+	}
+
+	client.codec_.compressor_ = server.codec_.compressor_ = compressor;
+	client.codec_.compressor_level_ = server.codec_.compressor_level_ = level;
+	client.codec_.compressor_window_log_ = server.codec_.compressor_window_log_ = window_log;
+	client.codec_.compressor_bypass_threshold_ = server.codec_.compressor_bypass_threshold_ = bypass;
+
+	CodecBench bench(&client, &server, corpus);
+	event_main();
+}
+
+static bool
+fill(int fd, Buffer *input)
+{
+	uint8_t data[65536];
+	ssize_t len;
+
+	len = read(fd, data, sizeof data);
+	if (len == -1)
+		HALT("/fill") << "read failed.";
+	if (len == 0)
+		return (false);
+	input->append(data, len);
+	return (true);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: codecbench [-vx] [-c lz4] [-l level] [file ...]\n"
+"       codecbench [-vx] -c zlib [-l level] [-b bypass_threshold] [file ...]\n"
+"       codecbench [-vx] -c zstd [-l level] [-w window_log] [file ...]\n");
+	exit(1);
+}
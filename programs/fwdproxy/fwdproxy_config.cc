@@ -58,7 +58,11 @@ FWDProxyConfig::parse(std::deque<std::string>& tokens)
 
 	tokens.clear();
 
-	new ProxyListener("configured", SocketAddressFamilyIP, interface, SocketAddressFamilyIP, remote);
+	ProxyListener *listener = new ProxyListener("configured", SocketAddressFamilyIP, interface, SocketAddressFamilyIP, remote);
+	if (!listener->listening()) {
+		delete listener;
+		return (false);
+	}
 	return (true);
 }
 
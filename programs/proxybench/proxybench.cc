@@ -0,0 +1,1206 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include <common/buffer.h>
+#include <common/endian.h>
+#include <common/histogram.h>
+#include <common/time/time.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_client.h>
+#include <io/net/tcp_server.h>
+
+#include <io/socket/simple_server.h>
+#include <io/socket/socket.h>
+
+/*
+ * Measures WANProxy end to end on loopback, in the topology of the sample
+ * wanproxy.conf: a source connects to a client WANProxy, which encodes to a
+ * server WANProxy, which decodes and connects to a sink.
+ *
+ * Both WANProxies are started afresh for each corpus, so each starts with
+ * cold caches, and stopped after it, so that the CPU time they used can be
+ * had from getrusage(2).  Each flow starts with its number, so that the
+ * sink can tell how long after the source began connecting the first byte
+ * of it arrived.  Results are written to standard output as JSON.
+ *
+ * Ports are allocated upwards from the base port: the client WANProxy
+ * listens on the first, the server WANProxy on the second, the sink on the
+ * third, and the monitors of the client and server on the fourth and
+ * fifth.
+ */
+
+#define	PROXYBENCH_HOST			"127.0.0.1"
+#define	PROXYBENCH_PORT			(3300)
+
+/*
+ * The repetitive corpora are made of copies of one block of random data,
+ * shared by all flows.
+ */
+#define	PROXYBENCH_BLOCK_SIZE		(65536)
+
+/*
+ * The most random bytes inserted before each copy of the block in the
+ * shifted corpus, so that copies do not fall on the same alignment.
+ */
+#define	PROXYBENCH_SHIFT_MAX		(64)
+
+/*
+ * How much of each flow in the rpc corpus is a template shared by all of
+ * them, as the framing and headers of requests would be.
+ */
+#define	PROXYBENCH_RPC_TEMPLATE_SIZE	(384)
+
+/*
+ * How long to wait between attempts to reach a starting WANProxy's monitor,
+ * in milliseconds, and how many attempts to make.
+ */
+#define	PROXYBENCH_STARTUP_RETRY_MS	(100)
+#define	PROXYBENCH_STARTUP_RETRIES	(100)
+
+struct ProxyBenchCorpus {
+	const char *name_;
+	unsigned flows_;
+	size_t flow_bytes_;
+	unsigned concurrency_;
+};
+
+static const ProxyBenchCorpus proxybench_corpora[] = {
+	{ "random",	4,	16 * 1024 * 1024,	4 },
+	{ "repetitive",	4,	16 * 1024 * 1024,	4 },
+	{ "shifted",	4,	16 * 1024 * 1024,	4 },
+	{ "rpc",	2000,	512,			16 },
+	{ NULL,		0,	0,			0 }
+};
+
+class ProxyBench;
+
+/*
+ * One connection from the source, which sends its payload, shuts down its
+ * side, and waits for the other end to close.
+ */
+class ProxyBenchFlow {
+	LogHandle log_;
+	ProxyBench *bench_;
+	Buffer payload_;
+	Socket *socket_;
+	Action *action_;
+public:
+	ProxyBenchFlow(ProxyBench *bench, const Buffer& payload, const std::string& remote)
+	: log_("/proxybench/flow"),
+	  bench_(bench),
+	  payload_(payload),
+	  socket_(NULL),
+	  action_(NULL)
+	{
+		SocketEventCallback *cb = callback(this, &ProxyBenchFlow::connect_complete);
+		action_ = TCPClient::connect(SocketAddressFamilyIP, remote, cb);
+	}
+
+	~ProxyBenchFlow()
+	{
+		ASSERT(log_, socket_ == NULL);
+		ASSERT(log_, action_ == NULL);
+	}
+
+private:
+	void connect_complete(Event, Socket *);
+	void write_complete(Event);
+	void shutdown_complete(Event);
+	void read_complete(Event);
+	void close_complete(void);
+};
+
+/*
+ * One connection to the sink, which reads everything and then closes.
+ */
+class ProxyBenchSinkClient {
+	LogHandle log_;
+	ProxyBench *bench_;
+	Socket *socket_;
+	Action *action_;
+	Buffer header_;
+	bool identified_;
+	uint32_t flow_;
+	uintmax_t bytes_;
+public:
+	ProxyBenchSinkClient(ProxyBench *bench, Socket *socket)
+	: log_("/proxybench/sink/client"),
+	  bench_(bench),
+	  socket_(socket),
+	  action_(NULL),
+	  header_(),
+	  identified_(false),
+	  flow_(0),
+	  bytes_(0)
+	{
+		EventCallback *cb = callback(this, &ProxyBenchSinkClient::read_complete);
+		action_ = socket_->read(0, cb);
+	}
+
+	~ProxyBenchSinkClient()
+	{
+		ASSERT(log_, socket_ == NULL);
+		ASSERT(log_, action_ == NULL);
+	}
+
+private:
+	void read_complete(Event);
+	void close_complete(void);
+};
+
+class ProxyBenchSink : public SimpleServer<TCPServer> {
+	ProxyBench *bench_;
+public:
+	ProxyBenchSink(ProxyBench *bench, const std::string& interface)
+	: SimpleServer<TCPServer>("/proxybench/sink", SocketAddressFamilyIP, interface),
+	  bench_(bench)
+	{ }
+
+	~ProxyBenchSink()
+	{ }
+
+	void client_connected(Socket *socket)
+	{
+		new ProxyBenchSinkClient(bench_, socket);
+	}
+};
+
+/*
+ * Fetches the counters of a WANProxy from its monitor.
+ */
+class ProxyBenchScrape {
+	LogHandle log_;
+	ProxyBench *bench_;
+	Socket *socket_;
+	Action *action_;
+	Buffer response_;
+	bool ok_;
+public:
+	ProxyBenchScrape(ProxyBench *bench, const std::string& remote)
+	: log_("/proxybench/scrape"),
+	  bench_(bench),
+	  socket_(NULL),
+	  action_(NULL),
+	  response_(),
+	  ok_(false)
+	{
+		SocketEventCallback *cb = callback(this, &ProxyBenchScrape::connect_complete);
+		action_ = TCPClient::connect(SocketAddressFamilyIP, remote, cb);
+	}
+
+	~ProxyBenchScrape()
+	{
+		ASSERT(log_, socket_ == NULL);
+		ASSERT(log_, action_ == NULL);
+	}
+
+private:
+	void connect_complete(Event, Socket *);
+	void write_complete(Event);
+	void read_complete(Event);
+	void close(void);
+	void close_complete(void);
+};
+
+class ProxyBench {
+	enum Phase {
+		Starting,
+		Running,
+		Finishing,
+	};
+
+	LogHandle log_;
+	std::string wanproxy_;
+	std::string compressor_;
+	int compressor_level_;
+	unsigned port_;
+	bool direct_;
+	unsigned seed_;
+	std::vector<ProxyBenchCorpus> corpora_;
+	std::vector<ProxyBenchCorpus>::const_iterator corpus_;
+
+	Phase phase_;
+	pid_t client_pid_;
+	pid_t server_pid_;
+	std::string client_config_;
+	std::string server_config_;
+	unsigned ready_;
+	unsigned retries_;
+	Action *retry_action_;
+	double cpu_seconds_;
+
+	std::vector<Buffer> payloads_;
+	std::vector<NanoTime> flow_start_;
+	unsigned next_flow_;
+	unsigned flows_done_;
+	uintmax_t bytes_;
+	Histogram first_byte_;
+	NanoTime start_;
+	NanoTime finish_;
+
+	std::vector<std::string> results_;
+public:
+	ProxyBench(const std::string& wanproxy, const std::string& compressor, int compressor_level,
+		   unsigned port, bool direct, unsigned seed, const std::vector<ProxyBenchCorpus>& corpora)
+	: log_("/proxybench"),
+	  wanproxy_(wanproxy),
+	  compressor_(compressor),
+	  compressor_level_(compressor_level),
+	  port_(port),
+	  direct_(direct),
+	  seed_(seed),
+	  corpora_(corpora),
+	  corpus_(corpora_.begin()),
+	  phase_(Starting),
+	  client_pid_(-1),
+	  server_pid_(-1),
+	  client_config_(),
+	  server_config_(),
+	  ready_(0),
+	  retries_(0),
+	  retry_action_(NULL),
+	  cpu_seconds_(0),
+	  payloads_(),
+	  flow_start_(),
+	  next_flow_(0),
+	  flows_done_(0),
+	  bytes_(0),
+	  first_byte_(),
+	  start_(),
+	  finish_(),
+	  results_()
+	{
+		ProxyBenchSink *sink = new ProxyBenchSink(this, address(2));
+		if (!sink->listening())
+			fail("Could not listen for the sink.");
+
+		start();
+	}
+
+	~ProxyBench()
+	{
+		ASSERT(log_, retry_action_ == NULL);
+		ASSERT(log_, client_pid_ == -1);
+		ASSERT(log_, server_pid_ == -1);
+	}
+
+	void flow_complete(ProxyBenchFlow *);
+	void flow_first_byte(uint32_t);
+	void flow_received(uint32_t, uintmax_t);
+	void scrape_complete(bool, const Buffer&);
+
+	void fail(const std::string&);
+
+private:
+	std::string address(unsigned offset) const
+	{
+		std::ostringstream os;
+		os << "[" << PROXYBENCH_HOST << "]:" << port_ + offset;
+		return (os.str());
+	}
+
+	void start(void);
+	void generate(void);
+
+	void spawn(void);
+	pid_t spawn(const std::string&, std::string *);
+	void scrape(void);
+	void retry_complete(void);
+	void stop_proxies(void);
+
+	void run(void);
+	void report(const Buffer *);
+	void finish(void);
+};
+
+static void random_append(Buffer *, size_t);
+static void usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	std::vector<ProxyBenchCorpus> corpora;
+	std::string wanproxy, compressor;
+	unsigned concurrency, flows, port, seed;
+	size_t flow_bytes;
+	bool direct, quiet, verbose;
+	int ch, level;
+
+	compressor = "None";
+	concurrency = 0;
+	direct = false;
+	flow_bytes = 0;
+	flows = 0;
+	level = -1;
+	port = PROXYBENCH_PORT;
+	quiet = false;
+	seed = 1;
+	verbose = false;
+
+	while ((ch = getopt(argc, argv, "?C:Dc:j:l:n:p:qS:s:vw:")) != -1) {
+		switch (ch) {
+		case 'C': {
+			const ProxyBenchCorpus *c;
+			for (c = proxybench_corpora; c->name_ != NULL; c++) {
+				if (strcmp(c->name_, optarg) == 0)
+					break;
+			}
+			if (c->name_ == NULL)
+				usage();
+			corpora.push_back(*c);
+			break;
+		}
+		case 'D':
+			direct = true;
+			break;
+		case 'c':
+			if (strcmp(optarg, "zlib") != 0 && strcmp(optarg, "zstd") != 0 &&
+			    strcmp(optarg, "lz4") != 0 && strcmp(optarg, "None") != 0)
+				usage();
+			compressor = optarg;
+			break;
+		case 'j':
+			concurrency = atoi(optarg);
+			break;
+		case 'l':
+			level = atoi(optarg);
+			break;
+		case 'n':
+			flows = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'S':
+			seed = atoi(optarg);
+			break;
+		case 's':
+			flow_bytes = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'w':
+			wanproxy = optarg;
+			break;
+		case '?':
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage();
+	if (direct == (wanproxy != ""))
+		usage();
+	if (quiet && verbose)
+		usage();
+	if ((compressor == "None") != (level == -1))
+		usage();
+	if (direct && compressor != "None")
+		usage();
+	if (flow_bytes != 0 && flow_bytes < sizeof (uint32_t))
+		usage();
+	if (port == 0 || port + 4 > 65535)
+		usage();
+
+	if (verbose) {
+		Log::mask(".?", Log::Debug);
+	} else if (quiet) {
+		Log::mask(".?", Log::Error);
+	} else {
+		Log::mask(".?", Log::Info);
+	}
+
+	if (corpora.empty()) {
+		const ProxyBenchCorpus *c;
+		for (c = proxybench_corpora; c->name_ != NULL; c++)
+			corpora.push_back(*c);
+	}
+
+	std::vector<ProxyBenchCorpus>::iterator it;
+	for (it = corpora.begin(); it != corpora.end(); ++it) {
+		if (flows != 0)
+			it->flows_ = flows;
+		if (flow_bytes != 0)
+			it->flow_bytes_ = flow_bytes;
+		if (concurrency != 0)
+			it->concurrency_ = concurrency;
+	}
+
+	/*
+	 * A WANProxy which goes away early should not take us with it.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+
+	new ProxyBench(wanproxy, compressor, level, port, direct, seed, corpora);
+
+	event_main();
+}
+
+/*
+ * Start the next corpus, or finish up if there are no more.
+ */
+void
+ProxyBench::start(void)
+{
+	if (corpus_ == corpora_.end()) {
+		finish();
+		return;
+	}
+
+	INFO(log_) << "Generating corpus " << corpus_->name_ << ": " << corpus_->flows_ << " flows of " << corpus_->flow_bytes_ << " bytes.";
+	generate();
+
+	if (direct_) {
+		run();
+		return;
+	}
+
+	spawn();
+}
+
+/*
+ * Make the payload of every flow up front, so that it isn't measured.  The
+ * first bytes of each are its number.
+ */
+void
+ProxyBench::generate(void)
+{
+	std::string name(corpus_->name_);
+	size_t length = corpus_->flow_bytes_ - sizeof (uint32_t);
+
+	srandom(seed_);
+	Buffer block;
+	random_append(&block, PROXYBENCH_BLOCK_SIZE);
+
+	payloads_.clear();
+	unsigned flow;
+	for (flow = 0; flow < corpus_->flows_; flow++) {
+		srandom(seed_ + 1 + flow);
+
+		Buffer data;
+		if (name == "random") {
+			random_append(&data, length);
+		} else if (name == "repetitive") {
+			while (data.length() < length)
+				data.append(block);
+		} else if (name == "shifted") {
+			while (data.length() < length) {
+				random_append(&data, 1 + random() % PROXYBENCH_SHIFT_MAX);
+				data.append(block);
+			}
+		} else if (name == "rpc") {
+			data.append(block, std::min(length, (size_t)PROXYBENCH_RPC_TEMPLATE_SIZE));
+			random_append(&data, length - data.length());
+		} else {
+			NOTREACHED(log_);
+		}
+		if (data.length() > length)
+			data.trim(data.length() - length);
+
+		Buffer payload;
+		BigEndian::append(&payload, (uint32_t)flow);
+		payload.append(data);
+		payloads_.push_back(payload);
+	}
+}
+
+void
+ProxyBench::spawn(void)
+{
+	std::ostringstream client;
+	client << "create codec codec0\n";
+	client << "set codec0.codec XCodec\n";
+	client << "set codec0.compressor " << compressor_ << "\n";
+	if (compressor_level_ != -1)
+		client << "set codec0.compressor_level " << compressor_level_ << "\n";
+	client << "activate codec0\n";
+	client << "create interface if0\n";
+	client << "set if0.family IP\n";
+	client << "set if0.host \"" << PROXYBENCH_HOST << "\"\n";
+	client << "set if0.port \"" << port_ << "\"\n";
+	client << "activate if0\n";
+	client << "create peer peer0\n";
+	client << "set peer0.family IP\n";
+	client << "set peer0.host \"" << PROXYBENCH_HOST << "\"\n";
+	client << "set peer0.port \"" << port_ + 1 << "\"\n";
+	client << "activate peer0\n";
+	client << "create proxy proxy0\n";
+	client << "set proxy0.type TCP-TCP\n";
+	client << "set proxy0.interface if0\n";
+	client << "set proxy0.interface_codec None\n";
+	client << "set proxy0.peer peer0\n";
+	client << "set proxy0.peer_codec codec0\n";
+	client << "activate proxy0\n";
+	client << "create interface if1\n";
+	client << "set if1.family IP\n";
+	client << "set if1.host \"" << PROXYBENCH_HOST << "\"\n";
+	client << "set if1.port \"" << port_ + 3 << "\"\n";
+	client << "activate if1\n";
+	client << "create monitor monitor0\n";
+	client << "set monitor0.interface if1\n";
+	client << "activate monitor0\n";
+
+	std::ostringstream server;
+	server << "create codec codec0\n";
+	server << "set codec0.codec XCodec\n";
+	server << "set codec0.compressor " << compressor_ << "\n";
+	if (compressor_level_ != -1)
+		server << "set codec0.compressor_level " << compressor_level_ << "\n";
+	server << "activate codec0\n";
+	server << "create interface if0\n";
+	server << "set if0.family IP\n";
+	server << "set if0.host \"" << PROXYBENCH_HOST << "\"\n";
+	server << "set if0.port \"" << port_ + 1 << "\"\n";
+	server << "activate if0\n";
+	server << "create peer peer0\n";
+	server << "set peer0.family IP\n";
+	server << "set peer0.host \"" << PROXYBENCH_HOST << "\"\n";
+	server << "set peer0.port \"" << port_ + 2 << "\"\n";
+	server << "activate peer0\n";
+	server << "create proxy proxy0\n";
+	server << "set proxy0.type TCP-TCP\n";
+	server << "set proxy0.interface if0\n";
+	server << "set proxy0.interface_codec codec0\n";
+	server << "set proxy0.peer peer0\n";
+	server << "set proxy0.peer_codec None\n";
+	server << "activate proxy0\n";
+	server << "create interface if1\n";
+	server << "set if1.family IP\n";
+	server << "set if1.host \"" << PROXYBENCH_HOST << "\"\n";
+	server << "set if1.port \"" << port_ + 4 << "\"\n";
+	server << "activate if1\n";
+	server << "create monitor monitor0\n";
+	server << "set monitor0.interface if1\n";
+	server << "activate monitor0\n";
+
+	server_pid_ = spawn(server.str(), &server_config_);
+	client_pid_ = spawn(client.str(), &client_config_);
+
+	phase_ = Starting;
+	ready_ = 0;
+	retries_ = 0;
+	scrape();
+}
+
+/*
+ * Start a WANProxy with the given configuration.
+ */
+pid_t
+ProxyBench::spawn(const std::string& config, std::string *pathp)
+{
+	char path[] = "/tmp/proxybench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+		fail("Could not create configuration file.");
+	ssize_t len = write(fd, config.c_str(), config.length());
+	if (len == -1 || (size_t)len != config.length())
+		fail("Could not write configuration file.");
+	::close(fd);
+	*pathp = path;
+
+	pid_t pid = fork();
+	if (pid == -1)
+		fail("Could not fork.");
+	if (pid == 0) {
+		execl(wanproxy_.c_str(), wanproxy_.c_str(), "-q", "-c", path, (char *)NULL);
+		_exit(1);
+	}
+	return (pid);
+}
+
+/*
+ * While starting, waits until the monitors of both WANProxies answer, and
+ * when finishing, gets the client's counters.
+ */
+void
+ProxyBench::scrape(void)
+{
+	if (phase_ == Starting && ready_ == 1)
+		new ProxyBenchScrape(this, address(4));
+	else
+		new ProxyBenchScrape(this, address(3));
+}
+
+void
+ProxyBench::scrape_complete(bool ok, const Buffer& response)
+{
+	switch (phase_) {
+	case Starting:
+		if (!ok) {
+			if (++retries_ == PROXYBENCH_STARTUP_RETRIES)
+				fail("WANProxy did not start.");
+
+			ASSERT(log_, retry_action_ == NULL);
+			SimpleCallback *cb = callback(this, &ProxyBench::retry_complete);
+			retry_action_ = EventSystem::instance()->timeout(PROXYBENCH_STARTUP_RETRY_MS, cb);
+			return;
+		}
+
+		if (++ready_ != 2) {
+			scrape();
+			return;
+		}
+
+		run();
+		break;
+	case Finishing:
+		if (!ok)
+			fail("Could not get counters from WANProxy.");
+
+		stop_proxies();
+		report(&response);
+
+		corpus_++;
+		start();
+		break;
+	default:
+		NOTREACHED(log_);
+	}
+}
+
+void
+ProxyBench::retry_complete(void)
+{
+	retry_action_->cancel();
+	retry_action_ = NULL;
+
+	scrape();
+}
+
+/*
+ * Stop both WANProxies and wait for them, so their CPU time is counted.
+ */
+void
+ProxyBench::stop_proxies(void)
+{
+	struct rusage before, after;
+	int rv, status;
+
+	rv = getrusage(RUSAGE_CHILDREN, &before);
+	ASSERT(log_, rv != -1);
+
+	if (client_pid_ != -1) {
+		kill(client_pid_, SIGTERM);
+		waitpid(client_pid_, &status, 0);
+		client_pid_ = -1;
+	}
+
+	if (server_pid_ != -1) {
+		kill(server_pid_, SIGTERM);
+		waitpid(server_pid_, &status, 0);
+		server_pid_ = -1;
+	}
+
+	rv = getrusage(RUSAGE_CHILDREN, &after);
+	ASSERT(log_, rv != -1);
+
+	cpu_seconds_ =
+		(after.ru_utime.tv_sec - before.ru_utime.tv_sec) +
+		(after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6 +
+		(after.ru_stime.tv_sec - before.ru_stime.tv_sec) +
+		(after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+
+	if (client_config_ != "") {
+		unlink(client_config_.c_str());
+		client_config_ = "";
+	}
+
+	if (server_config_ != "") {
+		unlink(server_config_.c_str());
+		server_config_ = "";
+	}
+}
+
+void
+ProxyBench::run(void)
+{
+	phase_ = Running;
+
+	flow_start_.clear();
+	flow_start_.resize(corpus_->flows_);
+	next_flow_ = 0;
+	flows_done_ = 0;
+	bytes_ = 0;
+	first_byte_ = Histogram();
+
+	INFO(log_) << "Running corpus " << corpus_->name_ << ".";
+
+	start_ = NanoTime::current_time();
+	while (next_flow_ < corpus_->flows_ && next_flow_ < corpus_->concurrency_) {
+		flow_start_[next_flow_] = NanoTime::current_time();
+		new ProxyBenchFlow(this, payloads_[next_flow_], address(direct_ ? 2 : 0));
+		next_flow_++;
+	}
+}
+
+void
+ProxyBench::flow_complete(ProxyBenchFlow *flow)
+{
+	delete flow;
+
+	if (next_flow_ < corpus_->flows_) {
+		flow_start_[next_flow_] = NanoTime::current_time();
+		new ProxyBenchFlow(this, payloads_[next_flow_], address(direct_ ? 2 : 0));
+		next_flow_++;
+	}
+
+	if (++flows_done_ != corpus_->flows_)
+		return;
+
+	finish_ = NanoTime::current_time();
+
+	uintmax_t expected = (uintmax_t)corpus_->flows_ * corpus_->flow_bytes_;
+	if (bytes_ != expected) {
+		std::ostringstream os;
+		os << "Sink received " << bytes_ << " bytes but " << expected << " were sent.";
+		fail(os.str());
+	}
+
+	if (direct_) {
+		report(NULL);
+
+		corpus_++;
+		start();
+		return;
+	}
+
+	phase_ = Finishing;
+	scrape();
+}
+
+void
+ProxyBench::flow_first_byte(uint32_t flow)
+{
+	if (flow >= flow_start_.size())
+		fail("Sink received an unknown flow.");
+
+	NanoTime now = NanoTime::current_time();
+	now -= flow_start_[flow];
+	first_byte_.record(now.total_nanoseconds());
+}
+
+void
+ProxyBench::flow_received(uint32_t, uintmax_t bytes)
+{
+	bytes_ += bytes;
+}
+
+/*
+ * Find a sample in the Prometheus text from a monitor.
+ */
+static bool
+metric(const std::string& text, const std::string& name, double *valuep)
+{
+	std::string::size_type pos = text.find("\n" + name + " ");
+	if (pos == std::string::npos)
+		return (false);
+	*valuep = strtod(text.c_str() + pos + 1 + name.length() + 1, NULL);
+	return (true);
+}
+
+void
+ProxyBench::report(const Buffer *response)
+{
+	NanoTime elapsed = finish_;
+	elapsed -= start_;
+	double seconds = elapsed.total_nanoseconds() / 1e9;
+
+	std::ostringstream os;
+	os.precision(6);
+	os << std::fixed;
+	os << "{\"corpus\":\"" << corpus_->name_ << "\"";
+	os << ",\"flows\":" << corpus_->flows_;
+	os << ",\"flow_bytes\":" << corpus_->flow_bytes_;
+	os << ",\"concurrency\":" << corpus_->concurrency_;
+	os << ",\"bytes\":" << bytes_;
+	os << ",\"seconds\":" << seconds;
+	os << ",\"mb_per_second\":" << (seconds == 0 ? 0.0 : bytes_ / seconds / 1e6);
+	os << ",\"first_byte_p50_ms\":" << first_byte_.percentile(50.0) / 1e6;
+	os << ",\"first_byte_p99_ms\":" << first_byte_.percentile(99.0) / 1e6;
+	os << ",\"first_byte_max_ms\":" << first_byte_.max() / 1e6;
+
+	if (response == NULL) {
+		os << ",\"cpu_seconds\":null";
+		os << ",\"cpu_seconds_per_gb\":null";
+		os << ",\"dedup_ratio\":null";
+		os << ",\"wire_ratio\":null";
+	} else {
+		os << ",\"cpu_seconds\":" << cpu_seconds_;
+		os << ",\"cpu_seconds_per_gb\":" << cpu_seconds_ / (bytes_ / 1e9);
+
+		std::string text;
+		response->extract(text);
+
+		double in, out;
+		if (metric(text, "wanproxy_xcodec_encoder_bytes_total{codec=\"codec0\",direction=\"in\"}", &in) &&
+		    metric(text, "wanproxy_xcodec_encoder_bytes_total{codec=\"codec0\",direction=\"out\"}", &out) && out != 0)
+			os << ",\"dedup_ratio\":" << in / out;
+		else
+			os << ",\"dedup_ratio\":null";
+		if (metric(text, "wanproxy_proxy_bytes_total{proxy=\"proxy0\",side=\"local\",direction=\"in\"}", &in) &&
+		    metric(text, "wanproxy_proxy_bytes_total{proxy=\"proxy0\",side=\"remote\",direction=\"out\"}", &out) && out != 0)
+			os << ",\"wire_ratio\":" << in / out;
+		else
+			os << ",\"wire_ratio\":null";
+	}
+	os << "}";
+
+	INFO(log_) << "Result: " << os.str();
+	results_.push_back(os.str());
+}
+
+void
+ProxyBench::finish(void)
+{
+	std::ostringstream os;
+	os << "{\"direct\":" << (direct_ ? "true" : "false");
+	os << ",\"compressor\":\"" << compressor_ << "\"";
+	if (compressor_level_ == -1)
+		os << ",\"compressor_level\":null";
+	else
+		os << ",\"compressor_level\":" << compressor_level_;
+	os << ",\"seed\":" << seed_;
+	os << ",\"results\":[";
+	std::vector<std::string>::const_iterator it;
+	for (it = results_.begin(); it != results_.end(); ++it) {
+		if (it != results_.begin())
+			os << ",";
+		os << *it;
+	}
+	os << "]}\n";
+
+	std::string json(os.str());
+	fwrite(json.c_str(), 1, json.length(), stdout);
+	fflush(stdout);
+
+	EventSystem::instance()->stop();
+}
+
+/*
+ * Don't leave WANProxies behind when giving up.
+ */
+void
+ProxyBench::fail(const std::string& why)
+{
+	if (client_pid_ != -1)
+		kill(client_pid_, SIGTERM);
+	if (server_pid_ != -1)
+		kill(server_pid_, SIGTERM);
+	if (client_config_ != "")
+		unlink(client_config_.c_str());
+	if (server_config_ != "")
+		unlink(server_config_.c_str());
+
+	HALT(log_) << why;
+}
+
+void
+ProxyBenchFlow::connect_complete(Event e, Socket *socket)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		bench_->fail("Could not connect.");
+		return;
+	}
+
+	socket_ = socket;
+	ASSERT(log_, socket_ != NULL);
+
+	EventCallback *cb = callback(this, &ProxyBenchFlow::write_complete);
+	action_ = socket_->write(&payload_, cb);
+}
+
+void
+ProxyBenchFlow::write_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		bench_->fail("Could not write.");
+		return;
+	}
+
+	EventCallback *cb = callback(this, &ProxyBenchFlow::shutdown_complete);
+	action_ = socket_->shutdown(false, true, cb);
+}
+
+void
+ProxyBenchFlow::shutdown_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		bench_->fail("Could not shut down.");
+		return;
+	}
+
+	EventCallback *cb = callback(this, &ProxyBenchFlow::read_complete);
+	action_ = socket_->read(0, cb);
+}
+
+/*
+ * The sink sends nothing; wait for it to close once it has everything.
+ */
+void
+ProxyBenchFlow::read_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		bench_->fail("Could not read.");
+		return;
+	}
+
+	SimpleCallback *cb = callback(this, &ProxyBenchFlow::close_complete);
+	action_ = socket_->close(cb);
+}
+
+void
+ProxyBenchFlow::close_complete(void)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	bench_->flow_complete(this);
+}
+
+void
+ProxyBenchSinkClient::read_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+	case Event::EOS:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		bench_->fail("Sink could not read.");
+		return;
+	}
+
+	bytes_ += e.buffer_.length();
+	if (!identified_) {
+		header_.append(e.buffer_);
+		if (header_.length() >= sizeof flow_) {
+			BigEndian::extract(&flow_, &header_);
+			header_.clear();
+			identified_ = true;
+
+			bench_->flow_first_byte(flow_);
+		}
+	}
+
+	if (e.type_ == Event::Done) {
+		EventCallback *cb = callback(this, &ProxyBenchSinkClient::read_complete);
+		action_ = socket_->read(0, cb);
+		return;
+	}
+
+	if (!identified_)
+		bench_->fail("Sink received a flow too short to identify.");
+	bench_->flow_received(flow_, bytes_);
+
+	SimpleCallback *cb = callback(this, &ProxyBenchSinkClient::close_complete);
+	action_ = socket_->close(cb);
+}
+
+void
+ProxyBenchSinkClient::close_complete(void)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	delete this;
+}
+
+void
+ProxyBenchScrape::connect_complete(Event e, Socket *socket)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		DEBUG(log_) << "Could not connect to monitor: " << e;
+		bench_->scrape_complete(false, response_);
+		delete this;
+		return;
+	}
+
+	socket_ = socket;
+	ASSERT(log_, socket_ != NULL);
+
+	Buffer request("GET /metrics HTTP/1.0\r\n\r\n");
+	EventCallback *cb = callback(this, &ProxyBenchScrape::write_complete);
+	action_ = socket_->write(&request, cb);
+}
+
+void
+ProxyBenchScrape::write_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		DEBUG(log_) << "Could not write to monitor: " << e;
+		close();
+		return;
+	}
+
+	EventCallback *cb = callback(this, &ProxyBenchScrape::read_complete);
+	action_ = socket_->read(0, cb);
+}
+
+void
+ProxyBenchScrape::read_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done: {
+		response_.append(e.buffer_);
+
+		EventCallback *cb = callback(this, &ProxyBenchScrape::read_complete);
+		action_ = socket_->read(0, cb);
+		return;
+	}
+	case Event::EOS:
+		response_.append(e.buffer_);
+		ok_ = response_.prefix("HTTP/1.1 200") || response_.prefix("HTTP/1.0 200");
+		break;
+	default:
+		DEBUG(log_) << "Could not read from monitor: " << e;
+		break;
+	}
+
+	close();
+}
+
+void
+ProxyBenchScrape::close(void)
+{
+	SimpleCallback *cb = callback(this, &ProxyBenchScrape::close_complete);
+	action_ = socket_->close(cb);
+}
+
+void
+ProxyBenchScrape::close_complete(void)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	bench_->scrape_complete(ok_, response_);
+	delete this;
+}
+
+static void
+random_append(Buffer *buf, size_t len)
+{
+	uint8_t data[4096];
+
+	while (len != 0) {
+		size_t chunk = std::min(len, sizeof data);
+		size_t i;
+		for (i = 0; i < chunk; i++)
+			data[i] = random() % 256;
+		buf->append(data, chunk);
+		len -= chunk;
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: proxybench [-q | -v] [-C corpus ...] [-c compressor -l level] [-n flows]\n"
+"                  [-s flow_bytes] [-j concurrency] [-p base_port] [-S seed]\n"
+"                  -w wanproxy\n"
+"       proxybench [-q | -v] -D [-C corpus ...] [-n flows] [-s flow_bytes]\n"
+"                  [-j concurrency] [-p base_port] [-S seed]\n"
+"corpora: random, repetitive, shifted, rpc\n");
+	exit(1);
+}
@@ -25,17 +25,23 @@
 
 #include <sys/types.h>
 #include <sys/errno.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
 #include <common/buffer.h>
 #include <common/endian.h>
 #include <common/limits.h>
+#include <common/thread/thread.h>
 #include <common/timer/timer.h>
 
 #include <xcodec/xcodec.h>
@@ -43,9 +49,10 @@
 #include <xcodec/xcodec_decoder.h>
 #include <xcodec/xcodec_encoder.h>
 #include <xcodec/xcodec_hash.h>
+#include <xcodec/xcodec_image.h>
 
 enum FileAction {
-	None, Compress, Decompress, Hashes
+	None, Compress, Decompress, Hashes, Image
 };
 
 #define	TACK_FLAG_QUIET_OUTPUT		(0x00000001)
@@ -57,6 +64,8 @@ enum FileAction {
 static void compress(const std::string&, int, int, XCodec *, unsigned, Timer *);
 static void decompress(const std::string&, int, int, XCodec *, unsigned, Timer *);
 static void hashes(int, int, unsigned, Timer *);
+static void image(const std::string&, int, char *[], unsigned);
+static void image_files(const std::string&, std::vector<std::string>&);
 static bool fill(int, Buffer *);
 static void flush(int, Buffer *);
 static void print_ratio(const std::string&, uint64_t, uint64_t);
@@ -83,36 +92,76 @@ public:
 	void enter(const uint64_t&, BufferSegment *)
 	{ }
 
+	unsigned chain(const uint64_t&) const
+	{
+		return (0);
+	}
+
+	BufferSegment *find(const uint64_t&, const XCodecFingerprint&, uint8_t *) const
+	{
+		return (NULL);
+	}
+
 	bool out_of_band(void) const
 	{
 		return (true);
 	}
+
+	size_t entries(void) const
+	{
+		return (0);
+	}
 };
 
+/*
+ * A cache kept in a dictionary image between runs.  Caches from before
+ * there were images, which are just the segments one after another, are
+ * read too, and written back as images.
+ */
 class TackPersistentCache : public XCodecCache {
-	int fd_;
+	std::string path_;
+	bool writable_;
 	XCodecCache *cache_;
-	Buffer new_data_;
+	XCodecImage image_;
+	bool changed_;
 public:
-	TackPersistentCache(const UUID& uuid, int fd)
+	TackPersistentCache(const UUID& uuid, const std::string& path, bool writable)
 	: XCodecCache(uuid),
-	  fd_(fd),
+	  path_(path),
+	  writable_(writable),
 	  cache_(new XCodecMemoryCache(uuid)),
-	  new_data_()
+	  image_(),
+	  changed_(false)
 	{
-		Buffer input;
-		while (fill(fd_, &input)) {
-			while (!input.empty()) {
-				BufferSegment *seg;
-				input.copyout(&seg, XCODEC_SEGMENT_LENGTH);
-				if (seg->length() != XCODEC_SEGMENT_LENGTH)
+		if (XCodecImage::probe(path_)) {
+			if (!image_.load(path_))
+				HALT("/tack/persistent/cache") << "Corrupt persistent cache.";
+		} else {
+			int fd = open(path_.c_str(), O_RDONLY);
+			if (fd == -1) {
+				if (errno != ENOENT || !writable_)
+					HALT("/tack") << "Could not open persistent cache.";
+			} else {
+				Buffer input;
+				while (fill(fd, &input)) {
+					while (input.length() >= XCODEC_SEGMENT_LENGTH) {
+						BufferSegment *seg;
+						input.copyout(&seg, XCODEC_SEGMENT_LENGTH);
+						input.skip(XCODEC_SEGMENT_LENGTH);
+
+						uint64_t hash = XCodecHash::hash(seg->data());
+						image_.add(hash, seg);
+						seg->unref();
+					}
+				}
+				if (!input.empty())
 					HALT("/tack/persistent/cache") << "Corrupt persistent cache.";
-				input.skip(XCODEC_SEGMENT_LENGTH);
+				close(fd);
 
-				uint64_t hash = XCodecHash::hash(seg->data());
-				cache_->enter(hash, seg);
+				changed_ = image_.entries() != 0;
 			}
 		}
+		image_.seed(cache_);
 	}
 
 	~TackPersistentCache()
@@ -120,10 +169,8 @@ public:
 		delete cache_;
 		cache_ = NULL;
 
-		if (!new_data_.empty())
-			flush(fd_, &new_data_);
-		close(fd_);
-		fd_ = -1;
+		if (changed_ && writable_ && !image_.save(path_))
+			HALT("/tack/persistent/cache") << "Could not write persistent cache.";
 	}
 
 	BufferSegment *lookup(const uint64_t& hash) const
@@ -134,7 +181,28 @@ public:
 	void enter(const uint64_t& hash, BufferSegment *seg)
 	{
 		cache_->enter(hash, seg);
-		new_data_.append(seg);
+		image_.add(hash, seg);
+		changed_ = true;
+	}
+
+	/*
+	 * Images have no tags, so only one segment is kept for a hash.
+	 */
+	unsigned chain(const uint64_t& hash) const
+	{
+		if (cache_->chain(hash) == 0)
+			return (0);
+		return (XCODEC_TAG_COUNT);
+	}
+
+	BufferSegment *find(const uint64_t& hash, const XCodecFingerprint& fingerprint, uint8_t *tagp) const
+	{
+		return (cache_->find(hash, fingerprint, tagp));
+	}
+
+	size_t entries(void) const
+	{
+		return (cache_->entries());
 	}
 
 	bool out_of_band(void) const
@@ -143,10 +211,104 @@ public:
 	}
 };
 
+/*
+ * Hashes the segments of a share of the files going into an image, and
+ * keeps one copy of each.  BufferSegments may only be made on the main
+ * thread, so the data is kept flat until the images are merged.
+ */
+class TackImageWorker : public Thread {
+	std::vector<std::string> files_;
+	std::map<uint64_t, size_t> offsets_;
+	std::string data_;
+public:
+	TackImageWorker(void)
+	: Thread("TackImageWorker"),
+	  files_(),
+	  offsets_(),
+	  data_()
+	{ }
+
+	~TackImageWorker()
+	{ }
+
+	void add(const std::string& file)
+	{
+		files_.push_back(file);
+	}
+
+	void merge(XCodecImage *xcimage)
+	{
+		std::map<uint64_t, size_t>::const_iterator it;
+		for (it = offsets_.begin(); it != offsets_.end(); ++it) {
+			BufferSegment *seg = BufferSegment::create((const uint8_t *)data_.data() + it->second, XCODEC_SEGMENT_LENGTH);
+			xcimage->add(it->first, seg);
+			seg->unref();
+		}
+		offsets_.clear();
+		data_.clear();
+	}
+
+private:
+	void main(void)
+	{
+		std::vector<std::string>::const_iterator it;
+		for (it = files_.begin(); it != files_.end(); ++it)
+			process(*it);
+	}
+
+	void stop(void)
+	{ }
+
+	/*
+	 * Segments start at the beginning of the file, as they would if
+	 * it were the first thing the encoder saw; wherever the file is
+	 * sent, the encoder's rolling hash finds them.  Any tail shorter
+	 * than a segment is left out.
+	 */
+	void process(const std::string& file)
+	{
+		uint8_t data[65536];
+		size_t have;
+		int fd;
+
+		fd = open(file.c_str(), O_RDONLY);
+		if (fd == -1) {
+			ERROR("/tack/image") << "Could not open: " << file;
+			return;
+		}
+
+		have = 0;
+		for (;;) {
+			ssize_t len = read(fd, data + have, sizeof data - have);
+			if (len == -1) {
+				ERROR("/tack/image") << "Could not read: " << file;
+				break;
+			}
+			if (len == 0)
+				break;
+			have += len;
+
+			size_t o;
+			for (o = 0; o + XCODEC_SEGMENT_LENGTH <= have; o += XCODEC_SEGMENT_LENGTH) {
+				uint64_t hash = XCodecHash::hash(data + o);
+				if (offsets_.find(hash) != offsets_.end())
+					continue;
+				offsets_[hash] = data_.size();
+				data_.append((const char *)data + o, XCODEC_SEGMENT_LENGTH);
+			}
+			memmove(data, data + o, have - o);
+			have -= o;
+		}
+		close(fd);
+	}
+};
+
 int
 main(int argc, char *argv[])
 {
 	const char *persist;
+	const char *imagefile;
+	unsigned jobs;
 	bool nullcache;
 	bool verbose;
 	FileAction action;
@@ -154,13 +316,19 @@ main(int argc, char *argv[])
 	int ch;
 
 	persist = NULL;
+	imagefile = NULL;
+	jobs = 1;
 	action = None;
 	flags = 0;
 	nullcache = false;
 	verbose = false;
 
-	while ((ch = getopt(argc, argv, "?cdhp:svENQST")) != -1) {
+	while ((ch = getopt(argc, argv, "?b:cdhj:p:svENQST")) != -1) {
 		switch (ch) {
+		case 'b':
+			action = Image;
+			imagefile = optarg;
+			break;
 		case 'c':
 			action = Compress;
 			break;
@@ -170,6 +338,11 @@ main(int argc, char *argv[])
 		case 'h':
 			action = Hashes;
 			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs == 0)
+				usage();
+			break;
 		case 'p':
 			persist = optarg;
 			break;
@@ -214,6 +387,13 @@ main(int argc, char *argv[])
 			usage();
 	}
 
+	if (action == Image) {
+		if (argc == 0)
+			usage();
+		if (flags != 0 || nullcache || persist != NULL)
+			usage();
+	}
+
 	if (persist != NULL && nullcache)
 		usage();
 
@@ -227,6 +407,11 @@ main(int argc, char *argv[])
 		Log::mask(".?", Log::Info);
 	}
 
+	if (action == Image) {
+		image(imagefile, argc, argv, jobs);
+		return (0);
+	}
+
 	UUID uuid;
 	uuid.generate();
 
@@ -237,18 +422,10 @@ main(int argc, char *argv[])
 		else
 			cache = new XCodecMemoryCache(uuid);
 	} else {
-		int fd;
-		if (action == Compress) {
-			fd = open(persist, O_RDWR | O_CREAT, 0600);
-		} else {
-			/*
-			 * When decompressing, only allow reads.
-			 */
-			fd = open(persist, O_RDONLY);
-		}
-		if (fd == -1)
-			HALT("/tack") << "Could not open persistent cache.";
-		cache = new TackPersistentCache(uuid, fd);
+		/*
+		 * When decompressing, only allow reads.
+		 */
+		cache = new TackPersistentCache(uuid, persist, action == Compress);
 	}
 	XCodec codec(cache);
 
@@ -293,7 +470,7 @@ compress(const std::string& name, int ifd, int ofd, XCodec *codec, unsigned flag
 static void
 decompress(const std::string& name, int ifd, int ofd, XCodec *codec, unsigned flags, Timer *timer)
 {
-	std::set<uint64_t> unknown_hashes;
+	std::set<XCodecName> unknown_hashes;
 	XCodecDecoder decoder(codec->cache());
 	Buffer input, output;
 	uint64_t inbytes, outbytes;
@@ -377,6 +554,83 @@ hashes(int ifd, int ofd, unsigned flags, Timer *timer)
 	ASSERT("/hashes", output.empty());
 }
 
+/*
+ * Build a dictionary image from files and directory trees, hashing them on
+ * as many threads as asked for.
+ */
+static void
+image(const std::string& imagefile, int argc, char *argv[], unsigned jobs)
+{
+	std::vector<std::string> files;
+	while (argc--)
+		image_files(*argv++, files);
+
+	std::vector<TackImageWorker *> workers;
+	unsigned i;
+	for (i = 0; i < jobs && i < files.size(); i++)
+		workers.push_back(new TackImageWorker());
+	for (i = 0; i < files.size(); i++)
+		workers[i % workers.size()]->add(files[i]);
+
+	std::vector<TackImageWorker *>::iterator it;
+	for (it = workers.begin(); it != workers.end(); ++it)
+		(*it)->start();
+
+	XCodecImage xcimage;
+	for (it = workers.begin(); it != workers.end(); ++it) {
+		(*it)->join();
+		(*it)->merge(&xcimage);
+		delete *it;
+	}
+
+	if (!xcimage.save(imagefile))
+		HALT("/tack/image") << "Could not write image.";
+	INFO("/tack/image") << files.size() << " files, " << xcimage.entries() << " segments.";
+}
+
+/*
+ * Expand a path into the regular files under it, in a stable order.
+ */
+static void
+image_files(const std::string& path, std::vector<std::string>& files)
+{
+	struct stat st;
+
+	if (lstat(path.c_str(), &st) == -1) {
+		ERROR("/tack/image") << "Could not stat: " << path;
+		return;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		files.push_back(path);
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode))
+		return;
+
+	DIR *dir = opendir(path.c_str());
+	if (dir == NULL) {
+		ERROR("/tack/image") << "Could not open directory: " << path;
+		return;
+	}
+
+	std::vector<std::string> names;
+	struct dirent *de;
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		names.push_back(de->d_name);
+	}
+	closedir(dir);
+
+	std::sort(names.begin(), names.end());
+
+	std::vector<std::string>::const_iterator it;
+	for (it = names.begin(); it != names.end(); ++it)
+		image_files(path + "/" + *it, files);
+}
+
 static bool
 fill(int fd, Buffer *input)
 {
@@ -557,6 +811,7 @@ usage(void)
 	fprintf(stderr,
 "usage: tack [-p cache | -N] [-svQ] [-T [-ES]] -c [file ...]\n"
 "       tack [-p cache | -N] [-svQ] [-T [-ES]] -d [file ...]\n"
-"       tack [-vQ] [-T [-ES]] -h [file ...]\n");
+"       tack [-vQ] [-T [-ES]] -h [file ...]\n"
+"       tack [-v] [-j jobs] -b image file|directory ...\n");
 	exit(1);
 }
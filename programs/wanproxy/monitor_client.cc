@@ -43,6 +43,10 @@
 #include <io/pipe/splice.h>
 
 #include "monitor_client.h"
+#include "monitor_metrics.h"
+#include "proxy_connector.h"
+#include "ssh_proxy_connector.h"
+#include "wanproxy_reload.h"
 
 class HTMLConfigExporter : public ConfigExporter {
 	std::string select_;
@@ -98,10 +102,40 @@ public:
 	}
 };
 
+/*
+ * Shows how much each connection has read but not yet written, in each
+ * direction, and how much it has sent without compression.
+ */
+template<typename T>
+static void
+connections(std::ostringstream& os, const std::set<T *>& connectors)
+{
+	typename std::set<T *>::const_iterator it;
+	for (it = connectors.begin(); it != connectors.end(); ++it) {
+		const T *connector = *it;
+
+		os << "<tr><td><a href=\"/object/" << connector->name() << "\">" << connector->name() << "</a></td>";
+		os << "<td><tt>" << connector->client_name() << "</tt></td>";
+		os << "<td><tt>" << connector->incoming_buffered() << "</tt></td>";
+		os << "<td><tt>" << connector->outgoing_buffered() << "</tt></td>";
+		os << "<td><tt>" << connector->compressor_bypass_bytes() << "</tt></td>";
+		os << "<td><tt>" << connector->compressor_bypass_count() << "</tt></td></tr>";
+	}
+}
 
 void
 MonitorClient::handle_request(const std::string& method, const std::string& uri, HTTPProtocol::Request)
 {
+	/*
+	 * The reload is done on the event thread once we have answered;
+	 * how it went is logged.
+	 */
+	if (method == "POST" && uri == "/reload") {
+		WANProxyReload::request();
+		pipe_->send_response(HTTPProtocol::OK, "Reload requested.");
+		return;
+	}
+
 	if (method != "GET") {
 		pipe_->send_response(HTTPProtocol::BadRequest, "Unsupported method.");
 		return;
@@ -116,7 +150,22 @@ MonitorClient::handle_request(const std::string& method, const std::string& uri,
 	std::string select;
 	if (!path_components.empty()) {
 		switch (path_components.size()) {
+		case 1:
+			if (!path_components[0].equal("metrics")) {
+				pipe_->send_response(HTTPProtocol::NotFound, "Unsupported URI class.");
+				return;
+			}
+			pipe_->send_response(HTTPProtocol::OK, MonitorMetrics(config_).prometheus(), "text/plain; version=0.0.4");
+			return;
 		case 2:
+			if (path_components[0].equal("metrics")) {
+				if (!path_components[1].equal("json")) {
+					pipe_->send_response(HTTPProtocol::NotFound, "Unsupported metrics format.");
+					return;
+				}
+				pipe_->send_response(HTTPProtocol::OK, MonitorMetrics(config_).json(), "application/json");
+				return;
+			}
 			if (!path_components[0].equal("object")) {
 				pipe_->send_response(HTTPProtocol::NotFound, "Unsupported URI class.");
 				return;
@@ -131,5 +180,13 @@ MonitorClient::handle_request(const std::string& method, const std::string& uri,
 
 	HTMLConfigExporter exporter(select);
 	exporter.config(config_);
+	if (select == "") {
+		exporter.os_ << "<h1>Connections</h1>";
+		exporter.os_ << "<table>";
+		exporter.os_ << "<tr><th>proxy</th><th>client</th><th>incoming buffered</th><th>outgoing buffered</th><th>bypass bytes</th><th>bypass count</th></tr>";
+		connections(exporter.os_, ProxyConnector::connectors());
+		connections(exporter.os_, SSHProxyConnector::connectors());
+		exporter.os_ << "</table>";
+	}
 	pipe_->send_response(HTTPProtocol::OK, "<html><head><title>WANProxy Monitor</title><style type=\"text/css\">body { font-family: sans-serif; } td, th { vertical-align: text-top; text-align: left; }</style></head><body>" + exporter.os_.str() + "</body></html>", "text/html");
 }
@@ -0,0 +1,609 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sstream>
+
+#include <common/buffer.h>
+#include <common/histogram.h>
+#include <common/time/time.h>
+
+#include <config/config.h>
+#include <config/config_class.h>
+#include <config/config_object.h>
+
+#include <event/callback_thread.h>
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket_types.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+
+#include "monitor_metrics.h"
+#include "proxy_connector.h"
+#include "proxy_stats.h"
+#include "ssh_proxy_connector.h"
+#include "wanproxy_config_class_codec.h"
+
+/*
+ * Checks how much later than asked the event loop runs a timeout, which is
+ * how long callbacks are waiting to be run.
+ */
+class MonitorLagProbe {
+	LogHandle log_;
+	NanoTime expected_;
+	Action *timeout_action_;
+	Action *stop_action_;
+public:
+	static NanoTime last_;
+	static NanoTime max_;
+
+	MonitorLagProbe(void)
+	: log_("/wanproxy/monitor/lag"),
+	  expected_(),
+	  timeout_action_(NULL),
+	  stop_action_(NULL)
+	{
+		SimpleCallback *cb = callback(this, &MonitorLagProbe::stop);
+		stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, cb);
+
+		schedule();
+	}
+
+private:
+	~MonitorLagProbe()
+	{
+		ASSERT(log_, timeout_action_ == NULL);
+		ASSERT(log_, stop_action_ == NULL);
+	}
+
+	void schedule(void)
+	{
+		NanoTime interval;
+		interval.seconds_ = MONITOR_METRICS_LAG_PROBE_MS / 1000;
+		interval.nanoseconds_ = (MONITOR_METRICS_LAG_PROBE_MS % 1000) * 1000000;
+
+		expected_ = NanoTime::current_time();
+		expected_ += interval;
+
+		SimpleCallback *cb = callback(this, &MonitorLagProbe::timeout_complete);
+		timeout_action_ = EventSystem::instance()->timeout(MONITOR_METRICS_LAG_PROBE_MS, cb);
+	}
+
+	void timeout_complete(void)
+	{
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+
+		NanoTime now = NanoTime::current_time();
+		if (now > expected_) {
+			now -= expected_;
+			last_ = now;
+		} else {
+			last_ = NanoTime();
+		}
+		if (last_ > max_)
+			max_ = last_;
+
+		schedule();
+	}
+
+	void stop(void)
+	{
+		stop_action_->cancel();
+		stop_action_ = NULL;
+
+		if (timeout_action_ != NULL) {
+			timeout_action_->cancel();
+			timeout_action_ = NULL;
+		}
+
+		delete this;
+	}
+};
+
+NanoTime MonitorLagProbe::last_;
+NanoTime MonitorLagProbe::max_;
+
+/*
+ * Logs where the time in the event loop is going now and then, for those
+ * who do not scrape the monitor.
+ */
+class MonitorHistogramLog {
+	LogHandle log_;
+	Action *timeout_action_;
+	Action *stop_action_;
+public:
+	MonitorHistogramLog(void)
+	: log_("/wanproxy/monitor/histograms"),
+	  timeout_action_(NULL),
+	  stop_action_(NULL)
+	{
+		SimpleCallback *cb = callback(this, &MonitorHistogramLog::stop);
+		stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, cb);
+
+		schedule();
+	}
+
+private:
+	~MonitorHistogramLog()
+	{
+		ASSERT(log_, timeout_action_ == NULL);
+		ASSERT(log_, stop_action_ == NULL);
+	}
+
+	void schedule(void)
+	{
+		SimpleCallback *cb = callback(this, &MonitorHistogramLog::timeout_complete);
+		timeout_action_ = EventSystem::instance()->timeout(MONITOR_METRICS_HISTOGRAM_LOG_MS, cb);
+	}
+
+	void timeout_complete(void)
+	{
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+
+		std::set<CallbackThread *>::const_iterator it;
+		for (it = CallbackThread::threads().begin(); it != CallbackThread::threads().end(); ++it) {
+			const CallbackThread *td = *it;
+
+			summary(td->name() + " queue delay", td->queue_delay());
+			summary(td->name() + " execution", td->execution());
+		}
+		summary("Poll wait", EventSystem::instance()->poll_wait_time());
+		summary("Poll dispatch", EventSystem::instance()->poll_dispatch_time());
+		summary("Timeout lateness", EventSystem::instance()->timeout_lateness());
+
+		schedule();
+	}
+
+	void summary(const std::string& name, const Histogram *h)
+	{
+		if (h->count() == 0)
+			return;
+
+		INFO(log_) << name << ": " << h->count() << " samples" <<
+			", p50 " << microseconds(h->percentile(50.0)) <<
+			", p99 " << microseconds(h->percentile(99.0)) <<
+			", p99.9 " << microseconds(h->percentile(99.9)) <<
+			", max " << microseconds(h->max()) << ".";
+	}
+
+	static std::string microseconds(uintmax_t ns)
+	{
+		std::ostringstream os;
+		os.precision(3);
+		os << std::fixed << (double)ns / 1e3 << "us";
+		return (os.str());
+	}
+
+	void stop(void)
+	{
+		stop_action_->cancel();
+		stop_action_ = NULL;
+
+		if (timeout_action_ != NULL) {
+			timeout_action_->cancel();
+			timeout_action_ = NULL;
+		}
+
+		delete this;
+	}
+};
+
+static double
+seconds(const NanoTime& nt)
+{
+	return ((double)nt.seconds_ + (double)nt.nanoseconds_ / 1e9);
+}
+
+static std::string
+prometheus_escape(const std::string& str)
+{
+	std::string out;
+	std::string::const_iterator it;
+	for (it = str.begin(); it != str.end(); ++it) {
+		switch (*it) {
+		case '\\':
+			out += "\\\\";
+			break;
+		case '"':
+			out += "\\\"";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		default:
+			out += *it;
+			break;
+		}
+	}
+	return (out);
+}
+
+static std::string
+json_escape(const std::string& str)
+{
+	std::string out;
+	std::string::const_iterator it;
+	for (it = str.begin(); it != str.end(); ++it) {
+		unsigned char ch = *it;
+		switch (ch) {
+		case '\\':
+			out += "\\\\";
+			break;
+		case '"':
+			out += "\\\"";
+			break;
+		default:
+			if (ch < 0x20) {
+				char hex[7];
+				snprintf(hex, sizeof hex, "\\u%04x", ch);
+				out += hex;
+			} else {
+				out += ch;
+			}
+			break;
+		}
+	}
+	return (out);
+}
+
+MonitorMetrics::MonitorMetrics(const Config *config)
+: families_()
+{
+	config->marshall(this);
+
+	caches();
+	proxies();
+	event_loop();
+	callbacks();
+	buffers();
+}
+
+MonitorMetrics::~MonitorMetrics()
+{ }
+
+std::string
+MonitorMetrics::prometheus(void) const
+{
+	std::ostringstream os;
+
+	std::map<std::string, Family>::const_iterator fit;
+	for (fit = families_.begin(); fit != families_.end(); ++fit) {
+		const Family& family = fit->second;
+
+		os << "# HELP " << fit->first << ' ' << family.help_ << '\n';
+		os << "# TYPE " << fit->first << ' ' << family.type_ << '\n';
+
+		std::vector<Sample>::const_iterator sit;
+		for (sit = family.samples_.begin(); sit != family.samples_.end(); ++sit) {
+			const std::vector<std::pair<std::string, std::string> >& labels = sit->labels_.labels_;
+
+			os << fit->first << sit->suffix_;
+			if (!labels.empty()) {
+				os << '{';
+				std::vector<std::pair<std::string, std::string> >::const_iterator lit;
+				for (lit = labels.begin(); lit != labels.end(); ++lit) {
+					if (lit != labels.begin())
+						os << ',';
+					os << lit->first << "=\"" << prometheus_escape(lit->second) << '"';
+				}
+				os << '}';
+			}
+			os << ' ' << sit->value_ << '\n';
+		}
+	}
+
+	return (os.str());
+}
+
+std::string
+MonitorMetrics::json(void) const
+{
+	std::ostringstream os;
+
+	os << '{';
+	std::map<std::string, Family>::const_iterator fit;
+	for (fit = families_.begin(); fit != families_.end(); ++fit) {
+		const Family& family = fit->second;
+
+		if (fit != families_.begin())
+			os << ',';
+		os << '"' << fit->first << "\":{";
+		os << "\"type\":\"" << family.type_ << "\",";
+		os << "\"help\":\"" << json_escape(family.help_) << "\",";
+		os << "\"samples\":[";
+
+		std::vector<Sample>::const_iterator sit;
+		for (sit = family.samples_.begin(); sit != family.samples_.end(); ++sit) {
+			const std::vector<std::pair<std::string, std::string> >& labels = sit->labels_.labels_;
+
+			if (sit != family.samples_.begin())
+				os << ',';
+			os << "{\"name\":\"" << fit->first << sit->suffix_ << "\",";
+			os << "\"labels\":{";
+			std::vector<std::pair<std::string, std::string> >::const_iterator lit;
+			for (lit = labels.begin(); lit != labels.end(); ++lit) {
+				if (lit != labels.begin())
+					os << ',';
+				os << '"' << lit->first << "\":\"" << json_escape(lit->second) << '"';
+			}
+			os << "},\"value\":" << sit->value_ << '}';
+		}
+		os << "]}";
+	}
+	os << "}\n";
+
+	return (os.str());
+}
+
+/*
+ * Start keeping the measurements which are not simply counted as things
+ * happen.
+ */
+void
+MonitorMetrics::start(void)
+{
+	static bool started;
+
+	if (started)
+		return;
+	started = true;
+
+	new MonitorLagProbe();
+	new MonitorHistogramLog();
+}
+
+void
+MonitorMetrics::field(const ConfigClassInstance *, const ConfigClassMember *, const std::string&)
+{ }
+
+void
+MonitorMetrics::object(const ConfigObject *co, const std::string&)
+{
+	if (co->class_ == &wanproxy_config_class_codec)
+		codec(co);
+}
+
+void
+MonitorMetrics::value(const ConfigType *, const std::string&)
+{ }
+
+void
+MonitorMetrics::add(const std::string& name, const std::string& type, const std::string& help, const MetricLabels& labels, const std::string& value, const std::string& suffix)
+{
+	Family& family = families_[name];
+	if (family.type_ == "") {
+		family.type_ = type;
+		family.help_ = help;
+	}
+	ASSERT("/wanproxy/monitor/metrics", family.type_ == type);
+
+	Sample sample;
+	sample.suffix_ = suffix;
+	sample.labels_ = labels;
+	sample.value_ = value;
+	family.samples_.push_back(sample);
+}
+
+void
+MonitorMetrics::counter(const std::string& name, const std::string& help, const MetricLabels& labels, uintmax_t value)
+{
+	std::ostringstream os;
+	os << value;
+	add(name, "counter", help, labels, os.str());
+}
+
+void
+MonitorMetrics::gauge(const std::string& name, const std::string& help, const MetricLabels& labels, uintmax_t value)
+{
+	std::ostringstream os;
+	os << value;
+	add(name, "gauge", help, labels, os.str());
+}
+
+void
+MonitorMetrics::gauge(const std::string& name, const std::string& help, const MetricLabels& labels, double value)
+{
+	std::ostringstream os;
+	os.precision(12);
+	os << value;
+	add(name, "gauge", help, labels, os.str());
+}
+
+/*
+ * A histogram of durations in nanoseconds, as one in seconds.
+ */
+void
+MonitorMetrics::histogram(const std::string& name, const std::string& help, const MetricLabels& labels, const Histogram *h)
+{
+	/*
+	 * Take a copy so that the buckets and the count agree.
+	 */
+	Histogram snapshot(*h);
+
+	unsigned shift;
+	for (shift = MONITOR_METRICS_HISTOGRAM_LOW_SHIFT; shift <= MONITOR_METRICS_HISTOGRAM_HIGH_SHIFT; shift += 2) {
+		std::ostringstream le;
+		le.precision(12);
+		le << (double)((uintmax_t)1 << shift) / 1e9;
+
+		std::ostringstream os;
+		os << snapshot.count_below((uintmax_t)1 << shift);
+		add(name, "histogram", help, MetricLabels(labels)("le", le.str()), os.str(), "_bucket");
+	}
+
+	std::ostringstream count;
+	count << snapshot.count_below(~(uintmax_t)0);
+	add(name, "histogram", help, MetricLabels(labels)("le", "+Inf"), count.str(), "_bucket");
+
+	std::ostringstream sum;
+	sum.precision(12);
+	sum << (double)snapshot.sum() / 1e9;
+	add(name, "histogram", help, labels, sum.str(), "_sum");
+	add(name, "histogram", help, labels, count.str(), "_count");
+}
+
+void
+MonitorMetrics::codec(const ConfigObject *co)
+{
+	const WANProxyConfigClassCodec::Instance *inst =
+		dynamic_cast<const WANProxyConfigClassCodec::Instance *>(co->instance_);
+	if (inst == NULL)
+		return;
+
+	static const char bytes_help[] = "Bytes passed between streams and a codec.";
+	counter("wanproxy_codec_bytes_total", bytes_help, MetricLabels()("codec", co->name_)("direction", "outgoing_to_codec"), inst->outgoing_to_codec_bytes_);
+	counter("wanproxy_codec_bytes_total", bytes_help, MetricLabels()("codec", co->name_)("direction", "codec_to_outgoing"), inst->codec_to_outgoing_bytes_);
+	counter("wanproxy_codec_bytes_total", bytes_help, MetricLabels()("codec", co->name_)("direction", "incoming_to_codec"), inst->incoming_to_codec_bytes_);
+	counter("wanproxy_codec_bytes_total", bytes_help, MetricLabels()("codec", co->name_)("direction", "codec_to_incoming"), inst->codec_to_incoming_bytes_);
+
+	counter("wanproxy_codec_compressor_bypass_bytes_total", "Bytes sent without compression because they did not compress.", MetricLabels()("codec", co->name_), inst->compressor_bypass_bytes_);
+	counter("wanproxy_codec_compressor_bypass_total", "Times compression was bypassed.", MetricLabels()("codec", co->name_), inst->compressor_bypass_count_);
+
+	const XCodec *xcodec = inst->codec_.codec_;
+	if (xcodec == NULL)
+		return;
+	const XCodecStats *stats = xcodec->stats();
+
+	static const char encoder_help[] = "Bytes into and out of the XCodec encoder.";
+	counter("wanproxy_xcodec_encoder_bytes_total", encoder_help, MetricLabels()("codec", co->name_)("direction", "in"), stats->encoder_input_bytes_);
+	counter("wanproxy_xcodec_encoder_bytes_total", encoder_help, MetricLabels()("codec", co->name_)("direction", "out"), stats->encoder_output_bytes_);
+
+	static const char decoder_help[] = "Bytes into and out of the XCodec decoder.";
+	counter("wanproxy_xcodec_decoder_bytes_total", decoder_help, MetricLabels()("codec", co->name_)("direction", "in"), stats->decoder_input_bytes_);
+	counter("wanproxy_xcodec_decoder_bytes_total", decoder_help, MetricLabels()("codec", co->name_)("direction", "out"), stats->decoder_output_bytes_);
+
+	if (stats->encoder_output_bytes_ != 0)
+		gauge("wanproxy_xcodec_dedup_ratio", "Bytes into the XCodec encoder for each byte out.", MetricLabels()("codec", co->name_), (double)stats->encoder_input_bytes_ / (double)stats->encoder_output_bytes_);
+
+	counter("wanproxy_xcodec_ask_total", "<ASK>s sent and received.", MetricLabels()("codec", co->name_)("direction", "sent"), stats->ask_sent_);
+	counter("wanproxy_xcodec_ask_total", "<ASK>s sent and received.", MetricLabels()("codec", co->name_)("direction", "received"), stats->ask_received_);
+	counter("wanproxy_xcodec_learn_total", "<LEARN>s sent and received.", MetricLabels()("codec", co->name_)("direction", "sent"), stats->learn_sent_);
+	counter("wanproxy_xcodec_learn_total", "<LEARN>s sent and received.", MetricLabels()("codec", co->name_)("direction", "received"), stats->learn_received_);
+	counter("wanproxy_xcodec_learn_pushed_total", "<LEARN>s sent to peers before they asked.", MetricLabels()("codec", co->name_), stats->learn_pushed_);
+
+	counter("wanproxy_xcodec_ask_rounds_total", "Rounds of <ASK>s answered in full.", MetricLabels()("codec", co->name_), stats->ask_rounds_);
+	std::ostringstream os;
+	os.precision(12);
+	os << (double)stats->ask_round_nanoseconds_ / 1e9;
+	add("wanproxy_xcodec_ask_round_seconds_total", "counter", "Time the decoder spent waiting for <ASK>s to be answered.", MetricLabels()("codec", co->name_), os.str());
+}
+
+void
+MonitorMetrics::caches(void)
+{
+	const std::map<UUID, XCodecCache *>& caches = XCodecCache::caches();
+	std::map<UUID, XCodecCache *>::const_iterator it;
+	for (it = caches.begin(); it != caches.end(); ++it) {
+		const XCodecCache *cache = it->second;
+		MetricLabels labels;
+		labels("uuid", it->first.string_);
+
+		gauge("wanproxy_xcodec_cache_entries", "Segments in an XCodec cache.", labels, (uintmax_t)cache->entries());
+		counter("wanproxy_xcodec_cache_hits_total", "Lookups which found a segment in an XCodec cache.", labels, cache->hits());
+		counter("wanproxy_xcodec_cache_misses_total", "Lookups which did not find a segment in an XCodec cache.", labels, cache->misses());
+		counter("wanproxy_xcodec_cache_evictions_total", "Segments evicted from an XCodec cache.", labels, cache->evictions());
+	}
+}
+
+/*
+ * The totals cover connections which have closed; add in those still open.
+ */
+template<typename T>
+static void
+connections(std::map<std::string, ProxyStats> *stats, std::map<std::string, uintmax_t> *active, const std::set<T *>& connectors)
+{
+	typename std::set<T *>::const_iterator it;
+	for (it = connectors.begin(); it != connectors.end(); ++it) {
+		const T *connector = *it;
+
+		connector->stats(&(*stats)[connector->name()]);
+		(*active)[connector->name()]++;
+	}
+}
+
+void
+MonitorMetrics::proxies(void)
+{
+	std::map<std::string, ProxyStats> stats(ProxyStats::totals());
+	std::map<std::string, uintmax_t> active;
+
+	connections(&stats, &active, ProxyConnector::connectors());
+	connections(&stats, &active, SSHProxyConnector::connectors());
+
+	static const char bytes_help[] = "Bytes read and written by a proxy, on the side of its clients and of its peers.";
+	std::map<std::string, ProxyStats>::const_iterator it;
+	for (it = stats.begin(); it != stats.end(); ++it) {
+		const std::string& name = it->first;
+		const ProxyStats& ps = it->second;
+
+		counter("wanproxy_proxy_connections_total", "Connections handled by a proxy.", MetricLabels()("proxy", name), ps.connections_);
+		gauge("wanproxy_proxy_active_connections", "Connections open through a proxy.", MetricLabels()("proxy", name), active[name]);
+
+		counter("wanproxy_proxy_bytes_total", bytes_help, MetricLabels()("proxy", name)("side", "local")("direction", "in"), ps.local_read_bytes_);
+		counter("wanproxy_proxy_bytes_total", bytes_help, MetricLabels()("proxy", name)("side", "local")("direction", "out"), ps.local_written_bytes_);
+		counter("wanproxy_proxy_bytes_total", bytes_help, MetricLabels()("proxy", name)("side", "remote")("direction", "in"), ps.remote_read_bytes_);
+		counter("wanproxy_proxy_bytes_total", bytes_help, MetricLabels()("proxy", name)("side", "remote")("direction", "out"), ps.remote_written_bytes_);
+	}
+}
+
+void
+MonitorMetrics::event_loop(void)
+{
+	gauge("wanproxy_event_loop_lag_seconds", "How late the event loop last ran a timeout.", MetricLabels(), seconds(MonitorLagProbe::last_));
+	gauge("wanproxy_event_loop_lag_max_seconds", "The latest the event loop has run a timeout.", MetricLabels(), seconds(MonitorLagProbe::max_));
+}
+
+void
+MonitorMetrics::callbacks(void)
+{
+	std::set<CallbackThread *>::const_iterator it;
+	for (it = CallbackThread::threads().begin(); it != CallbackThread::threads().end(); ++it) {
+		CallbackThread *td = *it;
+
+		histogram("wanproxy_callback_queue_delay_seconds", "Time from a callback being scheduled to it being run.", MetricLabels()("thread", td->name()), td->queue_delay());
+		histogram("wanproxy_callback_execution_seconds", "Time taken to run a callback.", MetricLabels()("thread", td->name()), td->execution());
+
+		std::map<std::string, Histogram> types(td->type_execution());
+		std::map<std::string, Histogram>::const_iterator tit;
+		for (tit = types.begin(); tit != types.end(); ++tit)
+			histogram("wanproxy_callback_type_execution_seconds", "Time taken to run a callback, by the type of callback.", MetricLabels()("thread", td->name())("type", tit->first), &tit->second);
+	}
+
+	histogram("wanproxy_event_poll_wait_seconds", "Time the poll thread spent waiting for events.", MetricLabels(), EventSystem::instance()->poll_wait_time());
+	histogram("wanproxy_event_poll_dispatch_seconds", "Time the poll thread spent handing out the events from one wait.", MetricLabels(), EventSystem::instance()->poll_dispatch_time());
+	histogram("wanproxy_timeout_lateness_seconds", "Time from a timeout's deadline to its callback being scheduled.", MetricLabels(), EventSystem::instance()->timeout_lateness());
+}
+
+void
+MonitorMetrics::buffers(void)
+{
+	gauge("wanproxy_buffer_segment_cache_segments", "BufferSegments kept for reuse.", MetricLabels(), (uintmax_t)BufferSegment::cached());
+	gauge("wanproxy_buffer_segment_cache_limit", "The most BufferSegments kept for reuse.", MetricLabels(), (uintmax_t)BUFFER_SEGMENT_CACHE_LIMIT);
+	gauge("wanproxy_buffer_segment_size_bytes", "The size of each BufferSegment.", MetricLabels(), (uintmax_t)BUFFER_SEGMENT_SIZE);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_MONITOR_METRICS_H
+#define	PROGRAMS_WANPROXY_MONITOR_METRICS_H
+
+#include <map>
+#include <vector>
+
+#include <config/config_exporter.h>
+
+class Config;
+class Histogram;
+
+/*
+ * How often to check how late the event loop is running, in milliseconds.
+ */
+#define	MONITOR_METRICS_LAG_PROBE_MS	(1000)
+
+/*
+ * How often to log a summary of the event loop's histograms, in
+ * milliseconds.
+ */
+#define	MONITOR_METRICS_HISTOGRAM_LOG_MS	(60 * 1000)
+
+/*
+ * The bucket boundaries of histograms, in nanoseconds, go up by a factor of
+ * four from 2^10 (about a microsecond) to 2^34 (about 17 seconds.)
+ */
+#define	MONITOR_METRICS_HISTOGRAM_LOW_SHIFT	(10)
+#define	MONITOR_METRICS_HISTOGRAM_HIGH_SHIFT	(34)
+
+class MetricLabels {
+	friend class MonitorMetrics;
+
+	std::vector<std::pair<std::string, std::string> > labels_;
+public:
+	MetricLabels(void)
+	: labels_()
+	{ }
+
+	MetricLabels& operator() (const std::string& name, const std::string& value)
+	{
+		labels_.push_back(std::pair<std::string, std::string>(name, value));
+		return (*this);
+	}
+};
+
+/*
+ * A snapshot of WANProxy's counters, for scraping, rendered either in the
+ * Prometheus text format or as JSON.
+ *
+ * Nothing is aggregated as it is counted; the counters are plain fields of
+ * the codecs, caches and connectors, all updated on the event thread, and
+ * they are gathered up here when the monitor is asked for them, on the same
+ * thread.  The exception is the histograms of the event system's threads,
+ * which each thread keeps for itself, and which are read here without
+ * stopping it.
+ */
+class MonitorMetrics : public ConfigExporter {
+	struct Sample {
+		std::string suffix_;
+		MetricLabels labels_;
+		std::string value_;
+	};
+
+	struct Family {
+		std::string type_;
+		std::string help_;
+		std::vector<Sample> samples_;
+	};
+
+	std::map<std::string, Family> families_;
+public:
+	MonitorMetrics(const Config *);
+	~MonitorMetrics();
+
+	std::string prometheus(void) const;
+	std::string json(void) const;
+
+	static void start(void);
+
+private:
+	void field(const ConfigClassInstance *, const ConfigClassMember *, const std::string&);
+	void object(const ConfigObject *, const std::string&);
+	void value(const ConfigType *, const std::string&);
+
+	void add(const std::string&, const std::string&, const std::string&, const MetricLabels&, const std::string&, const std::string& = "");
+	void counter(const std::string&, const std::string&, const MetricLabels&, uintmax_t);
+	void gauge(const std::string&, const std::string&, const MetricLabels&, uintmax_t);
+	void gauge(const std::string&, const std::string&, const MetricLabels&, double);
+	void histogram(const std::string&, const std::string&, const MetricLabels&, const Histogram *);
+
+	void codec(const ConfigObject *);
+	void caches(void);
+	void proxies(void);
+	void event_loop(void);
+	void callbacks(void);
+	void buffers(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_MONITOR_METRICS_H */
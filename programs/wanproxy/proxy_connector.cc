@@ -38,17 +38,27 @@
 #include <io/net/tcp_client.h>
 
 #include "proxy_connector.h"
+#include "proxy_connector_pool.h"
+#include "proxy_stats.h"
+#include "wanproxy_codec_pipe_pair.h"
+
+std::set<ProxyConnector *> ProxyConnector::connectors_;
 
 ProxyConnector::ProxyConnector(const std::string& name,
-			 PipePair *pipe_pair, Socket *local_socket,
+			 PipePair *pipe_pair, StreamChannel *local_channel,
+			 const std::string& client_name,
 			 SocketAddressFamily family,
-			 const std::string& remote_name)
+			 const std::string& remote_name,
+			 const SocketOptions& remote_options,
+			 ProxyConnectorPool *pool)
 : log_("/wanproxy/proxy/" + name + "/connector"),
+  name_(name),
+  client_name_(client_name),
   stop_action_(NULL),
   local_action_(NULL),
-  local_socket_(local_socket),
+  local_channel_(local_channel),
   remote_action_(NULL),
-  remote_socket_(NULL),
+  remote_channel_(NULL),
   pipe_pair_(pipe_pair),
   incoming_pipe_(NULL),
   incoming_splice_(NULL),
@@ -57,25 +67,55 @@ ProxyConnector::ProxyConnector(const std::string& name,
   splice_pair_(NULL),
   splice_action_(NULL)
 {
-	if (pipe_pair_ != NULL) {
-		incoming_pipe_ = pipe_pair_->get_incoming();
-		outgoing_pipe_ = pipe_pair_->get_outgoing();
+	start();
+
+	Socket *socket = pool == NULL ? NULL : pool->get();
+	if (socket != NULL) {
+		connected(socket);
+	} else {
+		SocketEventCallback *cb = callback(this, &ProxyConnector::connect_complete);
+		remote_action_ = TCPClient::connect(family, remote_name, remote_options, cb);
 	}
+}
 
-	SocketEventCallback *cb = callback(this, &ProxyConnector::connect_complete);
-	remote_action_ = TCPClient::connect(family, remote_name, cb);
+/*
+ * Proxy to a channel which is already open, or which may be used as if it
+ * were, such as one to a tunnel.
+ */
+ProxyConnector::ProxyConnector(const std::string& name,
+			 PipePair *pipe_pair, StreamChannel *local_channel,
+			 const std::string& client_name,
+			 StreamChannel *remote_channel)
+: log_("/wanproxy/proxy/" + name + "/connector"),
+  name_(name),
+  client_name_(client_name),
+  stop_action_(NULL),
+  local_action_(NULL),
+  local_channel_(local_channel),
+  remote_action_(NULL),
+  remote_channel_(NULL),
+  pipe_pair_(pipe_pair),
+  incoming_pipe_(NULL),
+  incoming_splice_(NULL),
+  outgoing_pipe_(NULL),
+  outgoing_splice_(NULL),
+  splice_pair_(NULL),
+  splice_action_(NULL)
+{
+	start();
 
-	SimpleCallback *scb = callback(this, &ProxyConnector::stop);
-	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+	connected(remote_channel);
 }
 
 ProxyConnector::~ProxyConnector()
 {
+	connectors_.erase(this);
+
 	ASSERT(log_, stop_action_ == NULL);
 	ASSERT(log_, local_action_ == NULL);
-	ASSERT(log_, local_socket_ == NULL);
+	ASSERT(log_, local_channel_ == NULL);
 	ASSERT(log_, remote_action_ == NULL);
-	ASSERT(log_, remote_socket_ == NULL);
+	ASSERT(log_, remote_channel_ == NULL);
 	ASSERT(log_, incoming_splice_ == NULL);
 	ASSERT(log_, outgoing_splice_ == NULL);
 	ASSERT(log_, splice_pair_ == NULL);
@@ -100,32 +140,97 @@ ProxyConnector::~ProxyConnector()
 	}
 }
 
+std::string
+ProxyConnector::client_name(void) const
+{
+	return (client_name_);
+}
+
+size_t
+ProxyConnector::incoming_buffered(void) const
+{
+	if (incoming_splice_ == NULL)
+		return (0);
+	return (incoming_splice_->buffered());
+}
+
+size_t
+ProxyConnector::outgoing_buffered(void) const
+{
+	if (outgoing_splice_ == NULL)
+		return (0);
+	return (outgoing_splice_->buffered());
+}
+
+intmax_t
+ProxyConnector::compressor_bypass_bytes(void) const
+{
+	const WANProxyCodecPipePair *pair = dynamic_cast<const WANProxyCodecPipePair *>(pipe_pair_);
+	if (pair == NULL)
+		return (0);
+	return (pair->compressor_bypass_bytes());
+}
+
+intmax_t
+ProxyConnector::compressor_bypass_count(void) const
+{
+	const WANProxyCodecPipePair *pair = dynamic_cast<const WANProxyCodecPipePair *>(pipe_pair_);
+	if (pair == NULL)
+		return (0);
+	return (pair->compressor_bypass_count());
+}
+
+/*
+ * Add in what this connection has moved so far.
+ */
 void
-ProxyConnector::close_complete(Socket *socket)
+ProxyConnector::stats(ProxyStats *stats) const
 {
-	if (socket == local_socket_) {
+	stats->add(incoming_splice_, outgoing_splice_);
+}
+
+void
+ProxyConnector::start(void)
+{
+	if (pipe_pair_ != NULL) {
+		incoming_pipe_ = pipe_pair_->get_incoming();
+		outgoing_pipe_ = pipe_pair_->get_outgoing();
+	}
+
+	SimpleCallback *scb = callback(this, &ProxyConnector::stop);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+
+	connectors_.insert(this);
+
+	ProxyStats::totals(name_)->connections_++;
+}
+
+void
+ProxyConnector::close_complete(StreamChannel *channel)
+{
+	if (channel == local_channel_) {
 		local_action_->cancel();
 		local_action_ = NULL;
 	}
 
-	if (socket == remote_socket_) {
+	if (channel == remote_channel_) {
 		remote_action_->cancel();
 		remote_action_ = NULL;
 	}
 
-	if (socket == local_socket_) {
-		ASSERT(log_, local_socket_ != NULL);
-		delete local_socket_;
-		local_socket_ = NULL;
+	if (channel == local_channel_) {
+		ASSERT(log_, local_channel_ != NULL);
+		delete local_channel_;
+		local_channel_ = NULL;
 	}
 
-	if (socket == remote_socket_) {
-		ASSERT(log_, remote_socket_ != NULL);
-		delete remote_socket_;
-		remote_socket_ = NULL;
+	if (channel == remote_channel_) {
+		ASSERT(log_, remote_channel_ != NULL);
+		delete remote_channel_;
+		remote_channel_ = NULL;
 	}
 
-	if (local_socket_ == NULL && remote_socket_ == NULL) {
+	if (local_channel_ == NULL && remote_channel_ == NULL) {
 		delete this;
 	}
 }
@@ -149,11 +254,17 @@ ProxyConnector::connect_complete(Event e, Socket *socket)
 		return;
 	}
 
-	remote_socket_ = socket;
-	ASSERT(log_, remote_socket_ != NULL);
+	connected(socket);
+}
 
-	incoming_splice_ = new Splice(log_ + "/incoming", local_socket_, incoming_pipe_, remote_socket_);
-	outgoing_splice_ = new Splice(log_ + "/outgoing", remote_socket_, outgoing_pipe_, local_socket_);
+void
+ProxyConnector::connected(StreamChannel *channel)
+{
+	remote_channel_ = channel;
+	ASSERT(log_, remote_channel_ != NULL);
+
+	incoming_splice_ = new Splice(log_ + "/incoming", local_channel_, incoming_pipe_, remote_channel_);
+	outgoing_splice_ = new Splice(log_ + "/outgoing", remote_channel_, outgoing_pipe_, local_channel_);
 
 	splice_pair_ = new SplicePair(outgoing_splice_, incoming_splice_);
 
@@ -167,6 +278,8 @@ ProxyConnector::splice_complete(Event e)
 	splice_action_->cancel();
 	splice_action_ = NULL;
 
+	ProxyStats::totals(name_)->add(incoming_splice_, outgoing_splice_);
+
 	delete splice_pair_;
 	splice_pair_ = NULL;
 
@@ -233,6 +346,8 @@ ProxyConnector::schedule_close(void)
 		ASSERT(log_, outgoing_splice_ != NULL);
 		ASSERT(log_, incoming_splice_ != NULL);
 
+		ProxyStats::totals(name_)->add(incoming_splice_, outgoing_splice_);
+
 		delete splice_pair_;
 		splice_pair_ = NULL;
 
@@ -244,15 +359,15 @@ ProxyConnector::schedule_close(void)
 	}
 
 	ASSERT(log_, local_action_ == NULL);
-	ASSERT(log_, local_socket_ != NULL);
+	ASSERT(log_, local_channel_ != NULL);
 	SimpleCallback *lcb = callback(this, &ProxyConnector::close_complete,
-				       local_socket_);
-	local_action_ = local_socket_->close(lcb);
+				       local_channel_);
+	local_action_ = local_channel_->close(lcb);
 
 	ASSERT(log_, remote_action_ == NULL);
-	if (remote_socket_ != NULL) {
+	if (remote_channel_ != NULL) {
 		SimpleCallback *rcb = callback(this, &ProxyConnector::close_complete,
-					       remote_socket_);
-		remote_action_ = remote_socket_->close(rcb);
+					       remote_channel_);
+		remote_action_ = remote_channel_->close(rcb);
 	}
 }
@@ -30,20 +30,28 @@
 
 class Pipe;
 class PipePair;
+class ProxyConnectorPool;
+struct ProxyStats;
 class Socket;
 class Splice;
 class SplicePair;
+class StreamChannel;
+struct SocketOptions;
 
 class ProxyConnector {
+	static std::set<ProxyConnector *> connectors_;
+
 	LogHandle log_;
+	std::string name_;
+	std::string client_name_;
 
 	Action *stop_action_;
 
 	Action *local_action_;
-	Socket *local_socket_;
+	StreamChannel *local_channel_;
 
 	Action *remote_action_;
-	Socket *remote_socket_;
+	StreamChannel *remote_channel_;
 
 	PipePair *pipe_pair_;
 
@@ -57,12 +65,33 @@ class ProxyConnector {
 	Action *splice_action_;
 
 public:
-	ProxyConnector(const std::string&, PipePair *, Socket *, SocketAddressFamily, const std::string&);
+	ProxyConnector(const std::string&, PipePair *, StreamChannel *, const std::string&, SocketAddressFamily, const std::string&, const SocketOptions&, ProxyConnectorPool *);
+	ProxyConnector(const std::string&, PipePair *, StreamChannel *, const std::string&, StreamChannel *);
+
+	const std::string& name(void) const
+	{
+		return (name_);
+	}
+
+	std::string client_name(void) const;
+	size_t incoming_buffered(void) const;
+	size_t outgoing_buffered(void) const;
+	intmax_t compressor_bypass_bytes(void) const;
+	intmax_t compressor_bypass_count(void) const;
+	void stats(ProxyStats *) const;
+
+	static const std::set<ProxyConnector *>& connectors(void)
+	{
+		return (connectors_);
+	}
 private:
 	~ProxyConnector();
 
-	void close_complete(Socket *);
+	void start(void);
+
+	void close_complete(StreamChannel *);
 	void connect_complete(Event, Socket *);
+	void connected(StreamChannel *);
 	void splice_complete(Event);
 	void stop(void);
 
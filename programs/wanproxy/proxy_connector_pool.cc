@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_client.h>
+
+#include "proxy_connector_pool.h"
+
+ProxyConnectorPool::Member::Member(ProxyConnectorPool *pool)
+: log_(pool->log_ + "/member"),
+  pool_(pool),
+  socket_(NULL),
+  action_(NULL),
+  timeout_action_(NULL),
+  close_action_(NULL)
+{
+	SocketEventCallback *cb = callback(this, &ProxyConnectorPool::Member::connect_complete);
+	action_ = TCPClient::connect(pool_->family_, pool_->remote_name_, pool_->options_, cb);
+}
+
+ProxyConnectorPool::Member::~Member()
+{
+	ASSERT(log_, socket_ == NULL);
+	ASSERT(log_, action_ == NULL);
+	ASSERT(log_, timeout_action_ == NULL);
+	ASSERT(log_, close_action_ == NULL);
+}
+
+/*
+ * Hand the connection to a client, and go away.
+ */
+Socket *
+ProxyConnectorPool::Member::take(void)
+{
+	ASSERT(log_, socket_ != NULL);
+
+	if (action_ != NULL) {
+		action_->cancel();
+		action_ = NULL;
+	}
+
+	if (timeout_action_ != NULL) {
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+	}
+
+	Socket *socket = socket_;
+	socket_ = NULL;
+
+	delete this;
+
+	return (socket);
+}
+
+/*
+ * Drop the connection, and go away once it is closed.  Nothing more is
+ * heard from us by the pool.
+ */
+void
+ProxyConnectorPool::Member::close(void)
+{
+	pool_ = NULL;
+
+	if (action_ != NULL) {
+		action_->cancel();
+		action_ = NULL;
+	}
+
+	if (timeout_action_ != NULL) {
+		timeout_action_->cancel();
+		timeout_action_ = NULL;
+	}
+
+	if (socket_ == NULL) {
+		delete this;
+		return;
+	}
+
+	SimpleCallback *cb = callback(this, &ProxyConnectorPool::Member::close_complete);
+	close_action_ = socket_->close(cb);
+}
+
+void
+ProxyConnectorPool::Member::connect_complete(Event e, Socket *socket)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		INFO(log_) << "Connect failed: " << e;
+		pool_->failed(this);
+		return;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		pool_->failed(this);
+		return;
+	}
+
+	socket_ = socket;
+	ASSERT(log_, socket_ != NULL);
+
+	/*
+	 * Nothing should be read from an idle connection; if the read
+	 * completes at all, the connection is no good.
+	 */
+	EventCallback *cb = callback(this, &ProxyConnectorPool::Member::read_complete);
+	action_ = socket_->read(0, cb);
+
+	if (pool_->lifetime_ != 0) {
+		SimpleCallback *tcb = callback(this, &ProxyConnectorPool::Member::timeout_complete);
+		timeout_action_ = EventSystem::instance()->timeout(pool_->lifetime_ * 1000, tcb);
+	}
+
+	pool_->connected(this);
+}
+
+void
+ProxyConnectorPool::Member::read_complete(Event e)
+{
+	action_->cancel();
+	action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		INFO(log_) << "Peer sent data on an idle connection.";
+		break;
+	case Event::EOS:
+		DEBUG(log_) << "Peer closed an idle connection.";
+		break;
+	default:
+		INFO(log_) << "Idle connection failed: " << e;
+		break;
+	}
+
+	pool_->lost(this, false);
+}
+
+void
+ProxyConnectorPool::Member::timeout_complete(void)
+{
+	timeout_action_->cancel();
+	timeout_action_ = NULL;
+
+	pool_->lost(this, true);
+}
+
+void
+ProxyConnectorPool::Member::close_complete(void)
+{
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	delete this;
+}
+
+ProxyConnectorPool::ProxyConnectorPool(const std::string& name,
+				       SocketAddressFamily family,
+				       const std::string& remote_name,
+				       const SocketOptions& options,
+				       unsigned min, unsigned max,
+				       unsigned lifetime)
+: log_("/wanproxy/proxy/" + name + "/pool"),
+  family_(family),
+  remote_name_(remote_name),
+  options_(options),
+  min_(min),
+  max_(max),
+  lifetime_(lifetime),
+  target_(min),
+  connecting_(),
+  idle_(),
+  retry_action_(NULL)
+{
+	ASSERT(log_, min_ <= max_);
+
+	refill();
+}
+
+ProxyConnectorPool::~ProxyConnectorPool()
+{
+	if (retry_action_ != NULL) {
+		retry_action_->cancel();
+		retry_action_ = NULL;
+	}
+
+	std::set<Member *>::iterator it;
+	while ((it = connecting_.begin()) != connecting_.end()) {
+		Member *member = *it;
+		connecting_.erase(it);
+
+		member->close();
+	}
+
+	while (!idle_.empty()) {
+		idle_.front()->close();
+		idle_.pop_front();
+	}
+}
+
+/*
+ * Take an idle connection, if there is one.  Otherwise the caller must make
+ * its own, and the pool grows.
+ */
+Socket *
+ProxyConnectorPool::get(void)
+{
+	if (idle_.empty()) {
+		if (target_ < max_)
+			target_++;
+		refill();
+		return (NULL);
+	}
+
+	/*
+	 * Use the newest, so that any surplus is left to age out.
+	 */
+	Member *member = idle_.back();
+	idle_.pop_back();
+
+	Socket *socket = member->take();
+	refill();
+
+	return (socket);
+}
+
+void
+ProxyConnectorPool::connected(Member *member)
+{
+	ASSERT(log_, connecting_.find(member) != connecting_.end());
+	connecting_.erase(member);
+
+	idle_.push_back(member);
+}
+
+/*
+ * Don't keep trying to connect to a peer which is not there; wait a while
+ * before trying again.
+ */
+void
+ProxyConnectorPool::failed(Member *member)
+{
+	ASSERT(log_, connecting_.find(member) != connecting_.end());
+	connecting_.erase(member);
+
+	member->close();
+
+	if (retry_action_ == NULL) {
+		SimpleCallback *cb = callback(this, &ProxyConnectorPool::retry_complete);
+		retry_action_ = EventSystem::instance()->timeout(PROXY_CONNECTOR_POOL_RETRY_MS, cb);
+	}
+}
+
+void
+ProxyConnectorPool::lost(Member *member, bool expired)
+{
+	std::deque<Member *>::iterator it;
+	for (it = idle_.begin(); it != idle_.end(); ++it) {
+		if (*it == member)
+			break;
+	}
+	ASSERT(log_, it != idle_.end());
+	idle_.erase(it);
+
+	member->close();
+
+	if (expired && target_ > min_)
+		target_--;
+
+	refill();
+}
+
+void
+ProxyConnectorPool::refill(void)
+{
+	if (retry_action_ != NULL)
+		return;
+
+	while (idle_.size() + connecting_.size() < target_)
+		connecting_.insert(new Member(this));
+}
+
+void
+ProxyConnectorPool::retry_complete(void)
+{
+	retry_action_->cancel();
+	retry_action_ = NULL;
+
+	refill();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_CONNECTOR_POOL_H
+#define	PROGRAMS_WANPROXY_PROXY_CONNECTOR_POOL_H
+
+#include <deque>
+#include <set>
+
+#include <io/socket/socket_options.h>
+#include <io/socket/socket_types.h>
+
+class Socket;
+
+/*
+ * How long to wait before connecting again after a connection for the pool
+ * has failed, in milliseconds.
+ */
+#define	PROXY_CONNECTOR_POOL_RETRY_MS	(1000)
+
+/*
+ * Connections to a peer, made before there are clients to use them, so that
+ * a client need not wait for the connection to be set up.
+ *
+ * The pool keeps at least its minimum number of connections idle.  Each
+ * time a client finds the pool empty, one more is kept, up to the maximum,
+ * and each time an idle connection outlives its lifetime unused, one fewer
+ * is, down to the minimum.
+ *
+ * Idle connections are watched, and dropped if the peer closes them or
+ * sends anything, so only peers which wait for their clients to speak
+ * first can be pooled.
+ */
+class ProxyConnectorPool {
+	class Member {
+		LogHandle log_;
+		ProxyConnectorPool *pool_;
+		Socket *socket_;
+		Action *action_;
+		Action *timeout_action_;
+		Action *close_action_;
+	public:
+		Member(ProxyConnectorPool *);
+	private:
+		~Member();
+
+	public:
+		Socket *take(void);
+		void close(void);
+
+	private:
+		void connect_complete(Event, Socket *);
+		void read_complete(Event);
+		void timeout_complete(void);
+		void close_complete(void);
+	};
+
+	LogHandle log_;
+	SocketAddressFamily family_;
+	std::string remote_name_;
+	SocketOptions options_;
+	unsigned min_;
+	unsigned max_;
+	unsigned lifetime_;
+	unsigned target_;
+
+	std::set<Member *> connecting_;
+	std::deque<Member *> idle_;
+
+	Action *retry_action_;
+public:
+	ProxyConnectorPool(const std::string&, SocketAddressFamily, const std::string&, const SocketOptions&, unsigned, unsigned, unsigned);
+	~ProxyConnectorPool();
+
+	Socket *get(void);
+
+private:
+	void connected(Member *);
+	void failed(Member *);
+	void lost(Member *, bool);
+
+	void refill(void);
+	void retry_complete(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_CONNECTOR_POOL_H */
@@ -33,6 +33,7 @@
 #include <io/net/tcp_server.h>
 
 #include "proxy_connector.h"
+#include "proxy_connector_pool.h"
 #include "proxy_listener.h"
 
 #include "wanproxy_codec_pipe_pair.h"
@@ -42,22 +43,36 @@ ProxyListener::ProxyListener(const std::string& name,
 			     WANProxyCodec *remote_codec,
 			     SocketAddressFamily interface_family,
 			     const std::string& interface,
+			     const SocketOptions& interface_options,
 			     SocketAddressFamily remote_family,
-			     const std::string& remote_name)
-: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_family, interface),
+			     const std::string& remote_name,
+			     const SocketOptions& remote_options,
+			     ProxyConnectorPool *pool,
+			     int compressor_level)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_family, interface, interface_options),
   name_(name),
   interface_codec_(interface_codec),
   remote_codec_(remote_codec),
   remote_family_(remote_family),
-  remote_name_(remote_name)
+  remote_name_(remote_name),
+  remote_options_(remote_options),
+  pool_(pool),
+  compressor_level_(compressor_level)
 { }
 
 ProxyListener::~ProxyListener()
-{ }
+{
+	if (pool_ != NULL) {
+		delete pool_;
+		pool_ = NULL;
+	}
+}
 
 void
 ProxyListener::client_connected(Socket *socket)
 {
-	PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
-	new ProxyConnector(name_, pipe_pair, socket, remote_family_, remote_name_);
+	WANProxyCodecPipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
+	if (compressor_level_ != -1)
+		pipe_pair->set_compressor_level(compressor_level_);
+	new ProxyConnector(name_, pipe_pair, socket, socket->getpeername(), remote_family_, remote_name_, remote_options_, pool_);
 }
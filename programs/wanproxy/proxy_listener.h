@@ -28,6 +28,7 @@
 
 #include <io/socket/simple_server.h>
 
+class ProxyConnectorPool;
 class Socket;
 class TCPServer;
 struct WANProxyCodec;
@@ -38,10 +39,14 @@ class ProxyListener : public SimpleServer<TCPServer> {
 	WANProxyCodec *remote_codec_;
 	SocketAddressFamily remote_family_;
 	std::string remote_name_;
+	SocketOptions remote_options_;
+	ProxyConnectorPool *pool_;
+	int compressor_level_;
 public:
 	ProxyListener(const std::string&, WANProxyCodec *, WANProxyCodec *, SocketAddressFamily,
-		      const std::string&, SocketAddressFamily,
-		      const std::string&);
+		      const std::string&, const SocketOptions&, SocketAddressFamily,
+		      const std::string&, const SocketOptions&, ProxyConnectorPool *,
+		      int);
 	~ProxyListener();
 
 private:
@@ -35,8 +35,8 @@
 #include "proxy_socks_connection.h"
 #include "proxy_socks_listener.h"
 
-ProxySocksListener::ProxySocksListener(const std::string& name, SocketAddressFamily family, const std::string& interface)
-: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/socks/listener", family, interface),
+ProxySocksListener::ProxySocksListener(const std::string& name, SocketAddressFamily family, const std::string& interface, const SocketOptions& options)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/socks/listener", family, interface, options),
   name_(name)
 { }
 
@@ -36,7 +36,7 @@ class ProxySocksListener : public SimpleServer<TCPServer> {
 	std::string name_;
 
 public:
-	ProxySocksListener(const std::string&, SocketAddressFamily, const std::string&);
+	ProxySocksListener(const std::string&, SocketAddressFamily, const std::string&, const SocketOptions&);
 	~ProxySocksListener();
 
 private:
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_PROXY_STATS_H
+#define	PROGRAMS_WANPROXY_PROXY_STATS_H
+
+#include <map>
+
+class Splice;
+
+/*
+ * Counts for each proxy, by name, for the monitor.
+ *
+ * Connectors add in what their Splices have moved as they finish with them,
+ * so the totals here cover connections which have closed; the monitor adds
+ * in those still open when it reports.  Everything is done on the event
+ * thread, so these are plain counts.
+ */
+struct ProxyStats {
+	uintmax_t connections_;
+	uintmax_t local_read_bytes_;
+	uintmax_t local_written_bytes_;
+	uintmax_t remote_read_bytes_;
+	uintmax_t remote_written_bytes_;
+
+	ProxyStats(void)
+	: connections_(0),
+	  local_read_bytes_(0),
+	  local_written_bytes_(0),
+	  remote_read_bytes_(0),
+	  remote_written_bytes_(0)
+	{ }
+
+	void add(const Splice *, const Splice *);
+
+	static ProxyStats *totals(const std::string& name)
+	{
+		return (&totals_[name]);
+	}
+
+	static const std::map<std::string, ProxyStats>& totals(void)
+	{
+		return (totals_);
+	}
+
+private:
+	static std::map<std::string, ProxyStats> totals_;
+};
+
+#endif /* !PROGRAMS_WANPROXY_PROXY_STATS_H */
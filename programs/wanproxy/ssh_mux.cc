@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/splice.h>
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_client.h>
+
+#include <ssh/ssh_algorithm_negotiation.h>
+#include <ssh/ssh_connection.h>
+#include <ssh/ssh_server_host_key.h>
+#include <ssh/ssh_transport_pipe.h>
+
+#include "ssh_mux.h"
+#include "ssh_proxy_connector.h"
+
+#include "wanproxy_codec_pipe_pair.h"
+
+/*
+ * The type of the channels that carry proxied streams.
+ */
+#define	SSH_MUX_CHANNEL_TYPE	"stream@wanproxy.org"
+
+/*
+ * How long to hold channel data back for more to merge with it, in
+ * milliseconds.
+ */
+#define	SSH_MUX_COALESCE_DELAY	(5)
+
+std::map<SSHMux::Key, SSHMux *> SSHMux::clients_;
+
+/*
+ * Connect to a peer to open channels to.
+ */
+SSHMux::SSHMux(const std::string& name, SocketAddressFamily family, const std::string& remote_name, const SocketOptions& options)
+: log_("/wanproxy/proxy/" + name + "/ssh/client"),
+  name_(name),
+  key_(name, family, remote_name),
+  socket_(NULL),
+  peer_name_(remote_name),
+  session_(SSH::ClientRole),
+  pipe_(NULL),
+  connection_(NULL),
+  splice_(NULL),
+  splice_action_(NULL),
+  connect_action_(NULL),
+  accept_action_(NULL),
+  close_action_(NULL),
+  stop_action_(NULL),
+  interface_codec_(NULL),
+  remote_codec_(NULL),
+  remote_family_(family),
+  remote_name_(remote_name),
+  remote_options_(options)
+{
+	start();
+
+	SocketEventCallback *cb = callback(this, &SSHMux::connect_complete);
+	connect_action_ = TCPClient::connect(family, remote_name, options, cb);
+
+	clients_[key_] = this;
+}
+
+/*
+ * Take a connection from a peer, and proxy each channel it opens to the
+ * remote address given.
+ */
+SSHMux::SSHMux(const std::string& name, Socket *socket,
+	       WANProxyCodec *interface_codec, WANProxyCodec *remote_codec,
+	       SocketAddressFamily remote_family, const std::string& remote_name,
+	       const SocketOptions& remote_options)
+: log_("/wanproxy/proxy/" + name + "/ssh/server"),
+  name_(name),
+  key_(),
+  socket_(socket),
+  peer_name_(socket->getpeername()),
+  session_(SSH::ServerRole),
+  pipe_(NULL),
+  connection_(NULL),
+  splice_(NULL),
+  splice_action_(NULL),
+  connect_action_(NULL),
+  accept_action_(NULL),
+  close_action_(NULL),
+  stop_action_(NULL),
+  interface_codec_(interface_codec),
+  remote_codec_(remote_codec),
+  remote_family_(remote_family),
+  remote_name_(remote_name),
+  remote_options_(remote_options)
+{
+	start();
+
+	connection_->listen();
+
+	SSH::ChannelCallback *acb = callback(this, &SSHMux::accept_complete);
+	accept_action_ = connection_->accept(acb);
+
+	splice_ = new Splice(log_, socket_, pipe_, socket_);
+	EventCallback *cb = callback(this, &SSHMux::splice_complete);
+	splice_action_ = splice_->start(cb);
+}
+
+SSHMux::~SSHMux()
+{
+	ASSERT(log_, socket_ == NULL);
+	ASSERT(log_, pipe_ == NULL);
+	ASSERT(log_, connection_ == NULL);
+	ASSERT(log_, splice_ == NULL);
+	ASSERT(log_, splice_action_ == NULL);
+	ASSERT(log_, connect_action_ == NULL);
+	ASSERT(log_, accept_action_ == NULL);
+	ASSERT(log_, close_action_ == NULL);
+	ASSERT(log_, stop_action_ == NULL);
+}
+
+/*
+ * Open a channel to the peer at the given address, connecting to it if we
+ * are not already.
+ */
+SSH::Channel *
+SSHMux::open(const std::string& name, SocketAddressFamily family, const std::string& remote_name, const SocketOptions& options)
+{
+	std::map<Key, SSHMux *>::const_iterator it;
+	SSHMux *mux;
+
+	it = clients_.find(Key(name, family, remote_name));
+	if (it == clients_.end())
+		mux = new SSHMux(name, family, remote_name, options);
+	else
+		mux = it->second;
+
+	return (mux->connection_->open());
+}
+
+void
+SSHMux::start(void)
+{
+	session_.algorithm_negotiation_ = new SSH::AlgorithmNegotiation(&session_);
+	if (session_.role_ == SSH::ServerRole) {
+		SSH::ServerHostKey *server_host_key = SSH::ServerHostKey::server(&session_, "ssh-server1.pem");
+		session_.algorithm_negotiation_->add_algorithm(server_host_key);
+	}
+	session_.algorithm_negotiation_->add_algorithms();
+
+	pipe_ = new SSH::TransportPipe(&session_);
+	/*
+	 * Both ends are an SSH::Connection, which offers every channel the
+	 * same maximum packet size, so merge data into packets that large.
+	 */
+	pipe_->set_coalescing(SSH_CONNECTION_PACKET_SIZE, SSH_MUX_COALESCE_DELAY);
+	connection_ = new SSH::Connection(log_, pipe_, SSH_MUX_CHANNEL_TYPE);
+
+	SimpleCallback *scb = callback(this, &SSHMux::stop);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+}
+
+void
+SSHMux::connect_complete(Event e, Socket *socket)
+{
+	connect_action_->cancel();
+	connect_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		INFO(log_) << "Connect failed: " << e;
+		schedule_close();
+		return;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		schedule_close();
+		return;
+	}
+
+	socket_ = socket;
+	ASSERT(log_, socket_ != NULL);
+
+	splice_ = new Splice(log_, socket_, pipe_, socket_);
+	EventCallback *cb = callback(this, &SSHMux::splice_complete);
+	splice_action_ = splice_->start(cb);
+}
+
+void
+SSHMux::accept_complete(SSH::Channel *channel)
+{
+	accept_action_->cancel();
+	accept_action_ = NULL;
+
+	PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
+	new SSHProxyConnector(name_, pipe_pair, channel, peer_name_, remote_family_, remote_name_, remote_options_);
+
+	SSH::ChannelCallback *acb = callback(this, &SSHMux::accept_complete);
+	accept_action_ = connection_->accept(acb);
+}
+
+void
+SSHMux::splice_complete(Event e)
+{
+	splice_action_->cancel();
+	splice_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		DEBUG(log_) << "Peer exiting normally.";
+		break;
+	case Event::Error:
+		ERROR(log_) << "Peer exiting with error: " << e;
+		break;
+	default:
+		ERROR(log_) << "Peer exiting with unknown event: " << e;
+		break;
+	}
+
+	schedule_close();
+}
+
+void
+SSHMux::stop(void)
+{
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	schedule_close();
+}
+
+/*
+ * Fail every channel still open; their owners will close them.  Streams
+ * started after this get a connection of their own.
+ */
+void
+SSHMux::schedule_close(void)
+{
+	std::map<Key, SSHMux *>::iterator it;
+
+	it = clients_.find(key_);
+	if (it != clients_.end() && it->second == this)
+		clients_.erase(it);
+
+	if (stop_action_ != NULL) {
+		stop_action_->cancel();
+		stop_action_ = NULL;
+	}
+
+	if (connect_action_ != NULL) {
+		connect_action_->cancel();
+		connect_action_ = NULL;
+	}
+
+	if (accept_action_ != NULL) {
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+
+	if (splice_ != NULL) {
+		if (splice_action_ != NULL) {
+			splice_action_->cancel();
+			splice_action_ = NULL;
+		}
+
+		delete splice_;
+		splice_ = NULL;
+	}
+
+	delete connection_;
+	connection_ = NULL;
+
+	delete pipe_;
+	pipe_ = NULL;
+
+	if (socket_ == NULL) {
+		delete this;
+		return;
+	}
+
+	ASSERT(log_, close_action_ == NULL);
+	SimpleCallback *cb = callback(this, &SSHMux::close_complete);
+	close_action_ = socket_->close(cb);
+}
+
+void
+SSHMux::close_complete(void)
+{
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	delete this;
+}
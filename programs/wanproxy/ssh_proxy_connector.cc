@@ -23,39 +23,42 @@
  * SUCH DAMAGE.
  */
 
-#include <common/endian.h>
-
 #include <event/event_callback.h>
 #include <event/event_system.h>
 
 #include <io/pipe/pipe.h>
 #include <io/pipe/pipe_null.h>
 #include <io/pipe/pipe_pair.h>
-#include <io/socket/socket.h>
 #include <io/pipe/splice.h>
 #include <io/pipe/splice_pair.h>
 
-#include <io/net/tcp_client.h>
+#include <ssh/ssh_connection.h>
 
+#include "proxy_stats.h"
+#include "ssh_mux.h"
 #include "ssh_proxy_connector.h"
+#include "wanproxy_codec_pipe_pair.h"
+
+std::set<SSHProxyConnector *> SSHProxyConnector::connectors_;
 
 SSHProxyConnector::SSHProxyConnector(const std::string& name,
-				     PipePair *pipe_pair, Socket *local_socket,
+				     PipePair *pipe_pair,
+				     SSH::Channel *local_channel,
+				     const std::string& client_name,
 				     SocketAddressFamily family,
 				     const std::string& remote_name,
-				     WANProxyCodec *incoming_codec,
-				     WANProxyCodec *outgoing_codec)
+				     const SocketOptions& remote_options)
 : log_("/wanproxy/proxy/" + name + "/connector"),
+  name_(name),
+  client_name_(client_name),
   stop_action_(NULL),
   local_action_(NULL),
-  local_socket_(local_socket),
+  local_channel_(local_channel),
   remote_action_(NULL),
-  remote_socket_(NULL),
+  remote_channel_(NULL),
   pipe_pair_(pipe_pair),
-  incoming_stream_(log_, SSH::ServerRole, incoming_codec, outgoing_codec),
   incoming_pipe_(NULL),
   incoming_splice_(NULL),
-  outgoing_stream_(log_, SSH::ClientRole, outgoing_codec, incoming_codec),
   outgoing_pipe_(NULL),
   outgoing_splice_(NULL),
   splice_pair_(NULL),
@@ -66,20 +69,37 @@ SSHProxyConnector::SSHProxyConnector(const std::string& name,
 		outgoing_pipe_ = pipe_pair_->get_outgoing();
 	}
 
-	SocketEventCallback *cb = callback(this, &SSHProxyConnector::connect_complete);
-	remote_action_ = TCPClient::connect(family, remote_name, cb);
+	/*
+	 * The remote channel may be used at once, although it may be some
+	 * time before our peer confirms it.
+	 */
+	remote_channel_ = SSHMux::open(name_, family, remote_name, remote_options);
+
+	incoming_splice_ = new Splice(log_ + "/incoming", local_channel_, incoming_pipe_, remote_channel_);
+	outgoing_splice_ = new Splice(log_ + "/outgoing", remote_channel_, outgoing_pipe_, local_channel_);
+
+	splice_pair_ = new SplicePair(outgoing_splice_, incoming_splice_);
+
+	EventCallback *cb = callback(this, &SSHProxyConnector::splice_complete);
+	splice_action_ = splice_pair_->start(cb);
 
 	SimpleCallback *scb = callback(this, &SSHProxyConnector::stop);
 	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+
+	connectors_.insert(this);
+
+	ProxyStats::totals(name_)->connections_++;
 }
 
 SSHProxyConnector::~SSHProxyConnector()
 {
+	connectors_.erase(this);
+
 	ASSERT(log_, stop_action_ == NULL);
 	ASSERT(log_, local_action_ == NULL);
-	ASSERT(log_, local_socket_ == NULL);
+	ASSERT(log_, local_channel_ == NULL);
 	ASSERT(log_, remote_action_ == NULL);
-	ASSERT(log_, remote_socket_ == NULL);
+	ASSERT(log_, remote_channel_ == NULL);
 	ASSERT(log_, incoming_splice_ == NULL);
 	ASSERT(log_, outgoing_splice_ == NULL);
 	ASSERT(log_, splice_pair_ == NULL);
@@ -104,71 +124,77 @@ SSHProxyConnector::~SSHProxyConnector()
 	}
 }
 
-void
-SSHProxyConnector::close_complete(Socket *socket)
+std::string
+SSHProxyConnector::client_name(void) const
 {
-	if (socket == local_socket_) {
-		local_action_->cancel();
-		local_action_ = NULL;
-	}
+	return (client_name_);
+}
 
-	if (socket == remote_socket_) {
-		remote_action_->cancel();
-		remote_action_ = NULL;
-	}
+size_t
+SSHProxyConnector::incoming_buffered(void) const
+{
+	if (incoming_splice_ == NULL)
+		return (0);
+	return (incoming_splice_->buffered());
+}
 
-	if (socket == local_socket_) {
-		ASSERT(log_, local_socket_ != NULL);
-		delete local_socket_;
-		local_socket_ = NULL;
-	}
+size_t
+SSHProxyConnector::outgoing_buffered(void) const
+{
+	if (outgoing_splice_ == NULL)
+		return (0);
+	return (outgoing_splice_->buffered());
+}
 
-	if (socket == remote_socket_) {
-		ASSERT(log_, remote_socket_ != NULL);
-		delete remote_socket_;
-		remote_socket_ = NULL;
-	}
+intmax_t
+SSHProxyConnector::compressor_bypass_bytes(void) const
+{
+	const WANProxyCodecPipePair *pair = dynamic_cast<const WANProxyCodecPipePair *>(pipe_pair_);
+	if (pair == NULL)
+		return (0);
+	return (pair->compressor_bypass_bytes());
+}
 
-	if (local_socket_ == NULL && remote_socket_ == NULL) {
-		delete this;
-	}
+intmax_t
+SSHProxyConnector::compressor_bypass_count(void) const
+{
+	const WANProxyCodecPipePair *pair = dynamic_cast<const WANProxyCodecPipePair *>(pipe_pair_);
+	if (pair == NULL)
+		return (0);
+	return (pair->compressor_bypass_count());
 }
 
+/*
+ * Add in what this connection has moved so far.
+ */
 void
-SSHProxyConnector::connect_complete(Event e, Socket *socket)
+SSHProxyConnector::stats(ProxyStats *stats) const
 {
-	remote_action_->cancel();
-	remote_action_ = NULL;
-
-	switch (e.type_) {
-	case Event::Done:
-		break;
-	case Event::Error:
-		INFO(log_) << "Connect failed: " << e;
-		schedule_close();
-		return;
-	default:
-		ERROR(log_) << "Unexpected event: " << e;
-		schedule_close();
-		return;
-	}
-
-	remote_socket_ = socket;
-	ASSERT(log_, remote_socket_ != NULL);
+	stats->add(incoming_splice_, outgoing_splice_);
+}
 
-	SimpleCallback *iscb = callback(this, &SSHProxyConnector::ssh_stream_complete, &incoming_stream_);
-	incoming_stream_action_ = incoming_stream_.start(local_socket_, iscb);
+void
+SSHProxyConnector::close_complete(SSH::Channel *channel)
+{
+	if (channel == local_channel_) {
+		local_action_->cancel();
+		local_action_ = NULL;
 
-	SimpleCallback *oscb = callback(this, &SSHProxyConnector::ssh_stream_complete, &outgoing_stream_);
-	outgoing_stream_action_ = outgoing_stream_.start(remote_socket_, oscb);
+		delete local_channel_;
+		local_channel_ = NULL;
+	}
 
-	incoming_splice_ = new Splice(log_ + "/incoming", &incoming_stream_, incoming_pipe_, &outgoing_stream_);
-	outgoing_splice_ = new Splice(log_ + "/outgoing", &outgoing_stream_, outgoing_pipe_, &incoming_stream_);
+	if (channel == remote_channel_) {
+		remote_action_->cancel();
+		remote_action_ = NULL;
 
-	splice_pair_ = new SplicePair(outgoing_splice_, incoming_splice_);
+		delete remote_channel_;
+		remote_channel_ = NULL;
+	}
 
-	EventCallback *cb = callback(this, &SSHProxyConnector::splice_complete);
-	splice_action_ = splice_pair_->start(cb);
+	if (local_channel_ == NULL && remote_channel_ == NULL) {
+		delete this;
+	}
 }
 
 void
@@ -177,6 +203,8 @@ SSHProxyConnector::splice_complete(Event e)
 	splice_action_->cancel();
 	splice_action_ = NULL;
 
+	ProxyStats::totals(name_)->add(incoming_splice_, outgoing_splice_);
+
 	delete splice_pair_;
 	splice_pair_ = NULL;
 
@@ -203,18 +231,6 @@ SSHProxyConnector::stop(void)
 	stop_action_->cancel();
 	stop_action_ = NULL;
 
-	/*
-	 * Connecting.
-	 */
-	if (local_action_ == NULL && remote_action_ != NULL &&
-	    splice_action_ == NULL) {
-		remote_action_->cancel();
-		remote_action_ = NULL;
-
-		schedule_close();
-		return;
-	}
-
 	/*
 	 * Already closing.  Should not happen.
 	 */
@@ -243,6 +259,8 @@ SSHProxyConnector::schedule_close(void)
 		ASSERT(log_, outgoing_splice_ != NULL);
 		ASSERT(log_, incoming_splice_ != NULL);
 
+		ProxyStats::totals(name_)->add(incoming_splice_, outgoing_splice_);
+
 		delete splice_pair_;
 		splice_pair_ = NULL;
 
@@ -254,28 +272,14 @@ SSHProxyConnector::schedule_close(void)
 	}
 
 	ASSERT(log_, local_action_ == NULL);
-	ASSERT(log_, local_socket_ != NULL);
+	ASSERT(log_, local_channel_ != NULL);
 	SimpleCallback *lcb = callback(this, &SSHProxyConnector::close_complete,
-				       local_socket_);
-	local_action_ = local_socket_->close(lcb);
+				       local_channel_);
+	local_action_ = local_channel_->close(lcb);
 
 	ASSERT(log_, remote_action_ == NULL);
-	if (remote_socket_ != NULL) {
-		SimpleCallback *rcb = callback(this, &SSHProxyConnector::close_complete,
-					       remote_socket_);
-		remote_action_ = remote_socket_->close(rcb);
-	}
-}
-
-void
-SSHProxyConnector::ssh_stream_complete(SSHStream *stream)
-{
-	if (stream == &incoming_stream_) {
-		incoming_stream_action_->cancel();
-		incoming_stream_action_ = NULL;
-	} else {
-		ASSERT(log_, stream == &outgoing_stream_);
-		outgoing_stream_action_->cancel();
-		outgoing_stream_action_ = NULL;
-	}
+	ASSERT(log_, remote_channel_ != NULL);
+	SimpleCallback *rcb = callback(this, &SSHProxyConnector::close_complete,
+				       remote_channel_);
+	remote_action_ = remote_channel_->close(rcb);
 }
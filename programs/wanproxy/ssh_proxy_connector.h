@@ -28,55 +28,72 @@
 
 #include <set>
 
-#include <io/channel.h>
-
-#include "ssh_stream.h"
+#include <io/socket/socket_types.h>
 
 class Pipe;
 class PipePair;
-class Socket;
+struct ProxyStats;
 class Splice;
 class SplicePair;
-struct WANProxyCodec;
+namespace SSH { class Channel; }
+struct SocketOptions;
 
+/*
+ * Proxies a stream from a channel on a connection from one peer to a channel
+ * on the connection to another.
+ */
 class SSHProxyConnector {
+	static std::set<SSHProxyConnector *> connectors_;
+
 	LogHandle log_;
+	std::string name_;
+	std::string client_name_;
 
 	Action *stop_action_;
 
 	Action *local_action_;
-	Socket *local_socket_;
+	SSH::Channel *local_channel_;
 
 	Action *remote_action_;
-	Socket *remote_socket_;
+	SSH::Channel *remote_channel_;
 
 	PipePair *pipe_pair_;
 
-	SSHStream incoming_stream_;
-	Action *incoming_stream_action_;
 	Pipe *incoming_pipe_;
 	Splice *incoming_splice_;
 
-	SSHStream outgoing_stream_;
-	Action *outgoing_stream_action_;
 	Pipe *outgoing_pipe_;
 	Splice *outgoing_splice_;
 
 	SplicePair *splice_pair_;
 	Action *splice_action_;
 public:
-	SSHProxyConnector(const std::string&, PipePair *, Socket *, SocketAddressFamily, const std::string&, WANProxyCodec *, WANProxyCodec *);
+	SSHProxyConnector(const std::string&, PipePair *, SSH::Channel *, const std::string&, SocketAddressFamily, const std::string&, const SocketOptions&);
+
+	const std::string& name(void) const
+	{
+		return (name_);
+	}
+
+	std::string client_name(void) const;
+	size_t incoming_buffered(void) const;
+	size_t outgoing_buffered(void) const;
+	intmax_t compressor_bypass_bytes(void) const;
+	intmax_t compressor_bypass_count(void) const;
+	void stats(ProxyStats *) const;
+
+	static const std::set<SSHProxyConnector *>& connectors(void)
+	{
+		return (connectors_);
+	}
 private:
 	~SSHProxyConnector();
 
-	void close_complete(Socket *);
-	void connect_complete(Event, Socket *);
+	void close_complete(SSH::Channel *);
 	void splice_complete(Event);
 	void stop(void);
 
 	void schedule_close(void);
-
-	void ssh_stream_complete(SSHStream *);
 };
 
 #endif /* !PROGRAMS_WANPROXY_SSH_PROXY_CONNECTOR_H */
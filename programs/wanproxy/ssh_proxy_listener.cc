@@ -32,24 +32,25 @@
 
 #include <io/net/tcp_server.h>
 
-#include "ssh_proxy_connector.h"
+#include "ssh_mux.h"
 #include "ssh_proxy_listener.h"
 
-#include "wanproxy_codec_pipe_pair.h"
-
 SSHProxyListener::SSHProxyListener(const std::string& name,
 				   WANProxyCodec *interface_codec,
 				   WANProxyCodec *remote_codec,
 				   SocketAddressFamily interface_family,
 				   const std::string& interface,
+				   const SocketOptions& interface_options,
 				   SocketAddressFamily remote_family,
-				   const std::string& remote_name)
-: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_family, interface),
+				   const std::string& remote_name,
+				   const SocketOptions& remote_options)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_family, interface, interface_options),
   name_(name),
   interface_codec_(interface_codec),
   remote_codec_(remote_codec),
   remote_family_(remote_family),
-  remote_name_(remote_name)
+  remote_name_(remote_name),
+  remote_options_(remote_options)
 { }
 
 SSHProxyListener::~SSHProxyListener()
@@ -58,6 +59,5 @@ SSHProxyListener::~SSHProxyListener()
 void
 SSHProxyListener::client_connected(Socket *socket)
 {
-	PipePair *pipe_pair = new WANProxyCodecPipePair(interface_codec_, remote_codec_);
-	new SSHProxyConnector(name_, pipe_pair, socket, remote_family_, remote_name_, interface_codec_, remote_codec_);
+	new SSHMux(name_, socket, interface_codec_, remote_codec_, remote_family_, remote_name_, remote_options_);
 }
@@ -38,10 +38,11 @@ class SSHProxyListener : public SimpleServer<TCPServer> {
 	WANProxyCodec *remote_codec_;
 	SocketAddressFamily remote_family_;
 	std::string remote_name_;
+	SocketOptions remote_options_;
 public:
 	SSHProxyListener(const std::string&, WANProxyCodec *, WANProxyCodec *, SocketAddressFamily,
-			 const std::string&, SocketAddressFamily,
-			 const std::string&);
+			 const std::string&, const SocketOptions&, SocketAddressFamily,
+			 const std::string&, const SocketOptions&);
 	~SSHProxyListener();
 
 private:
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <deque>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_chain.h>
+#include <io/pipe/pipe_pair.h>
+#include <io/pipe/splice.h>
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_client.h>
+
+#include <ssh/ssh_connection.h>
+
+#include "proxy_connector.h"
+#include "tunnel_mux.h"
+#include "tunnel_pipe.h"
+
+#include "wanproxy_codec_pipe_pair.h"
+
+/*
+ * The type of the channels that carry proxied streams.
+ */
+#define	TUNNEL_MUX_CHANNEL_TYPE	"tunnel@wanproxy.org"
+
+std::map<TunnelMux::Key, TunnelMux *> TunnelMux::clients_;
+
+/*
+ * Connect to a peer to open channels to.
+ */
+TunnelMux::TunnelMux(const std::string& name, WANProxyCodec *codec, SocketAddressFamily family, const std::string& remote_name, const SocketOptions& options)
+: log_("/wanproxy/proxy/" + name + "/tunnel/client"),
+  name_(name),
+  key_(name, codec, family, remote_name),
+  socket_(NULL),
+  peer_name_(remote_name),
+  codec_(codec),
+  codec_pipe_pair_(NULL),
+  tunnel_pipe_(NULL),
+  pipe_(NULL),
+  connection_(NULL),
+  splice_(NULL),
+  splice_action_(NULL),
+  connect_action_(NULL),
+  accept_action_(NULL),
+  close_action_(NULL),
+  stop_action_(NULL),
+  remote_family_(family),
+  remote_name_(remote_name),
+  remote_options_(options)
+{
+	start(false);
+
+	SocketEventCallback *cb = callback(this, &TunnelMux::connect_complete);
+	connect_action_ = TCPClient::connect(family, remote_name, options, cb);
+
+	clients_[key_] = this;
+}
+
+/*
+ * Take a connection from a peer, and proxy each channel it opens to the
+ * remote address given.
+ */
+TunnelMux::TunnelMux(const std::string& name, Socket *socket, WANProxyCodec *codec,
+		     SocketAddressFamily remote_family, const std::string& remote_name,
+		     const SocketOptions& remote_options)
+: log_("/wanproxy/proxy/" + name + "/tunnel/server"),
+  name_(name),
+  key_(),
+  socket_(socket),
+  peer_name_(socket->getpeername()),
+  codec_(codec),
+  codec_pipe_pair_(NULL),
+  tunnel_pipe_(NULL),
+  pipe_(NULL),
+  connection_(NULL),
+  splice_(NULL),
+  splice_action_(NULL),
+  connect_action_(NULL),
+  accept_action_(NULL),
+  close_action_(NULL),
+  stop_action_(NULL),
+  remote_family_(remote_family),
+  remote_name_(remote_name),
+  remote_options_(remote_options)
+{
+	start(true);
+
+	connection_->listen();
+
+	SSH::ChannelCallback *acb = callback(this, &TunnelMux::accept_complete);
+	accept_action_ = connection_->accept(acb);
+
+	splice_ = new Splice(log_, socket_, pipe_, socket_);
+	EventCallback *cb = callback(this, &TunnelMux::splice_complete);
+	splice_action_ = splice_->start(cb);
+}
+
+TunnelMux::~TunnelMux()
+{
+	ASSERT(log_, socket_ == NULL);
+	ASSERT(log_, codec_pipe_pair_ == NULL);
+	ASSERT(log_, tunnel_pipe_ == NULL);
+	ASSERT(log_, pipe_ == NULL);
+	ASSERT(log_, connection_ == NULL);
+	ASSERT(log_, splice_ == NULL);
+	ASSERT(log_, splice_action_ == NULL);
+	ASSERT(log_, connect_action_ == NULL);
+	ASSERT(log_, accept_action_ == NULL);
+	ASSERT(log_, close_action_ == NULL);
+	ASSERT(log_, stop_action_ == NULL);
+}
+
+/*
+ * Open a channel to the peer at the given address, connecting to it if we
+ * are not already.
+ */
+SSH::Channel *
+TunnelMux::open(const std::string& name, WANProxyCodec *codec, SocketAddressFamily family, const std::string& remote_name, const SocketOptions& options)
+{
+	std::map<Key, TunnelMux *>::const_iterator it;
+	TunnelMux *mux;
+
+	it = clients_.find(Key(name, codec, family, remote_name));
+	if (it == clients_.end())
+		mux = new TunnelMux(name, codec, family, remote_name, options);
+	else
+		mux = it->second;
+
+	return (mux->connection_->open());
+}
+
+/*
+ * Data from our peer is decoded before it is split into channels, and the
+ * channels are merged before being encoded for our peer.
+ */
+void
+TunnelMux::start(bool server)
+{
+	tunnel_pipe_ = new TunnelPipe();
+
+	if (server)
+		codec_pipe_pair_ = new WANProxyCodecPipePair(codec_, NULL);
+	else
+		codec_pipe_pair_ = new WANProxyCodecPipePair(NULL, codec_);
+
+	Pipe *decode_pipe, *encode_pipe;
+	if (server) {
+		decode_pipe = codec_pipe_pair_->get_incoming();
+		encode_pipe = codec_pipe_pair_->get_outgoing();
+	} else {
+		decode_pipe = codec_pipe_pair_->get_outgoing();
+		encode_pipe = codec_pipe_pair_->get_incoming();
+	}
+
+	if (decode_pipe == NULL) {
+		ASSERT(log_, encode_pipe == NULL);
+		pipe_ = tunnel_pipe_;
+	} else {
+		std::deque<Pipe *> pipe_list;
+		pipe_list.push_back(decode_pipe);
+		pipe_list.push_back(tunnel_pipe_);
+		pipe_list.push_back(encode_pipe);
+		pipe_ = new PipeChain(pipe_list);
+	}
+
+	connection_ = new SSH::Connection(log_, tunnel_pipe_, TUNNEL_MUX_CHANNEL_TYPE);
+
+	SimpleCallback *scb = callback(this, &TunnelMux::stop);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+}
+
+void
+TunnelMux::connect_complete(Event e, Socket *socket)
+{
+	connect_action_->cancel();
+	connect_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	case Event::Error:
+		INFO(log_) << "Connect failed: " << e;
+		schedule_close();
+		return;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		schedule_close();
+		return;
+	}
+
+	socket_ = socket;
+	ASSERT(log_, socket_ != NULL);
+
+	splice_ = new Splice(log_, socket_, pipe_, socket_);
+	EventCallback *cb = callback(this, &TunnelMux::splice_complete);
+	splice_action_ = splice_->start(cb);
+}
+
+/*
+ * The codec has already been run, so each stream is proxied as it is.
+ */
+void
+TunnelMux::accept_complete(SSH::Channel *channel)
+{
+	accept_action_->cancel();
+	accept_action_ = NULL;
+
+	new ProxyConnector(name_, NULL, channel, peer_name_, remote_family_, remote_name_, remote_options_, NULL);
+
+	SSH::ChannelCallback *acb = callback(this, &TunnelMux::accept_complete);
+	accept_action_ = connection_->accept(acb);
+}
+
+void
+TunnelMux::splice_complete(Event e)
+{
+	splice_action_->cancel();
+	splice_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::EOS:
+		DEBUG(log_) << "Peer exiting normally.";
+		break;
+	case Event::Error:
+		ERROR(log_) << "Peer exiting with error: " << e;
+		break;
+	default:
+		ERROR(log_) << "Peer exiting with unknown event: " << e;
+		break;
+	}
+
+	schedule_close();
+}
+
+void
+TunnelMux::stop(void)
+{
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	schedule_close();
+}
+
+/*
+ * Fail every channel still open; their owners will close them.  Streams
+ * started after this get a connection of their own.
+ */
+void
+TunnelMux::schedule_close(void)
+{
+	std::map<Key, TunnelMux *>::iterator it;
+
+	it = clients_.find(key_);
+	if (it != clients_.end() && it->second == this)
+		clients_.erase(it);
+
+	if (stop_action_ != NULL) {
+		stop_action_->cancel();
+		stop_action_ = NULL;
+	}
+
+	if (connect_action_ != NULL) {
+		connect_action_->cancel();
+		connect_action_ = NULL;
+	}
+
+	if (accept_action_ != NULL) {
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+
+	if (splice_ != NULL) {
+		if (splice_action_ != NULL) {
+			splice_action_->cancel();
+			splice_action_ = NULL;
+		}
+
+		delete splice_;
+		splice_ = NULL;
+	}
+
+	delete connection_;
+	connection_ = NULL;
+
+	/*
+	 * The chain goes first, since it may have actions running on the
+	 * pipes within it.
+	 */
+	if (pipe_ != tunnel_pipe_)
+		delete pipe_;
+	pipe_ = NULL;
+
+	delete tunnel_pipe_;
+	tunnel_pipe_ = NULL;
+
+	delete codec_pipe_pair_;
+	codec_pipe_pair_ = NULL;
+
+	if (socket_ == NULL) {
+		delete this;
+		return;
+	}
+
+	ASSERT(log_, close_action_ == NULL);
+	SimpleCallback *cb = callback(this, &TunnelMux::close_complete);
+	close_action_ = socket_->close(cb);
+}
+
+void
+TunnelMux::close_complete(void)
+{
+	close_action_->cancel();
+	close_action_ = NULL;
+
+	ASSERT(log_, socket_ != NULL);
+	delete socket_;
+	socket_ = NULL;
+
+	delete this;
+}
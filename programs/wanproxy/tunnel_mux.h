@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_TUNNEL_MUX_H
+#define	PROGRAMS_WANPROXY_TUNNEL_MUX_H
+
+#include <map>
+
+#include <io/socket/socket_options.h>
+#include <io/socket/socket_types.h>
+
+class Pipe;
+class PipePair;
+class Socket;
+class Splice;
+namespace SSH {
+	class Channel;
+	class Connection;
+}
+class TunnelPipe;
+struct WANProxyCodec;
+
+/*
+ * One long-lived connection to another WANProxy, carrying any number of
+ * proxied streams, each in a channel of its own with its own flow control.
+ *
+ * The codec is run over the connection as a whole rather than over each
+ * stream, so every stream shares one encoder and its window, and one
+ * exchange of HELLO, ASK and LEARN; a short stream benefits at once from
+ * everything sent before it.
+ */
+class TunnelMux {
+	/*
+	 * Connections are shared only by streams from the same proxy, whose
+	 * socket options they were made with, to the same address, and with
+	 * the same codec.
+	 */
+	struct Key {
+		std::string name_;
+		WANProxyCodec *codec_;
+		SocketAddressFamily family_;
+		std::string remote_name_;
+
+		Key(void)
+		: name_(),
+		  codec_(NULL),
+		  family_(SocketAddressFamilyUnspecified),
+		  remote_name_()
+		{ }
+
+		Key(const std::string& name, WANProxyCodec *codec, SocketAddressFamily family, const std::string& remote_name)
+		: name_(name),
+		  codec_(codec),
+		  family_(family),
+		  remote_name_(remote_name)
+		{ }
+
+		bool operator< (const Key& b) const
+		{
+			if (name_ != b.name_)
+				return (name_ < b.name_);
+			if (codec_ != b.codec_)
+				return (codec_ < b.codec_);
+			if (family_ != b.family_)
+				return (family_ < b.family_);
+			return (remote_name_ < b.remote_name_);
+		}
+	};
+
+	static std::map<Key, TunnelMux *> clients_;
+
+	LogHandle log_;
+	std::string name_;
+	Key key_;
+	Socket *socket_;
+	std::string peer_name_;
+	WANProxyCodec *codec_;
+	PipePair *codec_pipe_pair_;
+	TunnelPipe *tunnel_pipe_;
+	Pipe *pipe_;
+	SSH::Connection *connection_;
+	Splice *splice_;
+	Action *splice_action_;
+	Action *connect_action_;
+	Action *accept_action_;
+	Action *close_action_;
+	Action *stop_action_;
+
+	SocketAddressFamily remote_family_;
+	std::string remote_name_;
+	SocketOptions remote_options_;
+
+	TunnelMux(const std::string&, WANProxyCodec *, SocketAddressFamily, const std::string&, const SocketOptions&);
+public:
+	TunnelMux(const std::string&, Socket *, WANProxyCodec *,
+		  SocketAddressFamily, const std::string&, const SocketOptions&);
+private:
+	~TunnelMux();
+
+public:
+	static SSH::Channel *open(const std::string&, WANProxyCodec *, SocketAddressFamily, const std::string&, const SocketOptions&);
+
+private:
+	void start(bool);
+
+	void connect_complete(Event, Socket *);
+	void accept_complete(SSH::Channel *);
+	void splice_complete(Event);
+	void stop(void);
+
+	void schedule_close(void);
+	void close_complete(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_TUNNEL_MUX_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/endian.h>
+
+#include <event/event_callback.h>
+
+#include "tunnel_pipe.h"
+
+TunnelPipe::TunnelPipe(void)
+: PipeProducer("/wanproxy/tunnel/pipe"),
+  input_buffer_(),
+  closed_(false),
+  receive_callback_(NULL),
+  receive_action_(NULL)
+{ }
+
+TunnelPipe::~TunnelPipe()
+{
+	ASSERT(log_, receive_callback_ == NULL);
+	ASSERT(log_, receive_action_ == NULL);
+}
+
+Action *
+TunnelPipe::receive(EventCallback *cb)
+{
+	ASSERT(log_, receive_callback_ == NULL);
+	ASSERT(log_, receive_action_ == NULL);
+
+	receive_callback_ = cb;
+	receive_do();
+
+	if (receive_callback_ != NULL)
+		return (cancellation(this, &TunnelPipe::receive_cancel));
+
+	ASSERT(log_, receive_action_ != NULL);
+	Action *a = receive_action_;
+	receive_action_ = NULL;
+	return (a);
+}
+
+void
+TunnelPipe::send(Buffer *payload)
+{
+	if (closed_) {
+		DEBUG(log_) << "Dropping packet sent after close.";
+		payload->clear();
+		return;
+	}
+
+	ASSERT(log_, !payload->empty());
+
+	Buffer frame;
+	BigEndian::append(&frame, (uint32_t)payload->length());
+	payload->moveout(&frame);
+	produce(&frame);
+}
+
+/*
+ * There is nothing to set up, so packets may be sent at once.
+ */
+Action *
+TunnelPipe::ready(SimpleCallback *cb)
+{
+	return (cb->schedule());
+}
+
+void
+TunnelPipe::consume(Buffer *in)
+{
+	if (in->empty()) {
+		if (!input_buffer_.empty())
+			DEBUG(log_) << "Received EOS with data outstanding.";
+		if (!closed_) {
+			closed_ = true;
+			produce_eos();
+		}
+		return;
+	}
+
+	if (closed_) {
+		in->clear();
+		return;
+	}
+
+	in->moveout(&input_buffer_);
+	receive_do();
+}
+
+void
+TunnelPipe::fail(void)
+{
+	if (closed_)
+		return;
+	closed_ = true;
+
+	input_buffer_.clear();
+
+	produce_error();
+}
+
+void
+TunnelPipe::receive_cancel(void)
+{
+	if (receive_action_ != NULL) {
+		receive_action_->cancel();
+		receive_action_ = NULL;
+	}
+
+	if (receive_callback_ != NULL) {
+		delete receive_callback_;
+		receive_callback_ = NULL;
+	}
+}
+
+/*
+ * Hand the next frame to whoever is waiting for it, if it has all arrived.
+ */
+void
+TunnelPipe::receive_do(void)
+{
+	uint32_t frame_len;
+
+	if (closed_ || receive_callback_ == NULL)
+		return;
+
+	if (input_buffer_.length() < sizeof frame_len)
+		return;
+	BigEndian::extract(&frame_len, &input_buffer_);
+	if (frame_len == 0 || frame_len > TUNNEL_PIPE_MAXIMUM_FRAME_SIZE) {
+		ERROR(log_) << "Frame length " << frame_len << " out of range.";
+		fail();
+		return;
+	}
+	if (input_buffer_.length() < sizeof frame_len + frame_len)
+		return;
+
+	Buffer frame;
+	input_buffer_.skip(sizeof frame_len);
+	input_buffer_.moveout(&frame, frame_len);
+
+	receive_callback_->param(Event(Event::Done, frame));
+	receive_action_ = receive_callback_->schedule();
+	receive_callback_ = NULL;
+}
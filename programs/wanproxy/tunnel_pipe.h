@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_TUNNEL_PIPE_H
+#define	PROGRAMS_WANPROXY_TUNNEL_PIPE_H
+
+#include <io/pipe/pipe.h>
+#include <io/pipe/pipe_producer.h>
+
+#include <ssh/ssh_transport.h>
+
+/*
+ * The largest frame we will accept from our peer, not counting its length.
+ * This must hold a full channel data packet.
+ */
+#define	TUNNEL_PIPE_MAXIMUM_FRAME_SIZE	(64 * 1024)
+
+/*
+ * Frames packets of the SSH connection protocol, each preceded by its length
+ * as a 32-bit big-endian integer, with no encryption or authentication.  It
+ * is meant to be run between two WANProxies inside their codecs, which then
+ * see every stream carried over it as one.
+ */
+class TunnelPipe : public PipeProducer, public SSH::Transport {
+	Buffer input_buffer_;
+	bool closed_;
+
+	EventCallback *receive_callback_;
+	Action *receive_action_;
+public:
+	TunnelPipe(void);
+	~TunnelPipe();
+
+	Action *receive(EventCallback *);
+	void send(Buffer *);
+	Action *ready(SimpleCallback *);
+
+private:
+	void consume(Buffer *);
+
+	void fail(void);
+
+	void receive_cancel(void);
+	void receive_do(void);
+};
+
+#endif /* !PROGRAMS_WANPROXY_TUNNEL_PIPE_H */
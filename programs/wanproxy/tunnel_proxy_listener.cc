@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/socket/socket.h>
+
+#include <io/net/tcp_server.h>
+
+#include <ssh/ssh_connection.h>
+
+#include "proxy_connector.h"
+#include "tunnel_mux.h"
+#include "tunnel_proxy_listener.h"
+
+TunnelProxyListener::TunnelProxyListener(const std::string& name,
+					 bool tunnel_in,
+					 WANProxyCodec *codec,
+					 SocketAddressFamily interface_family,
+					 const std::string& interface,
+					 const SocketOptions& interface_options,
+					 SocketAddressFamily remote_family,
+					 const std::string& remote_name,
+					 const SocketOptions& remote_options)
+: SimpleServer<TCPServer>("/wanproxy/proxy/" + name + "/listener", interface_family, interface, interface_options),
+  name_(name),
+  tunnel_in_(tunnel_in),
+  codec_(codec),
+  remote_family_(remote_family),
+  remote_name_(remote_name),
+  remote_options_(remote_options)
+{ }
+
+TunnelProxyListener::~TunnelProxyListener()
+{ }
+
+void
+TunnelProxyListener::client_connected(Socket *socket)
+{
+	if (tunnel_in_) {
+		new TunnelMux(name_, socket, codec_, remote_family_, remote_name_, remote_options_);
+		return;
+	}
+
+	/*
+	 * The channel may be used at once, although it may be some time
+	 * before our peer confirms it.
+	 */
+	SSH::Channel *channel = TunnelMux::open(name_, codec_, remote_family_, remote_name_, remote_options_);
+	new ProxyConnector(name_, NULL, socket, socket->getpeername(), channel);
+}
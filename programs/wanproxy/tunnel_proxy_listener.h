@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012 Juli Mallett. All rights reserved.
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions
@@ -23,59 +23,35 @@
  * SUCH DAMAGE.
  */
 
-#ifndef	PROGRAMS_WANPROXY_SSH_STREAM_H
-#define	PROGRAMS_WANPROXY_SSH_STREAM_H
+#ifndef	PROGRAMS_WANPROXY_TUNNEL_PROXY_LISTENER_H
+#define	PROGRAMS_WANPROXY_TUNNEL_PROXY_LISTENER_H
 
-#include <io/channel.h>
-
-#include <ssh/ssh_session.h>
+#include <io/socket/simple_server.h>
 
 class Socket;
-class Splice;
-namespace SSH { class TransportPipe; }
+class TCPServer;
 struct WANProxyCodec;
 
-class SSHStream : public StreamChannel {
-	LogHandle log_;
-	Socket *socket_;
-	SSH::Session session_;
-	WANProxyCodec *incoming_codec_;
-	WANProxyCodec *outgoing_codec_;
-	SSH::TransportPipe *pipe_;
-	Splice *splice_;
-	Action *splice_action_;
-	SimpleCallback *start_callback_;
-	Action *start_action_;
-	EventCallback *read_callback_;
-	Action *read_action_;
-	Buffer input_buffer_;
-	bool ready_;
-	Action *ready_action_;
-	EventCallback *write_callback_;
-	Action *write_action_;
+/*
+ * Either takes clients and sends each of their streams through a tunnel to
+ * our peer, or takes tunnels from our peers and proxies each of the streams
+ * in them on to the remote address.  The codec, if any, is on the tunnel.
+ */
+class TunnelProxyListener : public SimpleServer<TCPServer> {
+	std::string name_;
+	bool tunnel_in_;
+	WANProxyCodec *codec_;
+	SocketAddressFamily remote_family_;
+	std::string remote_name_;
+	SocketOptions remote_options_;
 public:
-	SSHStream(const LogHandle&, SSH::Role, WANProxyCodec *, WANProxyCodec *);
-	~SSHStream();
-
-	Action *start(Socket *socket, SimpleCallback *);
-
-	Action *close(SimpleCallback *);
-	Action *read(size_t, EventCallback *);
-	Action *write(Buffer *, EventCallback *);
-	Action *shutdown(bool, bool, EventCallback *);
+	TunnelProxyListener(const std::string&, bool, WANProxyCodec *, SocketAddressFamily,
+			    const std::string&, const SocketOptions&, SocketAddressFamily,
+			    const std::string&, const SocketOptions&);
+	~TunnelProxyListener();
 
 private:
-	void start_cancel(void);
-	void read_cancel(void);
-
-	void splice_complete(Event);
-
-	void ready_complete(void);
-
-	void receive_complete(Event);
-
-	void write_cancel(void);
-	void write_do(void);
+	void client_connected(Socket *);
 };
 
-#endif /* !PROGRAMS_WANPROXY_SSH_STREAM_H */
+#endif /* !PROGRAMS_WANPROXY_TUNNEL_PROXY_LISTENER_H */
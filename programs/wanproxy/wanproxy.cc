@@ -28,11 +28,18 @@
 #include <common/buffer.h>
 #include <common/endian.h>
 
+#include <common/thread/log_thread.h>
+
 #include <event/action.h>
 #include <event/callback.h>
+#include <event/event_callback.h>
 #include <event/event_main.h>
 
+#include <io/net/tcp_server.h>
+
 #include "wanproxy_config.h"
+#include "wanproxy_handoff.h"
+#include "wanproxy_reload.h"
 
 static void usage(void);
 
@@ -40,9 +47,12 @@ int
 main(int argc, char *argv[])
 {
 	std::string configfile("");
+	std::string handoffpath("");
+	unsigned deadline;
 	bool quiet, verbose;
 	int ch;
 
+	deadline = WANPROXY_DRAIN_DEADLINE;
 	quiet = false;
 	verbose = false;
 
@@ -50,11 +60,17 @@ main(int argc, char *argv[])
 	INFO("/wanproxy") << "Copyright (c) 2008-2013 WANProxy.org.";
 	INFO("/wanproxy") << "All rights reserved.";
 
-	while ((ch = getopt(argc, argv, "c:qv")) != -1) {
+	while ((ch = getopt(argc, argv, "c:d:qs:v")) != -1) {
 		switch (ch) {
 		case 'c':
 			configfile = optarg;
 			break;
+		case 'd':
+			deadline = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			handoffpath = optarg;
+			break;
 		case 'q':
 			quiet = true;
 			break;
@@ -80,18 +96,46 @@ main(int argc, char *argv[])
 		Log::mask(".?", Log::Info);
 	}
 
+	/*
+	 * Leave writing out log messages to a thread of its own, so that the
+	 * event and callback threads need not wait on it.
+	 */
+	LogThread log_thread;
+	log_thread.start();
+
+	/*
+	 * Take over from a WANProxy already running, if there is one, before
+	 * listening; if we fail to configure ourselves, it carries on.
+	 */
+	if (handoffpath != "" && !WANProxyHandoff::receive(handoffpath)) {
+		ERROR("/wanproxy") << "Could not take over from running WANProxy.";
+		log_thread.stop();
+		log_thread.join();
+		return (1);
+	}
+
 	WANProxyConfig config;
 	if (!config.configure(configfile)) {
 		ERROR("/wanproxy") << "Could not configure proxies.";
+		log_thread.stop();
+		log_thread.join();
 		return (1);
 	}
+	TCPServer::inherited_close();
+	WANProxyHandoff::confirm();
+
+	WANProxyReload reload(&config);
+	WANProxyHandoff handoff(&config, handoffpath, deadline);
 
 	event_main();
+
+	log_thread.stop();
+	log_thread.join();
 }
 
 static void
 usage(void)
 {
-	INFO("/wanproxy/usage") << "wanproxy [-q | -v] -c configfile";
+	INFO("/wanproxy/usage") << "wanproxy [-q | -v] [-s handoff-socket] [-d drain-seconds] -c configfile";
 	exit(1);
 }
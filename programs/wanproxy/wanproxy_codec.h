@@ -26,28 +26,48 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CODEC_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CODEC_H
 
+#include "wanproxy_config_type_compressor.h"
+
 class XCodec;
+class ZstdDictionary;
 
 struct WANProxyCodec {
 	std::string name_;
 	XCodec *codec_;
-	bool compressor_;
+	size_t codec_push_rate_;
+	WANProxyConfigCompressor compressor_;
 	unsigned compressor_level_;
+	unsigned compressor_flush_ms_;
+	size_t compressor_flush_bytes_;
+	unsigned compressor_window_log_;
+	const ZstdDictionary *compressor_dictionary_;
+	unsigned compressor_bypass_threshold_;
 
 	intmax_t *outgoing_to_codec_bytes_;
 	intmax_t *codec_to_outgoing_bytes_;
 	intmax_t *incoming_to_codec_bytes_;
 	intmax_t *codec_to_incoming_bytes_;
 
+	intmax_t *compressor_bypass_bytes_;
+	intmax_t *compressor_bypass_count_;
+
 	WANProxyCodec(void)
 	: name_(""),
 	  codec_(NULL),
-	  compressor_(false),
+	  codec_push_rate_(0),
+	  compressor_(WANProxyConfigCompressorNone),
 	  compressor_level_(0),
+	  compressor_flush_ms_(0),
+	  compressor_flush_bytes_(0),
+	  compressor_window_log_(0),
+	  compressor_dictionary_(NULL),
+	  compressor_bypass_threshold_(0),
 	  outgoing_to_codec_bytes_(NULL),
 	  codec_to_outgoing_bytes_(NULL),
 	  incoming_to_codec_bytes_(NULL),
-	  codec_to_incoming_bytes_(NULL)
+	  codec_to_incoming_bytes_(NULL),
+	  compressor_bypass_bytes_(NULL),
+	  compressor_bypass_count_(NULL)
 	{ }
 };
 
@@ -28,7 +28,7 @@
 #include <event/event_callback.h>
 
 #include <io/pipe/pipe.h>
-#include <io/pipe/pipe_link.h>
+#include <io/pipe/pipe_chain.h>
 #include <io/pipe/pipe_null.h>
 #include <io/pipe/pipe_pair.h>
 
@@ -37,9 +37,15 @@
 #include <xcodec/xcodec_encoder.h>
 #include <xcodec/xcodec_pipe_pair.h>
 
+#include <lz4/lz4_compress_pipe.h>
+#include <lz4/lz4_decompress_pipe.h>
+
 #include <zlib/deflate_pipe.h>
 #include <zlib/inflate_pipe.h>
 
+#include <zstd/zstd_compress_pipe.h>
+#include <zstd/zstd_decompress_pipe.h>
+
 #include "wanproxy_codec.h"
 #include "wanproxy_codec_pipe_pair.h"
 
@@ -67,6 +73,32 @@ namespace {
 			}
 		}
 	};
+
+	void
+	compressor_pipes(const WANProxyCodec *codec, Pipe **compress_pipep, Pipe **decompress_pipep)
+	{
+		switch (codec->compressor_) {
+		case WANProxyConfigCompressorZlib: {
+			DeflatePipe *deflate_pipe = new DeflatePipe(codec->compressor_level_, codec->compressor_flush_ms_, codec->compressor_flush_bytes_);
+			if (codec->compressor_bypass_threshold_ != 0)
+				deflate_pipe->set_bypass(codec->compressor_bypass_threshold_, codec->compressor_bypass_bytes_, codec->compressor_bypass_count_);
+
+			*compress_pipep = deflate_pipe;
+			*decompress_pipep = new InflatePipe();
+			break;
+		}
+		case WANProxyConfigCompressorZstd:
+			*compress_pipep = new ZstdCompressPipe(codec->compressor_level_, codec->compressor_window_log_, codec->compressor_dictionary_);
+			*decompress_pipep = new ZstdDecompressPipe(codec->compressor_window_log_, codec->compressor_dictionary_);
+			break;
+		case WANProxyConfigCompressorLZ4:
+			*compress_pipep = new LZ4CompressPipe(codec->compressor_level_);
+			*decompress_pipep = new LZ4DecompressPipe();
+			break;
+		default:
+			NOTREACHED("/wanproxy/codec/pipe/pair/config");
+		}
+	}
 };
 
 WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCodec *outgoing)
@@ -74,7 +106,8 @@ WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCo
   outgoing_pipe_(NULL),
   pipes_(),
   pipe_pairs_(),
-  pipe_links_()
+  pipe_chains_(),
+  deflate_pipes_()
 {
 	std::deque<Pipe *> incoming_pipe_list, outgoing_pipe_list;
 
@@ -90,19 +123,24 @@ WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCo
 			pipes_.insert(outgoing_pipe);
 		}
 
-		if (incoming->compressor_) {
-			Pipe *deflate_pipe = new DeflatePipe(incoming->compressor_level_);
-			Pipe *inflate_pipe = new InflatePipe();
+		if (incoming->compressor_ != WANProxyConfigCompressorNone) {
+			Pipe *compress_pipe, *decompress_pipe;
+
+			compressor_pipes(incoming, &compress_pipe, &decompress_pipe);
+
+			DeflatePipe *deflate_pipe = dynamic_cast<DeflatePipe *>(compress_pipe);
+			if (deflate_pipe != NULL)
+				deflate_pipes_.push_back(deflate_pipe);
 
-			incoming_pipe_list.push_back(inflate_pipe);
-			outgoing_pipe_list.push_front(deflate_pipe);
+			incoming_pipe_list.push_back(decompress_pipe);
+			outgoing_pipe_list.push_front(compress_pipe);
 
-			pipes_.insert(deflate_pipe);
-			pipes_.insert(inflate_pipe);
+			pipes_.insert(compress_pipe);
+			pipes_.insert(decompress_pipe);
 		}
 
 		if (incoming->codec_ != NULL) {
-			PipePair *pair = new XCodecPipePair("/wanproxy/codec/" + incoming->name_, incoming->codec_, XCodecPipePairTypeServer);
+			PipePair *pair = new XCodecPipePair("/wanproxy/codec/" + incoming->name_, incoming->codec_, XCodecPipePairTypeServer, incoming->codec_push_rate_);
 			pipe_pairs_.insert(pair);
 
 			incoming_pipe_list.push_back(pair->get_incoming());
@@ -134,22 +172,27 @@ WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCo
 		}
 
 		if (outgoing->codec_ != NULL) {
-			PipePair *pair = new XCodecPipePair("/wanproxy/codec/" + outgoing->name_, outgoing->codec_, XCodecPipePairTypeClient);
+			PipePair *pair = new XCodecPipePair("/wanproxy/codec/" + outgoing->name_, outgoing->codec_, XCodecPipePairTypeClient, outgoing->codec_push_rate_);
 			pipe_pairs_.insert(pair);
 
 			incoming_pipe_list.push_back(pair->get_incoming());
 			outgoing_pipe_list.push_front(pair->get_outgoing());
 		}
 
-		if (outgoing->compressor_) {
-			Pipe *deflate_pipe = new DeflatePipe(outgoing->compressor_level_);
-			Pipe *inflate_pipe = new InflatePipe();
+		if (outgoing->compressor_ != WANProxyConfigCompressorNone) {
+			Pipe *compress_pipe, *decompress_pipe;
 
-			incoming_pipe_list.push_back(deflate_pipe);
-			outgoing_pipe_list.push_front(inflate_pipe);
+			compressor_pipes(outgoing, &compress_pipe, &decompress_pipe);
 
-			pipes_.insert(deflate_pipe);
-			pipes_.insert(inflate_pipe);
+			DeflatePipe *deflate_pipe = dynamic_cast<DeflatePipe *>(compress_pipe);
+			if (deflate_pipe != NULL)
+				deflate_pipes_.push_back(deflate_pipe);
+
+			incoming_pipe_list.push_back(compress_pipe);
+			outgoing_pipe_list.push_front(decompress_pipe);
+
+			pipes_.insert(compress_pipe);
+			pipes_.insert(decompress_pipe);
 		}
 
 		if (true) {
@@ -172,37 +215,26 @@ WANProxyCodecPipePair::WANProxyCodecPipePair(WANProxyCodec *incoming, WANProxyCo
 
 	ASSERT("/wanproxy/codec/pipe/pair/config", incoming_pipe_list.size() == outgoing_pipe_list.size());
 
-	incoming_pipe_ = incoming_pipe_list.front();
-	incoming_pipe_list.pop_front();
-
-	outgoing_pipe_ = outgoing_pipe_list.front();
-	outgoing_pipe_list.pop_front();
-
-	while (!incoming_pipe_list.empty() && !outgoing_pipe_list.empty()) {
-		incoming_pipe_ = new PipeLink(incoming_pipe_, incoming_pipe_list.front());
-		outgoing_pipe_ = new PipeLink(outgoing_pipe_, outgoing_pipe_list.front());
+	incoming_pipe_ = new PipeChain(incoming_pipe_list);
+	outgoing_pipe_ = new PipeChain(outgoing_pipe_list);
 
-		pipe_links_.push_front(incoming_pipe_);
-		pipe_links_.push_front(outgoing_pipe_);
-
-		incoming_pipe_list.pop_front();
-		outgoing_pipe_list.pop_front();
-	}
-	ASSERT("/wanproxy/codec/pipe/pair/config", incoming_pipe_list.empty() && outgoing_pipe_list.empty());
+	pipe_chains_.push_back(incoming_pipe_);
+	pipe_chains_.push_back(outgoing_pipe_);
 }
 
 WANProxyCodecPipePair::~WANProxyCodecPipePair()
 {
+
 	/*
-	 * We need to delete the PipeLinks first, since they may have
+	 * We need to delete the PipeChains first, since they may have
 	 * actions running internally.
 	 */
-	std::list<Pipe *>::iterator plit;
-	while ((plit = pipe_links_.begin()) != pipe_links_.end()) {
-		Pipe *pipe_link = *plit;
-		pipe_links_.erase(plit);
+	std::list<Pipe *>::iterator pcit;
+	while ((pcit = pipe_chains_.begin()) != pipe_chains_.end()) {
+		Pipe *pipe_chain = *pcit;
+		pipe_chains_.erase(pcit);
 
-		delete pipe_link;
+		delete pipe_chain;
 	}
 
 	std::set<Pipe *>::iterator pit;
@@ -233,3 +265,39 @@ WANProxyCodecPipePair::get_outgoing(void)
 {
 	return (outgoing_pipe_);
 }
+
+/*
+ * Set the level of this flow's deflate pipes, overriding their codecs'.
+ */
+void
+WANProxyCodecPipePair::set_compressor_level(int level)
+{
+	std::list<DeflatePipe *>::const_iterator it;
+	for (it = deflate_pipes_.begin(); it != deflate_pipes_.end(); ++it)
+		(*it)->set_level(level);
+}
+
+/*
+ * What this flow's deflate pipes have sent without compression.
+ */
+intmax_t
+WANProxyCodecPipePair::compressor_bypass_bytes(void) const
+{
+	intmax_t bytes = 0;
+
+	std::list<DeflatePipe *>::const_iterator it;
+	for (it = deflate_pipes_.begin(); it != deflate_pipes_.end(); ++it)
+		bytes += (*it)->bypass_bytes();
+	return (bytes);
+}
+
+intmax_t
+WANProxyCodecPipePair::compressor_bypass_count(void) const
+{
+	intmax_t count = 0;
+
+	std::list<DeflatePipe *>::const_iterator it;
+	for (it = deflate_pipes_.begin(); it != deflate_pipes_.end(); ++it)
+		count += (*it)->bypass_count();
+	return (count);
+}
@@ -31,6 +31,7 @@
 
 #include <io/pipe/pipe_pair.h>
 
+class DeflatePipe;
 struct WANProxyCodec;
 class XCodec;
 
@@ -40,13 +41,20 @@ class WANProxyCodecPipePair : public PipePair {
 
 	std::set<Pipe *> pipes_;
 	std::set<PipePair *> pipe_pairs_;
-	std::list<Pipe *> pipe_links_;
+	std::list<Pipe *> pipe_chains_;
+
+	std::list<DeflatePipe *> deflate_pipes_;
 public:
 	WANProxyCodecPipePair(WANProxyCodec *, WANProxyCodec *);
 	~WANProxyCodecPipePair();
 
 	Pipe *get_incoming(void);
 	Pipe *get_outgoing(void);
+
+	void set_compressor_level(int);
+
+	intmax_t compressor_bypass_bytes(void) const;
+	intmax_t compressor_bypass_count(void) const;
 };
 
 #endif /* !PROGRAMS_WANPROXY_WANPROXY_CODEC_PIPE_PAIR_H */
@@ -43,7 +43,11 @@
 
 WANProxyConfig::WANProxyConfig(void)
 : log_("/wanproxy/config"),
-  config_(NULL)
+  name_(""),
+  config_(NULL),
+  next_(NULL),
+  activations_(),
+  draining_(false)
 { }
 
 WANProxyConfig::~WANProxyConfig()
@@ -83,6 +87,20 @@ WANProxyConfig::parse_activate(std::deque<std::string>& tokens)
 		return;
 	}
 
+	/*
+	 * While reloading, only note what is to be activated, and leave it
+	 * to the running configuration to activate what has changed.
+	 */
+	if (next_ != NULL) {
+		if (next_->lookup(tokens[0]) == NULL) {
+			ERROR(log_) << "Object (" << tokens[0] << ") can not be activated as it does not exist.";
+			return;
+		}
+		activations_.push_back(tokens[0]);
+		tokens.clear();
+		return;
+	}
+
 	if (!config_->activate(tokens[0])) {
 		ERROR(log_) << "Object (" << tokens[0] << ") activation failed.";
 		return;
@@ -98,7 +116,7 @@ WANProxyConfig::parse_create(std::deque<std::string>& tokens)
 		return;
 	}
 
-	if (!config_->create(tokens[0], tokens[1])) {
+	if (!parsing()->create(tokens[0], tokens[1])) {
 		ERROR(log_) << "Object (" << tokens[1] << ") could not be created.";
 		return;
 	}
@@ -126,7 +144,7 @@ WANProxyConfig::parse_set(std::deque<std::string>& tokens)
 		return;
 	}
 
-	if (!config_->set(object, member, tokens[1])) {
+	if (!parsing()->set(object, member, tokens[1])) {
 		ERROR(log_) << "Set of object member (" << tokens[0] << ") failed.";
 		return;
 	}
@@ -151,15 +169,89 @@ WANProxyConfig::configure(const std::string& name)
 		return (false);
 	}
 
-	config_ = new Config();
-	config_->import(&config_class_log_mask);
-	config_->import(&wanproxy_config_class_codec);
-	config_->import(&wanproxy_config_class_interface);
-	config_->import(&wanproxy_config_class_monitor);
-	config_->import(&wanproxy_config_class_peer);
-	config_->import(&wanproxy_config_class_proxy);
-	config_->import(&wanproxy_config_class_proxy_socks);
+	config_ = create();
+	if (!read(in)) {
+		delete config_;
+		config_ = NULL;
+
+		return (false);
+	}
+	name_ = name;
+
+	return (true);
+}
+
+/*
+ * Read the configuration file again, and apply only what has changed in it.
+ * Listeners which are removed or changed stop accepting, but connections
+ * they have already accepted carry on as they were.
+ */
+bool
+WANProxyConfig::reload(void)
+{
+	if (config_ == NULL) {
+		ERROR(log_) << "WANProxy not configured.";
+		return (false);
+	}
+
+	if (draining_) {
+		ERROR(log_) << "Not reloading while draining.";
+		return (false);
+	}
+
+	INFO(log_) << "Reloading WANProxy configuration.";
+
+	std::fstream in;
+	in.open(name_.c_str(), std::ios::in);
+
+	if (!in.good()) {
+		ERROR(log_) << "Could not open file: " << name_;
+		return (false);
+	}
+
+	next_ = create();
+	if (!read(in)) {
+		ERROR(log_) << "Keeping the running configuration.";
+
+		/* XXX Leaks the objects created before the error.  */
+		delete next_;
+		next_ = NULL;
+		activations_.clear();
 
+		return (false);
+	}
+
+	bool ok = config_->reload(next_, activations_);
+
+	delete next_;
+	next_ = NULL;
+	activations_.clear();
+
+	if (!ok) {
+		ERROR(log_) << "Keeping the running configuration.";
+		return (false);
+	}
+
+	return (true);
+}
+
+Config *
+WANProxyConfig::create(void) const
+{
+	Config *config = new Config();
+	config->import(&config_class_log_mask);
+	config->import(&wanproxy_config_class_codec);
+	config->import(&wanproxy_config_class_interface);
+	config->import(&wanproxy_config_class_monitor);
+	config->import(&wanproxy_config_class_peer);
+	config->import(&wanproxy_config_class_proxy);
+	config->import(&wanproxy_config_class_proxy_socks);
+	return (config);
+}
+
+bool
+WANProxyConfig::read(std::fstream& in)
+{
 	std::deque<std::string> tokens;
 
 	while (in.good()) {
@@ -184,10 +276,6 @@ WANProxyConfig::configure(const std::string& name)
 		ASSERT(log_, !tokens.empty());
 		if (!parse(tokens)) {
 			ERROR(log_) << "Error in configuration directive: " << line;
-
-			delete config_;
-			config_ = NULL;
-
 			return (false);
 		}
 		ASSERT(log_, tokens.empty());
@@ -26,16 +26,34 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CONFIG_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_H
 
+#include <deque>
+#include <fstream>
+
 class Config;
 
 class WANProxyConfig {
 	LogHandle log_;
+	std::string name_;
 	Config *config_;
+	Config *next_;
+	std::deque<std::string> activations_;
+	bool draining_;
 public:
 	WANProxyConfig(void);
 	~WANProxyConfig();
 
 private:
+	/*
+	 * The configuration being read: a new one, which is not activated
+	 * as it is read, while reloading.
+	 */
+	Config *parsing(void) const
+	{
+		return (next_ != NULL ? next_ : config_);
+	}
+
+	Config *create(void) const;
+	bool read(std::fstream&);
 	bool parse(std::deque<std::string>&);
 
 	void parse_activate(std::deque<std::string>&);
@@ -44,6 +62,16 @@ private:
 
 public:
 	bool configure(const std::string&);
+	bool reload(void);
+
+	/*
+	 * The listeners are going away for good; refuse to reload from now
+	 * on, as that would mean listening again.
+	 */
+	void drain(void)
+	{
+		draining_ = true;
+	}
 };
 
 #endif /* !PROGRAMS_WANPROXY_WANPROXY_CONFIG_H */
@@ -23,6 +23,9 @@
  * SUCH DAMAGE.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <common/buffer.h>
 
 #include <config/config_class.h>
@@ -30,6 +33,9 @@
 
 #include <xcodec/xcodec.h>
 #include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_image.h>
+
+#include <zstd/zstd_dictionary.h>
 
 #include "wanproxy_config_class_codec.h"
 
@@ -42,6 +48,32 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 
 	switch (codec_type_) {
 	case WANProxyConfigCodecXCodec: {
+		if (codec_push_rate_ < 0) {
+			ERROR("/wanproxy/config/codec") << "Codec push rate must not be negative.";
+			return (false);
+		}
+		codec_.codec_push_rate_ = codec_push_rate_;
+
+		/*
+		 * Keep the dictionary of the codec this one replaces.
+		 */
+		if (codec_.codec_ != NULL)
+			break;
+
+		/*
+		 * Start from a dictionary image, if one is given; the
+		 * image is kept for the life of the codec, to seed the
+		 * caches for our peers.
+		 */
+		XCodecImage *image = NULL;
+		if (!codec_image_.empty()) {
+			image = new XCodecImage();
+			if (!image->load(codec_image_)) {
+				delete image;
+				return (false);
+			}
+		}
+
 		/*
 		 * XXX
 		 * Fetch UUID from permanent storage if there is any.
@@ -53,13 +85,20 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 		if (cache == NULL) {
 			cache = new XCodecMemoryCache(uuid);
 			XCodecCache::enter(uuid, cache);
+			if (image != NULL)
+				image->seed(cache);
 		}
-		XCodec *xcodec = new XCodec(cache);
+		XCodec *xcodec = new XCodec(cache, image);
 
 		codec_.codec_ = xcodec;
 		break;
 	}
 	case WANProxyConfigCodecNone:
+		if (!codec_image_.empty() || codec_push_rate_ != 0) {
+			ERROR("/wanproxy/config/codec") << "Codec image and push rate are only supported by XCodec.";
+			return (false);
+		}
+
 		codec_.codec_ = NULL;
 		break;
 	default:
@@ -74,8 +113,58 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 			return (false);
 		}
 
-		codec_.compressor_ = true;
-		codec_.compressor_level_ = compressor_level_;
+		if (compressor_window_log_ != 0 || !compressor_dictionary_.empty()) {
+			ERROR("/wanproxy/config/codec") << "Compressor window log and dictionary are not supported by zlib.";
+			return (false);
+		}
+
+		if (compressor_bypass_threshold_ < 0 || compressor_bypass_threshold_ > 99) {
+			ERROR("/wanproxy/config/codec") << "Compressor bypass threshold must be in range 0..99 (inclusive.)";
+			return (false);
+		}
+		break;
+	case WANProxyConfigCompressorZstd:
+		if (compressor_level_ < 1 || compressor_level_ > 22) {
+			ERROR("/wanproxy/config/codec") << "Compressor level must be in range 1..22 (inclusive.)";
+			return (false);
+		}
+
+		if (compressor_flush_ms_ != 0 || compressor_flush_bytes_ != 0) {
+			ERROR("/wanproxy/config/codec") << "Compressor flush interval and threshold are only supported by zlib.";
+			return (false);
+		}
+
+		if (compressor_bypass_threshold_ != 0) {
+			ERROR("/wanproxy/config/codec") << "Compressor bypass is only supported by zlib.";
+			return (false);
+		}
+
+		if (compressor_window_log_ != 0 &&
+		    (compressor_window_log_ < 10 || compressor_window_log_ > 30)) {
+			ERROR("/wanproxy/config/codec") << "Compressor window log must be in range 10..30 (inclusive.)";
+			return (false);
+		}
+		break;
+	case WANProxyConfigCompressorLZ4:
+		if (compressor_level_ < 0 || compressor_level_ > 12) {
+			ERROR("/wanproxy/config/codec") << "Compressor level must be in range 0..12 (inclusive.)";
+			return (false);
+		}
+
+		if (compressor_flush_ms_ != 0 || compressor_flush_bytes_ != 0) {
+			ERROR("/wanproxy/config/codec") << "Compressor flush interval and threshold are only supported by zlib.";
+			return (false);
+		}
+
+		if (compressor_bypass_threshold_ != 0) {
+			ERROR("/wanproxy/config/codec") << "Compressor bypass is only supported by zlib.";
+			return (false);
+		}
+
+		if (compressor_window_log_ != 0 || !compressor_dictionary_.empty()) {
+			ERROR("/wanproxy/config/codec") << "Compressor window log and dictionary are not supported by lz4.";
+			return (false);
+		}
 		break;
 	case WANProxyConfigCompressorNone:
 		if (compressor_level_ != -1) {
@@ -83,13 +172,108 @@ WANProxyConfigClassCodec::Instance::activate(const ConfigObject *co)
 			return (false);
 		}
 
-		codec_.compressor_ = false;
+		codec_.compressor_ = WANProxyConfigCompressorNone;
 		codec_.compressor_level_ = 0;
-		break;
+		codec_.compressor_flush_ms_ = 0;
+		codec_.compressor_flush_bytes_ = 0;
+		codec_.compressor_window_log_ = 0;
+		codec_.compressor_dictionary_ = NULL;
+		codec_.compressor_bypass_threshold_ = 0;
+		return (true);
 	default:
 		ERROR("/wanproxy/config/codec") << "Invalid compressor type.";
 		return (false);
 	}
 
+	if (compressor_flush_ms_ < 0 || compressor_flush_bytes_ < 0) {
+		ERROR("/wanproxy/config/codec") << "Compressor flush interval and threshold must not be negative.";
+		return (false);
+	}
+
+	/*
+	 * Digest the dictionary once, at this codec's level, for every flow
+	 * to share.  It is kept for the life of the codec, including when it
+	 * is activated again after a failed reload.
+	 */
+	if (!compressor_dictionary_.empty() && compressor_dictionary_data_ == NULL) {
+		Buffer dictionary;
+		if (!load_dictionary(&dictionary))
+			return (false);
+
+		compressor_dictionary_data_ = ZstdDictionary::create(&dictionary, compressor_level_);
+		if (compressor_dictionary_data_ == NULL) {
+			ERROR("/wanproxy/config/codec") << "Could not use compressor dictionary: " << compressor_dictionary_;
+			return (false);
+		}
+	}
+
+	codec_.compressor_ = compressor_;
+	codec_.compressor_level_ = compressor_level_;
+	codec_.compressor_flush_ms_ = compressor_flush_ms_;
+	codec_.compressor_flush_bytes_ = compressor_flush_bytes_;
+	codec_.compressor_window_log_ = compressor_window_log_;
+	codec_.compressor_bypass_threshold_ = compressor_bypass_threshold_;
+	codec_.compressor_dictionary_ = compressor_dictionary_data_;
+
+	return (true);
+}
+
+/*
+ * A codec changed on reload keeps the XCodec of the one it replaces, and so
+ * its cache, rather than starting again from nothing; the peers' caches for
+ * it are still good.  A new codec image means starting over from that.
+ */
+void
+WANProxyConfigClassCodec::Instance::inherit(const ConfigClassInstance *old)
+{
+	const Instance *instance = dynamic_cast<const Instance *>(old);
+	ASSERT("/wanproxy/config/codec", instance != NULL);
+
+	if (codec_type_ == WANProxyConfigCodecXCodec &&
+	    instance->codec_type_ == WANProxyConfigCodecXCodec &&
+	    codec_image_ == instance->codec_image_)
+		codec_.codec_ = instance->codec_.codec_;
+}
+
+/*
+ * Read the compressor dictionary, if any, into memory so that it can be
+ * digested for every flow using this codec.  Both ends must use the same one.
+ */
+bool
+WANProxyConfigClassCodec::Instance::load_dictionary(Buffer *dictionary)
+{
+	dictionary->clear();
+
+	if (compressor_dictionary_.empty())
+		return (true);
+
+	int fd = ::open(compressor_dictionary_.c_str(), O_RDONLY);
+	if (fd == -1) {
+		ERROR("/wanproxy/config/codec") << "Could not open compressor dictionary: " << compressor_dictionary_;
+		return (false);
+	}
+
+	for (;;) {
+		uint8_t data[65536];
+		ssize_t len;
+
+		len = ::read(fd, data, sizeof data);
+		if (len == -1) {
+			ERROR("/wanproxy/config/codec") << "Could not read compressor dictionary: " << compressor_dictionary_;
+			::close(fd);
+			dictionary->clear();
+			return (false);
+		}
+		if (len == 0)
+			break;
+		dictionary->append(data, len);
+	}
+	::close(fd);
+
+	if (dictionary->empty()) {
+		ERROR("/wanproxy/config/codec") << "Compressor dictionary is empty: " << compressor_dictionary_;
+		return (false);
+	}
+
 	return (true);
 }
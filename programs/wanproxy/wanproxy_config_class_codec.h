@@ -27,6 +27,7 @@
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_CODEC_H
 
 #include <config/config_type_int.h>
+#include <config/config_type_string.h>
 
 #include "wanproxy_codec.h"
 #include "wanproxy_config_type_codec.h"
@@ -37,44 +38,82 @@ public:
 	struct Instance : public ConfigClassInstance {
 		WANProxyCodec codec_;
 		WANProxyConfigCodec codec_type_;
+		std::string codec_image_;
+		intmax_t codec_push_rate_;
 		WANProxyConfigCompressor compressor_;
 		intmax_t compressor_level_;
+		intmax_t compressor_flush_ms_;
+		intmax_t compressor_flush_bytes_;
+		intmax_t compressor_window_log_;
+		std::string compressor_dictionary_;
+		ZstdDictionary *compressor_dictionary_data_;
+		intmax_t compressor_bypass_threshold_;
 
 		intmax_t outgoing_to_codec_bytes_;
 		intmax_t codec_to_outgoing_bytes_;
 		intmax_t incoming_to_codec_bytes_;
 		intmax_t codec_to_incoming_bytes_;
 
+		intmax_t compressor_bypass_bytes_;
+		intmax_t compressor_bypass_count_;
+
 		Instance(void)
 		: codec_(),
 		  codec_type_(WANProxyConfigCodecNone),
+		  codec_image_(""),
+		  codec_push_rate_(0),
 		  compressor_(WANProxyConfigCompressorNone),
 		  compressor_level_(0),
+		  compressor_flush_ms_(0),
+		  compressor_flush_bytes_(0),
+		  compressor_window_log_(0),
+		  compressor_dictionary_(""),
+		  compressor_dictionary_data_(NULL),
+		  compressor_bypass_threshold_(0),
 		  outgoing_to_codec_bytes_(0),
 		  codec_to_outgoing_bytes_(0),
 		  incoming_to_codec_bytes_(0),
-		  codec_to_incoming_bytes_(0)
+		  codec_to_incoming_bytes_(0),
+		  compressor_bypass_bytes_(0),
+		  compressor_bypass_count_(0)
 		{
 			codec_.outgoing_to_codec_bytes_ = &outgoing_to_codec_bytes_;
 			codec_.codec_to_outgoing_bytes_ = &codec_to_outgoing_bytes_;
 			codec_.incoming_to_codec_bytes_ = &incoming_to_codec_bytes_;
 			codec_.codec_to_incoming_bytes_ = &codec_to_incoming_bytes_;
+
+			codec_.compressor_bypass_bytes_ = &compressor_bypass_bytes_;
+			codec_.compressor_bypass_count_ = &compressor_bypass_count_;
 		}
 
 		bool activate(const ConfigObject *);
+		void inherit(const ConfigClassInstance *);
+
+	private:
+		bool load_dictionary(Buffer *);
 	};
 
 	WANProxyConfigClassCodec(void)
 	: ConfigClass("codec", new ConstructorFactory<ConfigClassInstance, Instance>)
 	{
 		add_member("codec", &wanproxy_config_type_codec, &Instance::codec_type_);
+		add_member("codec_image", &config_type_string, &Instance::codec_image_);
+		add_member("codec_push_rate", &config_type_int, &Instance::codec_push_rate_);
 		add_member("compressor", &wanproxy_config_type_compressor, &Instance::compressor_);
 		add_member("compressor_level", &config_type_int, &Instance::compressor_level_);
+		add_member("compressor_flush_ms", &config_type_int, &Instance::compressor_flush_ms_);
+		add_member("compressor_flush_bytes", &config_type_int, &Instance::compressor_flush_bytes_);
+		add_member("compressor_window_log", &config_type_int, &Instance::compressor_window_log_);
+		add_member("compressor_dictionary", &config_type_string, &Instance::compressor_dictionary_);
+		add_member("compressor_bypass_threshold", &config_type_int, &Instance::compressor_bypass_threshold_);
 
 		add_member("outgoing_to_codec_bytes", &config_type_int, &Instance::outgoing_to_codec_bytes_);
 		add_member("codec_to_outgoing_bytes", &config_type_int, &Instance::codec_to_outgoing_bytes_);
 		add_member("incoming_to_codec_bytes", &config_type_int, &Instance::incoming_to_codec_bytes_);
 		add_member("codec_to_incoming_bytes", &config_type_int, &Instance::codec_to_incoming_bytes_);
+
+		add_member("compressor_bypass_bytes", &config_type_int, &Instance::compressor_bypass_bytes_);
+		add_member("compressor_bypass_count", &config_type_int, &Instance::compressor_bypass_count_);
 	}
 
 	~WANProxyConfigClassCodec()
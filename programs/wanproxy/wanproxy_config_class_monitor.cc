@@ -38,6 +38,7 @@
 #include <io/socket/socket_types.h>
 
 #include "monitor_client.h"
+#include "monitor_metrics.h"
 #include "wanproxy_config_class_interface.h"
 #include "wanproxy_config_class_monitor.h"
 
@@ -54,7 +55,24 @@ WANProxyConfigClassMonitor::Instance::activate(const ConfigObject *co)
 	if (interface->host_ == "" || interface->port_ == "")
 		return (false);
 	std::string interface_address = '[' + interface->host_ + ']' + ':' + interface->port_;
-	new HTTPServer<TCPServer, MonitorClient, Config *>(co->config_, interface->family_, interface_address);
+	listener_ = new HTTPServer<TCPServer, MonitorClient, Config *>(co->config_, interface->family_, interface_address);
+	if (!listener_->listening()) {
+		delete listener_;
+		listener_ = NULL;
+		return (false);
+	}
+
+	MonitorMetrics::start();
 
 	return (true);
 }
+
+void
+WANProxyConfigClassMonitor::Instance::deactivate(const ConfigObject *)
+{
+	if (listener_ == NULL)
+		return;
+
+	listener_->retire();
+	listener_ = NULL;
+}
@@ -28,17 +28,22 @@
 
 #include <config/config_type_pointer.h>
 
-class MonitorListener;
+class TCPServer;
+template<typename> class SimpleServer;
 
 class WANProxyConfigClassMonitor : public ConfigClass {
 	struct Instance : public ConfigClassInstance {
 		ConfigObject *interface_;
 
+		SimpleServer<TCPServer> *listener_;
+
 		Instance(void)
-		: interface_(NULL)
+		: interface_(NULL),
+		  listener_(NULL)
 		{ }
 
 		bool activate(const ConfigObject *);
+		void deactivate(const ConfigObject *);
 	};
 public:
 	WANProxyConfigClassMonitor(void)
@@ -33,8 +33,12 @@
 
 #include <io/socket/socket_types.h>
 
+#include <io/net/tcp_server.h>
+
+#include "proxy_connector_pool.h"
 #include "proxy_listener.h"
 #include "ssh_proxy_listener.h"
+#include "tunnel_proxy_listener.h"
 #include "wanproxy_config_class_codec.h"
 #include "wanproxy_config_class_interface.h"
 #include "wanproxy_config_class_peer.h"
@@ -86,11 +90,96 @@ WANProxyConfigClassProxy::Instance::activate(const ConfigObject *co)
 	std::string interface_address = '[' + interface->host_ + ']' + ':' + interface->port_;
 	std::string peer_address = '[' + peer->host_ + ']' + ':' + peer->port_;
 
-	if (type_ == WANProxyConfigProxyTypeTCPTCP) {
-		new ProxyListener(co->name_, interface_codec, peer_codec, interface->family_, interface_address, peer->family_, peer_address);
-	} else {
-		new SSHProxyListener(co->name_, interface_codec, peer_codec, interface->family_, interface_address, peer->family_, peer_address);
+	if (pool_min_ < 0 || pool_max_ < pool_min_ || pool_lifetime_ < 0) {
+		ERROR("/wanproxy/config/proxy") << "Pool sizes must satisfy 0 <= pool_min <= pool_max, and pool_lifetime must not be negative.";
+		return (false);
+	}
+
+	/*
+	 * SSH and tunnel proxies already share one connection to each peer.
+	 */
+	if (pool_max_ != 0 && type_ != WANProxyConfigProxyTypeTCPTCP) {
+		ERROR("/wanproxy/config/proxy") << "Only TCP proxies may have a connection pool.";
+		return (false);
+	}
+
+	/*
+	 * The codec of a tunnel proxy is run over the tunnel, and so only
+	 * on the side which has one.
+	 */
+	if ((type_ == WANProxyConfigProxyTypeTCPTunnel && interface_codec != NULL) ||
+	    (type_ == WANProxyConfigProxyTypeTunnelTCP && peer_codec != NULL)) {
+		ERROR("/wanproxy/config/proxy") << "Tunnel proxies may only have a codec on the tunnel side.";
+		return (false);
+	}
+
+	/*
+	 * A proxy may run its flows' deflate at a level other than its
+	 * codecs', which it sets on each flow as it starts.
+	 */
+	if (compressor_level_ != -1) {
+		if (type_ != WANProxyConfigProxyTypeTCPTCP) {
+			ERROR("/wanproxy/config/proxy") << "Only TCP proxies may override the compressor level.";
+			return (false);
+		}
+
+		if (compressor_level_ < 0 || compressor_level_ > 9) {
+			ERROR("/wanproxy/config/proxy") << "Compressor level must be in range 0..9 (inclusive.)";
+			return (false);
+		}
+
+		if ((interface_codec == NULL || interface_codec->compressor_ != WANProxyConfigCompressorZlib) &&
+		    (peer_codec == NULL || peer_codec->compressor_ != WANProxyConfigCompressorZlib)) {
+			ERROR("/wanproxy/config/proxy") << "Compressor level set but no codec uses zlib.";
+			return (false);
+		}
+
+		if ((interface_codec != NULL && interface_codec->compressor_ != WANProxyConfigCompressorNone &&
+		     interface_codec->compressor_ != WANProxyConfigCompressorZlib) ||
+		    (peer_codec != NULL && peer_codec->compressor_ != WANProxyConfigCompressorNone &&
+		     peer_codec->compressor_ != WANProxyConfigCompressorZlib)) {
+			ERROR("/wanproxy/config/proxy") << "Compressor level may only be overridden for zlib.";
+			return (false);
+		}
+	}
+
+	switch (type_) {
+	case WANProxyConfigProxyTypeTCPTCP: {
+		ProxyConnectorPool *pool;
+		if (pool_max_ != 0)
+			pool = new ProxyConnectorPool(co->name_, peer->family_, peer_address, peer->options(), pool_min_, pool_max_, pool_lifetime_);
+		else
+			pool = NULL;
+
+		listener_ = new ProxyListener(co->name_, interface_codec, peer_codec, interface->family_, interface_address, interface->options(), peer->family_, peer_address, peer->options(), pool, compressor_level_);
+		break;
+	}
+	case WANProxyConfigProxyTypeSSHSSH:
+		listener_ = new SSHProxyListener(co->name_, interface_codec, peer_codec, interface->family_, interface_address, interface->options(), peer->family_, peer_address, peer->options());
+		break;
+	case WANProxyConfigProxyTypeTCPTunnel:
+		listener_ = new TunnelProxyListener(co->name_, false, peer_codec, interface->family_, interface_address, interface->options(), peer->family_, peer_address, peer->options());
+		break;
+	case WANProxyConfigProxyTypeTunnelTCP:
+		listener_ = new TunnelProxyListener(co->name_, true, interface_codec, interface->family_, interface_address, interface->options(), peer->family_, peer_address, peer->options());
+		break;
+	}
+
+	if (!listener_->listening()) {
+		delete listener_;
+		listener_ = NULL;
+		return (false);
 	}
 
 	return (true);
 }
+
+void
+WANProxyConfigClassProxy::Instance::deactivate(const ConfigObject *)
+{
+	if (listener_ == NULL)
+		return;
+
+	listener_->retire();
+	listener_ = NULL;
+}
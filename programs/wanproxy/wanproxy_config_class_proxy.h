@@ -26,11 +26,13 @@
 #ifndef	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 #define	PROGRAMS_WANPROXY_WANPROXY_CONFIG_CLASS_PROXY_H
 
+#include <config/config_type_int.h>
 #include <config/config_type_pointer.h>
 
 #include "wanproxy_config_type_proxy_type.h"
 
-class ProxyListener;
+class TCPServer;
+template<typename> class SimpleServer;
 
 class WANProxyConfigClassProxy : public ConfigClass {
 	struct Instance : public ConfigClassInstance {
@@ -39,16 +41,28 @@ class WANProxyConfigClassProxy : public ConfigClass {
 		ConfigObject *interface_codec_;
 		ConfigObject *peer_;
 		ConfigObject *peer_codec_;
+		intmax_t pool_min_;
+		intmax_t pool_max_;
+		intmax_t pool_lifetime_;
+		intmax_t compressor_level_;
+
+		SimpleServer<TCPServer> *listener_;
 
 		Instance(void)
 		: type_(WANProxyConfigProxyTypeTCPTCP),
 		  interface_(NULL),
 		  interface_codec_(NULL),
 		  peer_(NULL),
-		  peer_codec_(NULL)
+		  peer_codec_(NULL),
+		  pool_min_(0),
+		  pool_max_(0),
+		  pool_lifetime_(0),
+		  compressor_level_(-1),
+		  listener_(NULL)
 		{ }
 
 		bool activate(const ConfigObject *);
+		void deactivate(const ConfigObject *);
 	};
 public:
 	WANProxyConfigClassProxy(void)
@@ -59,6 +73,10 @@ public:
 		add_member("interface_codec", &config_type_pointer, &Instance::interface_codec_);
 		add_member("peer", &config_type_pointer, &Instance::peer_);
 		add_member("peer_codec", &config_type_pointer, &Instance::peer_codec_);
+		add_member("pool_min", &config_type_int, &Instance::pool_min_);
+		add_member("pool_max", &config_type_int, &Instance::pool_max_);
+		add_member("pool_lifetime", &config_type_int, &Instance::pool_lifetime_);
+		add_member("compressor_level", &config_type_int, &Instance::compressor_level_);
 	}
 
 	/* XXX So wrong.  */
@@ -33,6 +33,8 @@
 
 #include <io/socket/socket_types.h>
 
+#include <io/net/tcp_server.h>
+
 #include "proxy_socks_listener.h"
 #include "wanproxy_config_class_interface.h"
 #include "wanproxy_config_class_proxy_socks.h"
@@ -51,7 +53,22 @@ WANProxyConfigClassProxySocks::Instance::activate(const ConfigObject *co)
 		return (false);
 	std::string interface_address = '[' + interface->host_ + ']' + ':' + interface->port_;
 
-	new ProxySocksListener(co->name_, interface->family_, interface_address);
+	listener_ = new ProxySocksListener(co->name_, interface->family_, interface_address, interface->options());
+	if (!listener_->listening()) {
+		delete listener_;
+		listener_ = NULL;
+		return (false);
+	}
 
 	return (true);
 }
+
+void
+WANProxyConfigClassProxySocks::Instance::deactivate(const ConfigObject *)
+{
+	if (listener_ == NULL)
+		return;
+
+	listener_->retire();
+	listener_ = NULL;
+}
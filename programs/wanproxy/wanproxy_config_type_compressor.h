@@ -30,7 +30,9 @@
 
 enum WANProxyConfigCompressor {
 	WANProxyConfigCompressorNone,
-	WANProxyConfigCompressorZlib
+	WANProxyConfigCompressorZlib,
+	WANProxyConfigCompressorZstd,
+	WANProxyConfigCompressorLZ4
 };
 
 typedef ConfigTypeEnum<WANProxyConfigCompressor> WANProxyConfigTypeCompressor;
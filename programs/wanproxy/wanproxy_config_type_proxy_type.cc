@@ -30,6 +30,8 @@ static struct WANProxyConfigTypeProxyType::Mapping wanproxy_config_type_proxy_ty
 	{ "TCP-TCP",	WANProxyConfigProxyTypeTCPTCP },
 	{ "SSH",	WANProxyConfigProxyTypeSSHSSH },
 	{ "SSH-SSH",	WANProxyConfigProxyTypeSSHSSH },
+	{ "TCP-TUNNEL",	WANProxyConfigProxyTypeTCPTunnel },
+	{ "TUNNEL-TCP",	WANProxyConfigProxyTypeTunnelTCP },
 	{ NULL,		WANProxyConfigProxyTypeTCPTCP }
 };
 
@@ -31,6 +31,8 @@
 enum WANProxyConfigProxyType {
 	WANProxyConfigProxyTypeTCPTCP,
 	WANProxyConfigProxyTypeSSHSSH,
+	WANProxyConfigProxyTypeTCPTunnel,
+	WANProxyConfigProxyTypeTunnelTCP,
 };
 
 typedef ConfigTypeEnum<WANProxyConfigProxyType> WANProxyConfigTypeProxyType;
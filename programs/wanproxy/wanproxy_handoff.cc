@@ -0,0 +1,581 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include <io/net/tcp_server.h>
+
+#include <io/socket/simple_server.h>
+#include <io/socket/socket.h>
+#include <io/socket/unix_server.h>
+
+#include "proxy_connector.h"
+#include "ssh_proxy_connector.h"
+#include "wanproxy_config.h"
+#include "wanproxy_handoff.h"
+
+#if defined(MSG_NOSIGNAL)
+#define	HANDOFF_SEND_FLAGS	(MSG_NOSIGNAL)
+#else
+#define	HANDOFF_SEND_FLAGS	(0)
+#endif
+
+static bool handoff_read(int, void *, size_t);
+static bool handoff_send(int, const std::string&, int);
+
+int WANProxyHandoff::pipe_[2] = { -1, -1 };
+int WANProxyHandoff::peer_ = -1;
+
+WANProxyHandoff::WANProxyHandoff(WANProxyConfig *config, const std::string& path, unsigned deadline)
+: log_("/wanproxy/handoff"),
+  config_(config),
+  path_(path),
+  deadline_(deadline),
+  server_(NULL),
+  client_(NULL),
+  handed_off_(false),
+  draining_(false),
+  drain_ms_(0),
+  accept_action_(NULL),
+  client_action_(NULL),
+  client_close_action_(NULL),
+  server_close_action_(NULL),
+  poll_action_(NULL),
+  drain_action_(NULL),
+  stop_action_(NULL)
+{
+	ASSERT(log_, pipe_[0] == -1);
+
+	if (::pipe(pipe_) == -1)
+		HALT(log_) << "Could not create pipe: " << strerror(errno);
+
+	unsigned i;
+	for (i = 0; i < 2; i++) {
+		int flags = ::fcntl(pipe_[i], F_GETFL);
+		if (flags == -1 || ::fcntl(pipe_[i], F_SETFL, flags | O_NONBLOCK) == -1)
+			HALT(log_) << "Could not make pipe non-blocking: " << strerror(errno);
+	}
+
+	::signal(SIGTERM, WANProxyHandoff::signal_drain);
+
+	EventCallback *cb = callback(this, &WANProxyHandoff::poll_complete);
+	poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, pipe_[0], cb);
+
+	if (path_ != "") {
+		::unlink(path_.c_str());
+
+		server_ = UnixServer::listen(path_);
+		if (server_ == NULL) {
+			ERROR(log_) << "Could not listen for handoffs on: " << path_;
+		} else {
+			/*
+			 * Whoever can connect to the handoff socket can take
+			 * our listeners, so only we may.
+			 */
+			if (::chmod(path_.c_str(), S_IRUSR | S_IWUSR) == -1)
+				ERROR(log_) << "Could not restrict access to handoff socket: " << strerror(errno);
+
+			INFO(log_) << "Listening for handoffs on: " << path_;
+
+			SocketEventCallback *acb = callback(this, &WANProxyHandoff::accept_complete);
+			accept_action_ = server_->accept(acb);
+		}
+	}
+
+	SimpleCallback *scb = callback(this, &WANProxyHandoff::stop);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+}
+
+WANProxyHandoff::~WANProxyHandoff()
+{
+	ASSERT(log_, accept_action_ == NULL);
+	ASSERT(log_, client_action_ == NULL);
+	ASSERT(log_, poll_action_ == NULL);
+	ASSERT(log_, drain_action_ == NULL);
+
+	if (stop_action_ != NULL) {
+		stop_action_->cancel();
+		stop_action_ = NULL;
+	}
+
+	::signal(SIGTERM, SIG_DFL);
+
+	::close(pipe_[0]);
+	::close(pipe_[1]);
+	pipe_[0] = pipe_[1] = -1;
+}
+
+/*
+ * Take over the listeners of the WANProxy listening for handoffs on the given
+ * socket, if there is one.  This is done before the event system is started,
+ * and so blocks.  The connection is kept until we confirm that we have taken
+ * over, or exit.
+ */
+bool
+WANProxyHandoff::receive(const std::string& path)
+{
+	struct sockaddr_un sun;
+
+	if (path.length() >= sizeof sun.sun_path) {
+		ERROR("/wanproxy/handoff") << "Handoff socket path too long: " << path;
+		return (false);
+	}
+
+	memset(&sun, 0, sizeof sun);
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path.c_str(), sizeof sun.sun_path - 1);
+
+	int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == -1) {
+		ERROR("/wanproxy/handoff") << "Could not create socket: " << strerror(errno);
+		return (false);
+	}
+
+	if (::connect(s, (struct sockaddr *)&sun, sizeof sun) == -1) {
+		::close(s);
+
+		switch (errno) {
+		case ENOENT:
+		case ECONNREFUSED:
+			INFO("/wanproxy/handoff") << "No WANProxy to take over from.";
+			return (true);
+		default:
+			ERROR("/wanproxy/handoff") << "Could not connect to handoff socket: " << strerror(errno);
+			return (false);
+		}
+	}
+
+	struct timeval tv;
+	tv.tv_sec = WANPROXY_HANDOFF_TIMEOUT;
+	tv.tv_usec = 0;
+	if (::setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == -1)
+		ERROR("/wanproxy/handoff") << "Could not set handoff timeout: " << strerror(errno);
+
+	/*
+	 * Each listener comes as a two-byte length and its name, with its
+	 * descriptor on the length; a length of zero ends the list.  The
+	 * length is read on its own, so that what follows, and the next
+	 * descriptor, are not mixed in with it.
+	 */
+	unsigned count = 0;
+	for (;;) {
+		uint8_t lenbuf[2];
+		struct iovec iov;
+		union {
+			struct cmsghdr hdr;
+			char buf[CMSG_SPACE(sizeof (int))];
+		} control;
+		struct msghdr msg;
+		ssize_t len;
+
+		iov.iov_base = lenbuf;
+		iov.iov_len = sizeof lenbuf;
+
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		len = ::recvmsg(s, &msg, MSG_WAITALL);
+		if (len != (ssize_t)sizeof lenbuf) {
+			ERROR("/wanproxy/handoff") << "Could not receive listener: " << (len == -1 ? strerror(errno) : "short read");
+			::close(s);
+			return (false);
+		}
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (lenbuf[0] == 0 && lenbuf[1] == 0 && cmsg == NULL)
+			break;
+		if (cmsg == NULL || (msg.msg_flags & MSG_CTRUNC) != 0 ||
+		    cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+		    cmsg->cmsg_len != CMSG_LEN(sizeof (int))) {
+			ERROR("/wanproxy/handoff") << "Listener received without its descriptor.";
+			::close(s);
+			return (false);
+		}
+
+		int fd;
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof fd);
+
+		std::string name((lenbuf[0] << 8) | lenbuf[1], '\0');
+		if (!handoff_read(s, &name[0], name.length())) {
+			ERROR("/wanproxy/handoff") << "Could not receive listener name.";
+			::close(fd);
+			::close(s);
+			return (false);
+		}
+
+		TCPServer::inherit(name, fd);
+		count++;
+	}
+	peer_ = s;
+
+	INFO("/wanproxy/handoff") << "Received " << count << " listeners.";
+
+	return (true);
+}
+
+/*
+ * Tell the WANProxy we received listeners from that we are ready to use them,
+ * and that it should drain.
+ */
+void
+WANProxyHandoff::confirm(void)
+{
+	if (peer_ == -1)
+		return;
+
+	if (::send(peer_, "", 1, HANDOFF_SEND_FLAGS) != 1)
+		ERROR("/wanproxy/handoff") << "Could not confirm handoff: " << strerror(errno);
+	else
+		INFO("/wanproxy/handoff") << "Took over listeners.";
+
+	::close(peer_);
+	peer_ = -1;
+}
+
+void
+WANProxyHandoff::accept_complete(Event e, Socket *client)
+{
+	accept_action_->cancel();
+	accept_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default: {
+		ERROR(log_) << "Accept error: " << e;
+		SocketEventCallback *cb = callback(this, &WANProxyHandoff::accept_complete);
+		accept_action_ = server_->accept(cb);
+		return;
+	}
+	}
+
+	ASSERT(log_, client_ == NULL);
+	client_ = client;
+
+	std::map<std::string, int> fds = TCPServer::descriptors();
+	std::map<std::string, int>::const_iterator it;
+	for (it = fds.begin(); it != fds.end(); ++it) {
+		if (!handoff_send(client_->descriptor(), it->first, it->second)) {
+			ERROR(log_) << "Could not hand off listener for " << it->first << ": " << strerror(errno);
+			client_close();
+			return;
+		}
+	}
+	if (!handoff_send(client_->descriptor(), "", -1)) {
+		ERROR(log_) << "Could not finish handoff: " << strerror(errno);
+		client_close();
+		return;
+	}
+
+	INFO(log_) << "Sent " << fds.size() << " listeners; waiting for confirmation.";
+
+	EventCallback *cb = callback(this, &WANProxyHandoff::confirm_complete);
+	client_action_ = client_->read(1, cb);
+}
+
+void
+WANProxyHandoff::confirm_complete(Event e)
+{
+	client_action_->cancel();
+	client_action_ = NULL;
+
+	if (e.type_ != Event::Done || e.buffer_.empty()) {
+		INFO(log_) << "New WANProxy did not take over; carrying on.";
+		client_close();
+		return;
+	}
+
+	INFO(log_) << "Handed off listeners.";
+	handed_off_ = true;
+
+	client_close();
+	drain();
+}
+
+void
+WANProxyHandoff::client_close(void)
+{
+	ASSERT(log_, client_ != NULL);
+
+	if (client_action_ != NULL) {
+		client_action_->cancel();
+		client_action_ = NULL;
+	}
+
+	if (client_close_action_ != NULL)
+		return;
+
+	SimpleCallback *cb = callback(this, &WANProxyHandoff::client_close_complete);
+	client_close_action_ = client_->close(cb);
+}
+
+void
+WANProxyHandoff::client_close_complete(void)
+{
+	client_close_action_->cancel();
+	client_close_action_ = NULL;
+
+	ASSERT(log_, client_ != NULL);
+	delete client_;
+	client_ = NULL;
+
+	/*
+	 * After a failed handoff, wait for another try.
+	 */
+	if (server_ != NULL && server_close_action_ == NULL) {
+		ASSERT(log_, accept_action_ == NULL);
+
+		SocketEventCallback *cb = callback(this, &WANProxyHandoff::accept_complete);
+		accept_action_ = server_->accept(cb);
+	}
+}
+
+void
+WANProxyHandoff::server_close(void)
+{
+	if (server_ == NULL || server_close_action_ != NULL)
+		return;
+
+	if (accept_action_ != NULL) {
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+
+	SimpleCallback *cb = callback(this, &WANProxyHandoff::server_close_complete);
+	server_close_action_ = server_->close(cb);
+}
+
+void
+WANProxyHandoff::server_close_complete(void)
+{
+	server_close_action_->cancel();
+	server_close_action_ = NULL;
+
+	delete server_;
+	server_ = NULL;
+
+	/*
+	 * Once handed off, the socket is the new WANProxy's.
+	 */
+	if (!handed_off_)
+		::unlink(path_.c_str());
+}
+
+void
+WANProxyHandoff::poll_complete(Event e)
+{
+	poll_action_->cancel();
+	poll_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		return;
+	}
+
+	char buf[64];
+	bool signalled = false;
+	while (::read(pipe_[0], buf, sizeof buf) > 0)
+		signalled = true;
+
+	if (signalled) {
+		if (draining_) {
+			INFO(log_) << "Stopping without waiting for connections.";
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		drain();
+	}
+
+	EventCallback *cb = callback(this, &WANProxyHandoff::poll_complete);
+	poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, pipe_[0], cb);
+}
+
+void
+WANProxyHandoff::drain(void)
+{
+	if (draining_)
+		return;
+	draining_ = true;
+
+	INFO(log_) << "Draining; no longer accepting connections.";
+
+	config_->drain();
+	SimpleServer<TCPServer>::retire_all();
+
+	server_close();
+
+	ASSERT(log_, drain_action_ == NULL);
+	SimpleCallback *cb = callback(this, &WANProxyHandoff::drain_complete);
+	drain_action_ = EventSystem::instance()->timeout(WANPROXY_DRAIN_POLL_MS, cb);
+}
+
+void
+WANProxyHandoff::drain_complete(void)
+{
+	drain_action_->cancel();
+	drain_action_ = NULL;
+
+	size_t open = ProxyConnector::connectors().size() +
+		SSHProxyConnector::connectors().size();
+	if (open == 0) {
+		INFO(log_) << "Drained; stopping.";
+		EventSystem::instance()->stop();
+		return;
+	}
+
+	drain_ms_ += WANPROXY_DRAIN_POLL_MS;
+	if (drain_ms_ >= deadline_ * 1000) {
+		INFO(log_) << "Stopping with " << open << " connections still open.";
+		EventSystem::instance()->stop();
+		return;
+	}
+
+	DEBUG(log_) << "Waiting for " << open << " connections.";
+
+	SimpleCallback *cb = callback(this, &WANProxyHandoff::drain_complete);
+	drain_action_ = EventSystem::instance()->timeout(WANPROXY_DRAIN_POLL_MS, cb);
+}
+
+void
+WANProxyHandoff::stop(void)
+{
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	if (poll_action_ != NULL) {
+		poll_action_->cancel();
+		poll_action_ = NULL;
+	}
+
+	if (drain_action_ != NULL) {
+		drain_action_->cancel();
+		drain_action_ = NULL;
+	}
+
+	if (client_ != NULL)
+		client_close();
+	server_close();
+}
+
+void
+WANProxyHandoff::signal_drain(int)
+{
+	int serrno = errno;
+	(void)::write(pipe_[1], "", 1);
+	errno = serrno;
+}
+
+static bool
+handoff_read(int s, void *buf, size_t len)
+{
+	uint8_t *p = (uint8_t *)buf;
+
+	while (len != 0) {
+		ssize_t rv = ::read(s, p, len);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			return (false);
+		p += rv;
+		len -= rv;
+	}
+	return (true);
+}
+
+static bool
+handoff_send(int s, const std::string& name, int fd)
+{
+	uint8_t lenbuf[2];
+	struct iovec iov[2];
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof (int))];
+	} control;
+	struct msghdr msg;
+
+	if (name.length() > 0xffff) {
+		errno = ENAMETOOLONG;
+		return (false);
+	}
+	lenbuf[0] = name.length() >> 8;
+	lenbuf[1] = name.length() & 0xff;
+
+	iov[0].iov_base = lenbuf;
+	iov[0].iov_len = sizeof lenbuf;
+	iov[1].iov_base = const_cast<char *>(name.data());
+	iov[1].iov_len = name.length();
+
+	memset(&control, 0, sizeof control);
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	/*
+	 * The end of the list has no descriptor.
+	 */
+	if (fd != -1) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof fd);
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+	}
+
+	/*
+	 * XXX
+	 * The client socket is non-blocking, but what we send is far less
+	 * than its buffer holds, so a short send is treated as failure.
+	 */
+	ssize_t len = ::sendmsg(s, &msg, HANDOFF_SEND_FLAGS);
+	if (len == -1)
+		return (false);
+	if ((size_t)len != sizeof lenbuf + name.length()) {
+		errno = EAGAIN;
+		return (false);
+	}
+	return (true);
+}
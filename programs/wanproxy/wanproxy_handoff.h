@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	PROGRAMS_WANPROXY_WANPROXY_HANDOFF_H
+#define	PROGRAMS_WANPROXY_WANPROXY_HANDOFF_H
+
+class Socket;
+class UnixServer;
+class WANProxyConfig;
+
+/*
+ * How long to wait for connections to finish when draining, by default, in
+ * seconds.
+ */
+#define	WANPROXY_DRAIN_DEADLINE		(60)
+
+/*
+ * How often to check whether the connections open when we started to drain
+ * have finished, in milliseconds.
+ */
+#define	WANPROXY_DRAIN_POLL_MS		(1000)
+
+/*
+ * How long a new WANProxy waits to be sent the listeners of the one it is
+ * taking over from, in seconds.
+ */
+#define	WANPROXY_HANDOFF_TIMEOUT	(10)
+
+/*
+ * Draining, and handing our listeners to a new WANProxy.
+ *
+ * To drain, we stop accepting, and stop once the connections we already
+ * have are done, or once the deadline passes.  SIGTERM starts a drain.
+ *
+ * A new WANProxy given the same handoff socket as a running one connects to
+ * it before configuring itself, and is sent the descriptor of each of its
+ * listeners, with SCM_RIGHTS, along with the name it is listening on.  It
+ * then uses those in place of listening on the same names itself, so no
+ * connection is refused while one takes over from the other.  Once it has
+ * configured itself, it says so, and the old WANProxy drains; if it fails
+ * to, the old WANProxy carries on as before.
+ */
+class WANProxyHandoff {
+	static int pipe_[2];
+	static int peer_;
+
+	LogHandle log_;
+	WANProxyConfig *config_;
+	std::string path_;
+	unsigned deadline_;
+	UnixServer *server_;
+	Socket *client_;
+	bool handed_off_;
+	bool draining_;
+	unsigned drain_ms_;
+	Action *accept_action_;
+	Action *client_action_;
+	Action *client_close_action_;
+	Action *server_close_action_;
+	Action *poll_action_;
+	Action *drain_action_;
+	Action *stop_action_;
+public:
+	WANProxyHandoff(WANProxyConfig *, const std::string&, unsigned);
+	~WANProxyHandoff();
+
+	static bool receive(const std::string&);
+	static void confirm(void);
+
+private:
+	void accept_complete(Event, Socket *);
+	void confirm_complete(Event);
+	void client_close(void);
+	void client_close_complete(void);
+	void server_close(void);
+	void server_close_complete(void);
+	void poll_complete(Event);
+	void drain(void);
+	void drain_complete(void);
+	void stop(void);
+
+	static void signal_drain(int);
+};
+
+#endif /* !PROGRAMS_WANPROXY_WANPROXY_HANDOFF_H */
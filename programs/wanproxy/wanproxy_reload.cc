@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event/event_callback.h>
+#include <event/event_system.h>
+
+#include "wanproxy_config.h"
+#include "wanproxy_reload.h"
+
+int WANProxyReload::pipe_[2] = { -1, -1 };
+
+WANProxyReload::WANProxyReload(WANProxyConfig *config)
+: log_("/wanproxy/reload"),
+  config_(config),
+  poll_action_(NULL),
+  stop_action_(NULL)
+{
+	ASSERT(log_, pipe_[0] == -1);
+
+	if (::pipe(pipe_) == -1)
+		HALT(log_) << "Could not create pipe: " << strerror(errno);
+
+	/*
+	 * Neither the signal handler nor the event thread may block on it.
+	 */
+	unsigned i;
+	for (i = 0; i < 2; i++) {
+		int flags = ::fcntl(pipe_[i], F_GETFL);
+		if (flags == -1 || ::fcntl(pipe_[i], F_SETFL, flags | O_NONBLOCK) == -1)
+			HALT(log_) << "Could not make pipe non-blocking: " << strerror(errno);
+	}
+
+	::signal(SIGHUP, WANProxyReload::signal_reload);
+
+	EventCallback *cb = callback(this, &WANProxyReload::poll_complete);
+	poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, pipe_[0], cb);
+
+	SimpleCallback *scb = callback(this, &WANProxyReload::stop);
+	stop_action_ = EventSystem::instance()->register_interest(EventInterestStop, scb);
+}
+
+WANProxyReload::~WANProxyReload()
+{
+	ASSERT(log_, poll_action_ == NULL);
+
+	if (stop_action_ != NULL) {
+		stop_action_->cancel();
+		stop_action_ = NULL;
+	}
+
+	::signal(SIGHUP, SIG_DFL);
+
+	::close(pipe_[0]);
+	::close(pipe_[1]);
+	pipe_[0] = pipe_[1] = -1;
+}
+
+/*
+ * Ask for a reload; safe to call from any thread.
+ */
+void
+WANProxyReload::request(void)
+{
+	::kill(::getpid(), SIGHUP);
+}
+
+void
+WANProxyReload::poll_complete(Event e)
+{
+	poll_action_->cancel();
+	poll_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event: " << e;
+		return;
+	}
+
+	/*
+	 * Any number of signals since the last reload need only one more.
+	 */
+	char buf[64];
+	bool signalled = false;
+	while (::read(pipe_[0], buf, sizeof buf) > 0)
+		signalled = true;
+
+	if (signalled) {
+		if (!config_->reload())
+			ERROR(log_) << "Reload failed.";
+		else
+			INFO(log_) << "Reload complete.";
+	}
+
+	EventCallback *cb = callback(this, &WANProxyReload::poll_complete);
+	poll_action_ = EventSystem::instance()->poll(EventPoll::Readable, pipe_[0], cb);
+}
+
+void
+WANProxyReload::stop(void)
+{
+	stop_action_->cancel();
+	stop_action_ = NULL;
+
+	if (poll_action_ != NULL) {
+		poll_action_->cancel();
+		poll_action_ = NULL;
+	}
+}
+
+void
+WANProxyReload::signal_reload(int)
+{
+	int serrno = errno;
+	(void)::write(pipe_[1], "", 1);
+	errno = serrno;
+}
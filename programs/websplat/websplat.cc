@@ -272,7 +272,10 @@ main(int argc, char *argv[])
 		Log::mask(".?", Log::Info);
 	}
 
-	new HTTPServer<TCPServer, WebsplatClient, WebsplatConfig>(WebsplatConfig(root), SocketAddressFamilyIP, interface);
+	HTTPServer<TCPServer, WebsplatClient, WebsplatConfig> *server =
+		new HTTPServer<TCPServer, WebsplatClient, WebsplatConfig>(WebsplatConfig(root), SocketAddressFamilyIP, interface);
+	if (!server->listening())
+		HALT("/websplat") << "Could not listen on: " << interface;
 
 	event_main();
 }
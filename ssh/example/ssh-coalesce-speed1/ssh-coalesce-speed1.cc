@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <common/buffer.h>
+#include <common/endian.h>
+#include <common/timer/timer.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+
+#include <ssh/ssh_connection.h>
+#include <ssh/ssh_encryption.h>
+#include <ssh/ssh_protocol.h>
+#include <ssh/ssh_session.h>
+#include <ssh/ssh_transport_pipe.h>
+
+#define	SSH_COALESCE_SPEED_DELAY	(5)
+
+/*
+ * Sends channel data in small writes from one TransportPipe to another,
+ * as a stream being relayed a read at a time would be, and reports how
+ * many packets and bytes it took to get there, with and without
+ * coalescing.  The pipes are joined in memory and sealed with
+ * aes128-gcm@openssh.com under a fixed key, so what is measured is the
+ * transport's own cost, without sockets or key exchange.
+ */
+class CoalesceSpeed {
+	LogHandle log_;
+	SSH::Session client_session_;
+	SSH::Session server_session_;
+	SSH::TransportPipe *client_;
+	SSH::TransportPipe *server_;
+	Action *client_input_action_;
+	Action *output_action_;
+	Action *input_action_;
+	Action *receive_action_;
+	Action *write_action_;
+	unsigned writes_;
+	unsigned write_size_;
+	unsigned burst_;
+	unsigned written_;
+	uintmax_t wire_bytes_;
+	uintmax_t packets_;
+	uintmax_t data_bytes_;
+	Timer timer_;
+public:
+	CoalesceSpeed(unsigned writes, unsigned write_size, unsigned burst, size_t limit)
+	: log_("/example/ssh/coalesce/speed1"),
+	  client_session_(SSH::ClientRole),
+	  server_session_(SSH::ServerRole),
+	  client_(NULL),
+	  server_(NULL),
+	  client_input_action_(NULL),
+	  output_action_(NULL),
+	  input_action_(NULL),
+	  receive_action_(NULL),
+	  write_action_(NULL),
+	  writes_(writes),
+	  write_size_(write_size),
+	  burst_(burst),
+	  written_(0),
+	  wire_bytes_(0),
+	  packets_(0),
+	  data_bytes_(0),
+	  timer_()
+	{
+		CryptoEncryption::Cipher cipher(CryptoEncryption::AES128, CryptoEncryption::GCM);
+		Buffer key, iv;
+		unsigned i;
+
+		for (i = 0; i < 16; i++)
+			key.append((uint8_t)i);
+		for (i = 0; i < 12; i++)
+			iv.append((uint8_t)i);
+
+		SSH::Encryption *sealer = SSH::Encryption::cipher(cipher);
+		SSH::Encryption *opener = SSH::Encryption::cipher(cipher);
+		if (sealer == NULL || opener == NULL)
+			HALT(log_) << "Could not find a suitable cipher.";
+		if (!sealer->initialize(CryptoEncryption::Encrypt, &key, &iv) ||
+		    !opener->initialize(CryptoEncryption::Decrypt, &key, &iv))
+			HALT(log_) << "Could not initialize cipher.";
+		client_session_.active_algorithms_.local_to_remote_->encryption_ = sealer;
+		server_session_.active_algorithms_.remote_to_local_->encryption_ = opener;
+
+		client_ = new SSH::TransportPipe(&client_session_);
+		server_ = new SSH::TransportPipe(&server_session_);
+		if (limit != 0)
+			client_->set_coalescing(limit, SSH_COALESCE_SPEED_DELAY);
+
+		EventCallback *ocb = callback(this, &CoalesceSpeed::output_complete);
+		output_action_ = ((Pipe *)client_)->output(ocb);
+
+		EventCallback *rcb = callback(this, &CoalesceSpeed::receive_complete);
+		receive_action_ = server_->receive(rcb);
+
+		/*
+		 * The server's identification string is all the client
+		 * needs to start sending packets.
+		 */
+		Buffer identification("SSH-2.0-Speed\r\n");
+		EventCallback *icb = callback(this, &CoalesceSpeed::client_input_complete);
+		client_input_action_ = ((Pipe *)client_)->input(&identification, icb);
+	}
+
+	~CoalesceSpeed()
+	{
+		ASSERT(log_, client_input_action_ == NULL);
+		ASSERT(log_, write_action_ == NULL);
+
+		if (output_action_ != NULL) {
+			output_action_->cancel();
+			output_action_ = NULL;
+		}
+
+		if (input_action_ != NULL) {
+			input_action_->cancel();
+			input_action_ = NULL;
+		}
+
+		if (receive_action_ != NULL) {
+			receive_action_->cancel();
+			receive_action_ = NULL;
+		}
+
+		delete client_;
+		client_ = NULL;
+
+		delete server_;
+		server_ = NULL;
+
+		delete client_session_.active_algorithms_.local_to_remote_->encryption_;
+		delete server_session_.active_algorithms_.remote_to_local_->encryption_;
+	}
+
+private:
+	void client_input_complete(Event e)
+	{
+		client_input_action_->cancel();
+		client_input_action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		timer_.start();
+		write();
+	}
+
+	/*
+	 * Send a burst of writes and come back for the next once the event
+	 * loop has had a turn, as data read from a socket would come.
+	 */
+	void write(void)
+	{
+		unsigned i;
+
+		for (i = 0; i < burst_ && written_ < writes_; i++, written_++) {
+			Buffer payload, data;
+
+			while (data.length() < write_size_)
+				data.append((uint8_t)written_);
+
+			payload.append(SSH::Message::ConnectionChannelData);
+			SSH::UInt32::encode(&payload, 0);
+			SSH::String::encode(&payload, &data);
+			client_->send(&payload);
+		}
+
+		if (written_ == writes_)
+			return;
+
+		SimpleCallback *cb = callback(this, &CoalesceSpeed::write_complete);
+		write_action_ = cb->schedule();
+	}
+
+	void write_complete(void)
+	{
+		write_action_->cancel();
+		write_action_ = NULL;
+
+		write();
+	}
+
+	void output_complete(Event e)
+	{
+		output_action_->cancel();
+		output_action_ = NULL;
+
+		if (e.type_ != Event::Done || e.buffer_.empty())
+			HALT(log_) << "Unexpected event: " << e;
+
+		ASSERT(log_, input_action_ == NULL);
+
+		wire_bytes_ += e.buffer_.length();
+
+		EventCallback *icb = callback(this, &CoalesceSpeed::input_complete);
+		input_action_ = ((Pipe *)server_)->input(&e.buffer_, icb);
+	}
+
+	void input_complete(Event e)
+	{
+		input_action_->cancel();
+		input_action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		if (client_ == NULL)
+			return;
+
+		EventCallback *ocb = callback(this, &CoalesceSpeed::output_complete);
+		output_action_ = ((Pipe *)client_)->output(ocb);
+	}
+
+	void receive_complete(Event e)
+	{
+		receive_action_->cancel();
+		receive_action_ = NULL;
+
+		if (e.type_ != Event::Done)
+			HALT(log_) << "Unexpected event: " << e;
+
+		uint32_t data_len;
+		e.buffer_.extract(&data_len, 1 + sizeof (uint32_t));
+		data_len = BigEndian::decode(data_len);
+
+		packets_++;
+		data_bytes_ += data_len;
+
+		if (data_bytes_ < (uintmax_t)writes_ * write_size_) {
+			EventCallback *rcb = callback(this, &CoalesceSpeed::receive_complete);
+			receive_action_ = server_->receive(rcb);
+			return;
+		}
+
+		timer_.stop();
+		report();
+		EventSystem::instance()->stop();
+	}
+
+	void report(void)
+	{
+		uintmax_t microseconds = timer_.sample();
+
+		/* The client's identification string doesn't count.  */
+		wire_bytes_ -= client_session_.client_version_.length() + 2;
+
+		INFO(log_) << writes_ << " writes of " << write_size_ << " bytes, " << burst_ << " per turn.";
+		INFO(log_) << packets_ << " packets, " << wire_bytes_ << " bytes on the wire, " << ((float)wire_bytes_ / data_bytes_) << " per byte of data.";
+		INFO(log_) << microseconds << " microseconds, " << ((float)data_bytes_ / (microseconds == 0 ? 1 : microseconds)) << " MB/s.";
+	}
+};
+
+static void usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	unsigned writes, write_size, burst;
+	size_t limit;
+	int ch;
+
+	writes = 100000;
+	write_size = 64;
+	burst = 16;
+	limit = 0;
+
+	while ((ch = getopt(argc, argv, "?b:c:n:s:")) != -1) {
+		switch (ch) {
+		case 'b':
+			burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			limit = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			writes = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			write_size = strtoul(optarg, NULL, 0);
+			break;
+		case '?':
+		default:
+			usage();
+		}
+	}
+
+	if (writes == 0 || write_size == 0 || burst == 0)
+		usage();
+	if (limit > SSH_CONNECTION_PACKET_SIZE)
+		usage();
+
+	CoalesceSpeed speed(writes, write_size, burst, limit);
+	event_main();
+}
+
+static void
+usage(void)
+{
+	INFO("/example/ssh/coalesce/speed1") << "usage: ssh-coalesce-speed1 [-b writes-per-turn] [-c coalesce-limit] [-n writes] [-s write-size]";
+	exit(1);
+}
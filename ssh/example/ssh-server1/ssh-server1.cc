@@ -43,6 +43,12 @@
 #include <ssh/ssh_session.h>
 #include <ssh/ssh_transport_pipe.h>
 
+/*
+ * How long to hold echoed channel data back for more to merge with it, in
+ * milliseconds.
+ */
+#define	SSH_SERVER1_COALESCE_DELAY	(5)
+
 /*
  * XXX Create an SSH chat program.  Let only one of each user be connected at a time.  Send lines of data to all others.
  */
@@ -146,6 +152,7 @@ private:
 		Buffer service;
 		Buffer type;
 		Buffer msg;
+		Buffer data;
 		SSHChannel *channel;
 		uint32_t recipient_channel, sender_channel, window_size, packet_size;
 		bool want_reply;
@@ -224,6 +231,14 @@ private:
 			recipient_channel = sender_channel;
 			sender_channel = channel_setup(recipient_channel, window_size, packet_size);
 
+			/*
+			 * Merge echoed data into packets as large as the client
+			 * will take.
+			 * XXX Assumes one channel, or that all channels share a
+			 *     packet size.
+			 */
+			pipe_->set_coalescing(packet_size, SSH_SERVER1_COALESCE_DELAY);
+
 			/* Set up session.  */
 			msg.append(SSH::Message::ConnectionChannelOpenConfirmation);
 			SSH::UInt32::encode(&msg, recipient_channel);
@@ -328,8 +343,31 @@ private:
 			break;
 		case SSH::Message::ConnectionChannelWindowAdjust:
 			/* Follow our peer's lead on window adjustments.  */
+			break;
 		case SSH::Message::ConnectionChannelData:
-			/* For now, just ignore data.  Will pass to something shell-like eventually.  */
+			/* For now, just echo data.  Will pass to something shell-like eventually.  */
+			e.buffer_.skip(1);
+			if (!SSH::UInt32::decode(&recipient_channel, &e.buffer_)) {
+				ERROR(log_) << "Could not decode recipient channel.";
+				return;
+			}
+			if (!SSH::String::decode(&msg, &e.buffer_)) {
+				ERROR(log_) << "Could not decode channel data.";
+				return;
+			}
+
+			chit = channel_map_.find(recipient_channel);
+			if (chit == channel_map_.end() ||
+			    chit->second->mode_ != SSHChannel::ShellMode) {
+				msg.clear();
+				break;
+			}
+			channel = chit->second;
+
+			data.append(SSH::Message::ConnectionChannelData);
+			SSH::UInt32::encode(&data, channel->remote_channel_);
+			SSH::String::encode(&data, &msg);
+			pipe_->send(&data);
 			break;
 		default:
 			DEBUG(log_) << "Unhandled message:" << std::endl << e.buffer_.hexdump();
@@ -428,6 +466,8 @@ public:
 int
 main(void)
 {
-	new SSHServer(SocketAddressFamilyIP, "[::]:2299");
+	SSHServer *server = new SSHServer(SocketAddressFamilyIP, "[::]:2299");
+	if (!server->listening())
+		HALT("/ssh/server") << "Could not listen.";
 	event_main();
 }
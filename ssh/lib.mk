@@ -1,6 +1,7 @@
 VPATH+=	${TOPDIR}/ssh
 
 SRCS+=	ssh_algorithm_negotiation.cc
+SRCS+=	ssh_connection.cc
 SRCS+=	ssh_transport_pipe.cc
 SRCS+=	ssh_protocol.cc
 SRCS+=	ssh_session.cc
@@ -0,0 +1,894 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/buffer.h>
+#include <common/endian.h>
+
+#include <event/event_callback.h>
+
+#include <ssh/ssh_connection.h>
+#include <ssh/ssh_protocol.h>
+#include <ssh/ssh_transport.h>
+
+namespace {
+	static const uint32_t
+		ChannelOpenAdministrativelyProhibited = 1,
+		ChannelOpenUnknownChannelType = 3;
+}
+
+SSH::Channel::Channel(Connection *connection)
+: log_(connection->log_ + "/channel"),
+  connection_(connection),
+  local_channel_(0),
+  remote_channel_(0),
+  open_(false),
+  failed_(false),
+  eof_(false),
+  eof_pending_(false),
+  eof_sent_(false),
+  close_sent_(false),
+  close_received_(false),
+  local_window_(SSH_CONNECTION_WINDOW_SIZE),
+  local_consumed_(0),
+  remote_window_(0),
+  remote_packet_size_(0),
+  input_buffer_(),
+  output_buffer_(),
+  read_callback_(NULL),
+  read_action_(NULL),
+  write_callback_(NULL),
+  write_action_(NULL)
+{ }
+
+SSH::Channel::~Channel()
+{
+	if (connection_ != NULL) {
+		connection_->close(this);
+		connection_ = NULL;
+	}
+
+	ASSERT(log_, read_callback_ == NULL);
+	ASSERT(log_, read_action_ == NULL);
+	ASSERT(log_, write_callback_ == NULL);
+	ASSERT(log_, write_action_ == NULL);
+}
+
+/*
+ * Anything not yet sent is abandoned; use shutdown first to be sure that
+ * everything written reaches our peer.
+ */
+Action *
+SSH::Channel::close(SimpleCallback *cb)
+{
+	ASSERT(log_, read_callback_ == NULL);
+	ASSERT(log_, read_action_ == NULL);
+	ASSERT(log_, write_callback_ == NULL);
+	ASSERT(log_, write_action_ == NULL);
+
+	failed_ = true;
+	input_buffer_.clear();
+	output_buffer_.clear();
+
+	if (connection_ != NULL) {
+		connection_->close(this);
+		connection_ = NULL;
+	}
+
+	return (cb->schedule());
+}
+
+Action *
+SSH::Channel::read(size_t amt, EventCallback *cb)
+{
+	ASSERT(log_, read_callback_ == NULL);
+	ASSERT(log_, read_action_ == NULL);
+
+	/* XXX Reads of a given amount are not supported.  */
+	if (amt != 0) {
+		cb->param(Event::Error);
+		return (cb->schedule());
+	}
+
+	read_callback_ = cb;
+	read_do();
+
+	if (read_callback_ != NULL)
+		return (cancellation(this, &SSH::Channel::read_cancel));
+
+	ASSERT(log_, read_action_ != NULL);
+	Action *a = read_action_;
+	read_action_ = NULL;
+	return (a);
+}
+
+/*
+ * Writes complete once our peer's window has let all of the data be sent,
+ * so that a slow reader at the far end holds back the writer here.
+ */
+Action *
+SSH::Channel::write(Buffer *buf, EventCallback *cb)
+{
+	ASSERT(log_, write_callback_ == NULL);
+	ASSERT(log_, write_action_ == NULL);
+
+	if (eof_pending_) {
+		ERROR(log_) << "Write after shutdown.";
+		buf->clear();
+		cb->param(Event::Error);
+		return (cb->schedule());
+	}
+
+	buf->moveout(&output_buffer_);
+
+	write_callback_ = cb;
+	write_do();
+
+	if (write_callback_ != NULL)
+		return (cancellation(this, &SSH::Channel::write_cancel));
+
+	ASSERT(log_, write_action_ != NULL);
+	Action *a = write_action_;
+	write_action_ = NULL;
+	return (a);
+}
+
+/*
+ * Shutting down writes completes once everything written has been sent,
+ * followed by end of file.
+ */
+Action *
+SSH::Channel::shutdown(bool shut_read, bool shut_write, EventCallback *cb)
+{
+	ASSERT(log_, write_callback_ == NULL);
+	ASSERT(log_, write_action_ == NULL);
+
+	if (shut_read)
+		input_buffer_.clear();
+
+	if (!shut_write) {
+		cb->param(Event::Done);
+		return (cb->schedule());
+	}
+
+	eof_pending_ = true;
+
+	write_callback_ = cb;
+	write_do();
+
+	if (write_callback_ != NULL)
+		return (cancellation(this, &SSH::Channel::write_cancel));
+
+	ASSERT(log_, write_action_ != NULL);
+	Action *a = write_action_;
+	write_action_ = NULL;
+	return (a);
+}
+
+void
+SSH::Channel::opened(uint32_t remote_channel, uint32_t window_size, uint32_t packet_size)
+{
+	ASSERT(log_, !open_);
+
+	open_ = true;
+	remote_channel_ = remote_channel;
+	remote_window_ = window_size;
+	remote_packet_size_ = packet_size;
+
+	write_do();
+}
+
+void
+SSH::Channel::fail(void)
+{
+	failed_ = true;
+
+	read_do();
+	write_do();
+}
+
+void
+SSH::Channel::detach(void)
+{
+	connection_ = NULL;
+	fail();
+}
+
+/*
+ * Take data from our peer, which must fit in the window we have given it.
+ * Extended data is counted against the window, but we have nowhere to put
+ * it.
+ */
+bool
+SSH::Channel::data(Buffer *buf, bool extended)
+{
+	if (buf->length() > local_window_)
+		return (false);
+	local_window_ -= buf->length();
+
+	if (extended || eof_ || failed_) {
+		consume(buf->length());
+		buf->clear();
+		return (true);
+	}
+
+	buf->moveout(&input_buffer_);
+	read_do();
+
+	return (true);
+}
+
+/*
+ * Once half of the window has been read, give it back, so that our peer
+ * can keep sending while the rest is read.
+ */
+void
+SSH::Channel::consume(size_t amt)
+{
+	local_consumed_ += amt;
+	if (local_consumed_ < SSH_CONNECTION_WINDOW_SIZE / 2)
+		return;
+
+	if (connection_ == NULL || failed_ || eof_)
+		return;
+
+	Buffer msg;
+	msg.append(SSH::Message::ConnectionChannelWindowAdjust);
+	SSH::UInt32::encode(&msg, remote_channel_);
+	SSH::UInt32::encode(&msg, local_consumed_);
+	connection_->send(&msg);
+
+	local_window_ += local_consumed_;
+	local_consumed_ = 0;
+}
+
+void
+SSH::Channel::end_of_file(void)
+{
+	eof_ = true;
+	read_do();
+}
+
+void
+SSH::Channel::window_adjust(uint32_t amt)
+{
+	if (remote_window_ + amt < remote_window_)
+		remote_window_ = 0xffffffff;
+	else
+		remote_window_ += amt;
+
+	write_do();
+}
+
+void
+SSH::Channel::read_cancel(void)
+{
+	if (read_action_ != NULL) {
+		read_action_->cancel();
+		read_action_ = NULL;
+	}
+
+	if (read_callback_ != NULL) {
+		delete read_callback_;
+		read_callback_ = NULL;
+	}
+}
+
+void
+SSH::Channel::read_do(void)
+{
+	if (read_callback_ == NULL)
+		return;
+
+	if (!input_buffer_.empty()) {
+		size_t amt = input_buffer_.length();
+
+		read_callback_->param(Event(Event::Done, input_buffer_));
+		input_buffer_.clear();
+
+		consume(amt);
+	} else if (eof_ || close_received_) {
+		read_callback_->param(Event::EOS);
+	} else if (failed_) {
+		read_callback_->param(Event::Error);
+	} else {
+		return;
+	}
+
+	read_action_ = read_callback_->schedule();
+	read_callback_ = NULL;
+}
+
+void
+SSH::Channel::write_cancel(void)
+{
+	if (write_action_ != NULL) {
+		write_action_->cancel();
+		write_action_ = NULL;
+	}
+
+	if (write_callback_ != NULL) {
+		delete write_callback_;
+		write_callback_ = NULL;
+	}
+}
+
+/*
+ * Send as much as our peer's window allows, in packets no larger than it
+ * will take, and end of file once everything has gone.
+ */
+void
+SSH::Channel::write_do(void)
+{
+	if (failed_) {
+		output_buffer_.clear();
+
+		if (write_callback_ != NULL) {
+			write_callback_->param(Event::Error);
+			write_action_ = write_callback_->schedule();
+			write_callback_ = NULL;
+		}
+		return;
+	}
+
+	if (!open_)
+		return;
+
+	while (!output_buffer_.empty() && remote_window_ != 0 &&
+	       remote_packet_size_ != 0) {
+		size_t amt = output_buffer_.length();
+		if (amt > remote_window_)
+			amt = remote_window_;
+		if (amt > remote_packet_size_)
+			amt = remote_packet_size_;
+
+		Buffer data;
+		output_buffer_.moveout(&data, amt);
+
+		Buffer msg;
+		msg.append(SSH::Message::ConnectionChannelData);
+		SSH::UInt32::encode(&msg, remote_channel_);
+		SSH::String::encode(&msg, &data);
+		connection_->send(&msg);
+
+		remote_window_ -= amt;
+	}
+
+	if (!output_buffer_.empty())
+		return;
+
+	if (eof_pending_ && !eof_sent_) {
+		Buffer msg;
+		msg.append(SSH::Message::ConnectionChannelEndOfFile);
+		SSH::UInt32::encode(&msg, remote_channel_);
+		connection_->send(&msg);
+
+		eof_sent_ = true;
+	}
+
+	if (write_callback_ != NULL) {
+		write_callback_->param(Event::Done);
+		write_action_ = write_callback_->schedule();
+		write_callback_ = NULL;
+	}
+}
+
+SSH::Connection::Connection(const LogHandle& log, Transport *pipe, const std::string& type)
+: log_(log + "/connection"),
+  pipe_(pipe),
+  type_(type),
+  ready_(false),
+  ready_action_(NULL),
+  send_queue_(),
+  receive_action_(NULL),
+  channel_next_(0),
+  channel_map_(),
+  accepting_(false),
+  accept_queue_(),
+  accept_callback_(NULL),
+  accept_action_(NULL)
+{
+	SimpleCallback *cb = callback(this, &SSH::Connection::ready_complete);
+	ready_action_ = pipe_->ready(cb);
+
+	EventCallback *rcb = callback(this, &SSH::Connection::receive_complete);
+	receive_action_ = pipe_->receive(rcb);
+}
+
+/*
+ * Every channel still in use fails, and is left to its owner to close.
+ */
+SSH::Connection::~Connection()
+{
+	if (ready_action_ != NULL) {
+		ready_action_->cancel();
+		ready_action_ = NULL;
+	}
+
+	if (receive_action_ != NULL) {
+		receive_action_->cancel();
+		receive_action_ = NULL;
+	}
+
+	accept_cancel();
+
+	std::map<uint32_t, Channel *>::iterator it;
+	for (it = channel_map_.begin(); it != channel_map_.end(); ++it) {
+		if (it->second != NULL)
+			it->second->detach();
+	}
+	channel_map_.clear();
+
+	while (!accept_queue_.empty()) {
+		delete accept_queue_.front();
+		accept_queue_.pop_front();
+	}
+}
+
+/*
+ * The channel may be written to at once; data is held until our peer
+ * confirms it.  If our peer refuses it, the channel fails.
+ */
+SSH::Channel *
+SSH::Connection::open(void)
+{
+	Channel *channel = new Channel(this);
+	allocate(channel);
+
+	Buffer msg;
+	msg.append(SSH::Message::ConnectionChannelOpen);
+	SSH::String::encode(&msg, Buffer(type_));
+	SSH::UInt32::encode(&msg, channel->local_channel_);
+	SSH::UInt32::encode(&msg, SSH_CONNECTION_WINDOW_SIZE);
+	SSH::UInt32::encode(&msg, SSH_CONNECTION_PACKET_SIZE);
+	send(&msg);
+
+	return (channel);
+}
+
+/*
+ * Start taking channels our peer opens, to be handed out by accept.
+ */
+void
+SSH::Connection::listen(void)
+{
+	accepting_ = true;
+}
+
+Action *
+SSH::Connection::accept(ChannelCallback *cb)
+{
+	ASSERT(log_, accepting_);
+	ASSERT(log_, accept_callback_ == NULL);
+	ASSERT(log_, accept_action_ == NULL);
+
+	accept_callback_ = cb;
+	accept_do();
+
+	if (accept_callback_ != NULL)
+		return (cancellation(this, &SSH::Connection::accept_cancel));
+
+	ASSERT(log_, accept_action_ != NULL);
+	Action *a = accept_action_;
+	accept_action_ = NULL;
+	return (a);
+}
+
+void
+SSH::Connection::allocate(Channel *channel)
+{
+	while (channel_map_.find(channel_next_) != channel_map_.end())
+		channel_next_++;
+
+	channel->local_channel_ = channel_next_++;
+	channel_map_[channel->local_channel_] = channel;
+}
+
+/*
+ * The channel's number stays in use until our peer has closed it too.
+ */
+void
+SSH::Connection::close(Channel *channel)
+{
+	if (channel->open_ && !channel->close_sent_) {
+		Buffer msg;
+		msg.append(SSH::Message::ConnectionChannelClose);
+		SSH::UInt32::encode(&msg, channel->remote_channel_);
+		send(&msg);
+
+		channel->close_sent_ = true;
+	}
+
+	std::map<uint32_t, Channel *>::iterator it;
+	it = channel_map_.find(channel->local_channel_);
+	if (it == channel_map_.end() || it->second != channel)
+		return;
+
+	if (channel->close_received_)
+		channel_map_.erase(it);
+	else
+		it->second = NULL;
+}
+
+/*
+ * Nothing may be sent until keys have been exchanged.
+ */
+void
+SSH::Connection::send(Buffer *msg)
+{
+	if (!ready_) {
+		send_queue_.push_back(*msg);
+		msg->clear();
+		return;
+	}
+
+	pipe_->send(msg);
+}
+
+void
+SSH::Connection::ready_complete(void)
+{
+	ready_action_->cancel();
+	ready_action_ = NULL;
+
+	ready_ = true;
+
+	while (!send_queue_.empty()) {
+		pipe_->send(&send_queue_.front());
+		send_queue_.pop_front();
+	}
+}
+
+void
+SSH::Connection::receive_complete(Event e)
+{
+	receive_action_->cancel();
+	receive_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Unexpected event while waiting for a packet: " << e;
+		return;
+	}
+
+	ASSERT(log_, !e.buffer_.empty());
+
+	uint8_t msg = e.buffer_.pop();
+	bool ok;
+	switch (msg) {
+	case SSH::Message::ConnectionChannelOpen:
+		ok = receive_channel_open(&e.buffer_);
+		break;
+	case SSH::Message::ConnectionChannelOpenConfirmation:
+		ok = receive_channel_open_confirmation(&e.buffer_);
+		break;
+	case SSH::Message::ConnectionChannelOpenFailure:
+		ok = receive_channel_open_failure(&e.buffer_);
+		break;
+	case SSH::Message::ConnectionChannelWindowAdjust:
+	case SSH::Message::ConnectionChannelData:
+	case SSH::Message::ConnectionChannelExtendedData:
+	case SSH::Message::ConnectionChannelEndOfFile:
+	case SSH::Message::ConnectionChannelClose:
+		ok = receive_channel_message(msg, &e.buffer_);
+		break;
+	case SSH::Message::ConnectionProtocolGlobalRequestMessage:
+	case SSH::Message::ConnectionChannelRequest:
+		ok = receive_request(msg, &e.buffer_);
+		break;
+	default:
+		DEBUG(log_) << "Ignoring message " << (unsigned)msg << ".";
+		ok = true;
+		break;
+	}
+
+	/* XXX Should disconnect.  */
+	if (!ok)
+		ERROR(log_) << "Could not decode message " << (unsigned)msg << ".";
+
+	EventCallback *rcb = callback(this, &SSH::Connection::receive_complete);
+	receive_action_ = pipe_->receive(rcb);
+}
+
+bool
+SSH::Connection::receive_channel_open(Buffer *in)
+{
+	Buffer type;
+	uint32_t sender_channel, window_size, packet_size;
+
+	if (!SSH::String::decode(&type, in))
+		return (false);
+	if (!SSH::UInt32::decode(&sender_channel, in))
+		return (false);
+	if (!SSH::UInt32::decode(&window_size, in))
+		return (false);
+	if (!SSH::UInt32::decode(&packet_size, in))
+		return (false);
+
+	uint32_t reason;
+	if (!type.equal(type_)) {
+		reason = ChannelOpenUnknownChannelType;
+	} else if (!accepting_ || packet_size == 0) {
+		reason = ChannelOpenAdministrativelyProhibited;
+	} else {
+		Channel *channel = new Channel(this);
+		allocate(channel);
+
+		Buffer msg;
+		msg.append(SSH::Message::ConnectionChannelOpenConfirmation);
+		SSH::UInt32::encode(&msg, sender_channel);
+		SSH::UInt32::encode(&msg, channel->local_channel_);
+		SSH::UInt32::encode(&msg, SSH_CONNECTION_WINDOW_SIZE);
+		SSH::UInt32::encode(&msg, SSH_CONNECTION_PACKET_SIZE);
+		send(&msg);
+
+		channel->opened(sender_channel, window_size, packet_size);
+
+		accept_queue_.push_back(channel);
+		accept_do();
+		return (true);
+	}
+
+	INFO(log_) << "Refusing channel open request.";
+
+	Buffer msg;
+	msg.append(SSH::Message::ConnectionChannelOpenFailure);
+	SSH::UInt32::encode(&msg, sender_channel);
+	SSH::UInt32::encode(&msg, reason);
+	SSH::String::encode(&msg, Buffer("Channel type not supported."));
+	SSH::String::encode(&msg, Buffer("en-CA"));
+	send(&msg);
+
+	return (true);
+}
+
+bool
+SSH::Connection::receive_channel_open_confirmation(Buffer *in)
+{
+	uint32_t recipient_channel, sender_channel, window_size, packet_size;
+
+	if (!SSH::UInt32::decode(&recipient_channel, in))
+		return (false);
+	if (!SSH::UInt32::decode(&sender_channel, in))
+		return (false);
+	if (!SSH::UInt32::decode(&window_size, in))
+		return (false);
+	if (!SSH::UInt32::decode(&packet_size, in))
+		return (false);
+
+	std::map<uint32_t, Channel *>::iterator it;
+	it = channel_map_.find(recipient_channel);
+	if (it == channel_map_.end()) {
+		ERROR(log_) << "Confirmation of unknown channel.";
+		return (false);
+	}
+
+	Channel *channel = it->second;
+
+	/*
+	 * Closed while waiting for our peer; close its end too.
+	 */
+	if (channel == NULL) {
+		Buffer msg;
+		msg.append(SSH::Message::ConnectionChannelClose);
+		SSH::UInt32::encode(&msg, sender_channel);
+		send(&msg);
+		return (true);
+	}
+
+	if (channel->open_) {
+		ERROR(log_) << "Confirmation of channel which is already open.";
+		return (false);
+	}
+
+	channel->opened(sender_channel, window_size, packet_size);
+
+	if (packet_size == 0) {
+		ERROR(log_) << "Peer will not take any channel data.";
+		channel->fail();
+		close(channel);
+	}
+
+	return (true);
+}
+
+bool
+SSH::Connection::receive_channel_open_failure(Buffer *in)
+{
+	uint32_t recipient_channel, reason;
+	Buffer description;
+
+	if (!SSH::UInt32::decode(&recipient_channel, in))
+		return (false);
+	if (!SSH::UInt32::decode(&reason, in))
+		return (false);
+	if (!SSH::String::decode(&description, in))
+		return (false);
+
+	std::map<uint32_t, Channel *>::iterator it;
+	it = channel_map_.find(recipient_channel);
+	if (it == channel_map_.end()) {
+		ERROR(log_) << "Failure to open unknown channel.";
+		return (false);
+	}
+
+	Channel *channel = it->second;
+	channel_map_.erase(it);
+
+	if (channel == NULL)
+		return (true);
+
+	if (channel->open_) {
+		ERROR(log_) << "Failure to open channel which is already open.";
+		return (false);
+	}
+
+	std::string text;
+	description.extract(text);
+	ERROR(log_) << "Peer refused channel (reason " << reason << "): " << text;
+
+	channel->close_received_ = true;
+	channel->fail();
+
+	return (true);
+}
+
+bool
+SSH::Connection::receive_channel_message(uint8_t msg, Buffer *in)
+{
+	uint32_t recipient_channel;
+
+	if (!SSH::UInt32::decode(&recipient_channel, in))
+		return (false);
+
+	std::map<uint32_t, Channel *>::iterator it;
+	it = channel_map_.find(recipient_channel);
+	if (it == channel_map_.end()) {
+		ERROR(log_) << "Message for unknown channel.";
+		return (false);
+	}
+
+	Channel *channel = it->second;
+
+	if (msg == SSH::Message::ConnectionChannelClose) {
+		channel_map_.erase(it);
+
+		if (channel != NULL) {
+			channel->close_received_ = true;
+			channel->fail();
+		}
+		return (true);
+	}
+
+	/*
+	 * We have closed the channel, and our peer has yet to see that.
+	 */
+	if (channel == NULL)
+		return (true);
+
+	if (!channel->open_) {
+		ERROR(log_) << "Message for channel which is not yet open.";
+		return (false);
+	}
+
+	uint32_t amt, code;
+	Buffer data;
+	switch (msg) {
+	case SSH::Message::ConnectionChannelWindowAdjust:
+		if (!SSH::UInt32::decode(&amt, in))
+			return (false);
+		channel->window_adjust(amt);
+		break;
+	case SSH::Message::ConnectionChannelData:
+	case SSH::Message::ConnectionChannelExtendedData:
+		if (msg == SSH::Message::ConnectionChannelExtendedData &&
+		    !SSH::UInt32::decode(&code, in))
+			return (false);
+		if (!SSH::String::decode(&data, in))
+			return (false);
+		if (!channel->data(&data, msg == SSH::Message::ConnectionChannelExtendedData)) {
+			ERROR(log_) << "Peer sent more data than the window allows.";
+			channel->fail();
+			close(channel);
+		}
+		break;
+	case SSH::Message::ConnectionChannelEndOfFile:
+		channel->end_of_file();
+		break;
+	default:
+		NOTREACHED(log_);
+	}
+
+	return (true);
+}
+
+/*
+ * We make no requests, and grant none.
+ */
+bool
+SSH::Connection::receive_request(uint8_t msg, Buffer *in)
+{
+	uint32_t recipient_channel;
+	Buffer type;
+
+	if (msg == SSH::Message::ConnectionChannelRequest &&
+	    !SSH::UInt32::decode(&recipient_channel, in))
+		return (false);
+	if (!SSH::String::decode(&type, in))
+		return (false);
+	if (in->empty())
+		return (false);
+	bool want_reply = in->pop();
+
+	DEBUG(log_) << "Refusing request:" << std::endl << type.hexdump();
+
+	if (!want_reply)
+		return (true);
+
+	Buffer reply;
+	if (msg == SSH::Message::ConnectionChannelRequest) {
+		std::map<uint32_t, Channel *>::const_iterator it;
+		it = channel_map_.find(recipient_channel);
+		if (it == channel_map_.end() || it->second == NULL ||
+		    !it->second->open_)
+			return (true);
+
+		reply.append(SSH::Message::ConnectionChannelRequestFailure);
+		SSH::UInt32::encode(&reply, it->second->remote_channel_);
+	} else {
+		reply.append(SSH::Message::ConnectionProtocolGlobalRequestFailureMessage);
+	}
+	send(&reply);
+
+	return (true);
+}
+
+void
+SSH::Connection::accept_cancel(void)
+{
+	if (accept_action_ != NULL) {
+		accept_action_->cancel();
+		accept_action_ = NULL;
+	}
+
+	if (accept_callback_ != NULL) {
+		delete accept_callback_;
+		accept_callback_ = NULL;
+	}
+}
+
+void
+SSH::Connection::accept_do(void)
+{
+	if (accept_callback_ == NULL || accept_queue_.empty())
+		return;
+
+	accept_callback_->param(accept_queue_.front());
+	accept_queue_.pop_front();
+
+	accept_action_ = accept_callback_->schedule();
+	accept_callback_ = NULL;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	SSH_SSH_CONNECTION_H
+#define	SSH_SSH_CONNECTION_H
+
+#include <deque>
+#include <map>
+
+#include <io/channel.h>
+
+/*
+ * How much data we let our peer send on a channel before it has to wait for
+ * us to read some of it.  This bounds what one channel can have buffered
+ * here, and so must cover the bandwidth-delay product of the link if a
+ * single channel is to keep it full.
+ */
+#define	SSH_CONNECTION_WINDOW_SIZE	(2 * 1024 * 1024)
+
+/*
+ * The most channel data we take in a single packet.
+ */
+#define	SSH_CONNECTION_PACKET_SIZE	(32768)
+
+namespace SSH {
+	class Channel;
+	class Connection;
+	class Transport;
+
+	typedef class TypedCallback<Channel *> ChannelCallback;
+
+	/*
+	 * A channel of the connection protocol, RFC 4254, carrying one stream
+	 * of data in each direction.  Channels are created by a Connection,
+	 * but belong to whoever opened or accepted them, who must close and
+	 * delete them.  A channel outlives its Connection, failing whatever
+	 * is done with it after the Connection has gone.
+	 */
+	class Channel : public StreamChannel {
+		friend class Connection;
+
+		LogHandle log_;
+		Connection *connection_;
+		uint32_t local_channel_;
+		uint32_t remote_channel_;
+
+		bool open_;		/* Our peer has confirmed the channel.  */
+		bool failed_;		/* The channel can carry no more data.  */
+		bool eof_;		/* Our peer will send no more data.  */
+		bool eof_pending_;	/* We will send no more data.  */
+		bool eof_sent_;
+		bool close_sent_;
+		bool close_received_;
+
+		uint32_t local_window_;
+		uint32_t local_consumed_;
+		uint32_t remote_window_;
+		uint32_t remote_packet_size_;
+
+		Buffer input_buffer_;
+		Buffer output_buffer_;
+
+		EventCallback *read_callback_;
+		Action *read_action_;
+
+		EventCallback *write_callback_;
+		Action *write_action_;
+
+		Channel(Connection *);
+	public:
+		~Channel();
+
+		Action *close(SimpleCallback *);
+		Action *read(size_t, EventCallback *);
+		Action *write(Buffer *, EventCallback *);
+		Action *shutdown(bool, bool, EventCallback *);
+
+	private:
+		void opened(uint32_t, uint32_t, uint32_t);
+		void fail(void);
+		void detach(void);
+
+		bool data(Buffer *, bool);
+		void consume(size_t);
+		void end_of_file(void);
+		void window_adjust(uint32_t);
+
+		void read_cancel(void);
+		void read_do(void);
+
+		void write_cancel(void);
+		void write_do(void);
+	};
+
+	/*
+	 * The connection protocol, multiplexing any number of channels over a
+	 * single transport.  Channels of one type may be opened to our peer,
+	 * and channels of that type which our peer opens may be accepted;
+	 * channels of other types are refused.
+	 *
+	 * XXX
+	 * There is no authentication; the connection protocol is started as
+	 * soon as keys have been exchanged, so both ends must expect that.
+	 */
+	class Connection {
+		friend class Channel;
+
+		LogHandle log_;
+		Transport *pipe_;
+		std::string type_;
+
+		bool ready_;
+		Action *ready_action_;
+		std::deque<Buffer> send_queue_;
+
+		Action *receive_action_;
+
+		uint32_t channel_next_;
+		std::map<uint32_t, Channel *> channel_map_;
+
+		bool accepting_;
+		std::deque<Channel *> accept_queue_;
+		ChannelCallback *accept_callback_;
+		Action *accept_action_;
+	public:
+		Connection(const LogHandle&, Transport *, const std::string&);
+		~Connection();
+
+		Channel *open(void);
+
+		void listen(void);
+		Action *accept(ChannelCallback *);
+
+		size_t channels(void) const
+		{
+			return (channel_map_.size());
+		}
+
+	private:
+		void allocate(Channel *);
+		void close(Channel *);
+
+		void send(Buffer *);
+
+		void ready_complete(void);
+
+		void receive_complete(Event);
+		bool receive_channel_open(Buffer *);
+		bool receive_channel_open_confirmation(Buffer *);
+		bool receive_channel_open_failure(Buffer *);
+		bool receive_channel_message(uint8_t, Buffer *);
+		bool receive_request(uint8_t, Buffer *);
+
+		void accept_cancel(void);
+		void accept_do(void);
+	};
+}
+
+#endif /* !SSH_SSH_CONNECTION_H */
@@ -24,6 +24,10 @@
  */
 
 #include <common/buffer.h>
+#include <common/endian.h>
+
+#include <crypto/crypto_mac.h>
+#include <crypto/crypto_thread.h>
 
 #include <ssh/ssh_algorithm_negotiation.h>
 #include <ssh/ssh_encryption.h>
@@ -37,6 +41,9 @@ namespace {
 	};
 
 	static const struct ssh_encryption_algorithm ssh_encryption_algorithms[] = {
+		{ "aes128-gcm@openssh.com",	CryptoEncryption::AES128,	CryptoEncryption::GCM	},
+		{ "chacha20-poly1305@openssh.com",	CryptoEncryption::ChaCha20,	CryptoEncryption::Stream},
+		{ "aes256-gcm@openssh.com",	CryptoEncryption::AES256,	CryptoEncryption::GCM	},
 		{ "aes128-ctr",		CryptoEncryption::AES128,	CryptoEncryption::CTR	},
 		{ "aes128-cbc",		CryptoEncryption::AES128,	CryptoEncryption::CBC	},
 		{ "aes192-ctr",		CryptoEncryption::AES192,	CryptoEncryption::CTR	},
@@ -85,6 +92,314 @@ namespace {
 			in->clear();
 			return (true);
 		}
+
+		Action *submit(Buffer *in, EventCallback *cb)
+		{
+			return (session_->submit(in, cb));
+		}
+
+		bool length(uint32_t, const Buffer *, uint32_t *)
+		{
+			NOTREACHED(log_);
+		}
+
+		Action *seal(uint32_t, Buffer *, EventCallback *)
+		{
+			NOTREACHED(log_);
+		}
+
+		Action *open(uint32_t, Buffer *, EventCallback *)
+		{
+			NOTREACHED(log_);
+		}
+	};
+
+	/*
+	 * Runs one of an AEAD cipher's packet methods on a CryptoThread,
+	 * with the nonce it was given when the packet was submitted.
+	 */
+	template<typename T>
+	class PacketOperation : public CryptoThread::Operation {
+		typedef bool (T::*method_t)(Buffer *, const Buffer *, Buffer *);
+
+		T *obj_;
+		method_t method_;
+		Buffer nonce_;
+	public:
+		PacketOperation(T *obj, method_t method, const Buffer& nonce)
+		: obj_(obj),
+		  method_(method),
+		  nonce_(nonce)
+		{ }
+
+		~PacketOperation()
+		{ }
+
+		bool perform(Buffer *out, Buffer *in)
+		{
+			return ((obj_->*method_)(out, &nonce_, in));
+		}
+	};
+
+	/*
+	 * AES-GCM as in RFC 5647, with OpenSSH's names and its rule that the
+	 * negotiated MAC is ignored.  The packet length is sent in the clear
+	 * as additional data, and the nonce is the IV from key exchange with
+	 * its low 64 bits incremented for each packet.
+	 */
+	class CryptoSSHAESGCM : public SSH::Encryption {
+		LogHandle log_;
+		CryptoEncryption::Session *session_;
+		Buffer iv_;
+	public:
+		CryptoSSHAESGCM(const std::string& xname, CryptoEncryption::Session *session)
+		: SSH::Encryption(xname, session->block_size(), session->key_size(), session->iv_size(), session->tag_size()),
+		  log_("/ssh/encryption/crypto/" + xname),
+		  session_(session),
+		  iv_()
+		{ }
+
+		~CryptoSSHAESGCM()
+		{ }
+
+		Encryption *clone(void) const
+		{
+			return (new CryptoSSHAESGCM(name_, session_->clone()));
+		}
+
+		bool initialize(CryptoEncryption::Operation operation, const Buffer *key, const Buffer *iv)
+		{
+			if (iv->length() != iv_size_)
+				return (false);
+			iv_ = *iv;
+			return (session_->initialize(operation, key, iv));
+		}
+
+		bool cipher(Buffer *, Buffer *)
+		{
+			NOTREACHED(log_);
+		}
+
+		Action *submit(Buffer *, EventCallback *)
+		{
+			NOTREACHED(log_);
+		}
+
+		bool length(uint32_t, const Buffer *in, uint32_t *lenp)
+		{
+			BigEndian::extract(lenp, in);
+			return (true);
+		}
+
+		Action *seal(uint32_t, Buffer *in, EventCallback *cb)
+		{
+			return (CryptoThread::submit(this, new PacketOperation<CryptoSSHAESGCM>(this, &CryptoSSHAESGCM::seal_packet, nonce()), in, cb));
+		}
+
+		Action *open(uint32_t, Buffer *in, EventCallback *cb)
+		{
+			return (CryptoThread::submit(this, new PacketOperation<CryptoSSHAESGCM>(this, &CryptoSSHAESGCM::open_packet, nonce()), in, cb));
+		}
+
+	private:
+		Buffer nonce(void)
+		{
+			Buffer nonce(iv_);
+			uint32_t fixed;
+			uint64_t counter;
+
+			BigEndian::extract(&fixed, &iv_);
+			iv_.skip(sizeof fixed);
+			BigEndian::extract(&counter, &iv_);
+			iv_.clear();
+
+			BigEndian::append(&iv_, fixed);
+			BigEndian::append(&iv_, counter + 1);
+
+			return (nonce);
+		}
+
+		bool seal_packet(Buffer *out, const Buffer *nonce, Buffer *in)
+		{
+			Buffer aad;
+			in->moveout(&aad, sizeof (uint32_t));
+
+			out->append(aad);
+			return (session_->seal(out, nonce, &aad, in));
+		}
+
+		bool open_packet(Buffer *out, const Buffer *nonce, Buffer *in)
+		{
+			Buffer aad;
+			in->moveout(&aad, sizeof (uint32_t));
+
+			return (session_->open(out, nonce, &aad, in));
+		}
+	};
+
+	/*
+	 * OpenSSH's chacha20-poly1305@openssh.com.  The 64-byte key is split
+	 * into a key for the payload and one for the packet length, and the
+	 * packet sequence number is the nonce for both.  The first block of
+	 * the payload keystream keys Poly1305, which authenticates the
+	 * encrypted length and payload together.
+	 *
+	 * The length is decrypted on the EventThread as packets arrive, and
+	 * only ever for received packets, so open_packet() never touches
+	 * header_ and the two can run concurrently.
+	 */
+	class CryptoSSHChaCha20Poly1305 : public SSH::Encryption {
+		LogHandle log_;
+		CryptoEncryption::Session *main_;
+		CryptoEncryption::Session *header_;
+		CryptoMAC::Instance *poly1305_;
+		CryptoEncryption::Operation operation_;
+		Buffer main_key_;
+		Buffer header_key_;
+	public:
+		CryptoSSHChaCha20Poly1305(const std::string& xname, CryptoEncryption::Session *main, CryptoEncryption::Session *header, CryptoMAC::Instance *poly1305)
+		: SSH::Encryption(xname, 8, 64, 0, poly1305->size()),
+		  log_("/ssh/encryption/crypto/" + xname),
+		  main_(main),
+		  header_(header),
+		  poly1305_(poly1305),
+		  operation_(CryptoEncryption::Encrypt),
+		  main_key_(),
+		  header_key_()
+		{ }
+
+		~CryptoSSHChaCha20Poly1305()
+		{ }
+
+		Encryption *clone(void) const
+		{
+			return (new CryptoSSHChaCha20Poly1305(name_, main_->clone(), header_->clone(), poly1305_->clone()));
+		}
+
+		bool initialize(CryptoEncryption::Operation operation, const Buffer *key, const Buffer *)
+		{
+			if (key->length() != key_size_)
+				return (false);
+			operation_ = operation;
+			main_key_ = Buffer(*key, key_size_ / 2);
+			header_key_ = *key;
+			header_key_.skip(key_size_ / 2);
+			return (true);
+		}
+
+		bool cipher(Buffer *, Buffer *)
+		{
+			NOTREACHED(log_);
+		}
+
+		Action *submit(Buffer *, EventCallback *)
+		{
+			NOTREACHED(log_);
+		}
+
+		bool length(uint32_t sequence_number, const Buffer *in, uint32_t *lenp)
+		{
+			ASSERT(log_, operation_ == CryptoEncryption::Decrypt);
+
+			Buffer ciphertext(*in, sizeof *lenp);
+			Buffer plaintext;
+			if (!keystream(header_, &header_key_, nonce(sequence_number), 0, &plaintext, &ciphertext))
+				return (false);
+			BigEndian::extract(lenp, &plaintext);
+			return (true);
+		}
+
+		Action *seal(uint32_t sequence_number, Buffer *in, EventCallback *cb)
+		{
+			ASSERT(log_, operation_ == CryptoEncryption::Encrypt);
+			return (CryptoThread::submit(this, new PacketOperation<CryptoSSHChaCha20Poly1305>(this, &CryptoSSHChaCha20Poly1305::seal_packet, nonce(sequence_number)), in, cb));
+		}
+
+		Action *open(uint32_t sequence_number, Buffer *in, EventCallback *cb)
+		{
+			ASSERT(log_, operation_ == CryptoEncryption::Decrypt);
+			return (CryptoThread::submit(this, new PacketOperation<CryptoSSHChaCha20Poly1305>(this, &CryptoSSHChaCha20Poly1305::open_packet, nonce(sequence_number)), in, cb));
+		}
+
+	private:
+		static Buffer nonce(uint32_t sequence_number)
+		{
+			Buffer nonce;
+			BigEndian::append(&nonce, (uint64_t)sequence_number);
+			return (nonce);
+		}
+
+		/*
+		 * OpenSSL's ChaCha20 takes a 32-bit little-endian block counter
+		 * followed by a 96-bit nonce; the high half of OpenSSH's 64-bit
+		 * counter is always zero, so it is the start of the nonce.
+		 */
+		bool keystream(CryptoEncryption::Session *session, const Buffer *key, const Buffer& nonce, uint32_t counter, Buffer *out, Buffer *in)
+		{
+			Buffer iv;
+			LittleEndian::append(&iv, counter);
+			LittleEndian::append(&iv, (uint32_t)0);
+			iv.append(nonce);
+
+			if (!session->initialize(operation_, key, &iv))
+				return (false);
+			return (session->cipher(out, in));
+		}
+
+		bool poly1305_key(const Buffer *nonce)
+		{
+			static const uint8_t zero[32] = { 0 };
+			Buffer block(zero, sizeof zero);
+			Buffer key;
+
+			if (!keystream(main_, &main_key_, *nonce, 0, &key, &block))
+				return (false);
+			return (poly1305_->initialize(&key));
+		}
+
+		bool seal_packet(Buffer *out, const Buffer *nonce, Buffer *in)
+		{
+			ASSERT(log_, out->empty());
+
+			Buffer header;
+			in->moveout(&header, sizeof (uint32_t));
+
+			if (!keystream(header_, &header_key_, *nonce, 0, out, &header))
+				return (false);
+			if (!keystream(main_, &main_key_, *nonce, 1, out, in))
+				return (false);
+
+			if (!poly1305_key(nonce))
+				return (false);
+			Buffer tag;
+			if (!poly1305_->mac(&tag, out))
+				return (false);
+
+			out->append(tag);
+			return (true);
+		}
+
+		bool open_packet(Buffer *out, const Buffer *nonce, Buffer *in)
+		{
+			if (in->length() < sizeof (uint32_t) + tag_size_)
+				return (false);
+
+			uint8_t tag[16];
+			ASSERT(log_, tag_size_ == sizeof tag);
+			in->copyout(tag, in->length() - sizeof tag, sizeof tag);
+			in->trim(sizeof tag);
+
+			if (!poly1305_key(nonce))
+				return (false);
+			Buffer expected_tag;
+			if (!poly1305_->mac(&expected_tag, in))
+				return (false);
+			if (!expected_tag.equal(tag, sizeof tag))
+				return (false);
+
+			in->skip(sizeof (uint32_t));
+			return (keystream(main_, &main_key_, *nonce, 1, out, in));
+		}
 	};
 }
 
@@ -121,6 +436,23 @@ SSH::Encryption::cipher(CryptoEncryption::Cipher cipher)
 			ERROR("/ssh/encryption") << "Could not get session for cipher: " << cipher;
 			return (NULL);
 		}
+		if (cipher.second == CryptoEncryption::GCM)
+			return (new CryptoSSHAESGCM(alg->rfc4250_name_, session));
+		if (cipher.first == CryptoEncryption::ChaCha20) {
+			const CryptoMAC::Method *mac_method = CryptoMAC::Method::method(CryptoMAC::Poly1305);
+			if (mac_method == NULL) {
+				DEBUG("/ssh/encryption") << "Could not get method for Poly1305.";
+				delete session;
+				return (NULL);
+			}
+			CryptoMAC::Instance *poly1305 = mac_method->instance(CryptoMAC::Poly1305);
+			if (poly1305 == NULL) {
+				ERROR("/ssh/encryption") << "Could not get instance for Poly1305.";
+				delete session;
+				return (NULL);
+			}
+			return (new CryptoSSHChaCha20Poly1305(alg->rfc4250_name_, session, session->clone(), poly1305));
+		}
 		return (new CryptoSSHEncryption(alg->rfc4250_name_, session));
 	}
 	DEBUG("/ssh/encryption") << "No SSH encryption support is available for cipher: " << cipher;
@@ -37,12 +37,14 @@ namespace SSH {
 		const unsigned block_size_;
 		const unsigned key_size_;
 		const unsigned iv_size_;
+		const unsigned tag_size_;
 
-		Encryption(const std::string& xname, unsigned xblock_size, unsigned xkey_size, unsigned xiv_size)
+		Encryption(const std::string& xname, unsigned xblock_size, unsigned xkey_size, unsigned xiv_size, unsigned xtag_size = 0)
 		: name_(xname),
 		  block_size_(xblock_size),
 		  key_size_(xkey_size),
-		  iv_size_(xiv_size)
+		  iv_size_(xiv_size),
+		  tag_size_(xtag_size)
 		{ }
 
 	public:
@@ -64,6 +66,15 @@ namespace SSH {
 			return (iv_size_);
 		}
 
+		/*
+		 * Non-zero for AEAD ciphers, which authenticate each packet
+		 * themselves so that no MAC is used with them.
+		 */
+		unsigned tag_size(void) const
+		{
+			return (tag_size_);
+		}
+
 		std::string name(void) const
 		{
 			return (name_);
@@ -73,6 +84,18 @@ namespace SSH {
 
 		virtual bool initialize(CryptoEncryption::Operation, const Buffer *, const Buffer *) = 0;
 		virtual bool cipher(Buffer *, Buffer *) = 0;
+		virtual Action *submit(Buffer *, EventCallback *) = 0;
+
+		/*
+		 * For AEAD ciphers, which process whole packets given their
+		 * sequence number.  length() reads the packet length from the
+		 * start of a received packet.  seal() turns a packet into what
+		 * goes on the wire, tag and all.  open() takes that back to the
+		 * plaintext following the packet length, or fails.
+		 */
+		virtual bool length(uint32_t, const Buffer *, uint32_t *) = 0;
+		virtual Action *seal(uint32_t, Buffer *, EventCallback *) = 0;
+		virtual Action *open(uint32_t, Buffer *, EventCallback *) = 0;
 
 		static void add_algorithms(Session *);
 		static Encryption *cipher(CryptoEncryption::Cipher);
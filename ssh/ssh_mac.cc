@@ -74,6 +74,11 @@ namespace {
 		{
 			return (instance_->mac(out, in));
 		}
+
+		Action *submit(Buffer *in, EventCallback *cb)
+		{
+			return (instance_->submit(in, cb));
+		}
 	};
 }
 
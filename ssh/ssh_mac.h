@@ -66,6 +66,7 @@ namespace SSH {
 
 		virtual bool initialize(const Buffer *) = 0;
 		virtual bool mac(Buffer *, const Buffer *) = 0;
+		virtual Action *submit(Buffer *, EventCallback *) = 0;
 
 		static void add_algorithms(Session *);
 		static MAC *algorithm(CryptoMAC::Algorithm);
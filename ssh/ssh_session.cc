@@ -30,6 +30,17 @@
 #include <ssh/ssh_mac.h>
 #include <ssh/ssh_session.h>
 
+namespace {
+	/*
+	 * AEAD ciphers authenticate packets themselves, and the MAC that was
+	 * negotiated alongside one is not used.
+	 */
+	bool aead(const SSH::UnidirectionalAlgorithms *algorithms)
+	{
+		return (algorithms->encryption_ != NULL && algorithms->encryption_->tag_size() != 0);
+	}
+}
+
 void
 SSH::Session::activate_chosen(void)
 {
@@ -53,12 +64,12 @@ SSH::Session::activate_chosen(void)
 		server_to_client_iv_ = generate_key("B", active_algorithms_.server_to_client_.encryption_->iv_size());
 		server_to_client_key_ = generate_key("D", active_algorithms_.server_to_client_.encryption_->key_size());
 	}
-	if (active_algorithms_.client_to_server_.mac_ != NULL) {
+	if (active_algorithms_.client_to_server_.mac_ != NULL && !aead(&active_algorithms_.client_to_server_)) {
 		client_to_server_integrity_key_ = generate_key("E", active_algorithms_.client_to_server_.mac_->key_size());
 		if (!active_algorithms_.client_to_server_.mac_->initialize(&client_to_server_integrity_key_))
 			HALT("/ssh/session") << "Failed to activate client-to-server MAC.";
 	}
-	if (active_algorithms_.server_to_client_.mac_ != NULL) {
+	if (active_algorithms_.server_to_client_.mac_ != NULL && !aead(&active_algorithms_.server_to_client_)) {
 		server_to_client_integrity_key_ = generate_key("F", active_algorithms_.server_to_client_.mac_->key_size());
 		if (!active_algorithms_.server_to_client_.mac_->initialize(&server_to_client_integrity_key_))
 			HALT("/ssh/session") << "Failed to activate server-to-client MAC.";
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	SSH_SSH_TRANSPORT_H
+#define	SSH_SSH_TRANSPORT_H
+
+namespace SSH {
+	/*
+	 * Something which carries packets to and from our peer, in order.
+	 * The connection protocol needs nothing more than this, so it can be
+	 * run over a transport other than the SSH transport protocol.
+	 *
+	 * Each packet received is handed to receive() in turn; a transport
+	 * which fails says so by other means, since it is not its receiver
+	 * which has to clean up after it.
+	 */
+	class Transport {
+	protected:
+		Transport(void)
+		{ }
+
+	public:
+		virtual ~Transport()
+		{ }
+
+		virtual Action *receive(EventCallback *) = 0;
+		virtual void send(Buffer *) = 0;
+
+		/*
+		 * Called once packets may be sent.
+		 */
+		virtual Action *ready(SimpleCallback *) = 0;
+	};
+}
+
+#endif /* !SSH_SSH_TRANSPORT_H */
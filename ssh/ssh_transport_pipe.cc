@@ -25,9 +25,10 @@
 
 #include <common/endian.h>
 
-#include <event/event_callback.h>
+#include <crypto/crypto_thread.h>
 
-#include <http/http_protocol.h>
+#include <event/event_callback.h>
+#include <event/event_system.h>
 
 #include <io/pipe/pipe.h>
 #include <io/pipe/pipe_producer.h>
@@ -43,6 +44,98 @@
 
 namespace {
 	static uint8_t zero_padding[255];
+
+	/*
+	 * Protects an outgoing packet by computing its MAC and then encrypting
+	 * it in place, or recovers an incoming one by decrypting it in place
+	 * and then checking its MAC, in one operation on a CryptoThread so that
+	 * the packet is not shared between the two and copied.
+	 *
+	 * The MAC covers the packet sequence number and, for incoming packets,
+	 * the first block, which has already been decrypted to find the packet
+	 * length; these are the MAC prefix.
+	 */
+	class PacketOperation : public CryptoThread::Operation {
+	public:
+		enum Direction {
+			Send,
+			Receive
+		};
+	private:
+		Direction direction_;
+		SSH::Encryption *encryption_;
+		SSH::MAC *mac_;
+		Buffer mac_prefix_;
+		Buffer expected_mac_;
+	public:
+		PacketOperation(Direction direction, SSH::Encryption *encryption, SSH::MAC *mac, const Buffer& mac_prefix, const Buffer& expected_mac)
+		: direction_(direction),
+		  encryption_(encryption),
+		  mac_(mac),
+		  mac_prefix_(mac_prefix),
+		  expected_mac_(expected_mac)
+		{ }
+
+		~PacketOperation()
+		{ }
+
+		bool perform(Buffer *out, Buffer *in)
+		{
+			Buffer mac_input;
+			Buffer mac;
+
+			switch (direction_) {
+			case Send:
+				if (mac_ != NULL) {
+					mac_input = mac_prefix_;
+					mac_input.append(in);
+					if (!mac_->mac(&mac, &mac_input))
+						return (false);
+					mac_input.clear();
+				}
+
+				if (encryption_ != NULL) {
+					if (!encryption_->cipher(out, in))
+						return (false);
+				} else {
+					in->moveout(out);
+				}
+
+				out->append(mac);
+				return (true);
+			case Receive:
+				if (encryption_ != NULL) {
+					if (!encryption_->cipher(out, in))
+						return (false);
+				} else {
+					in->moveout(out);
+				}
+
+				if (mac_ != NULL) {
+					mac_input = mac_prefix_;
+					mac_input.append(out);
+					if (!mac_->mac(&mac, &mac_input))
+						return (false);
+					if (!mac.equal(&expected_mac_))
+						return (false);
+				}
+				return (true);
+			default:
+				return (false);
+			}
+		}
+
+		/*
+		 * Operations on behalf of the same cipher must run in order, so
+		 * they are keyed by it.
+		 */
+		static Action *submit(PacketOperation *op, Buffer *in, EventCallback *cb)
+		{
+			if (op->encryption_ != NULL)
+				return (CryptoThread::submit(op->encryption_, op, in, cb));
+			return (CryptoThread::submit(op->mac_, op, in, cb));
+		}
+	};
 }
 
 SSH::TransportPipe::TransportPipe(Session *session)
@@ -50,7 +143,20 @@ SSH::TransportPipe::TransportPipe(Session *session)
   session_(session),
   state_(GetIdentificationString),
   input_buffer_(),
+  receive_need_(0),
+  packet_len_(0),
   first_block_(),
+  first_block_action_(NULL),
+  eos_(false),
+  closed_(false),
+  send_queue_(),
+  receive_queue_(),
+  maximum_packet_size_(SSH_TRANSPORT_PIPE_MAXIMUM_PACKET_SIZE),
+  coalesce_limit_(0),
+  coalesce_delay_(0),
+  coalesce_channel_(0),
+  coalesce_buffer_(),
+  coalesce_action_(NULL),
   receive_callback_(NULL),
   receive_action_(NULL),
   ready_(false),
@@ -70,6 +176,26 @@ SSH::TransportPipe::~TransportPipe()
 
 	ASSERT(log_, ready_callback_ == NULL);
 	ASSERT(log_, ready_action_ == NULL);
+
+	if (first_block_action_ != NULL) {
+		first_block_action_->cancel();
+		first_block_action_ = NULL;
+	}
+
+	if (coalesce_action_ != NULL) {
+		coalesce_action_->cancel();
+		coalesce_action_ = NULL;
+	}
+
+	while (!send_queue_.empty()) {
+		delete send_queue_.front();
+		send_queue_.pop_front();
+	}
+
+	while (!receive_queue_.empty()) {
+		delete receive_queue_.front();
+		receive_queue_.pop_front();
+	}
 }
 
 Action *
@@ -101,14 +227,69 @@ SSH::TransportPipe::receive(EventCallback *cb)
 	return (a);
 }
 
+/*
+ * Channel data may be held back briefly and merged with the channel data
+ * which follows it; everything else is sent immediately, after any channel
+ * data which is being held.
+ */
+void
+SSH::TransportPipe::send(Buffer *payload)
+{
+	ASSERT(log_, state_ != GetIdentificationString);
+	if (closed_) {
+		DEBUG(log_) << "Dropping packet sent after close.";
+		payload->clear();
+		return;
+	}
+
+	if (coalesce(payload))
+		return;
+
+	coalesce_flush();
+	send_packet(payload);
+}
+
+/*
+ * Set the largest packet we will accept from our peer.
+ */
+void
+SSH::TransportPipe::set_maximum_packet_size(uint32_t size)
+{
+	ASSERT(log_, size >= 35000);
+	maximum_packet_size_ = size;
+}
+
+/*
+ * Merge channel data sent within delay milliseconds of each other into
+ * packets carrying up to limit bytes of data, trading a little latency for
+ * fewer packets, and so fewer MACs and less padding and framing.  The limit
+ * must not exceed our peer's maximum packet size for the channel.  A limit
+ * of 0 turns coalescing off.
+ */
+void
+SSH::TransportPipe::set_coalescing(size_t limit, unsigned delay)
+{
+	ASSERT(log_, limit == 0 || delay != 0);
+
+	coalesce_limit_ = limit;
+	coalesce_delay_ = delay;
+
+	if (coalesce_buffer_.length() >= coalesce_limit_)
+		coalesce_flush();
+}
+
 /*
  * Because this is primarily for WAN optimization we always use minimal
  * padding and zero padding.  Quick and dirty.  Perhaps revisit later,
  * although it makes send() asynchronous unless we add a blocking
  * RNG interface.
+ *
+ * The MAC and encryption are done on a CryptoThread, and the packet is
+ * produced once they are done and every packet sent before it has been,
+ * so many packets may be in flight at once.
  */
 void
-SSH::TransportPipe::send(Buffer *payload)
+SSH::TransportPipe::send_packet(Buffer *payload)
 {
 	Encryption *encryption_algorithm;
 	MAC *mac_algorithm;
@@ -116,9 +297,8 @@ SSH::TransportPipe::send(Buffer *payload)
 	uint8_t padding_len;
 	uint32_t packet_len;
 	unsigned block_size;
-	Buffer mac;
+	bool aead;
 
-	ASSERT(log_, state_ == GetPacket);
 	encryption_algorithm = session_->active_algorithms_.local_to_remote_->encryption_;
 	if (encryption_algorithm != NULL) {
 		block_size = encryption_algorithm->block_size();
@@ -128,9 +308,19 @@ SSH::TransportPipe::send(Buffer *payload)
 		block_size = 8;
 	}
 	mac_algorithm = session_->active_algorithms_.local_to_remote_->mac_;
+	aead = encryption_algorithm != NULL && encryption_algorithm->tag_size() != 0;
+	if (aead)
+		mac_algorithm = NULL;
 
+	/*
+	 * AEAD ciphers leave the packet length out of the padded portion
+	 * of the packet.
+	 */
 	packet_len = sizeof padding_len + payload->length();
-	padding_len = 4 + (block_size - ((sizeof packet_len + packet_len + 4) % block_size));
+	if (aead)
+		padding_len = 4 + (block_size - ((packet_len + 4) % block_size));
+	else
+		padding_len = 4 + (block_size - ((sizeof packet_len + packet_len + 4) % block_size));
 	packet_len += padding_len;
 
 	BigEndian::append(&packet, packet_len);
@@ -138,34 +328,184 @@ SSH::TransportPipe::send(Buffer *payload)
 	payload->moveout(&packet);
 	packet.append(zero_padding, padding_len);
 
-	if (mac_algorithm != NULL) {
-		Buffer mac_input;
+	Packet *p = new Packet(session_->local_sequence_number_++);
+	send_queue_.push_back(p);
 
-		SSH::UInt32::encode(&mac_input, session_->local_sequence_number_);
-		mac_input.append(&packet);
+	if (encryption_algorithm == NULL && mac_algorithm == NULL) {
+		packet.moveout(&p->packet_);
+		p->ready_ = true;
+		send_flush();
+		return;
+	}
 
-		if (!mac_algorithm->mac(&mac, &mac_input)) {
-			ERROR(log_) << "Could not compute outgoing MAC.";
-			produce_error();
-			return;
-		}
+	EventCallback *cb = callback(this, &SSH::TransportPipe::send_complete, p);
+	if (aead) {
+		p->action_ = encryption_algorithm->seal(p->sequence_number_, &packet, cb);
+	} else {
+		Buffer mac_prefix;
+		SSH::UInt32::encode(&mac_prefix, p->sequence_number_);
+
+		PacketOperation *op = new PacketOperation(PacketOperation::Send, encryption_algorithm, mac_algorithm, mac_prefix, Buffer());
+		p->action_ = PacketOperation::submit(op, &packet, cb);
 	}
+}
 
-	if (encryption_algorithm != NULL) {
-		Buffer ciphertext;
-		if (!encryption_algorithm->cipher(&ciphertext, &packet)) {
-			ERROR(log_) << "Could not encrypt outgoing packet.";
-			produce_error();
-			return;
-		}
-		packet = ciphertext;
+void
+SSH::TransportPipe::send_complete(Event e, Packet *p)
+{
+	p->action_->cancel();
+	p->action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Could not encrypt outgoing packet.";
+		fail();
+		return;
+	}
+
+	e.buffer_.moveout(&p->packet_);
+	p->ready_ = true;
+	send_flush();
+}
+
+/*
+ * Produce every packet at the head of the queue which is ready, in the
+ * order they were sent.
+ */
+void
+SSH::TransportPipe::send_flush(void)
+{
+	Buffer out;
+
+	while (!send_queue_.empty() && send_queue_.front()->ready_) {
+		Packet *p = send_queue_.front();
+		send_queue_.pop_front();
+
+		p->packet_.moveout(&out);
+		delete p;
+	}
+
+	if (!out.empty())
+		produce(&out);
+
+	if (eos_ && send_queue_.empty()) {
+		closed_ = true;
+		produce_eos();
+	}
+}
+
+/*
+ * Hold on to channel data to send with whatever follows it.  Returns false
+ * if the payload must be sent on its own.
+ */
+bool
+SSH::TransportPipe::coalesce(Buffer *payload)
+{
+	uint32_t channel;
+	uint32_t data_len;
+
+	if (coalesce_limit_ == 0)
+		return (false);
+
+	if (payload->length() <= 1 + sizeof channel + sizeof data_len ||
+	    payload->peek() != SSH::Message::ConnectionChannelData)
+		return (false);
+
+	payload->extract(&data_len, 1 + sizeof channel);
+	data_len = BigEndian::decode(data_len);
+	if (data_len != payload->length() - (1 + sizeof channel + sizeof data_len))
+		return (false);
+	if (data_len >= coalesce_limit_)
+		return (false);
+
+	payload->extract(&channel, 1);
+	channel = BigEndian::decode(channel);
+	if (!coalesce_buffer_.empty() &&
+	    (channel != coalesce_channel_ ||
+	     coalesce_buffer_.length() + data_len > coalesce_limit_))
+		coalesce_flush();
+
+	coalesce_channel_ = channel;
+	payload->skip(1 + sizeof channel + sizeof data_len);
+	payload->moveout(&coalesce_buffer_);
+
+	if (coalesce_buffer_.length() == coalesce_limit_) {
+		coalesce_flush();
+		return (true);
 	}
-	if (!mac.empty())
-		packet.append(mac);
 
-	session_->local_sequence_number_++;
+	if (coalesce_action_ == NULL) {
+		SimpleCallback *cb = callback(this, &SSH::TransportPipe::coalesce_complete);
+		coalesce_action_ = EventSystem::instance()->timeout(coalesce_delay_, cb);
+	}
+
+	return (true);
+}
+
+void
+SSH::TransportPipe::coalesce_flush(void)
+{
+	if (coalesce_action_ != NULL) {
+		coalesce_action_->cancel();
+		coalesce_action_ = NULL;
+	}
+
+	if (coalesce_buffer_.empty())
+		return;
 
-	produce(&packet);
+	Buffer payload;
+	payload.append(SSH::Message::ConnectionChannelData);
+	SSH::UInt32::encode(&payload, coalesce_channel_);
+	SSH::String::encode(&payload, &coalesce_buffer_);
+	send_packet(&payload);
+}
+
+void
+SSH::TransportPipe::coalesce_complete(void)
+{
+	coalesce_action_->cancel();
+	coalesce_action_ = NULL;
+
+	coalesce_flush();
+}
+
+/*
+ * Abandon everything in flight and fail the pipe.
+ */
+void
+SSH::TransportPipe::fail(void)
+{
+	if (closed_)
+		return;
+	closed_ = true;
+
+	input_buffer_.clear();
+	first_block_.clear();
+	coalesce_buffer_.clear();
+
+	if (first_block_action_ != NULL) {
+		first_block_action_->cancel();
+		first_block_action_ = NULL;
+	}
+
+	if (coalesce_action_ != NULL) {
+		coalesce_action_->cancel();
+		coalesce_action_ = NULL;
+	}
+
+	while (!send_queue_.empty()) {
+		delete send_queue_.front();
+		send_queue_.pop_front();
+	}
+
+	while (!receive_queue_.empty()) {
+		delete receive_queue_.front();
+		receive_queue_.pop_front();
+	}
+
+	produce_error();
 }
 
 Action *
@@ -205,42 +545,59 @@ SSH::TransportPipe::consume(Buffer *in)
 	if (in->empty()) {
 		if (!input_buffer_.empty())
 			DEBUG(log_) << "Received EOS with data outstanding.";
-		produce_eos();
+		eos_ = true;
+		if (!closed_)
+			coalesce_flush();
+		send_flush();
 		return;
 	}
 
 	in->moveout(&input_buffer_);
 
 	if (state_ == GetIdentificationString) {
-		HTTPProtocol::ParseStatus status;
-
 		while (!input_buffer_.empty()) {
-			Buffer line;
-			status = HTTPProtocol::ExtractLine(&line, &input_buffer_);
-			switch (status) {
-			case HTTPProtocol::ParseSuccess:
-				break;
-			case HTTPProtocol::ParseFailure:
-				ERROR(log_) << "Invalid line while waiting for identification string.";
-				produce_error();
-				return;
-			case HTTPProtocol::ParseIncomplete:
+			/*
+			 * Lines are at most 255 characters including the
+			 * line ending, so there's no need to look further.
+			 */
+			unsigned pos;
+			if (!input_buffer_.find('\n', &pos, SSH_IDENTIFICATION_LINE_MAX)) {
+				if (input_buffer_.length() >= SSH_IDENTIFICATION_LINE_MAX) {
+					ERROR(log_) << "Line too long while waiting for identification string.";
+					fail();
+					return;
+				}
 				/* Wait for more.  */
 				return;
 			}
 
+			Buffer line;
+			if (pos != 0)
+				input_buffer_.moveout(&line, pos);
+			input_buffer_.skip(1);
+
+			/*
+			 * Lines should end in CRLF, but some send only LF.
+			 */
+			if (!line.empty()) {
+				uint8_t ch;
+				line.extract(&ch, line.length() - 1);
+				if (ch == '\r')
+					line.trim(1);
+			}
+
 			if (!line.prefix("SSH-"))
 				continue; /* Next line.  */
 
 			if (!line.prefix("SSH-2.0")) {
 				ERROR(log_) << "Unsupported version.";
-				produce_error();
+				fail();
 				return;
 			}
 
 			session_->remote_version(line);
 
-			state_ = GetPacket;
+			state_ = GetPacketLength;
 			/*
 			 * XXX
 			 * Should have a callback here?
@@ -254,8 +611,7 @@ SSH::TransportPipe::consume(Buffer *in)
 		}
 	}
 
-	if (state_ == GetPacket && receive_callback_ != NULL)
-		receive_do();
+	receive_do();
 }
 
 void
@@ -272,211 +628,415 @@ SSH::TransportPipe::receive_cancel(void)
 	}
 }
 
+/*
+ * Start on as many received packets as we can, and hand back the next one
+ * if it is ready and someone is waiting for it.
+ */
 void
 SSH::TransportPipe::receive_do(void)
 {
-	ASSERT(log_, receive_action_ == NULL);
-	ASSERT(log_, receive_callback_ != NULL);
-
-	if (state_ != GetPacket)
+	if (state_ == GetIdentificationString)
 		return;
 
-	while (!input_buffer_.empty()) {
-		Encryption *encryption_algorithm;
-		MAC *mac_algorithm;
-		Buffer packet;
-		Buffer mac;
-		unsigned block_size;
-		unsigned mac_size;
-		uint32_t packet_len;
-		uint8_t padding_len;
-		uint8_t msg;
-
-		encryption_algorithm = session_->active_algorithms_.remote_to_local_->encryption_;
-		if (encryption_algorithm != NULL) {
-			block_size = encryption_algorithm->block_size();
-			if (block_size < 8)
-				block_size = 8;
-		} else {
-			block_size = 8;
-		}
-		mac_algorithm = session_->active_algorithms_.remote_to_local_->mac_;
-		if (mac_algorithm != NULL)
-			mac_size = mac_algorithm->size();
-		else
-			mac_size = 0;
+	for (;;) {
+		while (receive_packet())
+			continue;
 
-		if (input_buffer_.length() <= block_size) {
-			DEBUG(log_) << "Waiting for first block of packet.";
+		if (!receive_dispatch())
 			return;
+	}
+}
+
+/*
+ * Take the next packet out of the input and submit it for decryption and
+ * verification.  Since the length of a packet is in its first block, that
+ * must be decrypted before we can find the next packet.
+ *
+ * This is a state machine: first we get the packet length, which for a
+ * block cipher means decrypting the first block, exactly once; then we wait
+ * for the rest of the packet.  We keep track of how much input we need in
+ * order to make progress, so that each new piece of input that doesn't
+ * complete a packet costs only a comparison.
+ */
+bool
+SSH::TransportPipe::receive_packet(void)
+{
+	Encryption *encryption_algorithm;
+	MAC *mac_algorithm;
+	unsigned block_size;
+	unsigned mac_size;
+	uint32_t packet_len;
+	bool aead;
+
+	if (closed_ || input_buffer_.length() < receive_need_)
+		return (false);
+
+	encryption_algorithm = session_->active_algorithms_.remote_to_local_->encryption_;
+	if (encryption_algorithm != NULL) {
+		block_size = encryption_algorithm->block_size();
+		if (block_size < 8)
+			block_size = 8;
+	} else {
+		block_size = 8;
+	}
+	mac_algorithm = session_->active_algorithms_.remote_to_local_->mac_;
+	aead = encryption_algorithm != NULL && encryption_algorithm->tag_size() != 0;
+	if (aead)
+		mac_size = encryption_algorithm->tag_size();
+	else if (mac_algorithm != NULL)
+		mac_size = mac_algorithm->size();
+	else
+		mac_size = 0;
+
+	switch (state_) {
+	case GetPacketLength:
+		/*
+		 * Algorithm negotiation may change the algorithms used for
+		 * the packets which follow, so wait until it has been
+		 * dispatched.  With an AEAD cipher we don't know what a
+		 * packet is until it has been opened, so wait for that, too.
+		 */
+		if (!receive_queue_.empty()) {
+			uint8_t msg = receive_queue_.back()->msg_;
+			if (msg == 0)
+				return (false);
+			if (msg >= SSH::Message::AlgorithmNegotiationRangeBegin &&
+			    msg <= SSH::Message::AlgorithmNegotiationRangeEnd)
+				return (false);
 		}
 
-		if (encryption_algorithm != NULL) {
-			if (first_block_.empty()) {
-				Buffer block;
-				input_buffer_.moveout(&block, block_size);
-				if (!encryption_algorithm->cipher(&first_block_, &block)) {
-					ERROR(log_) << "Decryption of first block failed.";
-					produce_error();
-					return;
-				}
+		/*
+		 * AEAD ciphers give us the packet length up front, and
+		 * decrypt and authenticate the rest of the packet in a
+		 * single operation.
+		 */
+		if (aead) {
+			if (input_buffer_.length() < sizeof packet_len) {
+				receive_need_ = sizeof packet_len;
+				return (false);
+			}
+
+			if (!encryption_algorithm->length(session_->remote_sequence_number_, &input_buffer_, &packet_len)) {
+				ERROR(log_) << "Decryption of packet length failed.";
+				fail();
+				return (false);
+			}
+		} else if (encryption_algorithm != NULL) {
+			if (input_buffer_.length() < block_size) {
+				receive_need_ = block_size;
+				return (false);
 			}
-			BigEndian::extract(&packet_len, &first_block_);
+
+			Buffer block;
+			input_buffer_.moveout(&block, block_size);
+
+			state_ = GetPacketFirstBlock;
+			receive_need_ = 0;
+
+			PacketOperation *op = new PacketOperation(PacketOperation::Receive, encryption_algorithm, NULL, Buffer(), Buffer());
+			EventCallback *cb = callback(this, &SSH::TransportPipe::receive_first_block_complete);
+			first_block_action_ = PacketOperation::submit(op, &block, cb);
+			return (false);
 		} else {
+			if (input_buffer_.length() < sizeof packet_len) {
+				receive_need_ = sizeof packet_len;
+				return (false);
+			}
 			BigEndian::extract(&packet_len, &input_buffer_);
 		}
 
-		if (packet_len == 0) {
-			ERROR(log_) << "Need to handle 0-length packet.";
-			produce_error();
-			return;
+		if (!receive_length(packet_len, block_size, mac_size, aead))
+			return (false);
+		break;
+	case GetPacketFirstBlock:
+		if (first_block_action_ != NULL)
+			return (false);
+
+		BigEndian::extract(&packet_len, &first_block_);
+		if (!receive_length(packet_len, block_size, mac_size, aead))
+			return (false);
+		break;
+	case GetPacket:
+		break;
+	default:
+		NOTREACHED(log_);
+	}
+
+	ASSERT(log_, state_ == GetPacket);
+	packet_len = packet_len_;
+
+	/*
+	 * With a block cipher, the first block has already been taken out
+	 * of the input and decrypted.
+	 */
+	if (!aead && encryption_algorithm != NULL) {
+		if (input_buffer_.length() + block_size < sizeof packet_len + packet_len + mac_size) {
+			receive_need_ = sizeof packet_len + packet_len + mac_size - block_size;
+			return (false);
 		}
+	} else {
+		if (input_buffer_.length() < sizeof packet_len + packet_len + mac_size) {
+			receive_need_ = sizeof packet_len + packet_len + mac_size;
+			return (false);
+		}
+	}
 
-		if (encryption_algorithm != NULL) {
-			ASSERT(log_, !first_block_.empty());
+	state_ = GetPacketLength;
+	receive_need_ = 0;
 
-			if (block_size + input_buffer_.length() < sizeof packet_len + packet_len + mac_size) {
-				DEBUG(log_) << "Need " << sizeof packet_len + packet_len + mac_size << " bytes to decrypt encrypted packet; have " << (block_size + input_buffer_.length()) << ".";
-				return;
-			}
+	Packet *p = new Packet(session_->remote_sequence_number_++);
+	receive_queue_.push_back(p);
 
-			first_block_.moveout(&packet);
+	if (aead) {
+		BigEndian::append(&p->packet_, packet_len);
 
-			if (sizeof packet_len + packet_len > block_size) {
-				Buffer ciphertext;
-				input_buffer_.moveout(&ciphertext, sizeof packet_len + packet_len - block_size);
-				if (!encryption_algorithm->cipher(&packet, &ciphertext)) {
-					ERROR(log_) << "Decryption of packet failed.";
-					produce_error();
-					return;
-				}
-			} else {
-				DEBUG(log_) << "Packet of exactly one block.";
-			}
-			ASSERT(log_, packet.length() == sizeof packet_len + packet_len);
-		} else {
-			if (input_buffer_.length() < sizeof packet_len + packet_len + mac_size) {
-				DEBUG(log_) << "Need " << sizeof packet_len + packet_len + mac_size << " bytes; have " << input_buffer_.length() << ".";
-				return;
-			}
+		Buffer ciphertext;
+		input_buffer_.moveout(&ciphertext, sizeof packet_len + packet_len + mac_size);
 
-			input_buffer_.moveout(&packet, sizeof packet_len + packet_len);
-		}
+		EventCallback *cb = callback(this, &SSH::TransportPipe::receive_complete, p);
+		p->action_ = encryption_algorithm->open(p->sequence_number_, &ciphertext, cb);
+		return (true);
+	}
 
-		if (mac_algorithm != NULL) {
-			Buffer expected_mac;
-			Buffer mac_input;
+	Buffer mac_prefix;
+	SSH::UInt32::encode(&mac_prefix, p->sequence_number_);
 
-			input_buffer_.moveout(&mac, 0, mac_size);
-			SSH::UInt32::encode(&mac_input, session_->remote_sequence_number_);
-			mac_input.append(packet);
-			if (!mac_algorithm->mac(&expected_mac, &mac_input)) {
-				ERROR(log_) << "Could not compute expected MAC.";
-				produce_error();
-				return;
-			}
-			if (!expected_mac.equal(&mac)) {
-				ERROR(log_) << "Received MAC does not match expected MAC.";
-				produce_error();
-				return;
-			}
-		}
-		packet.skip(sizeof packet_len);
+	Buffer rest;
+	if (encryption_algorithm != NULL) {
+		first_block_.moveout(&p->packet_);
+		mac_prefix.append(p->packet_);
 
-		session_->remote_sequence_number_++;
+		if (sizeof packet_len + packet_len > block_size)
+			input_buffer_.moveout(&rest, sizeof packet_len + packet_len - block_size);
+		else
+			DEBUG(log_) << "Packet of exactly one block.";
+	} else {
+		input_buffer_.moveout(&rest, sizeof packet_len + packet_len);
+	}
 
-		padding_len = packet.pop();
-		if (padding_len != 0) {
-			if (packet.length() < padding_len) {
-				ERROR(log_) << "Padding too large for packet.";
-				produce_error();
-				return;
-			}
-			packet.trim(padding_len);
-		}
+	Buffer mac;
+	if (mac_algorithm != NULL)
+		input_buffer_.moveout(&mac, 0, mac_size);
 
-		if (packet.empty()) {
-			ERROR(log_) << "Need to handle empty packet.";
-			produce_error();
-			return;
+	if (p->packet_.length() > sizeof packet_len + 1)
+		p->packet_.extract(&p->msg_, sizeof packet_len + 1);
+	else if (rest.length() > sizeof packet_len + 1)
+		rest.extract(&p->msg_, sizeof packet_len + 1);
+
+	if (mac_algorithm == NULL && (encryption_algorithm == NULL || rest.empty())) {
+		rest.moveout(&p->packet_);
+		p->ready_ = true;
+		return (true);
+	}
+
+	if (rest.empty())
+		encryption_algorithm = NULL;
+
+	PacketOperation *op = new PacketOperation(PacketOperation::Receive, encryption_algorithm, mac_algorithm, mac_prefix, mac);
+	EventCallback *cb = callback(this, &SSH::TransportPipe::receive_complete, p);
+	p->action_ = PacketOperation::submit(op, &rest, cb);
+
+	return (true);
+}
+
+/*
+ * Check a packet length we have just learned, and wait for the rest of the
+ * packet.
+ */
+bool
+SSH::TransportPipe::receive_length(uint32_t packet_len, unsigned block_size, unsigned mac_size, bool aead)
+{
+	/*
+	 * The smallest packet has a byte of padding length, a byte of
+	 * message and four bytes of padding.
+	 */
+	if (packet_len < 1 + 1 + 4) {
+		ERROR(log_) << "Packet of " << packet_len << " bytes is too short.";
+		fail();
+		return (false);
+	}
+
+	if (packet_len > maximum_packet_size_ - (sizeof packet_len + mac_size)) {
+		ERROR(log_) << "Packet of " << packet_len << " bytes is larger than the maximum packet size.";
+		fail();
+		return (false);
+	}
+
+	/*
+	 * With an AEAD cipher the length field is not part of the encrypted
+	 * packet, and so not part of the block.
+	 */
+	if ((aead ? packet_len : sizeof packet_len + packet_len) % block_size != 0) {
+		ERROR(log_) << "Packet length is not a multiple of the block size.";
+		fail();
+		return (false);
+	}
+
+	packet_len_ = packet_len;
+	state_ = GetPacket;
+	return (true);
+}
+
+/*
+ * Hand the packet at the head of the queue to its handler, or to whoever
+ * is waiting in receive().  Returns true if there may be more to do.
+ */
+bool
+SSH::TransportPipe::receive_dispatch(void)
+{
+	uint8_t padding_len;
+	uint8_t msg;
+
+	if (closed_ || receive_callback_ == NULL)
+		return (false);
+
+	if (receive_queue_.empty() || !receive_queue_.front()->ready_)
+		return (false);
+
+	Packet *p = receive_queue_.front();
+	receive_queue_.pop_front();
+
+	Buffer packet;
+	p->packet_.moveout(&packet);
+	delete p;
+
+	packet.skip(sizeof (uint32_t));
+
+	padding_len = packet.pop();
+	if (padding_len != 0) {
+		if (packet.length() < padding_len) {
+			ERROR(log_) << "Padding too large for packet.";
+			fail();
+			return (false);
 		}
+		packet.trim(padding_len);
+	}
 
-		/*
-		 * Pass by range to registered handlers for each range.
-		 * Unhandled messages go to the receive_callback_, and
-		 * the caller can register key exchange mechanisms,
-		 * and handle (or discard) whatever they don't handle.
-		 *
-		 * NB: The caller could do all this, but it's assumed
-		 *     that they usually have better things to do.  If
-		 *     they register no handlers, they can certainly do
-		 *     so by hand.
-		 *
-		 * XXX It seems like having a separate class which handles
-		 *     all these details and algorithm negotiation would be
-		 *     nice, and to have this one be a bit more oriented
-		 *     towards managing just the transport layer.
-		 *
-		 *     At the very least, it needs to take responsibility
-		 *     for its failures and allow the handler functions
-		 *     here to mangle the packet buffer rather than trying
-		 *     to send it on to the receiver if decoding fails.
-		 *     A decoding failure should result in a disconnect,
-		 *     an error.
-		 */
-		msg = packet.peek();
-		if (msg >= SSH::Message::TransportRangeBegin &&
-		    msg <= SSH::Message::TransportRangeEnd) {
-			DEBUG(log_) << "Using default handler for transport message.";
-		} else if (msg >= SSH::Message::AlgorithmNegotiationRangeBegin &&
-			   msg <= SSH::Message::AlgorithmNegotiationRangeEnd) {
-			if (session_->algorithm_negotiation_ != NULL) {
-				if (session_->algorithm_negotiation_->input(this, &packet))
-					continue;
-				ERROR(log_) << "Algorithm negotiation message failed.";
-				produce_error();
-				return;
-			}
-			DEBUG(log_) << "Using default handler for algorithm negotiation message.";
-		} else if (msg >= SSH::Message::KeyExchangeMethodRangeBegin &&
-			   msg <= SSH::Message::KeyExchangeMethodRangeEnd) {
-			if (session_->chosen_algorithms_.key_exchange_ != NULL) {
-				if (session_->chosen_algorithms_.key_exchange_->input(this, &packet))
-					continue;
-				ERROR(log_) << "Key exchange message failed.";
-				produce_error();
-				return;
-			}
-			DEBUG(log_) << "Using default handler for key exchange method message.";
-		} else if (msg >= SSH::Message::UserAuthenticationGenericRangeBegin &&
-			   msg <= SSH::Message::UserAuthenticationGenericRangeEnd) {
-			DEBUG(log_) << "Using default handler for generic user authentication message.";
-		} else if (msg >= SSH::Message::UserAuthenticationMethodRangeBegin &&
-			   msg <= SSH::Message::UserAuthenticationMethodRangeEnd) {
-			DEBUG(log_) << "Using default handler for user authentication method message.";
-		} else if (msg >= SSH::Message::ConnectionProtocolGlobalRangeBegin &&
-			   msg <= SSH::Message::ConnectionProtocolGlobalRangeEnd) {
-			DEBUG(log_) << "Using default handler for generic connection protocol message.";
-		} else if (msg >= SSH::Message::ConnectionChannelRangeBegin &&
-			   msg <= SSH::Message::ConnectionChannelRangeEnd) {
-			DEBUG(log_) << "Using default handler for connection channel message.";
-		} else if (msg >= SSH::Message::ClientProtocolReservedRangeBegin &&
-			   msg <= SSH::Message::ClientProtocolReservedRangeEnd) {
-			DEBUG(log_) << "Using default handler for client protocol message.";
-		} else if (msg >= SSH::Message::LocalExtensionRangeBegin) {
-			/* Because msg is a uint8_t, it will always be <= SSH::Message::LocalExtensionRangeEnd.  */
-			DEBUG(log_) << "Using default handler for local extension message.";
-		} else {
-			ASSERT(log_, msg == 0);
-			ERROR(log_) << "Message outside of protocol range received.  Passing to default handler, but not expecting much.";
+	if (packet.empty()) {
+		ERROR(log_) << "Need to handle empty packet.";
+		fail();
+		return (false);
+	}
+
+	/*
+	 * Pass by range to registered handlers for each range.
+	 * Unhandled messages go to the receive_callback_, and
+	 * the caller can register key exchange mechanisms,
+	 * and handle (or discard) whatever they don't handle.
+	 *
+	 * NB: The caller could do all this, but it's assumed
+	 *     that they usually have better things to do.  If
+	 *     they register no handlers, they can certainly do
+	 *     so by hand.
+	 *
+	 * XXX It seems like having a separate class which handles
+	 *     all these details and algorithm negotiation would be
+	 *     nice, and to have this one be a bit more oriented
+	 *     towards managing just the transport layer.
+	 *
+	 *     At the very least, it needs to take responsibility
+	 *     for its failures and allow the handler functions
+	 *     here to mangle the packet buffer rather than trying
+	 *     to send it on to the receiver if decoding fails.
+	 *     A decoding failure should result in a disconnect,
+	 *     an error.
+	 */
+	msg = packet.peek();
+	if (msg >= SSH::Message::TransportRangeBegin &&
+	    msg <= SSH::Message::TransportRangeEnd) {
+		DEBUG(log_) << "Using default handler for transport message.";
+	} else if (msg >= SSH::Message::AlgorithmNegotiationRangeBegin &&
+		   msg <= SSH::Message::AlgorithmNegotiationRangeEnd) {
+		if (session_->algorithm_negotiation_ != NULL) {
+			if (session_->algorithm_negotiation_->input(this, &packet))
+				return (true);
+			ERROR(log_) << "Algorithm negotiation message failed.";
+			fail();
+			return (false);
 		}
+		DEBUG(log_) << "Using default handler for algorithm negotiation message.";
+	} else if (msg >= SSH::Message::KeyExchangeMethodRangeBegin &&
+		   msg <= SSH::Message::KeyExchangeMethodRangeEnd) {
+		if (session_->chosen_algorithms_.key_exchange_ != NULL) {
+			if (session_->chosen_algorithms_.key_exchange_->input(this, &packet))
+				return (true);
+			ERROR(log_) << "Key exchange message failed.";
+			fail();
+			return (false);
+		}
+		DEBUG(log_) << "Using default handler for key exchange method message.";
+	} else if (msg >= SSH::Message::UserAuthenticationGenericRangeBegin &&
+		   msg <= SSH::Message::UserAuthenticationGenericRangeEnd) {
+		DEBUG(log_) << "Using default handler for generic user authentication message.";
+	} else if (msg >= SSH::Message::UserAuthenticationMethodRangeBegin &&
+		   msg <= SSH::Message::UserAuthenticationMethodRangeEnd) {
+		DEBUG(log_) << "Using default handler for user authentication method message.";
+	} else if (msg >= SSH::Message::ConnectionProtocolGlobalRangeBegin &&
+		   msg <= SSH::Message::ConnectionProtocolGlobalRangeEnd) {
+		DEBUG(log_) << "Using default handler for generic connection protocol message.";
+	} else if (msg >= SSH::Message::ConnectionChannelRangeBegin &&
+		   msg <= SSH::Message::ConnectionChannelRangeEnd) {
+		DEBUG(log_) << "Using default handler for connection channel message.";
+	} else if (msg >= SSH::Message::ClientProtocolReservedRangeBegin &&
+		   msg <= SSH::Message::ClientProtocolReservedRangeEnd) {
+		DEBUG(log_) << "Using default handler for client protocol message.";
+	} else if (msg >= SSH::Message::LocalExtensionRangeBegin) {
+		/* Because msg is a uint8_t, it will always be <= SSH::Message::LocalExtensionRangeEnd.  */
+		DEBUG(log_) << "Using default handler for local extension message.";
+	} else {
+		ASSERT(log_, msg == 0);
+		ERROR(log_) << "Message outside of protocol range received.  Passing to default handler, but not expecting much.";
+	}
 
-		receive_callback_->param(Event(Event::Done, packet));
-		receive_action_ = receive_callback_->schedule();
-		receive_callback_ = NULL;
+	receive_callback_->param(Event(Event::Done, packet));
+	receive_action_ = receive_callback_->schedule();
+	receive_callback_ = NULL;
 
+	return (false);
+}
+
+void
+SSH::TransportPipe::receive_first_block_complete(Event e)
+{
+	first_block_action_->cancel();
+	first_block_action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Decryption of first block failed.";
+		fail();
+		return;
+	}
+
+	ASSERT(log_, first_block_.empty());
+	e.buffer_.moveout(&first_block_);
+
+	receive_do();
+}
+
+void
+SSH::TransportPipe::receive_complete(Event e, Packet *p)
+{
+	p->action_->cancel();
+	p->action_ = NULL;
+
+	switch (e.type_) {
+	case Event::Done:
+		break;
+	default:
+		ERROR(log_) << "Decryption or verification of packet failed.";
+		fail();
 		return;
 	}
+
+	e.buffer_.moveout(&p->packet_);
+	if (p->msg_ == 0 && p->packet_.length() > sizeof (uint32_t) + 1)
+		p->packet_.extract(&p->msg_, sizeof (uint32_t) + 1);
+	p->ready_ = true;
+
+	receive_do();
 }
 
 void
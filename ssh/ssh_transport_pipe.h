@@ -26,30 +26,90 @@
 #ifndef	SSH_SSH_TRANSPORT_PIPE_H
 #define	SSH_SSH_TRANSPORT_PIPE_H
 
+#include <deque>
+
 #include <io/pipe/pipe.h>
 #include <io/pipe/pipe_producer.h>
 
+#include <ssh/ssh_transport.h>
+
+/*
+ * The largest packet we will accept from our peer, in bytes, including the
+ * length, padding and MAC.  RFC 4253 requires at least 35000; this is what
+ * OpenSSH allows, so that we can carry whatever it sends.
+ */
+#define	SSH_TRANSPORT_PIPE_MAXIMUM_PACKET_SIZE	(256 * 1024)
+
+/*
+ * The longest line, including its line ending, that may precede or be the
+ * identification string.
+ */
+#define	SSH_IDENTIFICATION_LINE_MAX	(255)
+
 namespace SSH {
 	struct Session;
 
 	/*
-	 * XXX
-	 * It would be nice to have a Transport base class
-	 * for use throughout the codebase to handle things
-	 * like sending packets, and have TransportPipe be
-	 * a version that's modeled as a Pipe.
+	 * The SSH transport protocol, modeled as a Pipe.
 	 */
-	class TransportPipe : public PipeProducer {
+	class TransportPipe : public PipeProducer, public Transport {
 		enum State {
 			GetIdentificationString,
+			GetPacketLength,
+			GetPacketFirstBlock,
 			GetPacket
 		};
 
+		/*
+		 * A packet on its way through the CryptoThreads.  Packets are
+		 * sent and received in order, no matter what order their
+		 * cryptographic operations complete in.
+		 */
+		struct Packet {
+			uint8_t msg_;
+			uint32_t sequence_number_;
+			Buffer packet_;
+			Action *action_;
+			bool ready_;
+
+			Packet(uint32_t sequence_number)
+			: msg_(0),
+			  sequence_number_(sequence_number),
+			  packet_(),
+			  action_(NULL),
+			  ready_(false)
+			{ }
+
+			~Packet()
+			{
+				if (action_ != NULL) {
+					action_->cancel();
+					action_ = NULL;
+				}
+			}
+		};
+
 		Session *session_;
 
 		State state_;
 		Buffer input_buffer_;
+		size_t receive_need_;
+		uint32_t packet_len_;
 		Buffer first_block_;
+		Action *first_block_action_;
+		bool eos_;
+		bool closed_;
+
+		std::deque<Packet *> send_queue_;
+		std::deque<Packet *> receive_queue_;
+
+		uint32_t maximum_packet_size_;
+
+		size_t coalesce_limit_;
+		unsigned coalesce_delay_;
+		uint32_t coalesce_channel_;
+		Buffer coalesce_buffer_;
+		Action *coalesce_action_;
 
 		EventCallback *receive_callback_;
 		Action *receive_action_;
@@ -64,6 +124,9 @@ namespace SSH {
 		Action *receive(EventCallback *);
 		void send(Buffer *);
 
+		void set_maximum_packet_size(uint32_t);
+		void set_coalescing(size_t, unsigned);
+
 		Action *ready(SimpleCallback *);
 
 		void key_exchange_complete(void);
@@ -71,8 +134,24 @@ namespace SSH {
 	private:
 		void consume(Buffer *);
 
+		void fail(void);
+
+		bool coalesce(Buffer *);
+		void coalesce_flush(void);
+		void coalesce_complete(void);
+
+		void send_packet(Buffer *);
+		void send_complete(Event, Packet *);
+		void send_flush(void);
+
 		void receive_cancel(void);
 		void receive_do(void);
+		bool receive_packet(void);
+		bool receive_length(uint32_t, unsigned, unsigned, bool);
+		bool receive_dispatch(void);
+
+		void receive_first_block_complete(Event);
+		void receive_complete(Event, Packet *);
 
 		void ready_cancel(void);
 	};
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include <common/endian.h>
+#include <common/test.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <ssh/ssh_encryption.h>
+
+/*
+ * Known answers for the AEAD ciphers as SSH uses them, with the packet
+ * length given to each as it would be by the transport.
+ *
+ * aes128-gcm@openssh.com is given the key, IV and plaintext of Test Case 3
+ * of McGrew and Viega's GCM specification.  The packet length is only
+ * authenticated, so the payload encrypts to that test case's ciphertext;
+ * the tag covers the length, too.  The second packet checks that the low
+ * 64 bits of the IV count packets.
+ *
+ * chacha20-poly1305@openssh.com is given a key of the bytes 0 to 63 and
+ * two packets, the second of which takes more than one block of keystream,
+ * with sequence numbers 0 and 1.  Its answers were made
+ * with a separate implementation of OpenSSH's PROTOCOL.chacha20poly1305,
+ * whose ChaCha20 and Poly1305 give the answers in RFC 8439.
+ */
+static const uint8_t gcm_key[] = {
+	0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+	0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+};
+
+static const uint8_t gcm_iv[] = {
+	0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
+	0xde, 0xca, 0xf8, 0x88,
+};
+
+static const uint8_t gcm_packet[] = {
+	0x00, 0x00, 0x00, 0x40,
+	0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
+	0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+	0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+	0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+	0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+	0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+	0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+	0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55,
+};
+
+static const uint8_t gcm_sealed1[] = {
+	0x00, 0x00, 0x00, 0x40,
+	0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24,
+	0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+	0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0,
+	0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+	0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c,
+	0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+	0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97,
+	0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85,
+	0xe6, 0x11, 0x4f, 0x64, 0x68, 0x32, 0x52, 0x71,
+	0xe9, 0xb0, 0x3b, 0x51, 0x0a, 0x6d, 0xff, 0x85,
+};
+
+static const uint8_t gcm_sealed2[] = {
+	0x00, 0x00, 0x00, 0x40,
+	0x5c, 0x21, 0xc6, 0x8a, 0xa9, 0x78, 0x7c, 0x72,
+	0x94, 0xb2, 0xd7, 0xa4, 0x7a, 0x6e, 0x8e, 0x4d,
+	0x8a, 0xda, 0xfe, 0xea, 0x89, 0x4b, 0xf5, 0x04,
+	0x32, 0x3d, 0x55, 0xf6, 0x2a, 0xfe, 0x5b, 0xa1,
+	0x18, 0xa0, 0x28, 0x44, 0x4d, 0x26, 0x0b, 0x03,
+	0x2d, 0x49, 0x36, 0xa7, 0xa6, 0x2a, 0xce, 0xdc,
+	0xb0, 0x95, 0xf6, 0x14, 0xfe, 0xd4, 0x09, 0x21,
+	0x66, 0xb3, 0xc8, 0x9f, 0x8b, 0xfb, 0x6a, 0x26,
+	0x18, 0xb9, 0xf3, 0xf3, 0x2d, 0x9b, 0xd0, 0x15,
+	0x61, 0xa2, 0x1b, 0x00, 0xa1, 0xe0, 0x7b, 0xe5,
+};
+
+static const uint8_t chacha_packet1[] = {
+	0x00, 0x00, 0x00, 0x0c,
+	0x04, 0x02, 0x00, 0x00, 0x00, 0x02, 0x68, 0x69,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t chacha_sealed1[] = {
+	0x94, 0x45, 0x0e, 0x55,
+	0x1c, 0xba, 0x42, 0x31, 0xad, 0xe4, 0xce, 0xb8,
+	0x13, 0x61, 0x5c, 0x61,
+	0x2a, 0xe8, 0x25, 0xd8, 0x78, 0x37, 0x9d, 0x3b,
+	0x06, 0xb0, 0x8a, 0x2d, 0xc6, 0xf7, 0x24, 0x07,
+};
+
+static const uint8_t chacha_sealed2[] = {
+	0xc9, 0x22, 0xa7, 0xc5,
+	0x69, 0x5d, 0x7e, 0xda, 0x35, 0x0f, 0xbe, 0x7d,
+	0x25, 0x78, 0x74, 0x24, 0xbf, 0x19, 0x19, 0x1d,
+	0x00, 0xe0, 0x2d, 0x53, 0xda, 0xa4, 0xea, 0x62,
+	0x5d, 0x23, 0xaf, 0x33, 0x35, 0xf3, 0x81, 0x15,
+	0xf3, 0x0c, 0xce, 0x29, 0x97, 0xde, 0x88, 0xa4,
+	0x09, 0x61, 0xc1, 0x0f, 0x8a, 0xce, 0x84, 0xe1,
+	0xf5, 0xcf, 0x77, 0x40, 0xbd, 0x5e, 0x62, 0x02,
+	0x5c, 0x02, 0x2a, 0x75, 0x53, 0x2a, 0x11, 0x46,
+	0x5f, 0x93, 0x22, 0xf9, 0x86, 0x7f, 0xcf, 0x6a,
+	0x35, 0x39, 0x6f, 0x86, 0xfd, 0xca, 0x19, 0x59,
+	0xd8, 0x51, 0x2a, 0xe5, 0x64, 0xc3, 0xf0, 0x9e,
+	0xb1, 0xe8, 0xe2, 0x24, 0xcd, 0x6b, 0xde, 0xf5,
+	0xc8, 0xa0, 0x31, 0x54, 0x4f, 0xf3, 0x1b, 0x5c,
+	0xc2, 0x2f, 0xe3, 0x56, 0x44, 0xe1, 0x23, 0x08,
+};
+
+/*
+ * Seals each packet with one instance of a cipher and opens what that gives
+ * with another, as the two ends of a connection would.  Finally the first
+ * packet is opened again by a fresh instance, with a byte of its ciphertext
+ * changed, which must fail.
+ */
+class AEADTest {
+	struct Case {
+		uint32_t sequence_number_;
+		Buffer packet_;
+		Buffer sealed_;
+	};
+
+	TestGroup group_;
+	Buffer key_;
+	Buffer iv_;
+	SSH::Encryption *cipher_;
+	SSH::Encryption *sealer_;
+	SSH::Encryption *opener_;
+	std::vector<Case> cases_;
+	unsigned next_;
+	Action *action_;
+
+	static unsigned running_;
+public:
+	AEADTest(const std::string& name, CryptoEncryption::Cipher cipher, const Buffer& key, const Buffer& iv)
+	: group_("/test/ssh/aead/seal1/" + name, "SSH " + name + " Seal #1"),
+	  key_(key),
+	  iv_(iv),
+	  cipher_(SSH::Encryption::cipher(cipher)),
+	  sealer_(NULL),
+	  opener_(NULL),
+	  cases_(),
+	  next_(0),
+	  action_(NULL)
+	{
+		if (cipher_ == NULL)
+			HALT("/test/ssh/aead/seal1") << "Could not find a suitable cipher.";
+		{
+			Test _(group_, "Name.", cipher_->name() == name);
+		}
+
+		sealer_ = cipher_->clone();
+		{
+			Test _(group_, "Initialize for sealing.", sealer_->initialize(CryptoEncryption::Encrypt, &key_, &iv_));
+		}
+		opener_ = fresh_opener();
+
+		running_++;
+	}
+
+	~AEADTest()
+	{
+		delete cipher_;
+		delete sealer_;
+		delete opener_;
+	}
+
+	void add(uint32_t sequence_number, const Buffer& packet, const uint8_t *sealed, size_t sealed_length)
+	{
+		Case c;
+		c.sequence_number_ = sequence_number;
+		c.packet_ = packet;
+		c.sealed_.append(sealed, sealed_length);
+		cases_.push_back(c);
+	}
+
+	void start(void)
+	{
+		ASSERT("/test/ssh/aead/seal1", next_ < cases_.size());
+
+		const Case& c = cases_[next_];
+		Buffer packet(c.packet_);
+		EventCallback *cb = callback(this, &AEADTest::seal_complete);
+		action_ = sealer_->seal(c.sequence_number_, &packet, cb);
+	}
+
+private:
+	SSH::Encryption *fresh_opener(void)
+	{
+		SSH::Encryption *opener = cipher_->clone();
+		{
+			Test _(group_, "Initialize for opening.", opener->initialize(CryptoEncryption::Decrypt, &key_, &iv_));
+		}
+		return (opener);
+	}
+
+	void seal_complete(Event e)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		const Case& c = cases_[next_];
+		{
+			Test _(group_, "Seal done.", e.type_ == Event::Done);
+		}
+		{
+			Test _(group_, "Expected sealed packet.", e.buffer_.equal(&c.sealed_));
+		}
+
+		uint32_t expected_length;
+		BigEndian::extract(&expected_length, &c.packet_);
+
+		uint32_t length;
+		{
+			Test _(group_, "Packet length.", opener_->length(c.sequence_number_, &c.sealed_, &length) && length == expected_length);
+		}
+
+		Buffer sealed(c.sealed_);
+		EventCallback *cb = callback(this, &AEADTest::open_complete);
+		action_ = opener_->open(c.sequence_number_, &sealed, cb);
+	}
+
+	void open_complete(Event e)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		const Case& c = cases_[next_];
+		Buffer payload(c.packet_);
+		payload.skip(sizeof (uint32_t));
+		{
+			Test _(group_, "Open done.", e.type_ == Event::Done);
+		}
+		{
+			Test _(group_, "Expected payload.", e.buffer_.equal(&payload));
+		}
+
+		if (++next_ != cases_.size()) {
+			start();
+			return;
+		}
+
+		const Case& first = cases_.front();
+		uint8_t byte;
+		first.sealed_.extract(&byte, sizeof (uint32_t));
+
+		Buffer tampered(first.sealed_, sizeof (uint32_t));
+		tampered.append((uint8_t)(byte ^ 0x80));
+		Buffer rest(first.sealed_);
+		rest.skip(sizeof (uint32_t) + 1);
+		tampered.append(rest);
+
+		delete opener_;
+		opener_ = fresh_opener();
+
+		EventCallback *cb = callback(this, &AEADTest::tampered_complete);
+		action_ = opener_->open(first.sequence_number_, &tampered, cb);
+	}
+
+	void tampered_complete(Event e)
+	{
+		action_->cancel();
+		action_ = NULL;
+
+		{
+			Test _(group_, "Tampered packet refused.", e.type_ == Event::Error);
+		}
+
+		if (--running_ == 0)
+			EventSystem::instance()->stop();
+	}
+};
+
+unsigned AEADTest::running_;
+
+int
+main(void)
+{
+	AEADTest gcm("aes128-gcm@openssh.com", CryptoEncryption::Cipher(CryptoEncryption::AES128, CryptoEncryption::GCM), Buffer(gcm_key, sizeof gcm_key), Buffer(gcm_iv, sizeof gcm_iv));
+	gcm.add(0, Buffer(gcm_packet, sizeof gcm_packet), gcm_sealed1, sizeof gcm_sealed1);
+	gcm.add(1, Buffer(gcm_packet, sizeof gcm_packet), gcm_sealed2, sizeof gcm_sealed2);
+	gcm.start();
+
+	uint8_t bytes[96];
+	unsigned i;
+	for (i = 0; i < sizeof bytes; i++)
+		bytes[i] = i;
+
+	Buffer chacha_packet2;
+	BigEndian::append(&chacha_packet2, (uint32_t)sizeof bytes);
+	chacha_packet2.append(bytes, sizeof bytes);
+
+	AEADTest chacha("chacha20-poly1305@openssh.com", CryptoEncryption::Cipher(CryptoEncryption::ChaCha20, CryptoEncryption::Stream), Buffer(bytes, 64), Buffer());
+	chacha.add(0, Buffer(chacha_packet1, sizeof chacha_packet1), chacha_sealed1, sizeof chacha_sealed1);
+	chacha.add(1, chacha_packet2, chacha_sealed2, sizeof chacha_sealed2);
+	chacha.start();
+
+	event_main();
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#include <common/endian.h>
+#include <common/test.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+
+#include <ssh/ssh_session.h>
+#include <ssh/ssh_transport_pipe.h>
+
+#define	FUZZ_VALID_CASES	(200)
+#define	FUZZ_MUTATED_CASES	(2000)
+#define	FUZZ_MAX_PACKETS	(16)
+#define	FUZZ_MAX_PAYLOAD	(2048)
+#define	FUZZ_MAX_CHUNK		(128)
+
+/*
+ * Feeds the SSH transport parser unencrypted streams, split into pieces at
+ * random.  Well-formed streams must come out as the packets that went in;
+ * mangled ones may fail, but must not crash or wedge the parser.
+ *
+ * Files named on the command line are fed as streams of their own, so that
+ * an external fuzzer can drive the parser, or a crash can be reproduced.
+ */
+class Fuzzer {
+	struct Case {
+		Buffer stream_;
+		bool valid_;
+		std::vector<Buffer> payloads_;
+	};
+
+	LogHandle log_;
+	TestGroup group_;
+	std::deque<Case> cases_;
+	unsigned mismatches_;
+
+	Case case_;
+	SSH::Session *session_;
+	SSH::TransportPipe *pipe_;
+	std::deque<Buffer> chunks_;
+	std::vector<Buffer> received_;
+	bool error_;
+	Action *input_action_;
+	Action *receive_action_;
+public:
+	Fuzzer(void)
+	: log_("/test/ssh/transport/fuzz1"),
+	  group_("/test/ssh/transport/fuzz1", "SSH transport parser"),
+	  cases_(),
+	  mismatches_(0),
+	  case_(),
+	  session_(NULL),
+	  pipe_(NULL),
+	  chunks_(),
+	  received_(),
+	  error_(false),
+	  input_action_(NULL),
+	  receive_action_(NULL)
+	{ }
+
+	~Fuzzer()
+	{
+		ASSERT(log_, pipe_ == NULL);
+		ASSERT(log_, input_action_ == NULL);
+		ASSERT(log_, receive_action_ == NULL);
+	}
+
+	void add_valid(void)
+	{
+		Case c;
+		unsigned i, packets;
+
+		c.valid_ = true;
+
+		/* Servers may send other lines before the version.  */
+		if (random() % 2 == 0)
+			c.stream_.append("Welcome.\r\nNot a version line.\n");
+		c.stream_.append("SSH-2.0-Fuzz\r\n");
+
+		packets = 1 + random() % FUZZ_MAX_PACKETS;
+		for (i = 0; i < packets; i++) {
+			Buffer payload;
+			unsigned j, len;
+
+			len = 1 + random() % FUZZ_MAX_PAYLOAD;
+			payload.append((uint8_t)(1 + random() % 0xff));
+			for (j = 1; j < len; j++)
+				payload.append((uint8_t)random());
+
+			packet(&c.stream_, payload);
+			c.payloads_.push_back(payload);
+		}
+		cases_.push_back(c);
+	}
+
+	void add_mutated(void)
+	{
+		add_valid();
+
+		Case& c = cases_.back();
+		std::string stream;
+		unsigned i, mutations;
+
+		c.valid_ = false;
+		c.payloads_.clear();
+
+		c.stream_.extract(stream);
+		c.stream_.clear();
+
+		mutations = 1 + random() % 8;
+		for (i = 0; i < mutations; i++) {
+			size_t pos = random() % stream.size();
+
+			switch (random() % 4) {
+			case 0:
+				stream[pos] ^= 1 << (random() % 8);
+				break;
+			case 1:
+				stream[pos] = (char)random();
+				break;
+			case 2:
+				stream.insert(pos, 1, (char)random());
+				break;
+			case 3:
+				if (stream.size() > 1)
+					stream.erase(pos, 1);
+				break;
+			}
+		}
+		c.stream_.append(stream);
+	}
+
+	void add_file(const char *path)
+	{
+		Case c;
+		uint8_t buf[65536];
+		ssize_t len;
+		int fd;
+
+		fd = ::open(path, O_RDONLY);
+		if (fd == -1) {
+			ERROR(log_) << "Could not open " << path << ".";
+			return;
+		}
+		while ((len = ::read(fd, buf, sizeof buf)) > 0)
+			c.stream_.append(buf, len);
+		::close(fd);
+
+		c.valid_ = false;
+		cases_.push_back(c);
+	}
+
+	void start(void)
+	{
+		if (cases_.empty()) {
+			Test _(group_, "Every valid stream came out intact", mismatches_ == 0);
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		case_ = cases_.front();
+		cases_.pop_front();
+
+		session_ = new SSH::Session(SSH::ServerRole);
+		pipe_ = new SSH::TransportPipe(session_);
+
+		Buffer stream(case_.stream_);
+		while (!stream.empty()) {
+			Buffer chunk;
+			size_t len = 1 + random() % FUZZ_MAX_CHUNK;
+			if (len > stream.length())
+				len = stream.length();
+			stream.moveout(&chunk, len);
+			chunks_.push_back(chunk);
+		}
+		received_.clear();
+		error_ = false;
+
+		EventCallback *rcb = callback(this, &Fuzzer::receive_complete);
+		receive_action_ = pipe_->receive(rcb);
+
+		input();
+	}
+
+private:
+	/*
+	 * Frames a payload as an unencrypted packet, with minimal padding.
+	 */
+	void packet(Buffer *out, const Buffer& payload)
+	{
+		uint32_t packet_len;
+		uint8_t padding_len;
+
+		packet_len = 1 + payload.length();
+		padding_len = 4 + (8 - ((sizeof packet_len + packet_len + 4) % 8));
+		packet_len += padding_len;
+
+		BigEndian::append(out, packet_len);
+		out->append(padding_len);
+		out->append(payload);
+		while (padding_len-- != 0)
+			out->append((uint8_t)random());
+	}
+
+	void input(void)
+	{
+		if (chunks_.empty()) {
+			finish();
+			return;
+		}
+
+		Buffer chunk = chunks_.front();
+		chunks_.pop_front();
+
+		EventCallback *cb = callback(this, &Fuzzer::input_complete);
+		input_action_ = ((Pipe *)pipe_)->input(&chunk, cb);
+	}
+
+	void input_complete(Event e)
+	{
+		input_action_->cancel();
+		input_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		case Event::Error:
+			error_ = true;
+			chunks_.clear();
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+		}
+
+		input();
+	}
+
+	void receive_complete(Event e)
+	{
+		receive_action_->cancel();
+		receive_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			break;
+		default:
+			HALT(log_) << "Unexpected event: " << e;
+		}
+
+		received_.push_back(e.buffer_);
+
+		EventCallback *rcb = callback(this, &Fuzzer::receive_complete);
+		receive_action_ = pipe_->receive(rcb);
+
+		if (input_action_ == NULL && chunks_.empty())
+			finish();
+	}
+
+	/*
+	 * Once all the input has been taken, check what came out of a valid
+	 * stream, waiting if need be for packets still on their way to us.
+	 */
+	void finish(void)
+	{
+		if (pipe_ == NULL)
+			return;
+
+		if (case_.valid_) {
+			if (!error_ && received_.size() < case_.payloads_.size())
+				return;
+
+			{
+				Test _(group_, "Valid stream parsed without error", !error_);
+			}
+
+			{
+				Test _(group_, "Got every packet", received_.size() == case_.payloads_.size());
+			}
+
+			bool same = received_.size() == case_.payloads_.size();
+			std::vector<Buffer>::const_iterator it, pit;
+			for (it = received_.begin(), pit = case_.payloads_.begin();
+			     same && it != received_.end(); ++it, ++pit) {
+				if (!it->equal(&*pit))
+					same = false;
+			}
+			Test _(group_, "Got the packets that were sent", same);
+			if (!same)
+				mismatches_++;
+		}
+
+		if (receive_action_ != NULL) {
+			receive_action_->cancel();
+			receive_action_ = NULL;
+		}
+
+		delete pipe_;
+		pipe_ = NULL;
+
+		delete session_;
+		session_ = NULL;
+
+		start();
+	}
+};
+
+int
+main(int argc, char *argv[])
+{
+	Fuzzer fuzzer;
+	unsigned i;
+
+	if (argc > 1) {
+		for (i = 1; i < (unsigned)argc; i++)
+			fuzzer.add_file(argv[i]);
+	} else {
+		for (i = 0; i < FUZZ_VALID_CASES; i++)
+			fuzzer.add_valid();
+		for (i = 0; i < FUZZ_MUTATED_CASES; i++)
+			fuzzer.add_mutated();
+	}
+
+	fuzzer.start();
+	event_main();
+}
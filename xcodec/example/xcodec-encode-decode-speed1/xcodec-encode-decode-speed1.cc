@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <set>
+#include <vector>
+
+#include <common/buffer.h>
+#include <common/timer/timer.h>
+#include <common/uuid/uuid.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/xcodec_hash.h>
+
+/*
+ * Times XCodecEncoder::encode and XCodecDecoder::decode over generated
+ * corpora, first with empty caches and then again with the caches left by
+ * the first pass, as a client and server would have on a second transfer of
+ * the same data.  The encoder and decoder have caches of their own, and the
+ * corpus is given to them in pieces the size a pipe would see.
+ *
+ * With -p, the parts of encoding are also timed each on their own over the
+ * corpus: hashing every offset, looking every hash up in the warm cache,
+ * comparing segments and escaping.  Each is a function of its own, so that
+ * they may be told apart under a profiler, too.
+ */
+
+#define	XCODEC_SPEED_INPUT_SIZE		65536
+#define	XCODEC_SPEED_CORPUS_SIZE	(8 * 1024 * 1024)
+#define	XCODEC_SPEED_SHIFT_MAX		64
+
+static const char *corpus_words[] = {
+	"the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+	"as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+	"or", "his", "from", "at", "which", "but", "have", "an", "had", "they",
+	"you", "were", "their", "one", "all", "we", "can", "her", "has", "there",
+	"been", "if", "more", "when", "will", "would", "who", "so", "no", "proxy",
+};
+
+struct XCodecSpeedCorpus {
+	const char *name_;
+	void (*generate_)(Buffer *, size_t);
+};
+
+static void generate_random(Buffer *, size_t);
+static void generate_zeros(Buffer *, size_t);
+static void generate_shifted(Buffer *, size_t);
+static void generate_text(Buffer *, size_t);
+
+static const XCodecSpeedCorpus corpora[] = {
+	{ "random",	generate_random },
+	{ "zeros",	generate_zeros },
+	{ "shifted",	generate_shifted },
+	{ "text",	generate_text },
+};
+
+struct XCodecSpeedResult {
+	uintmax_t input_bytes_;
+	uintmax_t output_bytes_;
+	uintmax_t encode_microseconds_;
+	uintmax_t decode_microseconds_;
+	uintmax_t lookups_;
+	uintmax_t hits_;
+	uintmax_t collisions_;
+
+	XCodecSpeedResult(void)
+	: input_bytes_(0),
+	  output_bytes_(0),
+	  encode_microseconds_(0),
+	  decode_microseconds_(0),
+	  lookups_(0),
+	  hits_(0),
+	  collisions_(0)
+	{ }
+};
+
+static void bench(const std::string&, const Buffer&, bool);
+static void bench_pass(const std::string&, const std::string&, const Buffer&, XCodecCache *, XCodecCache *);
+static void bench_phases(const std::string&, const Buffer&, XCodecCache *);
+static uintmax_t phase_hash(const uint8_t *, size_t, std::vector<uint64_t>&);
+static uintmax_t phase_lookup(XCodecCache *, const std::vector<uint64_t>&);
+static uintmax_t phase_compare(const Buffer&, const std::vector<BufferSegment *>&);
+static uintmax_t phase_escape(const Buffer&);
+static void report_phase(const std::string&, const char *, uintmax_t, uintmax_t, uintmax_t, const char *);
+static float rate(uintmax_t, uintmax_t);
+static void usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	std::set<std::string> names;
+	size_t size;
+	unsigned seed;
+	bool phases, verbose;
+	int ch;
+
+	size = XCODEC_SPEED_CORPUS_SIZE;
+	seed = 1;
+	phases = false;
+	verbose = false;
+
+	while ((ch = getopt(argc, argv, "?C:pS:s:v")) != -1) {
+		switch (ch) {
+		case 'C':
+			names.insert(optarg);
+			break;
+		case 'p':
+			phases = true;
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case '?':
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage();
+	if (size < XCODEC_SEGMENT_LENGTH)
+		usage();
+
+	if (verbose) {
+		Log::mask(".?", Log::Debug);
+	} else {
+		Log::mask(".?", Log::Info);
+	}
+
+	unsigned i;
+	for (i = 0; i < sizeof corpora / sizeof corpora[0]; i++) {
+		const XCodecSpeedCorpus *corpus = &corpora[i];
+
+		if (!names.empty()) {
+			if (names.find(corpus->name_) == names.end())
+				continue;
+			names.erase(corpus->name_);
+		}
+
+		srandom(seed);
+
+		Buffer data;
+		corpus->generate_(&data, size);
+
+		bench(corpus->name_, data, phases);
+	}
+
+	if (!names.empty())
+		HALT("/example/xcodec/encode-decode/speed1") << "Unknown corpus: " << *names.begin();
+
+	return (0);
+}
+
+static void
+random_append(Buffer *buf, size_t len)
+{
+	uint8_t data[4096];
+
+	while (len != 0) {
+		size_t n = std::min(len, sizeof data);
+		unsigned i;
+
+		for (i = 0; i < n; i++)
+			data[i] = random();
+		buf->append(data, n);
+		len -= n;
+	}
+}
+
+static void
+generate_random(Buffer *buf, size_t size)
+{
+	random_append(buf, size);
+}
+
+static void
+generate_zeros(Buffer *buf, size_t size)
+{
+	uint8_t data[4096];
+
+	memset(data, 0, sizeof data);
+	while (size != 0) {
+		size_t n = std::min(size, sizeof data);
+		buf->append(data, n);
+		size -= n;
+	}
+}
+
+/*
+ * A block of random data repeated, with a few random bytes before each copy,
+ * so that the copies do not fall at the same offsets.
+ */
+static void
+generate_shifted(Buffer *buf, size_t size)
+{
+	Buffer block;
+	random_append(&block, XCODEC_SPEED_INPUT_SIZE);
+
+	while (buf->length() < size) {
+		random_append(buf, 1 + (random() % XCODEC_SPEED_SHIFT_MAX));
+		buf->append(block);
+	}
+	if (buf->length() > size)
+		buf->trim(buf->length() - size);
+}
+
+/*
+ * Words drawn at random from a short list, in lines.
+ */
+static void
+generate_text(Buffer *buf, size_t size)
+{
+	std::string line;
+
+	while (buf->length() < size) {
+		const char *word = corpus_words[random() % (sizeof corpus_words / sizeof corpus_words[0])];
+
+		if (!line.empty())
+			line += " ";
+		line += word;
+
+		if (line.length() >= 64 || random() % 16 == 0) {
+			line += "\n";
+			buf->append(line);
+			line.clear();
+		}
+	}
+	if (buf->length() > size)
+		buf->trim(buf->length() - size);
+}
+
+static void
+bench(const std::string& name, const Buffer& corpus, bool phases)
+{
+	UUID encoder_uuid, decoder_uuid;
+	encoder_uuid.generate();
+	decoder_uuid.generate();
+
+	XCodecCache *encoder_cache = new XCodecMemoryCache(encoder_uuid);
+	XCodecCache *decoder_cache = new XCodecMemoryCache(decoder_uuid);
+
+	bench_pass(name, "cold", corpus, encoder_cache, decoder_cache);
+	bench_pass(name, "warm", corpus, encoder_cache, decoder_cache);
+
+	if (phases)
+		bench_phases(name, corpus, encoder_cache);
+
+	delete encoder_cache;
+	delete decoder_cache;
+}
+
+/*
+ * One pass over the corpus with a new encoder and decoder, and so new
+ * windows, over whatever is in the caches already.
+ */
+static void
+bench_pass(const std::string& name, const std::string& caches, const Buffer& corpus, XCodecCache *encoder_cache, XCodecCache *decoder_cache)
+{
+	XCodecEncoder encoder(encoder_cache);
+	XCodecDecoder decoder(decoder_cache);
+	XCodecSpeedResult result;
+	std::vector<Buffer> encoded;
+	Buffer input(corpus);
+	Timer timer;
+
+	uintmax_t hits = encoder_cache->hits();
+	uintmax_t misses = encoder_cache->misses();
+
+	timer.start();
+	while (!input.empty()) {
+		Buffer in, out;
+
+		input.moveout(&in, std::min(input.length(), (size_t)XCODEC_SPEED_INPUT_SIZE));
+		encoder.encode(&out, &in);
+		result.output_bytes_ += out.length();
+		encoded.push_back(out);
+	}
+	timer.stop();
+	result.encode_microseconds_ = timer.sample();
+	timer.reset();
+
+	result.input_bytes_ = corpus.length();
+	result.hits_ = encoder_cache->hits() - hits;
+	result.lookups_ = result.hits_ + (encoder_cache->misses() - misses);
+	result.collisions_ = encoder.collisions();
+
+	std::set<XCodecName> unknown_hashes;
+	Buffer pending, output;
+
+	timer.start();
+	std::vector<Buffer>::iterator it;
+	for (it = encoded.begin(); it != encoded.end(); ++it) {
+		pending.append(*it);
+		if (!decoder.decode(&output, &pending, unknown_hashes))
+			HALT("/example/xcodec/encode-decode/speed1") << "Decoder failed on " << name << ".";
+		if (!unknown_hashes.empty())
+			HALT("/example/xcodec/encode-decode/speed1") << "Decoder asked for hashes on " << name << ".";
+	}
+	timer.stop();
+	result.decode_microseconds_ = timer.sample();
+
+	if (!pending.empty())
+		HALT("/example/xcodec/encode-decode/speed1") << "Decoder left " << pending.length() << " bytes on " << name << ".";
+	if (!output.equal(&corpus))
+		HALT("/example/xcodec/encode-decode/speed1") << "Output does not match corpus " << name << ".";
+
+	LogHandle log("/example/xcodec/encode-decode/speed1/" + name + "/" + caches);
+	INFO(log) << result.input_bytes_ << " bytes in, " << result.output_bytes_ << " bytes out, output ratio " << ((float)result.output_bytes_ / result.input_bytes_) << ".";
+	INFO(log) << "encode " << result.encode_microseconds_ << " microseconds, " << rate(result.input_bytes_, result.encode_microseconds_) << " MB/s.";
+	INFO(log) << "decode " << result.decode_microseconds_ << " microseconds, " << rate(result.input_bytes_, result.decode_microseconds_) << " MB/s.";
+	INFO(log) << result.lookups_ << " lookups (" << rate(result.lookups_, result.encode_microseconds_) << "M/s), " << result.hits_ << " hits, " << result.collisions_ << " collisions.";
+}
+
+/*
+ * Time the parts of encoding separately, over the corpus taken as one piece
+ * and against the warm encoder cache.
+ */
+static void
+bench_phases(const std::string& name, const Buffer& corpus, XCodecCache *cache)
+{
+	std::vector<uint8_t> data(corpus.length());
+	corpus.copyout(&data[0], data.size());
+
+	std::vector<uint64_t> hashes;
+	hashes.reserve(data.size() - XCODEC_SEGMENT_LENGTH + 1);
+
+	std::vector<BufferSegment *> segments;
+	size_t offset;
+	for (offset = 0; offset + XCODEC_SEGMENT_LENGTH <= data.size(); offset += XCODEC_SEGMENT_LENGTH)
+		segments.push_back(BufferSegment::create(&data[offset], XCODEC_SEGMENT_LENGTH));
+
+	Timer timer;
+	uintmax_t count;
+
+	timer.start();
+	count = phase_hash(&data[0], data.size(), hashes);
+	timer.stop();
+	report_phase(name, "hash", data.size(), timer.sample(), count, "hashes");
+	timer.reset();
+
+	timer.start();
+	count = phase_lookup(cache, hashes);
+	timer.stop();
+	report_phase(name, "lookup", data.size(), timer.sample(), hashes.size(), "lookups");
+	INFO("/example/xcodec/encode-decode/speed1/" + name + "/phase/lookup") << count << " hits.";
+	timer.reset();
+
+	timer.start();
+	count = phase_compare(corpus, segments);
+	timer.stop();
+	report_phase(name, "compare", segments.size() * XCODEC_SEGMENT_LENGTH, timer.sample(), count, "compares");
+	timer.reset();
+
+	timer.start();
+	count = phase_escape(corpus);
+	timer.stop();
+	report_phase(name, "escape", data.size(), timer.sample(), count, "escapes");
+
+	std::vector<BufferSegment *>::iterator it;
+	for (it = segments.begin(); it != segments.end(); ++it)
+		(*it)->unref();
+}
+
+/*
+ * Hash every offset, as the encoder does where it finds nothing to
+ * reference.
+ */
+static uintmax_t
+phase_hash(const uint8_t *data, size_t len, std::vector<uint64_t>& hashes)
+{
+	XCodecHash xcodec_hash;
+	size_t i;
+
+	for (i = 0; i < XCODEC_SEGMENT_LENGTH; i++)
+		xcodec_hash.add(data[i]);
+	hashes.push_back(xcodec_hash.mix());
+
+	for (; i < len; i++) {
+		xcodec_hash.roll(data[i]);
+		hashes.push_back(xcodec_hash.mix());
+	}
+
+	return (hashes.size());
+}
+
+static uintmax_t
+phase_lookup(XCodecCache *cache, const std::vector<uint64_t>& hashes)
+{
+	std::vector<uint64_t>::const_iterator it;
+	uintmax_t hits;
+
+	hits = 0;
+	for (it = hashes.begin(); it != hashes.end(); ++it) {
+		BufferSegment *seg = cache->lookup(*it);
+		if (seg == NULL)
+			continue;
+		seg->unref();
+		hits++;
+	}
+
+	return (hits);
+}
+
+/*
+ * Compare each segment of the corpus with its data where it lies in the
+ * corpus, as the encoder does with the segment it finds for each hash before
+ * referencing it.
+ */
+static uintmax_t
+phase_compare(const Buffer& corpus, const std::vector<BufferSegment *>& segments)
+{
+	Buffer::SegmentIterator iter = corpus.segments();
+	const BufferSegment *cseg = NULL;
+	unsigned coff = 0;
+	uintmax_t equal;
+	unsigned i;
+
+	equal = 0;
+	for (i = 0; i < segments.size(); i++) {
+		const uint8_t *p = segments[i]->data();
+		size_t resid = XCODEC_SEGMENT_LENGTH;
+		bool same = true;
+
+		while (resid != 0) {
+			if (cseg == NULL || coff == cseg->length()) {
+				cseg = *iter;
+				iter.next();
+				coff = 0;
+			}
+
+			size_t len = cseg->length() - coff;
+			if (len > resid)
+				len = resid;
+			if (same && memcmp(cseg->data() + coff, p, len) != 0)
+				same = false;
+
+			p += len;
+			coff += len;
+			resid -= len;
+		}
+
+		if (same)
+			equal++;
+	}
+
+	if (equal != segments.size())
+		HALT("/example/xcodec/encode-decode/speed1") << "Segments differ from corpus.";
+
+	return (equal);
+}
+
+/*
+ * Escape the whole corpus, as the encoder does with data it can neither
+ * declare nor reference.
+ */
+static uintmax_t
+phase_escape(const Buffer& corpus)
+{
+	Buffer input(corpus);
+	Buffer output;
+	uintmax_t escapes;
+
+	escapes = 0;
+	while (!input.empty()) {
+		unsigned offset;
+		if (!input.find(XCODEC_MAGIC, &offset)) {
+			input.moveout(&output);
+			break;
+		}
+
+		if (offset != 0)
+			input.moveout(&output, offset);
+
+		output.append(XCODEC_MAGIC);
+		output.append(XCODEC_OP_ESCAPE);
+		input.skip(sizeof XCODEC_MAGIC);
+		escapes++;
+	}
+
+	return (escapes);
+}
+
+static void
+report_phase(const std::string& name, const char *phase, uintmax_t bytes, uintmax_t microseconds, uintmax_t count, const char *what)
+{
+	INFO("/example/xcodec/encode-decode/speed1/" + name + "/phase/" + phase) << microseconds << " microseconds, " << rate(bytes, microseconds) << " MB/s, " << count << " " << what << " (" << rate(count, microseconds) << "M/s).";
+}
+
+/*
+ * Millions per second, given a count and microseconds.
+ */
+static float
+rate(uintmax_t count, uintmax_t microseconds)
+{
+	if (microseconds == 0)
+		return (0.0);
+	return ((float)count / microseconds);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+"usage: xcodec-encode-decode-speed1 [-pv] [-C corpus] [-S seed] [-s size]\n"
+"\n"
+"corpora: random zeros shifted text\n");
+	exit(1);
+}
@@ -3,5 +3,7 @@ VPATH+=	${TOPDIR}/xcodec
 SRCS+=	xcodec_cache.cc
 SRCS+=	xcodec_decoder.cc
 SRCS+=	xcodec_encoder.cc
+SRCS+=	xcodec_image.cc
 
 SRCS_io_pipe+=xcodec_pipe_pair.cc
+SRCS_io_pipe+=xcodec_push.cc
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <common/buffer.h>
+#include <common/test.h>
+#include <common/uuid/uuid.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/xcodec_fingerprint.h>
+#include <xcodec/xcodec_hash.h>
+
+/*
+ * Swapping two adjacent bytes in one place and swapping them back the other
+ * way round in another leaves both of the sums XCodecHash keeps unchanged,
+ * so the two segments made here have the same hash but different data.
+ */
+#define	SWAP_FIRST	(100)
+#define	SWAP_SECOND	(1000)
+
+/*
+ * A cache which keeps only one segment for a hash, as the caches of tack do,
+ * backed by a memory cache.
+ */
+class TaglessCache : public XCodecCache {
+	XCodecMemoryCache cache_;
+public:
+	TaglessCache(const UUID& uuid)
+	: XCodecCache(uuid),
+	  cache_(uuid)
+	{ }
+
+	~TaglessCache()
+	{ }
+
+	void enter(const uint64_t& hash, BufferSegment *seg)
+	{
+		cache_.enter(hash, seg);
+	}
+
+	BufferSegment *lookup(const uint64_t& hash) const
+	{
+		return (cache_.lookup(hash));
+	}
+
+	unsigned chain(const uint64_t& hash) const
+	{
+		if (cache_.chain(hash) == 0)
+			return (0);
+		return (XCODEC_TAG_COUNT);
+	}
+
+	BufferSegment *find(const uint64_t& hash, const XCodecFingerprint& fingerprint, uint8_t *tagp) const
+	{
+		return (cache_.find(hash, fingerprint, tagp));
+	}
+
+	bool out_of_band(void) const
+	{
+		return (false);
+	}
+
+	size_t entries(void) const
+	{
+		return (cache_.entries());
+	}
+};
+
+int
+main(void)
+{
+	TestGroup g("/test/xcodec/collision1", "XCodec hash collisions #1");
+
+	uint8_t a[XCODEC_SEGMENT_LENGTH], b[XCODEC_SEGMENT_LENGTH];
+	uint32_t seed = 1;
+	unsigned i;
+
+	for (i = 0; i < sizeof a; i++) {
+		seed = seed * 1103515245 + 12345;
+		a[i] = seed >> 16;
+	}
+	a[SWAP_FIRST] = 0x10;
+	a[SWAP_FIRST + 1] = 0x21;
+	a[SWAP_SECOND] = 0x21;
+	a[SWAP_SECOND + 1] = 0x10;
+
+	memcpy(b, a, sizeof b);
+	b[SWAP_FIRST] = 0x21;
+	b[SWAP_FIRST + 1] = 0x10;
+	b[SWAP_SECOND] = 0x10;
+	b[SWAP_SECOND + 1] = 0x21;
+
+	uint64_t hash = XCodecHash::hash(a);
+	{
+		Test _(g, "Different data.", memcmp(a, b, sizeof a) != 0);
+	}
+	{
+		Test _(g, "Same hash.", XCodecHash::hash(b) == hash);
+	}
+	{
+		Test _(g, "Different fingerprints.", XCodecFingerprint::fingerprint(a) != XCodecFingerprint::fingerprint(b));
+	}
+
+	/*
+	 * Fingerprints are the same however the data is split up.
+	 */
+	{
+		Buffer split;
+		split.append(b, 1);
+		split.append(a, 3);
+		split.append(a + 3, 1021);
+		split.append(a + 1024, sizeof a - 1024);
+		Test _(g, "Fingerprint of split data.", XCodecFingerprint::fingerprint(&split, 1) == XCodecFingerprint::fingerprint(a));
+	}
+
+	Buffer original;
+	for (i = 0; i < 2; i++) {
+		original.append(a, sizeof a);
+		original.append(b, sizeof b);
+	}
+
+	UUID uuid;
+	uuid.generate();
+
+	XCodecCache *encoder_cache = new XCodecMemoryCache(uuid);
+	XCodecCache *decoder_cache = new XCodecMemoryCache(uuid);
+
+	XCodecEncoder encoder(encoder_cache);
+	Buffer in(original), out;
+	encoder.encode(&out, &in);
+	{
+		Test _(g, "No collisions.", encoder.collisions() == 0);
+	}
+	{
+		Test _(g, "Both segments extracted.", encoder_cache->entries() == 2);
+	}
+	{
+		Test _(g, "Both segments referenced again.", out.length() < 2 * XCODEC_SEGMENT_LENGTH + 16);
+	}
+
+	XCodecDecoder decoder(decoder_cache);
+	std::set<XCodecName> unknown_hashes;
+	Buffer decoded;
+	{
+		Test _(g, "Decoder success.", decoder.decode(&decoded, &out, unknown_hashes));
+	}
+	{
+		Test _(g, "No unknown hashes.", unknown_hashes.empty());
+	}
+	{
+		Test _(g, "Expected data.", decoded.equal(&original));
+	}
+
+	/*
+	 * A new stream references the second segment by its hash and tag.
+	 */
+	Buffer second(b, sizeof b);
+	{
+		XCodecEncoder encoder2(encoder_cache);
+		in = second;
+		out.clear();
+		encoder2.encode(&out, &in);
+	}
+	{
+		Test _(g, "Referenced by hash and tag.", out.length() == 2 + sizeof (uint64_t) + 1);
+	}
+
+	{
+		XCodecDecoder decoder2(decoder_cache);
+		Buffer encoded(out);
+		decoded.clear();
+		{
+			Test _(g, "Decoder success.", decoder2.decode(&decoded, &encoded, unknown_hashes));
+		}
+		{
+			Test _(g, "Expected data.", decoded.equal(&second));
+		}
+	}
+
+	/*
+	 * A peer which has not seen it asks for it by hash and tag.
+	 */
+	{
+		XCodecCache *empty_cache = new XCodecMemoryCache(uuid);
+		XCodecDecoder decoder3(empty_cache);
+		Buffer encoded(out);
+		decoded.clear();
+		{
+			Test _(g, "Decoder success.", decoder3.decode(&decoded, &encoded, unknown_hashes));
+		}
+		{
+			Test _(g, "Unknown hash and tag.", unknown_hashes.size() == 1 && unknown_hashes.count(XCodecName(hash, 1)) == 1);
+		}
+		{
+			Test _(g, "Nothing decoded.", decoded.empty());
+		}
+		delete empty_cache;
+	}
+
+	/*
+	 * A decoder whose cache does not keep tags fails on a declaration
+	 * with a tag.
+	 */
+	{
+		XCodecMemoryCache encoder3_cache(uuid);
+		XCodecEncoder encoder3(&encoder3_cache);
+		in = original;
+		out.clear();
+		encoder3.encode(&out, &in);
+
+		TaglessCache tagless_cache(uuid);
+		XCodecDecoder decoder4(&tagless_cache);
+		decoded.clear();
+		{
+			Test _(g, "Decoder failure.", !decoder4.decode(&decoded, &out, unknown_hashes));
+		}
+	}
+
+	/*
+	 * An encoder whose peer does not decode tags escapes the second
+	 * segment rather than declaring it under a tag.
+	 */
+	{
+		XCodecMemoryCache encoder4_cache(uuid);
+		XCodecEncoder encoder4(&encoder4_cache);
+		encoder4.set_tags(false);
+		in = original;
+		out.clear();
+		encoder4.encode(&out, &in);
+		{
+			Test _(g, "Collisions without tags.", encoder4.collisions() != 0);
+		}
+		{
+			Test _(g, "One segment extracted.", encoder4_cache.entries() == 1);
+		}
+
+		TaglessCache tagless_cache(uuid);
+		XCodecDecoder decoder5(&tagless_cache);
+		decoded.clear();
+		unknown_hashes.clear();
+		{
+			Test _(g, "Decoder success.", decoder5.decode(&decoded, &out, unknown_hashes));
+		}
+		{
+			Test _(g, "No unknown hashes.", unknown_hashes.empty());
+		}
+		{
+			Test _(g, "Expected data.", decoded.equal(&original));
+		}
+	}
+
+	delete encoder_cache;
+	delete decoder_cache;
+
+	return (0);
+}
@@ -77,7 +77,7 @@ main(void)
 			out.moveout(&in);
 
 			XCodecDecoder decoder(cache);
-			std::set<uint64_t> unknown_hashes;
+			std::set<XCodecName> unknown_hashes;
 
 			bool ok = decoder.decode(&out, &in, unknown_hashes);
 			{
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <common/buffer.h>
+#include <common/test.h>
+#include <common/uuid/uuid.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_decoder.h>
+#include <xcodec/xcodec_encoder.h>
+#include <xcodec/xcodec_hash.h>
+#include <xcodec/xcodec_image.h>
+
+#define	SEGMENTS	(64)
+
+int
+main(void)
+{
+	TestGroup g("/test/xcodec/image1", "XCodecImage #1");
+
+	char path[] = "/tmp/xcodec-image1.XXXXXX";
+	int fd = mkstemp(path);
+	{
+		Test _(g, "Temporary file created.", fd != -1);
+	}
+	close(fd);
+
+	Buffer original;
+	{
+		XCodecImage image;
+		uint32_t seed = 1;
+
+		unsigned i;
+		for (i = 0; i < SEGMENTS; i++) {
+			uint8_t data[XCODEC_SEGMENT_LENGTH];
+			unsigned j;
+			for (j = 0; j < sizeof data; j++) {
+				seed = seed * 1103515245 + 12345;
+				data[j] = seed >> 16;
+			}
+			original.append(data, sizeof data);
+
+			BufferSegment *seg = BufferSegment::create(data, sizeof data);
+			{
+				Test _(g, "Segment added.", image.add(XCodecHash::hash(data), seg));
+			}
+			{
+				Test _(g, "Segment not added twice.", !image.add(XCodecHash::hash(data), seg));
+			}
+			seg->unref();
+		}
+
+		{
+			Test _(g, "Image saved.", image.save(path));
+		}
+	}
+
+	{
+		Test _(g, "Image recognized.", XCodecImage::probe(path));
+	}
+
+	XCodecImage image;
+	{
+		Test _(g, "Image loaded.", image.load(path));
+	}
+	{
+		Test _(g, "Expected number of segments.", image.entries() == SEGMENTS);
+	}
+
+	UUID uuid;
+	uuid.generate();
+
+	XCodecCache *encoder_cache = new XCodecMemoryCache(uuid);
+	image.seed(encoder_cache);
+
+	XCodecCache *decoder_cache = new XCodecMemoryCache(uuid);
+	image.seed(decoder_cache);
+
+	XCodecEncoder encoder(encoder_cache);
+	Buffer in(original), out;
+	encoder.encode(&out, &in);
+	{
+		Test _(g, "Nothing new extracted.", encoder_cache->entries() == SEGMENTS);
+	}
+	{
+		Test _(g, "Encoded as references.", out.length() < original.length() / 64);
+	}
+
+	XCodecDecoder decoder(decoder_cache);
+	std::set<XCodecName> unknown_hashes;
+	Buffer decoded;
+	{
+		Test _(g, "Decoder success.", decoder.decode(&decoded, &out, unknown_hashes));
+	}
+	{
+		Test _(g, "No unknown hashes.", unknown_hashes.empty());
+	}
+	{
+		Test _(g, "Expected data.", decoded.equal(&original));
+	}
+
+	delete encoder_cache;
+	delete decoder_cache;
+
+	/*
+	 * An image whose last segment no longer matches its hash in the
+	 * index must be refused.
+	 */
+	{
+		off_t last = XCODEC_IMAGE_HEADER_LENGTH + SEGMENTS * (sizeof (uint64_t) + XCODEC_SEGMENT_LENGTH) - 1;
+		uint8_t byte = 0;
+
+		fd = open(path, O_RDWR);
+		{
+			Test _(g, "Image opened.", fd != -1);
+		}
+		{
+			Test _(g, "Byte read.", pread(fd, &byte, sizeof byte, last) == sizeof byte);
+		}
+		byte ^= 0xff;
+		{
+			Test _(g, "Byte changed.", pwrite(fd, &byte, sizeof byte, last) == sizeof byte);
+		}
+		close(fd);
+	}
+	{
+		XCodecImage corrupt;
+		{
+			Test _(g, "Corrupt image refused.", !corrupt.load(path));
+		}
+		{
+			Test _(g, "Nothing kept from corrupt image.", corrupt.entries() == 0);
+		}
+	}
+
+	/*
+	 * A truncated image must be refused.
+	 */
+	{
+		Test _(g, "Image truncated.", truncate(path, XCODEC_IMAGE_HEADER_LENGTH + SEGMENTS * sizeof (uint64_t)) == 0);
+	}
+	{
+		XCodecImage truncated;
+		Test _(g, "Truncated image refused.", !truncated.load(path));
+	}
+
+	unlink(path);
+
+	return (0);
+}
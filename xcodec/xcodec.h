@@ -26,6 +26,8 @@
 #ifndef	XCODEC_XCODEC_H
 #define	XCODEC_XCODEC_H
 
+#include <utility>
+
 #define	XCODEC_MAGIC		((uint8_t)0xf1)	/* Magic!  */
 
 /*
@@ -84,17 +86,95 @@
  */
 #define	XCODEC_OP_BACKREF	((uint8_t)0x03)
 
+/*
+ * Usage:
+ * 	<MAGIC> <OP_EXTRACT_TAG> tag[uint8_t] data[uint8_t x XCODEC_SEGMENT_LENGTH]
+ *
+ * Effects:
+ * 	As OP_EXTRACT, but the data is associated with the hash of `data' and
+ * 	the tag `tag', which is never 0.  This is sent for data whose hash
+ * 	collides with that of other data the encoder already knows.
+ *
+ * Side-effects:
+ * 	The data is put into the backref FIFO.
+ */
+#define	XCODEC_OP_EXTRACT_TAG	((uint8_t)0x04)
+
+/*
+ * Usage:
+ * 	<MAGIC> <OP_REF_TAG> hash[uint64_t] tag[uint8_t]
+ *
+ * Effects:
+ * 	As OP_REF, for the data associated with the hash `hash' and the tag
+ * 	`tag', which is never 0.
+ *
+ * Side-effects:
+ * 	The data is put into the backref FIFO.
+ */
+#define	XCODEC_OP_REF_TAG	((uint8_t)0x05)
+
 #define	XCODEC_SEGMENT_LENGTH	(2048)
 
+/*
+ * Segments are named by their hash and a tag.  The first segment known by
+ * a hash has tag 0, which is all peers from before there were tags know of,
+ * and any others whose hashes collide with it are given the tags after it.
+ */
+#define	XCODEC_TAG_COUNT	(0x100)
+
+typedef	std::pair<uint64_t, uint8_t> XCodecName;
+
 class XCodecCache;
+class XCodecImage;
+
+/*
+ * What the streams using an XCodec have done, for monitoring.  These are
+ * only updated by the pipes, on the event thread, and so are plain counts.
+ *
+ * An <ASK> round is the time from sending <ASK>s to having every one of them
+ * answered, during which the decoder is stalled.
+ */
+struct XCodecStats {
+	uintmax_t encoder_input_bytes_;
+	uintmax_t encoder_output_bytes_;
+	uintmax_t decoder_input_bytes_;
+	uintmax_t decoder_output_bytes_;
+
+	uintmax_t ask_sent_;
+	uintmax_t ask_received_;
+	uintmax_t learn_sent_;
+	uintmax_t learn_received_;
+	uintmax_t learn_pushed_;
+
+	uintmax_t ask_rounds_;
+	uintmax_t ask_round_nanoseconds_;
+
+	XCodecStats(void)
+	: encoder_input_bytes_(0),
+	  encoder_output_bytes_(0),
+	  decoder_input_bytes_(0),
+	  decoder_output_bytes_(0),
+	  ask_sent_(0),
+	  ask_received_(0),
+	  learn_sent_(0),
+	  learn_received_(0),
+	  learn_pushed_(0),
+	  ask_rounds_(0),
+	  ask_round_nanoseconds_(0)
+	{ }
+};
 
 class XCodec {
 	LogHandle log_;
 	XCodecCache *cache_;
+	const XCodecImage *image_;
+	XCodecStats stats_;
 public:
-	XCodec(XCodecCache *database)
+	XCodec(XCodecCache *database, const XCodecImage *image = NULL)
 	: log_("/xcodec"),
-	  cache_(database)
+	  cache_(database),
+	  image_(image),
+	  stats_()
 	{ }
 
 	~XCodec()
@@ -104,6 +184,25 @@ public:
 	{
 		return (cache_);
 	}
+
+	/*
+	 * The dictionary image our cache was seeded from, if any, with
+	 * which the caches for our peers are seeded too.
+	 */
+	const XCodecImage *image(void) const
+	{
+		return (image_);
+	}
+
+	XCodecStats *stats(void)
+	{
+		return (&stats_);
+	}
+
+	const XCodecStats *stats(void) const
+	{
+		return (&stats_);
+	}
 };
 
 #endif /* !XCODEC_XCODEC_H */
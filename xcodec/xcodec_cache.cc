@@ -23,9 +23,164 @@
  * SUCH DAMAGE.
  */
 
+#include <algorithm>
+
 #include <common/buffer.h>
 
 #include <xcodec/xcodec.h>
 #include <xcodec/xcodec_cache.h>
 
 std::map<UUID, XCodecCache *> XCodecCache::cache_map;
+
+namespace {
+	/*
+	 * Orders by reference count, most first, and then by hash, so that
+	 * the order is stable.
+	 */
+	struct PopularOrder {
+		bool operator() (const std::pair<uintmax_t, uint64_t>& a, const std::pair<uintmax_t, uint64_t>& b) const
+		{
+			if (a.first != b.first)
+				return (a.first > b.first);
+			return (a.second < b.second);
+		}
+	};
+}
+
+/*
+ * Keep the most-referenced of the segments that have been referenced at all
+ * in a heap with the least of them on top, so that choosing a few from a
+ * large cache is cheap.
+ */
+void
+XCodecMemoryCache::popular(std::vector<std::pair<uint64_t, BufferSegment *> >& segments, size_t max, const std::set<uint64_t>& except) const
+{
+	std::vector<std::pair<uintmax_t, uint64_t> > heap;
+	PopularOrder order;
+
+	if (max == 0)
+		return;
+
+	segment_hash_map_t::const_iterator it;
+	for (it = segment_hash_map_.begin(); it != segment_hash_map_.end(); ++it) {
+		if (it->second.refs_ == 0)
+			continue;
+		if (except.find(it->first.hash_) != except.end())
+			continue;
+
+		std::pair<uintmax_t, uint64_t> candidate(it->second.refs_, it->first.hash_);
+		if (heap.size() == max) {
+			if (!order(candidate, heap.front()))
+				continue;
+			std::pop_heap(heap.begin(), heap.end(), order);
+			heap.pop_back();
+		}
+		heap.push_back(candidate);
+		std::push_heap(heap.begin(), heap.end(), order);
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), order);
+
+	std::vector<std::pair<uintmax_t, uint64_t> >::const_iterator hit;
+	for (hit = heap.begin(); hit != heap.end(); ++hit) {
+		it = segment_hash_map_.find(hit->second);
+		ASSERT(log_, it != segment_hash_map_.end());
+
+		BufferSegment *seg = it->second.seg_;
+		seg->ref();
+		segments.push_back(std::pair<uint64_t, BufferSegment *>(hit->second, seg));
+	}
+}
+
+/*
+ * Segments with a hash sort in the order of their tags, so the last of them
+ * gives the tag for the next.
+ */
+unsigned
+XCodecMemoryCache::chain(const uint64_t& hash) const
+{
+	if (!segment_chain_map_.empty()) {
+		segment_chain_map_t::const_iterator it;
+
+		it = segment_chain_map_.upper_bound(XCodecName(hash, XCODEC_TAG_COUNT - 1));
+		if (it != segment_chain_map_.begin()) {
+			--it;
+			if (it->first.first == hash)
+				return ((unsigned)it->first.second + 1);
+		}
+	}
+
+	if (segment_hash_map_.find(hash) != segment_hash_map_.end())
+		return (1);
+	misses_++;
+	return (0);
+}
+
+BufferSegment *
+XCodecMemoryCache::find(const uint64_t& hash, const XCodecFingerprint& fingerprint, uint8_t *tagp) const
+{
+	const Entry *entry = NULL;
+	uint8_t tag = 0;
+
+	segment_hash_map_t::const_iterator it = segment_hash_map_.find(hash);
+	if (it != segment_hash_map_.end() && it->second.fingerprint() == fingerprint) {
+		entry = &it->second;
+	} else if (!segment_chain_map_.empty()) {
+		segment_chain_map_t::const_iterator cit;
+		for (cit = segment_chain_map_.lower_bound(XCodecName(hash, 1));
+		     cit != segment_chain_map_.end() && cit->first.first == hash; ++cit) {
+			if (cit->second.fingerprint() == fingerprint) {
+				entry = &cit->second;
+				tag = cit->first.second;
+				break;
+			}
+		}
+	}
+
+	if (entry == NULL) {
+		misses_++;
+		return (NULL);
+	}
+	hits_++;
+	entry->refs_++;
+
+	BufferSegment *seg = entry->seg_;
+	seg->ref();
+	*tagp = tag;
+	return (seg);
+}
+
+bool
+XCodecMemoryCache::enter_tag(const uint64_t& hash, uint8_t tag, BufferSegment *seg)
+{
+	if (tag == 0) {
+		enter(hash, seg);
+		return (true);
+	}
+
+	ASSERT(log_, seg->length() == XCODEC_SEGMENT_LENGTH);
+	ASSERT(log_, segment_chain_map_.find(XCodecName(hash, tag)) == segment_chain_map_.end());
+	seg->ref();
+	segment_chain_map_.insert(segment_chain_map_t::value_type(XCodecName(hash, tag), Entry(seg)));
+	return (true);
+}
+
+BufferSegment *
+XCodecMemoryCache::lookup_tag(const uint64_t& hash, uint8_t tag) const
+{
+	if (tag == 0)
+		return (lookup(hash));
+
+	segment_chain_map_t::const_iterator it;
+	it = segment_chain_map_.find(XCodecName(hash, tag));
+	if (it == segment_chain_map_.end()) {
+		misses_++;
+		return (NULL);
+	}
+	hits_++;
+	it->second.refs_++;
+
+	BufferSegment *seg = it->second.seg_;
+	seg->ref();
+	return (seg);
+}
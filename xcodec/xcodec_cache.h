@@ -28,9 +28,13 @@
 
 #include <ext/hash_map>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <common/uuid/uuid.h>
 
+#include <xcodec/xcodec_fingerprint.h>
+
 /*
  * XXX
  * GCC supports hash<unsigned long> but not hash<unsigned long long>.  On some
@@ -70,8 +74,18 @@ class XCodecCache {
 protected:
 	UUID uuid_;
 
+	/*
+	 * Counted by the caches themselves, for monitoring.
+	 */
+	mutable uintmax_t hits_;
+	mutable uintmax_t misses_;
+	uintmax_t evictions_;
+
 	XCodecCache(const UUID& uuid)
-	: uuid_(uuid)
+	: uuid_(uuid),
+	  hits_(0),
+	  misses_(0),
+	  evictions_(0)
 	{ }
 
 public:
@@ -81,6 +95,66 @@ public:
 	virtual void enter(const uint64_t&, BufferSegment *) = 0;
 	virtual BufferSegment *lookup(const uint64_t&) const = 0;
 	virtual bool out_of_band(void) const = 0;
+	virtual size_t entries(void) const = 0;
+
+	/*
+	 * Segments whose hash collides with that of segments already in the
+	 * cache are entered under the next tag, and the segment with a given
+	 * hash and data is found by its fingerprint.  chain() gives the tag
+	 * the next segment with a hash would be entered under, which is 0 if
+	 * no segment has that hash, in which case a miss is counted, and
+	 * XCODEC_TAG_COUNT if no more can be entered.  Caches which do not
+	 * keep tags never have more than one segment with a hash, and
+	 * enter_tag() fails for any tag other than 0, which a peer may still
+	 * send.
+	 */
+	virtual unsigned chain(const uint64_t&) const = 0;
+	virtual BufferSegment *find(const uint64_t&, const XCodecFingerprint&, uint8_t *) const = 0;
+
+	virtual bool enter_tag(const uint64_t& hash, uint8_t tag, BufferSegment *seg)
+	{
+		if (tag != 0)
+			return (false);
+		enter(hash, seg);
+		return (true);
+	}
+
+	virtual BufferSegment *lookup_tag(const uint64_t& hash, uint8_t tag) const
+	{
+		if (tag != 0) {
+			misses_++;
+			return (NULL);
+		}
+		return (lookup(hash));
+	}
+
+	/*
+	 * The most-referenced segments other than those given, most first,
+	 * for those caches which keep count.  Each segment is referenced for
+	 * the caller.  Only segments with tag 0 are considered.
+	 */
+	virtual void popular(std::vector<std::pair<uint64_t, BufferSegment *> >&, size_t, const std::set<uint64_t>&) const
+	{ }
+
+	const UUID& uuid(void) const
+	{
+		return (uuid_);
+	}
+
+	uintmax_t hits(void) const
+	{
+		return (hits_);
+	}
+
+	uintmax_t misses(void) const
+	{
+		return (misses_);
+	}
+
+	uintmax_t evictions(void) const
+	{
+		return (evictions_);
+	}
 
 	bool uuid_encode(Buffer *buf) const
 	{
@@ -104,20 +178,61 @@ public:
 		return (it->second);
 	}
 
+	static const std::map<UUID, XCodecCache *>& caches(void)
+	{
+		return (cache_map);
+	}
+
 private:
 	static std::map<UUID, XCodecCache *> cache_map;
 };
 
 class XCodecMemoryCache : public XCodecCache {
-	typedef __gnu_cxx::hash_map<Hash64, BufferSegment *> segment_hash_map_t;
+	struct Entry {
+		BufferSegment *seg_;
+		mutable uintmax_t refs_;
+		mutable bool fingerprinted_;
+		mutable XCodecFingerprint fingerprint_;
+
+		Entry(BufferSegment *seg)
+		: seg_(seg),
+		  refs_(0),
+		  fingerprinted_(false),
+		  fingerprint_()
+		{ }
+
+		/*
+		 * Only the encoder's cache is ever searched by fingerprint,
+		 * so they are taken when first needed.
+		 */
+		const XCodecFingerprint& fingerprint(void) const
+		{
+			if (!fingerprinted_) {
+				fingerprint_ = XCodecFingerprint::fingerprint(seg_->data());
+				fingerprinted_ = true;
+			}
+			return (fingerprint_);
+		}
+	};
+
+	typedef __gnu_cxx::hash_map<Hash64, Entry> segment_hash_map_t;
+	typedef std::map<XCodecName, Entry> segment_chain_map_t;
 
 	LogHandle log_;
 	segment_hash_map_t segment_hash_map_;
+
+	/*
+	 * Segments with tags other than 0, which are rare.  A segment may be
+	 * here without there being one with tag 0 when a peer has told us
+	 * only of the one it extracted to us.
+	 */
+	segment_chain_map_t segment_chain_map_;
 public:
 	XCodecMemoryCache(const UUID& uuid)
 	: XCodecCache(uuid),
 	  log_("/xcodec/cache/memory"),
-	  segment_hash_map_()
+	  segment_hash_map_(),
+	  segment_chain_map_()
 	{ }
 
 	~XCodecMemoryCache()
@@ -125,8 +240,14 @@ public:
 		segment_hash_map_t::const_iterator it;
 		for (it = segment_hash_map_.begin();
 		     it != segment_hash_map_.end(); ++it)
-			it->second->unref();
+			it->second.seg_->unref();
 		segment_hash_map_.clear();
+
+		segment_chain_map_t::const_iterator cit;
+		for (cit = segment_chain_map_.begin();
+		     cit != segment_chain_map_.end(); ++cit)
+			cit->second.seg_->unref();
+		segment_chain_map_.clear();
 	}
 
 	void enter(const uint64_t& hash, BufferSegment *seg)
@@ -134,7 +255,7 @@ public:
 		ASSERT(log_, seg->length() == XCODEC_SEGMENT_LENGTH);
 		ASSERT(log_, segment_hash_map_.find(hash) == segment_hash_map_.end());
 		seg->ref();
-		segment_hash_map_[hash] = seg;
+		segment_hash_map_.insert(segment_hash_map_t::value_type(hash, Entry(seg)));
 	}
 
 	bool out_of_band(void) const
@@ -146,19 +267,35 @@ public:
 		return (false);
 	}
 
+	size_t entries(void) const
+	{
+		return (segment_hash_map_.size() + segment_chain_map_.size());
+	}
+
 	BufferSegment *lookup(const uint64_t& hash) const
 	{
 		segment_hash_map_t::const_iterator it;
 		it = segment_hash_map_.find(hash);
-		if (it == segment_hash_map_.end())
+		if (it == segment_hash_map_.end()) {
+			misses_++;
 			return (NULL);
+		}
+		hits_++;
+		it->second.refs_++;
 
 		BufferSegment *seg;
 
-		seg = it->second;
+		seg = it->second.seg_;
 		seg->ref();
 		return (seg);
 	}
+
+	unsigned chain(const uint64_t&) const;
+	BufferSegment *find(const uint64_t&, const XCodecFingerprint&, uint8_t *) const;
+	bool enter_tag(const uint64_t&, uint8_t, BufferSegment *);
+	BufferSegment *lookup_tag(const uint64_t&, uint8_t) const;
+
+	void popular(std::vector<std::pair<uint64_t, BufferSegment *> >&, size_t, const std::set<uint64_t>&) const;
 };
 
 #endif /* !XCODEC_XCODEC_CACHE_H */
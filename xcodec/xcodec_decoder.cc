@@ -64,7 +64,7 @@ XCodecDecoder::~XCodecDecoder()
  * share an originator.
  */
 bool
-XCodecDecoder::decode(Buffer *output, Buffer *input, std::set<uint64_t>& unknown_hashes)
+XCodecDecoder::decode(Buffer *output, Buffer *input, std::set<XCodecName>& unknown_hashes)
 {
 	while (!input->empty()) {
 		unsigned off;
@@ -118,7 +118,45 @@ XCodecDecoder::decode(Buffer *output, Buffer *input, std::set<uint64_t>& unknown
 					cache_->enter(hash, seg);
 				}
 
-				window_.declare(hash, seg);
+				window_.declare(XCodecName(hash, 0), seg);
+				output->append(seg);
+				seg->unref();
+			}
+			break;
+		case XCODEC_OP_EXTRACT_TAG:
+			if (input->length() < sizeof XCODEC_MAGIC + sizeof op + sizeof (uint8_t) + XCODEC_SEGMENT_LENGTH)
+				goto done;
+			else {
+				uint8_t tag;
+				input->moveout(&tag, sizeof XCODEC_MAGIC + sizeof op, sizeof tag);
+				if (tag == 0) {
+					ERROR(log_) << "Zero tag in <EXTRACT_TAG>.";
+					return (false);
+				}
+
+				BufferSegment *seg;
+				input->copyout(&seg, XCODEC_SEGMENT_LENGTH);
+				input->skip(XCODEC_SEGMENT_LENGTH);
+
+				uint64_t hash = XCodecHash::hash(seg->data());
+				BufferSegment *oseg = cache_->lookup_tag(hash, tag);
+				if (oseg != NULL) {
+					if (oseg->equal(seg)) {
+						seg->unref();
+						seg = oseg;
+					} else {
+						ERROR(log_) << "Collision in <EXTRACT_TAG>.";
+						oseg->unref();
+						seg->unref();
+						return (false);
+					}
+				} else if (!cache_->enter_tag(hash, tag, seg)) {
+					ERROR(log_) << "Cache does not keep the tag in <EXTRACT_TAG>.";
+					seg->unref();
+					return (false);
+				}
+
+				window_.declare(XCodecName(hash, tag), seg);
 				output->append(seg);
 				seg->unref();
 			}
@@ -131,11 +169,13 @@ XCodecDecoder::decode(Buffer *output, Buffer *input, std::set<uint64_t>& unknown
 				input->extract(&behash, sizeof XCODEC_MAGIC + sizeof op);
 				uint64_t hash = BigEndian::decode(behash);
 
+				XCodecName name(hash, 0);
+
 				BufferSegment *oseg = cache_->lookup(hash);
 				if (oseg == NULL) {
-					if (unknown_hashes.find(hash) == unknown_hashes.end()) {
+					if (unknown_hashes.find(name) == unknown_hashes.end()) {
 						DEBUG(log_) << "Sending <ASK>, waiting for <LEARN>.";
-						unknown_hashes.insert(hash);
+						unknown_hashes.insert(name);
 					} else {
 						DEBUG(log_) << "Already sent <ASK>, waiting for <LEARN>.";
 					}
@@ -145,7 +185,43 @@ XCodecDecoder::decode(Buffer *output, Buffer *input, std::set<uint64_t>& unknown
 
 				input->skip(sizeof XCODEC_MAGIC + sizeof op + sizeof behash);
 
-				window_.declare(hash, oseg);
+				window_.declare(name, oseg);
+				output->append(oseg);
+				oseg->unref();
+			}
+			break;
+		case XCODEC_OP_REF_TAG:
+			if (input->length() < sizeof XCODEC_MAGIC + sizeof op + sizeof (uint64_t) + sizeof (uint8_t))
+				goto done;
+			else {
+				uint64_t behash;
+				input->extract(&behash, sizeof XCODEC_MAGIC + sizeof op);
+				uint64_t hash = BigEndian::decode(behash);
+
+				uint8_t tag;
+				input->copyout(&tag, sizeof XCODEC_MAGIC + sizeof op + sizeof behash, sizeof tag);
+				if (tag == 0) {
+					ERROR(log_) << "Zero tag in <REF_TAG>.";
+					return (false);
+				}
+
+				XCodecName name(hash, tag);
+
+				BufferSegment *oseg = cache_->lookup_tag(hash, tag);
+				if (oseg == NULL) {
+					if (unknown_hashes.find(name) == unknown_hashes.end()) {
+						DEBUG(log_) << "Sending <ASK_TAG>, waiting for <LEARN_TAG>.";
+						unknown_hashes.insert(name);
+					} else {
+						DEBUG(log_) << "Already sent <ASK_TAG>, waiting for <LEARN_TAG>.";
+					}
+
+					return (true);
+				}
+
+				input->skip(sizeof XCODEC_MAGIC + sizeof op + sizeof behash + sizeof tag);
+
+				window_.declare(name, oseg);
 				output->append(oseg);
 				oseg->unref();
 			}
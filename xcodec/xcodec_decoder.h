@@ -41,7 +41,7 @@ public:
 	XCodecDecoder(XCodecCache *);
 	~XCodecDecoder();
 
-	bool decode(Buffer *, Buffer *, std::set<uint64_t>&);
+	bool decode(Buffer *, Buffer *, std::set<XCodecName>&);
 };
 
 #endif /* !XCODEC_XCODEC_DECODER_H */
@@ -29,19 +29,25 @@
 #include <xcodec/xcodec.h>
 #include <xcodec/xcodec_cache.h>
 #include <xcodec/xcodec_encoder.h>
+#include <xcodec/xcodec_fingerprint.h>
 #include <xcodec/xcodec_hash.h>
 
 struct candidate_symbol {
 	bool set_;
 	unsigned offset_;
 	uint64_t symbol_;
+	uint8_t tag_;
 };
 
+static bool segment_equal(const Buffer *, unsigned, const BufferSegment *);
+
 XCodecEncoder::XCodecEncoder(XCodecCache *cache)
 : log_("/xcodec/encoder"),
   cache_(cache),
   window_(),
-  stream_(!cache_->out_of_band())
+  stream_(!cache_->out_of_band()),
+  tags_(true),
+  collisions_(0)
 { }
 
 XCodecEncoder::~XCodecEncoder()
@@ -163,8 +169,7 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 			 * covers, declare it now.
 			 */
 			if (candidate.set_ && candidate.offset_ + XCODEC_SEGMENT_LENGTH <= start) {
-				BufferSegment *nseg;
-				encode_declaration(output, &outq, candidate.offset_, candidate.symbol_, &nseg);
+				encode_declaration(output, &outq, candidate.offset_, candidate.symbol_, candidate.tag_);
 
 				o -= candidate.offset_ + XCODEC_SEGMENT_LENGTH;
 				start = o - XCODEC_SEGMENT_LENGTH;
@@ -172,67 +177,75 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 				candidate.set_ = false;
 
 				/*
-				 * If, on top of that, the just-declared hash is
-				 * the same as the current hash, consider referencing
-				 * it immediately.
+				 * If the just-declared hash is the same as the
+				 * current hash, the lookup below will consider
+				 * referencing it immediately.
 				 */
-				if (hash == candidate.symbol_) {
-					/*
-					 * If it's a hash collision, though, nevermind.
-					 * Skip trying to use this hash as a reference,
-					 * too, and go on to the next one.
-					 */
-					if (!encode_reference(output, &outq, start, hash, nseg)) {
-						nseg->unref();
-						DEBUG(log_) << "Collision in adjacent-declare pass.";
-						continue;
-					}
-					nseg->unref();
-
-					/*
-					 * But if there's no collection, then we can move
-					 * on to looking for the *next* hash/data to declare
-					 * or reference.
-					 */
-					o = 0;
-					xcodec_hash.reset();
-
-					DEBUG(log_) << "Hit in adjacent-declare pass.";
-					continue;
-				}
-				nseg->unref();
 			}
 
 			/*
 			 * Now attempt to encode this hash as a reference if it
-			 * has been defined before.
+			 * has been defined before.  The hash alone is too weak
+			 * to be sure the data is the same, so the segments
+			 * with this hash are told apart by their fingerprints,
+			 * taken from the data where it lies, and the data of
+			 * the one found is then compared.
 			 */
-			BufferSegment *oseg = cache_->lookup(hash);
-			if (oseg != NULL) {
-				/*
-				 * This segment already exists.  If it's
-				 * identical to this chunk of data, then that's
-				 * positively fantastic.
-				 */
-				if (encode_reference(output, &outq, start, hash, oseg)) {
-					oseg->unref();
+			unsigned tag = cache_->chain(hash);
+			if (tag != 0) {
+				XCodecFingerprint fingerprint = XCodecFingerprint::fingerprint(&outq, start);
 
-					o = 0;
-					xcodec_hash.reset();
+				uint8_t otag;
+				BufferSegment *oseg = cache_->find(hash, fingerprint, &otag);
+				if (oseg != NULL && otag != 0 && !tags_) {
+					/*
+					 * The peer could not decode a reference
+					 * to this segment.
+					 */
+					oseg->unref();
+					collisions_++;
+					DEBUG(log_) << "Tagged segment in first pass without tags.";
+					continue;
+				}
+				if (oseg != NULL) {
+					/*
+					 * This segment already exists, and is
+					 * identical to this chunk of data, which
+					 * is positively fantastic.
+					 */
+					if (encode_reference(output, &outq, start, hash, otag, oseg)) {
+						oseg->unref();
+
+						o = 0;
+						xcodec_hash.reset();
+
+						/*
+						 * We have output any data before this
+						 * hash in escaped form, so any
+						 * candidate hash before it is invalid
+						 * now.
+						 */
+						candidate.set_ = false;
+						continue;
+					}
 
 					/*
-					 * We have output any data before this hash
-					 * in escaped form, so any candidate hash
-					 * before it is invalid now.
+					 * The fingerprints match but the data
+					 * does not.  This data can not be named
+					 * under this hash.
 					 */
-					candidate.set_ = false;
+					oseg->unref();
+					collisions_++;
+					DEBUG(log_) << "Fingerprint collision in first pass.";
 					continue;
 				}
 
 				/*
-				 * This hash isn't usable because it collides
-				 * with another, so keep looking for something
-				 * viable.
+				 * Other data has this hash.  If there's room
+				 * for one more segment with it and the peer
+				 * decodes tags, this data is a candidate under
+				 * the next tag.  Otherwise this hash isn't usable, so keep looking for
+				 * something viable.
 				 *
 				 * XXX
 				 * If this is the first hash (i.e.
@@ -240,14 +253,17 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 				 * start of the current window and escape the
 				 * first byte right away.  Does that help?
 				 */
-				oseg->unref();
-				DEBUG(log_) << "Collision in first pass.";
-				continue;
+				if (tag == XCODEC_TAG_COUNT || !tags_) {
+					collisions_++;
+					DEBUG(log_) << "Collision in first pass.";
+					continue;
+				}
 			}
 
 			/*
-			 * Not defined before, it's a candidate for declaration
-			 * if we don't already have one.
+			 * Not defined before, at least not as this data, so it's
+			 * a candidate for declaration if we don't already have
+			 * one.
 			 */
 			if (candidate.set_) {
 				/*
@@ -269,6 +285,7 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 			 */
 			candidate.offset_ = start;
 			candidate.symbol_ = hash;
+			candidate.tag_ = tag;
 			candidate.set_ = true;
 		}
 
@@ -286,7 +303,7 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 	 */
 	if (candidate.set_) {
 		ASSERT(log_, !outq.empty());
-		encode_declaration(output, &outq, candidate.offset_, candidate.symbol_, NULL);
+		encode_declaration(output, &outq, candidate.offset_, candidate.symbol_, candidate.tag_);
 		candidate.set_ = false;
 	}
 
@@ -304,7 +321,7 @@ XCodecEncoder::encode(Buffer *output, Buffer *input)
 }
 
 void
-XCodecEncoder::encode_declaration(Buffer *output, Buffer *input, unsigned offset, uint64_t hash, BufferSegment **segp)
+XCodecEncoder::encode_declaration(Buffer *output, Buffer *input, unsigned offset, uint64_t hash, uint8_t tag)
 {
 	if (offset != 0) {
 		encode_escape(output, input, offset);
@@ -313,18 +330,16 @@ XCodecEncoder::encode_declaration(Buffer *output, Buffer *input, unsigned offset
 	BufferSegment *nseg;
 	input->copyout(&nseg, XCODEC_SEGMENT_LENGTH);
 
-	cache_->enter(hash, nseg);
+	if (!cache_->enter_tag(hash, tag, nseg))
+		NOTREACHED(log_);
 
 	if (!stream_) {
 		/*
 		 * Declarations occur out-of-band.
 		 */
-		if (!encode_reference(output, input, 0, hash, nseg)) /* XXX Pass NULL not nseg to skip check?  */
+		if (!encode_reference(output, input, 0, hash, tag, nseg))
 			NOTREACHED(log_);
-		if (segp == NULL)
-			nseg->unref();
-		else
-			*segp = nseg;
+		nseg->unref();
 		return;
 	}
 
@@ -332,20 +347,21 @@ XCodecEncoder::encode_declaration(Buffer *output, Buffer *input, unsigned offset
 	 * Declarations are extracted in-band.
 	 */
 	output->append(XCODEC_MAGIC);
-	output->append(XCODEC_OP_EXTRACT);
+	if (tag == 0) {
+		output->append(XCODEC_OP_EXTRACT);
+	} else {
+		output->append(XCODEC_OP_EXTRACT_TAG);
+		output->append(tag);
+	}
 	output->append(nseg);
 
-	window_.declare(hash, nseg);
-	if (segp == NULL)
-		nseg->unref();
+	window_.declare(XCodecName(hash, tag), nseg);
+	nseg->unref();
 
 	/*
 	 * Skip to the end.
 	 */
 	input->skip(XCODEC_SEGMENT_LENGTH);
-
-	if (segp != NULL)
-		*segp = nseg;
 }
 
 void
@@ -376,12 +392,9 @@ XCodecEncoder::encode_escape(Buffer *output, Buffer *input, unsigned length)
 }
 
 bool
-XCodecEncoder::encode_reference(Buffer *output, Buffer *input, unsigned offset, uint64_t hash, BufferSegment *oseg)
+XCodecEncoder::encode_reference(Buffer *output, Buffer *input, unsigned offset, uint64_t hash, uint8_t tag, BufferSegment *oseg)
 {
-	uint8_t data[XCODEC_SEGMENT_LENGTH];
-	input->copyout(data, offset, sizeof data);
-
-	if (!oseg->equal(data, sizeof data))
+	if (!segment_equal(input, offset, oseg))
 		return (false);
 
 	if (offset != 0) {
@@ -396,19 +409,62 @@ XCodecEncoder::encode_reference(Buffer *output, Buffer *input, unsigned offset,
 	/*
 	 * And output a reference.
 	 */
+	XCodecName name(hash, tag);
 	uint8_t b;
-	if (window_.present(hash, &b)) {
+	if (window_.present(name, &b)) {
 		output->append(XCODEC_MAGIC);
 		output->append(XCODEC_OP_BACKREF);
 		output->append(b);
 	} else {
-		output->append(XCODEC_MAGIC);
-		output->append(XCODEC_OP_REF);
 		uint64_t behash = BigEndian::encode(hash);
-		output->append(&behash);
 
-		window_.declare(hash, oseg);
+		output->append(XCODEC_MAGIC);
+		if (tag == 0) {
+			output->append(XCODEC_OP_REF);
+			output->append(&behash);
+		} else {
+			output->append(XCODEC_OP_REF_TAG);
+			output->append(&behash);
+			output->append(tag);
+		}
+
+		window_.declare(name, oseg);
 	}
 
 	return (true);
 }
+
+/*
+ * Compare the segment's data to that at offset in the Buffer, where it lies
+ * rather than copying it out.
+ */
+static bool
+segment_equal(const Buffer *buf, unsigned offset, const BufferSegment *seg)
+{
+	ASSERT("/xcodec/encoder", buf->length() >= offset + XCODEC_SEGMENT_LENGTH);
+	ASSERT("/xcodec/encoder", seg->length() == XCODEC_SEGMENT_LENGTH);
+
+	const uint8_t *p = seg->data();
+	size_t resid = XCODEC_SEGMENT_LENGTH;
+	Buffer::SegmentIterator iter = buf->segments();
+	while (resid != 0) {
+		const BufferSegment *bseg = *iter;
+		iter.next();
+
+		if (offset >= bseg->length()) {
+			offset -= bseg->length();
+			continue;
+		}
+
+		size_t len = bseg->length() - offset;
+		if (len > resid)
+			len = resid;
+		if (memcmp(bseg->data() + offset, p, len) != 0)
+			return (false);
+
+		p += len;
+		offset = 0;
+		resid -= len;
+	}
+	return (true);
+}
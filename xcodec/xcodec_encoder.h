@@ -36,15 +36,38 @@ class XCodecEncoder {
 	XCodecWindow window_;
 	bool stream_;
 
+	/*
+	 * Whether the peer decodes segments with tags other than 0.  If not,
+	 * data whose hash is already taken is escaped.
+	 */
+	bool tags_;
+
+	/*
+	 * Hashes found in the cache whose data differs from the data they
+	 * were computed over, and which could not be referenced or declared
+	 * under a tag of their own.
+	 */
+	uintmax_t collisions_;
+
 public:
 	XCodecEncoder(XCodecCache *);
 	~XCodecEncoder();
 
+	uintmax_t collisions(void) const
+	{
+		return (collisions_);
+	}
+
+	void set_tags(bool tags)
+	{
+		tags_ = tags;
+	}
+
 	void encode(Buffer *, Buffer *);
 private:
-	void encode_declaration(Buffer *, Buffer *, unsigned, uint64_t, BufferSegment **);
+	void encode_declaration(Buffer *, Buffer *, unsigned, uint64_t, uint8_t);
 	void encode_escape(Buffer *, Buffer *, unsigned);
-	bool encode_reference(Buffer *, Buffer *, unsigned, uint64_t, BufferSegment *);
+	bool encode_reference(Buffer *, Buffer *, unsigned, uint64_t, uint8_t, BufferSegment *);
 };
 
 #endif /* !XCODEC_XCODEC_ENCODER_H */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	XCODEC_XCODEC_FINGERPRINT_H
+#define	XCODEC_XCODEC_FINGERPRINT_H
+
+#include <string.h>
+
+/*
+ * A 128-bit fingerprint of a segment's data, by which segments whose hashes
+ * collide are told apart without comparing each one's data.  It is taken over
+ * the data where it lies, even if that is spread over several BufferSegments
+ * of a Buffer.  Fingerprints are never sent to peers, and so are computed in
+ * host byte order.
+ *
+ * This is not a cryptographic hash, and someone who can choose what passes
+ * through the encoder may be able to make two segments which share both a
+ * hash and a fingerprint.  It only picks which segment to compare, and the
+ * encoder always compares the data of a segment before referencing it.
+ */
+class XCodecFingerprint {
+	/*
+	 * Two lanes which take the data a word at a time, carrying any part
+	 * of a word left at the end of one piece of data over to the next.
+	 */
+	class State {
+		uint64_t a_;
+		uint64_t b_;
+		uint8_t carry_[sizeof (uint64_t)];
+		unsigned carried_;
+	public:
+		State(void)
+		: a_(0x9e3779b97f4a7c15ull),
+		  b_(0xc2b2ae3d27d4eb4full),
+		  carry_(),
+		  carried_(0)
+		{ }
+
+		~State()
+		{ }
+
+		void add(const uint8_t *p, size_t len)
+		{
+			if (carried_ != 0) {
+				while (len != 0 && carried_ != sizeof carry_) {
+					carry_[carried_++] = *p++;
+					len--;
+				}
+				if (carried_ != sizeof carry_)
+					return;
+				word(carry_);
+				carried_ = 0;
+			}
+
+			while (len >= sizeof (uint64_t)) {
+				word(p);
+				p += sizeof (uint64_t);
+				len -= sizeof (uint64_t);
+			}
+
+			while (len != 0) {
+				carry_[carried_++] = *p++;
+				len--;
+			}
+		}
+
+		XCodecFingerprint finish(void) const
+		{
+			ASSERT("/xcodec/fingerprint", carried_ == 0);
+			return (XCodecFingerprint(mix(a_ + b_), mix(a_ ^ rotate(b_, 32))));
+		}
+
+	private:
+		void word(const uint8_t *p)
+		{
+			uint64_t w;
+
+			memcpy(&w, p, sizeof w);
+
+			a_ = rotate(a_ ^ (w * 0x87c37b91114253d5ull), 31) * 0x4cf5ad432745937full;
+			b_ = rotate(b_ + (w * 0xff51afd7ed558ccdull), 33) * 0xc4ceb9fe1a85ec53ull;
+		}
+
+		static uint64_t rotate(uint64_t x, unsigned bits)
+		{
+			return ((x << bits) | (x >> (64 - bits)));
+		}
+
+		/*
+		 * The finalizer from MurmurHash3.
+		 */
+		static uint64_t mix(uint64_t x)
+		{
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdull;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ull;
+			x ^= x >> 33;
+			return (x);
+		}
+	};
+
+	uint64_t hi_;
+	uint64_t lo_;
+
+	XCodecFingerprint(uint64_t hi, uint64_t lo)
+	: hi_(hi),
+	  lo_(lo)
+	{ }
+public:
+	XCodecFingerprint(void)
+	: hi_(0),
+	  lo_(0)
+	{ }
+
+	~XCodecFingerprint()
+	{ }
+
+	bool operator== (const XCodecFingerprint& fingerprint) const
+	{
+		return (hi_ == fingerprint.hi_ && lo_ == fingerprint.lo_);
+	}
+
+	bool operator!= (const XCodecFingerprint& fingerprint) const
+	{
+		return (!(*this == fingerprint));
+	}
+
+	static XCodecFingerprint fingerprint(const uint8_t *data)
+	{
+		State state;
+
+		state.add(data, XCODEC_SEGMENT_LENGTH);
+		return (state.finish());
+	}
+
+	static XCodecFingerprint fingerprint(const Buffer *buf, unsigned offset)
+	{
+		ASSERT("/xcodec/fingerprint", buf->length() >= offset + XCODEC_SEGMENT_LENGTH);
+
+		State state;
+		size_t resid = XCODEC_SEGMENT_LENGTH;
+		Buffer::SegmentIterator iter = buf->segments();
+		while (resid != 0) {
+			const BufferSegment *seg = *iter;
+			iter.next();
+
+			if (offset >= seg->length()) {
+				offset -= seg->length();
+				continue;
+			}
+
+			size_t len = seg->length() - offset;
+			if (len > resid)
+				len = resid;
+			state.add(seg->data() + offset, len);
+
+			offset = 0;
+			resid -= len;
+		}
+		return (state.finish());
+	}
+};
+
+#endif /* !XCODEC_XCODEC_FINGERPRINT_H */
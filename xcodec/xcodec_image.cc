@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <common/buffer.h>
+#include <common/endian.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_hash.h>
+#include <xcodec/xcodec_image.h>
+
+/*
+ * How many segments to read or write at a time.
+ */
+#define	XCODEC_IMAGE_BATCH	(32)
+
+static bool read_fully(int, uint8_t *, size_t);
+static bool write_buffer(int, Buffer *);
+
+XCodecImage::XCodecImage(void)
+: log_("/xcodec/image"),
+  segments_()
+{ }
+
+XCodecImage::~XCodecImage()
+{
+	clear();
+}
+
+/*
+ * Add a segment to the image, unless one with the same hash is already
+ * there.
+ */
+bool
+XCodecImage::add(const uint64_t& hash, BufferSegment *seg)
+{
+	ASSERT(log_, seg->length() == XCODEC_SEGMENT_LENGTH);
+
+	if (segments_.find(hash) != segments_.end())
+		return (false);
+	seg->ref();
+	segments_[hash] = seg;
+	return (true);
+}
+
+/*
+ * Load an image into this one, which must be empty.
+ */
+bool
+XCodecImage::load(const std::string& path)
+{
+	struct stat st;
+	int fd;
+
+	ASSERT(log_, segments_.empty());
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		ERROR(log_) << "Could not open dictionary image: " << path;
+		return (false);
+	}
+
+	if (::fstat(fd, &st) == -1) {
+		ERROR(log_) << "Could not stat dictionary image: " << path;
+		::close(fd);
+		return (false);
+	}
+
+	uint8_t header[XCODEC_IMAGE_HEADER_LENGTH];
+	if (!read_fully(fd, header, sizeof header) ||
+	    memcmp(header, XCODEC_IMAGE_MAGIC, XCODEC_IMAGE_MAGIC_LENGTH) != 0) {
+		ERROR(log_) << "Not a dictionary image: " << path;
+		::close(fd);
+		return (false);
+	}
+
+	uint32_t version, length;
+	uint64_t count;
+	memcpy(&version, &header[XCODEC_IMAGE_MAGIC_LENGTH], sizeof version);
+	memcpy(&length, &header[XCODEC_IMAGE_MAGIC_LENGTH + sizeof version], sizeof length);
+	memcpy(&count, &header[XCODEC_IMAGE_MAGIC_LENGTH + sizeof version + sizeof length], sizeof count);
+	version = BigEndian::decode(version);
+	length = BigEndian::decode(length);
+	count = BigEndian::decode(count);
+
+	if (version != XCODEC_IMAGE_VERSION || length != XCODEC_SEGMENT_LENGTH) {
+		ERROR(log_) << "Unsupported dictionary image version " << version << " with segment length " << length << ": " << path;
+		::close(fd);
+		return (false);
+	}
+
+	if (count > (uint64_t)st.st_size / (sizeof (uint64_t) + XCODEC_SEGMENT_LENGTH) ||
+	    (uint64_t)st.st_size != XCODEC_IMAGE_HEADER_LENGTH + count * (sizeof (uint64_t) + XCODEC_SEGMENT_LENGTH)) {
+		ERROR(log_) << "Truncated or corrupt dictionary image: " << path;
+		::close(fd);
+		return (false);
+	}
+
+	std::vector<uint64_t> index(count);
+	if (count != 0 && !read_fully(fd, (uint8_t *)&index[0], count * sizeof index[0])) {
+		ERROR(log_) << "Could not read dictionary image index: " << path;
+		::close(fd);
+		return (false);
+	}
+
+	uint64_t i;
+	for (i = 0; i < count; i++) {
+		index[i] = BigEndian::decode(index[i]);
+		if (i != 0 && index[i] <= index[i - 1]) {
+			ERROR(log_) << "Dictionary image index is out of order: " << path;
+			::close(fd);
+			return (false);
+		}
+	}
+
+	/*
+	 * The index is sorted, so each segment goes at the end of the map.
+	 */
+	uint8_t data[XCODEC_IMAGE_BATCH * XCODEC_SEGMENT_LENGTH];
+	for (i = 0; i < count; i += XCODEC_IMAGE_BATCH) {
+		unsigned n = std::min<uint64_t>(count - i, XCODEC_IMAGE_BATCH);
+		if (!read_fully(fd, data, n * XCODEC_SEGMENT_LENGTH)) {
+			ERROR(log_) << "Could not read dictionary image segments: " << path;
+			::close(fd);
+			clear();
+			return (false);
+		}
+
+		/*
+		 * A segment whose data does not match its hash in the index
+		 * would be referenced as something it is not, so the image
+		 * is refused rather than trusted.
+		 */
+		unsigned j;
+		for (j = 0; j < n; j++) {
+			if (XCodecHash::hash(&data[j * XCODEC_SEGMENT_LENGTH]) != index[i + j]) {
+				ERROR(log_) << "Dictionary image segment does not match its hash: " << path;
+				::close(fd);
+				clear();
+				return (false);
+			}
+
+			BufferSegment *seg = BufferSegment::create(&data[j * XCODEC_SEGMENT_LENGTH], XCODEC_SEGMENT_LENGTH);
+			segments_.insert(segments_.end(), segment_map_t::value_type(index[i + j], seg));
+		}
+	}
+	::close(fd);
+
+	INFO(log_) << "Loaded " << count << " segments from dictionary image: " << path;
+
+	return (true);
+}
+
+/*
+ * Write the image to a temporary file and rename it into place, so that
+ * nobody ever loads half of one.
+ */
+bool
+XCodecImage::save(const std::string& path) const
+{
+	std::string tmp(path + ".tmp");
+	int fd;
+
+	fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		ERROR(log_) << "Could not create dictionary image: " << tmp;
+		return (false);
+	}
+
+	Buffer output;
+
+	uint32_t version = BigEndian::encode((uint32_t)XCODEC_IMAGE_VERSION);
+	uint32_t length = BigEndian::encode((uint32_t)XCODEC_SEGMENT_LENGTH);
+	uint64_t count = BigEndian::encode((uint64_t)segments_.size());
+	output.append((const uint8_t *)XCODEC_IMAGE_MAGIC, XCODEC_IMAGE_MAGIC_LENGTH);
+	output.append(&version);
+	output.append(&length);
+	output.append(&count);
+
+	segment_map_t::const_iterator it;
+	for (it = segments_.begin(); it != segments_.end(); ++it) {
+		uint64_t hash = BigEndian::encode(it->first);
+		output.append(&hash);
+		if (output.length() >= XCODEC_IMAGE_BATCH * XCODEC_SEGMENT_LENGTH &&
+		    !write_buffer(fd, &output))
+			goto error;
+	}
+
+	for (it = segments_.begin(); it != segments_.end(); ++it) {
+		output.append(it->second);
+		if (output.length() >= XCODEC_IMAGE_BATCH * XCODEC_SEGMENT_LENGTH &&
+		    !write_buffer(fd, &output))
+			goto error;
+	}
+
+	if (!write_buffer(fd, &output) || ::fsync(fd) == -1)
+		goto error;
+	::close(fd);
+
+	if (::rename(tmp.c_str(), path.c_str()) == -1) {
+		ERROR(log_) << "Could not rename dictionary image into place: " << path;
+		::unlink(tmp.c_str());
+		return (false);
+	}
+
+	return (true);
+
+error:
+	ERROR(log_) << "Could not write dictionary image: " << tmp;
+	::close(fd);
+	::unlink(tmp.c_str());
+	return (false);
+}
+
+/*
+ * Enter every segment in the image into a cache which has nothing in it
+ * yet.  The segments are shared with the image, not copied.
+ */
+void
+XCodecImage::seed(XCodecCache *cache) const
+{
+	ASSERT(log_, cache->entries() == 0);
+
+	segment_map_t::const_iterator it;
+	for (it = segments_.begin(); it != segments_.end(); ++it)
+		cache->enter(it->first, it->second);
+}
+
+/*
+ * Check whether a file is a dictionary image at all, as opposed to a broken
+ * one.
+ */
+bool
+XCodecImage::probe(const std::string& path)
+{
+	uint8_t magic[XCODEC_IMAGE_MAGIC_LENGTH];
+	int fd;
+	bool ok;
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return (false);
+	ok = read_fully(fd, magic, sizeof magic) &&
+	     memcmp(magic, XCODEC_IMAGE_MAGIC, XCODEC_IMAGE_MAGIC_LENGTH) == 0;
+	::close(fd);
+
+	return (ok);
+}
+
+void
+XCodecImage::clear(void)
+{
+	segment_map_t::const_iterator it;
+	for (it = segments_.begin(); it != segments_.end(); ++it)
+		it->second->unref();
+	segments_.clear();
+}
+
+static bool
+read_fully(int fd, uint8_t *data, size_t len)
+{
+	while (len != 0) {
+		ssize_t rv = ::read(fd, data, len);
+		if (rv <= 0)
+			return (false);
+		data += rv;
+		len -= rv;
+	}
+	return (true);
+}
+
+static bool
+write_buffer(int fd, Buffer *output)
+{
+	while (!output->empty()) {
+		Buffer::SegmentIterator iter = output->segments();
+		const BufferSegment *seg = *iter;
+
+		ssize_t rv = ::write(fd, seg->data(), seg->length());
+		if (rv <= 0)
+			return (false);
+		output->skip((size_t)rv);
+	}
+	return (true);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	XCODEC_XCODEC_IMAGE_H
+#define	XCODEC_XCODEC_IMAGE_H
+
+#include <map>
+
+class XCodecCache;
+
+/*
+ * A dictionary image is a file of segments, with an index of their hashes,
+ * from which XCodec caches can be seeded before any data has been sent.
+ * If both peers load the same image, content in it is sent as references
+ * from the first time it is seen.
+ *
+ * An image is made up of:
+ * 	o) A header: the magic "XCODECIM", a 32-bit version, the 32-bit
+ * 	   segment length and a 64-bit count of segments.
+ * 	o) The index: the 64-bit hash of each segment, in ascending order.
+ * 	o) The segments themselves, in the same order as the index.
+ * All quantities are big-endian.
+ *
+ * Since the hashes are stored, nothing need be rehashed when an image is
+ * loaded.
+ */
+#define	XCODEC_IMAGE_MAGIC		"XCODECIM"
+#define	XCODEC_IMAGE_MAGIC_LENGTH	(8)
+#define	XCODEC_IMAGE_VERSION		(1)
+#define	XCODEC_IMAGE_HEADER_LENGTH	(XCODEC_IMAGE_MAGIC_LENGTH + 4 + 4 + 8)
+
+class XCodecImage {
+	typedef std::map<uint64_t, BufferSegment *> segment_map_t;
+
+	LogHandle log_;
+	segment_map_t segments_;
+public:
+	XCodecImage(void);
+	~XCodecImage();
+
+	bool add(const uint64_t&, BufferSegment *);
+
+	size_t entries(void) const
+	{
+		return (segments_.size());
+	}
+
+	bool load(const std::string&);
+	bool save(const std::string&) const;
+
+	void seed(XCodecCache *) const;
+
+	static bool probe(const std::string&);
+
+private:
+	void clear(void);
+};
+
+#endif /* !XCODEC_XCODEC_IMAGE_H */
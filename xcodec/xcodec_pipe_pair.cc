@@ -23,10 +23,13 @@
  * SUCH DAMAGE.
  */
 
+#include <algorithm>
+
 #include <common/buffer.h>
 #include <common/endian.h>
 
 #include <event/event_callback.h>
+#include <event/event_system.h>
 
 #include <io/pipe/pipe.h>
 #include <io/pipe/pipe_pair.h>
@@ -36,7 +39,9 @@
 #include <xcodec/xcodec_decoder.h>
 #include <xcodec/xcodec_encoder.h>
 #include <xcodec/xcodec_hash.h>
+#include <xcodec/xcodec_image.h>
 #include <xcodec/xcodec_pipe_pair.h>
+#include <xcodec/xcodec_push.h>
 
 /*
  * XXX
@@ -81,11 +86,26 @@
  * Effects:
  * 	Must appear at the start of and only at the start of an encoded	stream.
  *
+ * 	The data is the UUID of the sender's cache, optionally followed by a
+ * 	byte of flags, of which further bytes are ignored.  A peer which sends
+ * 	no flags is taken to have none set.
+ *
  * Sife-effects:
  * 	Possibly many.
  */
 #define	XCODEC_PIPE_OP_HELLO	((uint8_t)0xff)
 
+/*
+ * Flags in <OP_HELLO>.
+ *
+ * 	XCODEC_PIPE_HELLO_TAGS
+ * 		The sender decodes segments with tags other than 0, and so
+ * 		understands XCODEC_OP_EXTRACT_TAG, XCODEC_OP_REF_TAG,
+ * 		<OP_ASK_TAG> and <OP_LEARN_TAG>.  Without it, only tag 0 is
+ * 		used in what is sent to it.
+ */
+#define	XCODEC_PIPE_HELLO_TAGS	((uint8_t)0x01)
+
 /*
  * Usage:
  * 	<OP_LEARN> data[uint8_t x XCODEC_PIPE_SEGMENT_LENGTH]
@@ -138,6 +158,34 @@
  */
 #define	XCODEC_PIPE_OP_EOS_ACK	((uint8_t)0xfb)
 
+/*
+ * Usage:
+ * 	<OP_LEARN_TAG> tag[uint8_t] data[uint8_t x XCODEC_PIPE_SEGMENT_LENGTH]
+ *
+ * Effects:
+ * 	As OP_LEARN, but the data is associated with its hash and the tag
+ * 	`tag', which is never 0.
+ *
+ * Side-effects:
+ * 	None.
+ */
+#define	XCODEC_PIPE_OP_LEARN_TAG	((uint8_t)0xfa)
+
+/*
+ * Usage:
+ * 	<OP_ASK_TAG> hash[uint64_t] tag[uint8_t]
+ *
+ * Effects:
+ * 	An OP_LEARN_TAG will be sent in response with the data corresponding
+ * 	to the hash and the tag `tag', which is never 0.
+ *
+ * 	If the hash and tag are unknown, error will be indicated.
+ *
+ * Side-effects:
+ * 	None.
+ */
+#define	XCODEC_PIPE_OP_ASK_TAG	((uint8_t)0xf9)
+
 /*
  * Usage:
  * 	<FRAME> length[uint16_t] data[uint8_t x length]
@@ -152,6 +200,11 @@
 
 #define	XCODEC_PIPE_MAX_FRAME	(32768)
 
+/*
+ * How often to consider pushing segments to the peer, in milliseconds.
+ */
+#define	XCODEC_PIPE_PUSH_MS	(100)
+
 static void encode_frame(Buffer *, Buffer *);
 
 void
@@ -191,7 +244,7 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 				if (decoder_buffer_.length() < sizeof op + sizeof len + len)
 					return;
 
-				if (len != UUID_SIZE) {
+				if (len < UUID_SIZE) {
 					ERROR(log_) << "Unsupported <HELLO> length: " << (unsigned)len;
 					decoder_error();
 					return;
@@ -200,6 +253,13 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 				Buffer uubuf;
 				decoder_buffer_.moveout(&uubuf, sizeof op + sizeof len, UUID_SIZE);
 
+				uint8_t flags = 0;
+				if (len > UUID_SIZE) {
+					decoder_buffer_.moveout(&flags, sizeof flags);
+					if (len > UUID_SIZE + sizeof flags)
+						decoder_buffer_.skip(len - UUID_SIZE - sizeof flags);
+				}
+
 				UUID uuid;
 				if (!uuid.decode(&uubuf)) {
 					ERROR(log_) << "Invalid UUID in <HELLO>.";
@@ -211,22 +271,45 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 				if (decoder_cache_ == NULL) {
 					decoder_cache_ = new XCodecMemoryCache(uuid);
 					XCodecCache::enter(uuid, decoder_cache_);
+
+					/*
+					 * A peer which loaded the same image as us
+					 * will reference what is in it without ever
+					 * having extracted it.
+					 */
+					if (codec_->image() != NULL)
+						codec_->image()->seed(decoder_cache_);
 				}
 
 				ASSERT(log_, decoder_ == NULL);
 				decoder_ = new XCodecDecoder(decoder_cache_);
 
 				DEBUG(log_) << "Peer connected with UUID: " << uuid.string_;
+
+				/*
+				 * Our encoder may already have begun without
+				 * tags, and may use them from here on.
+				 */
+				decoder_peer_tags_ = (flags & XCODEC_PIPE_HELLO_TAGS) != 0;
+				if (encoder_ != NULL)
+					encoder_->set_tags(decoder_peer_tags_);
+
+				push_start();
 			}
 			break;
 		case XCODEC_PIPE_OP_ASK:
+		case XCODEC_PIPE_OP_ASK_TAG:
 			if (encoder_ == NULL) {
 				ERROR(log_) << "Got <ASK> before sending <HELLO>.";
 				decoder_error();
 				return;
 			} else {
 				uint64_t hash;
-				if (decoder_buffer_.length() < sizeof op + sizeof hash)
+				uint8_t tag = 0;
+				size_t len = sizeof op + sizeof hash;
+				if (op == XCODEC_PIPE_OP_ASK_TAG)
+					len += sizeof tag;
+				if (decoder_buffer_.length() < len)
 					return;
 
 				decoder_buffer_.skip(sizeof op);
@@ -234,46 +317,96 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 				decoder_buffer_.moveout(&hash);
 				hash = BigEndian::decode(hash);
 
-				BufferSegment *oseg = codec_->cache()->lookup(hash);
+				if (op == XCODEC_PIPE_OP_ASK_TAG) {
+					decoder_buffer_.moveout(&tag, sizeof tag);
+					if (tag == 0) {
+						ERROR(log_) << "Zero tag in <ASK_TAG>.";
+						decoder_error();
+						return;
+					}
+				}
+
+				codec_->stats()->ask_received_++;
+
+				BufferSegment *oseg = codec_->cache()->lookup_tag(hash, tag);
 				if (oseg == NULL) {
-					ERROR(log_) << "Unknown hash in <ASK>: " << hash;
+					ERROR(log_) << "Unknown hash in <ASK>: " << hash << "/" << (unsigned)tag;
 					decoder_error();
 					return;
 				}
 
 				DEBUG(log_) << "Responding to <ASK> with <LEARN>.";
 
+				if (push_ != NULL && tag == 0)
+					push_->sent(hash);
+
 				Buffer learn;
-				learn.append(XCODEC_PIPE_OP_LEARN);
+				if (tag == 0) {
+					learn.append(XCODEC_PIPE_OP_LEARN);
+				} else {
+					learn.append(XCODEC_PIPE_OP_LEARN_TAG);
+					learn.append(tag);
+				}
 				learn.append(oseg);
 				oseg->unref();
 
+				codec_->stats()->learn_sent_++;
+
 				encoder_produce(&learn);
 			}
 			break;
 		case XCODEC_PIPE_OP_LEARN:
+		case XCODEC_PIPE_OP_LEARN_TAG:
 			if (decoder_cache_ == NULL) {
 				ERROR(log_) << "Got <LEARN> before <HELLO>.";
 				decoder_error();
 				return;
 			} else {
-				if (decoder_buffer_.length() < sizeof op + XCODEC_SEGMENT_LENGTH)
+				uint8_t tag = 0;
+				size_t len = sizeof op + XCODEC_SEGMENT_LENGTH;
+				if (op == XCODEC_PIPE_OP_LEARN_TAG)
+					len += sizeof tag;
+				if (decoder_buffer_.length() < len)
 					return;
 
 				decoder_buffer_.skip(sizeof op);
 
+				if (op == XCODEC_PIPE_OP_LEARN_TAG) {
+					decoder_buffer_.moveout(&tag, sizeof tag);
+					if (tag == 0) {
+						ERROR(log_) << "Zero tag in <LEARN_TAG>.";
+						decoder_error();
+						return;
+					}
+				}
+
 				BufferSegment *seg;
 				decoder_buffer_.copyout(&seg, XCODEC_SEGMENT_LENGTH);
 				decoder_buffer_.skip(XCODEC_SEGMENT_LENGTH);
 
+				codec_->stats()->learn_received_++;
+
 				uint64_t hash = XCodecHash::hash(seg->data());
-				if (decoder_unknown_hashes_.find(hash) == decoder_unknown_hashes_.end()) {
-					INFO(log_) << "Gratuitous <LEARN> without <ASK>.";
+				XCodecName name(hash, tag);
+				if (decoder_unknown_hashes_.find(name) == decoder_unknown_hashes_.end()) {
+					/*
+					 * Peers push segments they expect us to
+					 * need before we ask.
+					 */
+					DEBUG(log_) << "Gratuitous <LEARN> without <ASK>.";
 				} else {
-					decoder_unknown_hashes_.erase(hash);
+					decoder_unknown_hashes_.erase(name);
+					if (decoder_unknown_hashes_.empty()) {
+						NanoTime now = NanoTime::current_time();
+						now -= decoder_ask_time_;
+
+						XCodecStats *stats = codec_->stats();
+						stats->ask_rounds_++;
+						stats->ask_round_nanoseconds_ += now.total_nanoseconds();
+					}
 				}
 
-				BufferSegment *oseg = decoder_cache_->lookup(hash);
+				BufferSegment *oseg = decoder_cache_->lookup_tag(hash, tag);
 				if (oseg != NULL) {
 					if (!oseg->equal(seg)) {
 						oseg->unref();
@@ -284,9 +417,13 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 					}
 					oseg->unref();
 					DEBUG(log_) << "Redundant <LEARN>.";
+				} else if (!decoder_cache_->enter_tag(hash, tag, seg)) {
+					ERROR(log_) << "Cache does not keep the tag in <LEARN>.";
+					seg->unref();
+					decoder_error();
+					return;
 				} else {
 					DEBUG(log_) << "Successful <LEARN>.";
-					decoder_cache_->enter(hash, seg);
 				}
 				seg->unref();
 			}
@@ -362,11 +499,14 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 		}
 
 		Buffer output;
+		size_t inlen = decoder_frame_buffer_.length();
 		if (!decoder_->decode(&output, &decoder_frame_buffer_, decoder_unknown_hashes_)) {
 			ERROR(log_) << "Decoder exiting with error.";
 			decoder_error();
 			return;
 		}
+		codec_->stats()->decoder_input_bytes_ += inlen - decoder_frame_buffer_.length();
+		codec_->stats()->decoder_output_bytes_ += output.length();
 
 		if (!output.empty()) {
 			ASSERT(log_, !decoder_sent_eos_);
@@ -386,15 +526,25 @@ XCodecPipePair::decoder_consume(Buffer *buf)
 		}
 
 		Buffer ask;
-		std::set<uint64_t>::const_iterator it;
+		std::set<XCodecName>::const_iterator it;
 		for (it = decoder_unknown_hashes_.begin(); it != decoder_unknown_hashes_.end(); ++it) {
-			uint64_t hash = *it;
+			uint64_t hash = it->first;
 			hash = BigEndian::encode(hash);
 
-			ask.append(XCODEC_PIPE_OP_ASK);
-			ask.append(&hash);
+			if (it->second == 0) {
+				ask.append(XCODEC_PIPE_OP_ASK);
+				ask.append(&hash);
+			} else {
+				ask.append(XCODEC_PIPE_OP_ASK_TAG);
+				ask.append(&hash);
+				ask.append(it->second);
+			}
+
+			codec_->stats()->ask_sent_++;
 		}
 		if (!ask.empty()) {
+			decoder_ask_time_ = NanoTime::current_time();
+
 			DEBUG(log_) << "Sending <ASK>s.";
 			encoder_produce(&ask);
 		}
@@ -454,23 +604,39 @@ XCodecPipePair::encoder_consume(Buffer *buf)
 			return;
 		}
 
+		ASSERT(log_, extra.length() == UUID_SIZE);
+		extra.append(XCODEC_PIPE_HELLO_TAGS);
+
 		uint8_t len = extra.length();
-		ASSERT(log_, len == UUID_SIZE);
 
 		output.append(XCODEC_PIPE_OP_HELLO);
 		output.append(len);
 		output.append(extra);
 
-		ASSERT(log_, output.length() == 2 + UUID_SIZE);
+		ASSERT(log_, output.length() == 2 + UUID_SIZE + 1);
 
+		/*
+		 * Until the peer's <HELLO> says it decodes tags, only tag 0
+		 * is used.
+		 */
 		encoder_ = new XCodecEncoder(codec_->cache());
+		encoder_->set_tags(decoder_peer_tags_);
+
+		push_start();
 	}
 
 	if (!buf->empty()) {
+		encoder_busy_ = true;
+
+		XCodecStats *stats = codec_->stats();
+		stats->encoder_input_bytes_ += buf->length();
+
 		Buffer encoded;
 		encoder_->encode(&encoded, buf);
 		ASSERT(log_, !encoded.empty());
 
+		stats->encoder_output_bytes_ += encoded.length();
+
 		encode_frame(&output, &encoded);
 	} else {
 		ASSERT(log_, !encoder_sent_eos_);
@@ -481,6 +647,71 @@ XCodecPipePair::encoder_consume(Buffer *buf)
 	encoder_produce(&output);
 }
 
+/*
+ * Once both <HELLO>s are through, start pushing to the peer the segments it
+ * is most likely to need, if we were asked to.
+ */
+void
+XCodecPipePair::push_start(void)
+{
+	if (push_rate_ == 0 || encoder_ == NULL || decoder_cache_ == NULL)
+		return;
+
+	ASSERT(log_, push_ == NULL);
+	push_ = XCodecPush::get(codec_->cache(), decoder_cache_->uuid());
+
+	SimpleCallback *cb = callback(this, &XCodecPipePair::push_timeout);
+	push_action_ = EventSystem::instance()->timeout(XCODEC_PIPE_PUSH_MS, cb);
+}
+
+/*
+ * Push only when the encoder has been idle since we last looked and all it
+ * has produced has gone, so that pushes use bandwidth nothing else wants.
+ * The existing <LEARN> is used, so peers need nothing new to receive them.
+ */
+void
+XCodecPipePair::push_timeout(void)
+{
+	push_action_->cancel();
+	push_action_ = NULL;
+
+	if (encoder_sent_eos_)
+		return;
+
+	if (!encoder_busy_ && encoder_pipe_->buffered() == 0) {
+		/*
+		 * Slow rates may take several intervals to earn one <LEARN>.
+		 */
+		size_t learn_length = sizeof (uint8_t) + XCODEC_SEGMENT_LENGTH;
+		size_t budget = push_rate_ * XCODEC_PIPE_PUSH_MS / 1000;
+		push_credit_ = std::min(push_credit_ + budget, std::max(budget, learn_length));
+
+		Buffer learn;
+		while (push_credit_ >= learn_length) {
+			uint64_t hash;
+			BufferSegment *seg = push_->next(&hash);
+			if (seg == NULL)
+				break;
+
+			learn.append(XCODEC_PIPE_OP_LEARN);
+			learn.append(seg);
+			seg->unref();
+
+			push_credit_ -= learn_length;
+			codec_->stats()->learn_pushed_++;
+		}
+
+		if (!learn.empty()) {
+			DEBUG(log_) << "Pushing " << learn.length() << " bytes of <LEARN>s.";
+			encoder_produce(&learn);
+		}
+	}
+	encoder_busy_ = false;
+
+	SimpleCallback *cb = callback(this, &XCodecPipePair::push_timeout);
+	push_action_ = EventSystem::instance()->timeout(XCODEC_PIPE_PUSH_MS, cb);
+}
+
 static void
 encode_frame(Buffer *out, Buffer *in)
 {
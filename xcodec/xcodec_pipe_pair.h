@@ -26,11 +26,15 @@
 #ifndef	XCODEC_XCODEC_PIPE_PAIR_H
 #define	XCODEC_XCODEC_PIPE_PAIR_H
 
+#include <common/time/time.h>
+
 #include <io/pipe/pipe_producer.h>
 #include <io/pipe/pipe_producer_wrapper.h>
 
 #include <xcodec/xcodec_decoder.h>
 
+class XCodecPush;
+
 enum XCodecPipePairType {
 	XCodecPipePairTypeClient,
 	XCodecPipePairTypeServer,
@@ -48,38 +52,57 @@ class XCodecPipePair : public PipePair {
 	 */
 	XCodecDecoder *decoder_;
 	XCodecCache *decoder_cache_;
-	std::set<uint64_t> decoder_unknown_hashes_;
+	std::set<XCodecName> decoder_unknown_hashes_;
+	NanoTime decoder_ask_time_;
 	bool decoder_received_eos_;
 	bool decoder_received_eos_ack_;
 	bool decoder_sent_eos_;
 	Buffer decoder_buffer_;
 	Buffer decoder_frame_buffer_;
 	PipeProducerWrapper<XCodecPipePair> *decoder_pipe_;
+	bool decoder_peer_tags_;
 
 	XCodecEncoder *encoder_;
 	bool encoder_produced_eos_;
 	bool encoder_sent_eos_;
 	bool encoder_sent_eos_ack_;
+	bool encoder_busy_;
 	PipeProducerWrapper<XCodecPipePair> *encoder_pipe_;
+
+	/*
+	 * Segments are pushed to the peer at up to push_rate_ bytes a second
+	 * while the encoder has nothing else to send.
+	 */
+	size_t push_rate_;
+	size_t push_credit_;
+	XCodecPush *push_;
+	Action *push_action_;
 public:
-	XCodecPipePair(const LogHandle& log, XCodec *codec, XCodecPipePairType type)
+	XCodecPipePair(const LogHandle& log, XCodec *codec, XCodecPipePairType type, size_t push_rate = 0)
 	: log_(log + "/xcodec"),
 	  codec_(codec),
 	  type_(type),
 	  decoder_(NULL),
 	  decoder_cache_(NULL),
 	  decoder_unknown_hashes_(),
+	  decoder_ask_time_(),
 	  decoder_received_eos_(false),
 	  decoder_received_eos_ack_(false),
 	  decoder_sent_eos_(false),
 	  decoder_buffer_(),
 	  decoder_frame_buffer_(),
 	  decoder_pipe_(NULL),
+	  decoder_peer_tags_(false),
 	  encoder_(NULL),
 	  encoder_produced_eos_(false),
 	  encoder_sent_eos_(false),
 	  encoder_sent_eos_ack_(false),
-	  encoder_pipe_(NULL)
+	  encoder_busy_(false),
+	  encoder_pipe_(NULL),
+	  push_rate_(push_rate),
+	  push_credit_(0),
+	  push_(NULL),
+	  push_action_(NULL)
 	{
 		decoder_pipe_ = new PipeProducerWrapper<XCodecPipePair>(log_ + "/decoder", this, &XCodecPipePair::decoder_consume);
 		encoder_pipe_ = new PipeProducerWrapper<XCodecPipePair>(log_ + "/encoder", this, &XCodecPipePair::encoder_consume);
@@ -87,6 +110,11 @@ public:
 
 	~XCodecPipePair()
 	{
+		if (push_action_ != NULL) {
+			push_action_->cancel();
+			push_action_ = NULL;
+		}
+
 		if (decoder_ != NULL) {
 			delete decoder_;
 			decoder_ = NULL;
@@ -147,6 +175,9 @@ private:
 		encoder_pipe_->produce_eos(buf);
 	}
 
+	void push_start(void);
+	void push_timeout(void);
+
 public:
 	Pipe *get_incoming(void)
 	{
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include <common/buffer.h>
+
+#include <xcodec/xcodec.h>
+#include <xcodec/xcodec_cache.h>
+#include <xcodec/xcodec_push.h>
+
+std::map<XCodecPush::push_key_t, XCodecPush *> XCodecPush::push_map;
+
+XCodecPush::XCodecPush(const XCodecCache *cache, const UUID& peer)
+: log_("/xcodec/push/" + peer.string_),
+  cache_(cache),
+  sent_(),
+  queue_(),
+  ranked_()
+{ }
+
+XCodecPush::~XCodecPush()
+{
+	while (!queue_.empty()) {
+		queue_.front().second->unref();
+		queue_.pop_front();
+	}
+}
+
+/*
+ * Note that the peer has the segment, whether we pushed it or it asked.
+ */
+void
+XCodecPush::sent(const uint64_t& hash)
+{
+	sent_.insert(hash);
+}
+
+/*
+ * The next segment to push, referenced for the caller, or NULL if there is
+ * nothing to push just now.
+ */
+BufferSegment *
+XCodecPush::next(uint64_t *hashp)
+{
+	for (;;) {
+		if (queue_.empty()) {
+			rank();
+			if (queue_.empty())
+				return (NULL);
+		}
+
+		push_segment_t ps = queue_.front();
+		queue_.pop_front();
+
+		if (sent_.find(ps.first) != sent_.end()) {
+			ps.second->unref();
+			continue;
+		}
+		sent_.insert(ps.first);
+
+		*hashp = ps.first;
+		return (ps.second);
+	}
+}
+
+XCodecPush *
+XCodecPush::get(const XCodecCache *cache, const UUID& peer)
+{
+	push_key_t key(cache, peer);
+
+	std::map<push_key_t, XCodecPush *>::const_iterator it;
+	it = push_map.find(key);
+	if (it != push_map.end())
+		return (it->second);
+
+	XCodecPush *push = new XCodecPush(cache, peer);
+	push_map[key] = push;
+	return (push);
+}
+
+/*
+ * Ranking looks at every segment in the cache, so don't do it more often
+ * than XCODEC_PUSH_RANK_MS when there turned out to be nothing to push.
+ */
+void
+XCodecPush::rank(void)
+{
+	NanoTime now = NanoTime::current_time();
+	if (ranked_.total_nanoseconds() != 0) {
+		NanoTime since = now;
+		since -= ranked_;
+		if (since.total_nanoseconds() < (uintmax_t)XCODEC_PUSH_RANK_MS * 1000 * 1000)
+			return;
+	}
+
+	std::vector<push_segment_t> segments;
+	cache_->popular(segments, XCODEC_PUSH_RANK, sent_);
+	queue_.insert(queue_.end(), segments.begin(), segments.end());
+
+	if (queue_.empty()) {
+		ranked_ = now;
+	} else {
+		ranked_ = NanoTime();
+		DEBUG(log_) << "Ranked " << queue_.size() << " segments to push.";
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	XCODEC_XCODEC_PUSH_H
+#define	XCODEC_XCODEC_PUSH_H
+
+#include <deque>
+#include <map>
+#include <set>
+
+#include <common/time/time.h>
+#include <common/uuid/uuid.h>
+
+class XCodecCache;
+
+/*
+ * How many segments to choose each time the cache is ranked, and how long
+ * to wait before ranking it again, in milliseconds, if nothing was left to
+ * push the last time.
+ */
+#define	XCODEC_PUSH_RANK	(1024)
+#define	XCODEC_PUSH_RANK_MS	(1000)
+
+/*
+ * The segments of our cache that are worth pushing to one peer before it
+ * has to <ASK> for them.  The most-referenced segments are pushed first,
+ * and each at most once; segments the peer has asked for are not pushed.
+ *
+ * One of these is kept for each peer of each cache, for as long as the
+ * cache is around, so that connections to the same peer pick up where the
+ * last left off.
+ */
+class XCodecPush {
+	typedef std::pair<const XCodecCache *, UUID> push_key_t;
+	typedef std::pair<uint64_t, BufferSegment *> push_segment_t;
+
+	LogHandle log_;
+	const XCodecCache *cache_;
+	std::set<uint64_t> sent_;
+	std::deque<push_segment_t> queue_;
+	NanoTime ranked_;
+
+	XCodecPush(const XCodecCache *, const UUID&);
+	~XCodecPush();
+
+public:
+	void sent(const uint64_t&);
+	BufferSegment *next(uint64_t *);
+
+	static XCodecPush *get(const XCodecCache *, const UUID&);
+
+private:
+	void rank(void);
+
+	static std::map<push_key_t, XCodecPush *> push_map;
+};
+
+#endif /* !XCODEC_XCODEC_PUSH_H */
@@ -28,6 +28,8 @@
 
 #include <map>
 
+#include <xcodec/xcodec.h>
+
 #define	XCODEC_WINDOW_MAX		(0xff)
 #define	XCODEC_WINDOW_COUNT		(XCODEC_WINDOW_MAX + 1)
 
@@ -38,10 +40,10 @@
  * Maybe add an explicit use() mechanism?
  */
 class XCodecWindow {
-	uint64_t window_[XCODEC_WINDOW_COUNT];
+	XCodecName window_[XCODEC_WINDOW_COUNT];
 	unsigned cursor_;
-	std::map<uint64_t, unsigned> present_;
-	std::map<uint64_t, BufferSegment *> segments_;
+	std::map<XCodecName, unsigned> present_;
+	std::map<XCodecName, BufferSegment *> segments_;
 public:
 	XCodecWindow(void)
 	: window_(),
@@ -52,33 +54,33 @@ public:
 		unsigned b;
 
 		for (b = 0; b < XCODEC_WINDOW_COUNT; b++) {
-			window_[b] = 0;
+			window_[b] = XCodecName(0, 0);
 		}
 	}
 
 	~XCodecWindow()
 	{
-		std::map<uint64_t, BufferSegment *>::iterator it;
+		std::map<XCodecName, BufferSegment *>::iterator it;
 
 		for (it = segments_.begin(); it != segments_.end(); ++it)
 			it->second->unref();
 		segments_.clear();
 	}
 
-	void declare(uint64_t hash, BufferSegment *seg)
+	void declare(const XCodecName& name, BufferSegment *seg)
 	{
-		if (hash == 0)
+		if (name.first == 0)
 			return;
 
-		if (present_.find(hash) != present_.end())
+		if (present_.find(name) != present_.end())
 			return;
 
-		uint64_t old = window_[cursor_];
-		if (old != 0) {
+		XCodecName old = window_[cursor_];
+		if (old.first != 0) {
 			ASSERT("/xcodec/window", present_[old] == cursor_);
 			present_.erase(old);
 
-			std::map<uint64_t, BufferSegment *>::iterator it;
+			std::map<XCodecName, BufferSegment *>::iterator it;
 			it = segments_.find(old);
 			ASSERT("/xcodec/window", it != segments_.end());
 			BufferSegment *oseg = it->second;
@@ -86,18 +88,18 @@ public:
 			segments_.erase(it);
 		}
 
-		window_[cursor_] = hash;
-		present_[hash] = cursor_;
+		window_[cursor_] = name;
+		present_[name] = cursor_;
 		seg->ref();
-		segments_[hash] = seg;
+		segments_[name] = seg;
 		cursor_ = (cursor_ + 1) % XCODEC_WINDOW_COUNT;
 	}
 
 	BufferSegment *dereference(unsigned c) const
 	{
-		if (window_[c] == 0)
+		if (window_[c].first == 0)
 			return (NULL);
-		std::map<uint64_t, BufferSegment *>::const_iterator it;
+		std::map<XCodecName, BufferSegment *>::const_iterator it;
 		it = segments_.find(window_[c]);
 		ASSERT("/xcodec/window", it != segments_.end());
 		BufferSegment *seg = it->second;
@@ -105,12 +107,12 @@ public:
 		return (seg);
 	}
 
-	bool present(uint64_t hash, uint8_t *c) const
+	bool present(const XCodecName& name, uint8_t *c) const
 	{
-		std::map<uint64_t, unsigned>::const_iterator it = present_.find(hash);
+		std::map<XCodecName, unsigned>::const_iterator it = present_.find(name);
 		if (it == present_.end())
 			return (false);
-		ASSERT("/xcodec/window", window_[it->second] == hash);
+		ASSERT("/xcodec/window", window_[it->second] == name);
 		*c = it->second;
 		return (true);
 	}
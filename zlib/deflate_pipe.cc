@@ -24,89 +24,339 @@
  */
 
 #include <event/event_callback.h>
+#include <event/event_system.h>
 
 #include <io/pipe/pipe.h>
 
 #include <zlib/deflate_pipe.h>
 
-#define	DEFLATE_CHUNK_SIZE	65536
+/*
+ * Compressed data is written directly into BufferSegments, which are then
+ * handed downstream without any intermediate copy.
+ */
 
-DeflatePipe::DeflatePipe(int level)
+DeflatePipe::DeflatePipe(int level, unsigned flush_ms, size_t flush_bytes)
 : PipeProducer("/zlib/deflate_pipe"),
-  stream_()
+  stream_(),
+  level_(level),
+  flush_ms_(flush_ms),
+  flush_bytes_(flush_bytes),
+  unflushed_bytes_(0),
+  flush_action_(NULL),
+  probe_level_(level),
+  bypass_threshold_(0),
+  bypassing_(false),
+  window_in_(0),
+  window_out_(0),
+  bypass_bytes_(0),
+  bypass_count_(0),
+  bypass_bytesp_(NULL),
+  bypass_countp_(NULL)
 {
 	stream_.zalloc = Z_NULL;
 	stream_.zfree = Z_NULL;
 	stream_.opaque = Z_NULL;
 
-	int error = deflateInit(&stream_, level);
+	int error = deflateInit(&stream_, level_);
 	if (error != Z_OK)
 		HALT(log_) << "Could not initialize deflate stream.";
 }
 
 DeflatePipe::~DeflatePipe()
 {
+	flush_cancel();
+
 	int error = deflateEnd(&stream_);
 	if (error != Z_OK)
 		ERROR(log_) << "Deflate stream did not end cleanly.";
 }
 
+/*
+ * Change the compression level mid-stream.  If the pipe is bypassing
+ * incompressible data, the new level takes effect at the next probe;
+ * otherwise the current window is started over, so that what it measures
+ * is deflate at the new level.
+ */
+bool
+DeflatePipe::set_level(int level)
+{
+	probe_level_ = level;
+	if (bypassing_)
+		return (true);
+
+	flush_cancel();
+
+	Buffer out;
+	if (!change_level(&out, level)) {
+		produce_error();
+		return (false);
+	}
+	window_in_ = 0;
+	window_out_ = 0;
+
+	if (!out.empty())
+		produce(&out);
+	return (true);
+}
+
+/*
+ * Enable bypassing when deflate saves less than threshold percent of its
+ * input.  This pipe counts the bytes it sends at level 0 and the number of
+ * times it enters bypass; the optional counters accumulate the same across
+ * pipes.
+ */
+void
+DeflatePipe::set_bypass(unsigned threshold, intmax_t *bypass_bytesp, intmax_t *bypass_countp)
+{
+	ASSERT(log_, threshold < 100);
+
+	bypass_threshold_ = threshold;
+	bypass_bytesp_ = bypass_bytesp;
+	bypass_countp_ = bypass_countp;
+
+	window_in_ = 0;
+	window_out_ = 0;
+}
+
 void
 DeflatePipe::consume(Buffer *in)
 {
 	Buffer out;
-	uint8_t outbuf[DEFLATE_CHUNK_SIZE];
-	bool first = true;
 
-	stream_.avail_out = sizeof outbuf;
-	stream_.next_out = outbuf;
+	if (in->empty()) {
+		flush_cancel();
+
+		if (!deflate_buffer(&out, NULL, Z_FINISH)) {
+			produce_error();
+			return;
+		}
+		produce_eos(&out);
+		return;
+	}
+
+	unflushed_bytes_ += in->length();
+	if (bypassing_) {
+		bypass_bytes_ += in->length();
+		if (bypass_bytesp_ != NULL)
+			*bypass_bytesp_ += in->length();
+	}
+
+	int flush;
+	if (flush_ms_ == 0 ||
+	    (flush_bytes_ != 0 && unflushed_bytes_ >= flush_bytes_))
+		flush = Z_SYNC_FLUSH;
+	else
+		flush = Z_NO_FLUSH;
+
+	if (!deflate_buffer(&out, in, flush)) {
+		produce_error();
+		return;
+	}
+
+	if (flush == Z_SYNC_FLUSH) {
+		flush_cancel();
+		unflushed_bytes_ = 0;
+
+		if (!adapt(&out)) {
+			produce_error();
+			return;
+		}
+	} else if (flush_action_ == NULL) {
+		SimpleCallback *cb = callback(this, &DeflatePipe::flush_timeout);
+		flush_action_ = EventSystem::instance()->timeout(flush_ms_, cb);
+	}
+
+	if (!out.empty())
+		produce(&out);
+}
+
+/*
+ * Called with everything consumed so far flushed, so that the output for
+ * the current window is complete.  Once the window is full, either start
+ * bypassing or go back to probing.
+ */
+bool
+DeflatePipe::adapt(Buffer *out)
+{
+	if (bypass_threshold_ == 0)
+		return (true);
+
+	if (bypassing_) {
+		if (window_in_ < DEFLATE_BYPASS_BYTES)
+			return (true);
+
+		DEBUG(log_) << "Probing at level " << probe_level_ << ".";
+		if (!change_level(out, probe_level_))
+			return (false);
+		bypassing_ = false;
+	} else {
+		if (window_in_ < DEFLATE_PROBE_BYTES)
+			return (true);
+
+		if ((uintmax_t)window_out_ * 100 >= (uintmax_t)window_in_ * (100 - bypass_threshold_)) {
+			DEBUG(log_) << "Bypassing after " << window_in_ << " bytes deflated to " << window_out_ << ".";
+			if (!change_level(out, 0))
+				return (false);
+			bypassing_ = true;
+			bypass_count_++;
+			if (bypass_countp_ != NULL)
+				(*bypass_countp_)++;
+		}
+	}
+
+	window_in_ = 0;
+	window_out_ = 0;
+
+	return (true);
+}
+
+/*
+ * Everything consumed so far is flushed at the old level first, so that
+ * the switch lands on a block boundary and deflateParams() has nothing
+ * left to emit.
+ */
+bool
+DeflatePipe::change_level(Buffer *out, int level)
+{
+	if (level == level_)
+		return (true);
+
+	if (!deflate_buffer(out, NULL, Z_SYNC_FLUSH))
+		return (false);
+	unflushed_bytes_ = 0;
+
+	BufferSegment *seg = BufferSegment::create();
+	stream_.avail_in = 0;
+	stream_.next_in = Z_NULL;
+	stream_.avail_out = BUFFER_SEGMENT_SIZE;
+	stream_.next_out = seg->tail();
+
+	int error = deflateParams(&stream_, level, Z_DEFAULT_STRATEGY);
+	if (stream_.avail_out != BUFFER_SEGMENT_SIZE) {
+		seg->set_length(BUFFER_SEGMENT_SIZE - stream_.avail_out);
+		out->append(seg);
+	}
+	seg->unref();
+
+	if (error != Z_OK) {
+		ERROR(log_) << "Could not change compression level: " << zError(error);
+		return (false);
+	}
+	level_ = level;
+
+	return (true);
+}
+
+/*
+ * Feed all of in (which may be NULL) through deflate and finish with the
+ * requested flush, appending output to out a BufferSegment at a time.
+ */
+bool
+DeflatePipe::deflate_buffer(Buffer *out, Buffer *in, int flush)
+{
+	BufferSegment *seg = NULL;
+	size_t inlen = in == NULL ? 0 : in->length();
+	size_t outlen = out->length();
 
 	for (;;) {
-		Buffer::SegmentIterator iter = in->segments();
-		const BufferSegment *seg;
-		int flush;
+		const BufferSegment *iseg;
+		int mode;
 
-		if (iter.end()) {
-			seg = NULL;
-			flush = first ? Z_FINISH : Z_SYNC_FLUSH;
+		if (in == NULL || in->empty()) {
+			iseg = NULL;
+			mode = flush;
 
 			stream_.avail_in = 0;
 			stream_.next_in = Z_NULL;
 		} else {
-			seg = *iter;
-			flush = Z_NO_FLUSH;
-			first = false;
+			iseg = *in->segments();
+			mode = Z_NO_FLUSH;
 
-			stream_.avail_in = seg->length();
-			stream_.next_in = (Bytef *)(uintptr_t)seg->data();
+			stream_.avail_in = iseg->length();
+			stream_.next_in = (Bytef *)(uintptr_t)iseg->data();
 		}
 
 		for (;;) {
-			int error = deflate(&stream_, flush);
-			if (error == Z_OK && stream_.avail_out > 0 &&
-			    flush == Z_NO_FLUSH)
-				break;
-
-			out.append(outbuf, sizeof outbuf - stream_.avail_out);
-			stream_.avail_out = sizeof outbuf;
-			stream_.next_out = outbuf;
-
-			if (flush == Z_NO_FLUSH)
-				break;
-			if (flush == Z_SYNC_FLUSH && error == Z_OK) {
-				if (!out.empty())
-					produce(&out);
-				return;
+			if (seg == NULL) {
+				seg = BufferSegment::create();
+				stream_.avail_out = BUFFER_SEGMENT_SIZE;
+				stream_.next_out = seg->tail();
 			}
-			if (flush == Z_FINISH && error == Z_STREAM_END) {
-				produce_eos(&out);
-				return;
+
+			int error = deflate(&stream_, mode);
+			if (error == Z_STREAM_ERROR) {
+				ERROR(log_) << "deflate(): " << zError(error);
+				seg->unref();
+				return (false);
+			}
+
+			if (stream_.avail_out == 0) {
+				seg->set_length(BUFFER_SEGMENT_SIZE);
+				out->append(seg);
+				seg->unref();
+				seg = NULL;
+				continue;
 			}
-			/* More data to output.  */
+
+			/*
+			 * There is output space left over, so deflate has
+			 * consumed all input and completed any flush, unless
+			 * we are finishing and the end has not been written.
+			 */
+			if (mode == Z_FINISH && error != Z_STREAM_END)
+				continue;
+			break;
+		}
+
+		if (iseg == NULL)
+			break;
+		ASSERT(log_, stream_.avail_in == 0);
+		in->skip(iseg->length());
+	}
+
+	if (seg != NULL) {
+		if (stream_.avail_out != BUFFER_SEGMENT_SIZE) {
+			seg->set_length(BUFFER_SEGMENT_SIZE - stream_.avail_out);
+			out->append(seg);
 		}
+		seg->unref();
+	}
+
+	if (bypass_threshold_ != 0) {
+		window_in_ += inlen;
+		window_out_ += out->length() - outlen;
+	}
+
+	return (true);
+}
+
+void
+DeflatePipe::flush_cancel(void)
+{
+	if (flush_action_ != NULL) {
+		flush_action_->cancel();
+		flush_action_ = NULL;
+	}
+}
 
-		if (seg != NULL)
-			in->skip(seg->length() - stream_.avail_in);
+void
+DeflatePipe::flush_timeout(void)
+{
+	flush_action_->cancel();
+	flush_action_ = NULL;
+
+	Buffer out;
+	if (!deflate_buffer(&out, NULL, Z_SYNC_FLUSH)) {
+		produce_error();
+		return;
 	}
-	NOTREACHED(log_);
+	unflushed_bytes_ = 0;
+
+	if (!adapt(&out)) {
+		produce_error();
+		return;
+	}
+
+	if (!out.empty())
+		produce(&out);
 }
@@ -30,14 +30,69 @@
 
 #include <zlib.h>
 
+#define	DEFLATE_PROBE_BYTES	(64 * 1024)
+#define	DEFLATE_BYPASS_BYTES	(1024 * 1024)
+
+/*
+ * By default a DeflatePipe does a Z_SYNC_FLUSH for every Buffer it consumes.
+ * If a flush interval is given, it instead defers the flush until either that
+ * many milliseconds have passed since the first unflushed byte arrived, or
+ * until the flush threshold (in input bytes) has been reached, whichever comes
+ * first.  That improves ratio and reduces overhead on chatty flows.
+ *
+ * If a bypass threshold (a percentage) is set, the ratio is measured over
+ * each DEFLATE_PROBE_BYTES of input, and if deflate is saving less than the
+ * threshold the pipe drops to level 0 for the next DEFLATE_BYPASS_BYTES, after
+ * which it probes again.  Level 0 emits stored blocks, so already-compressed
+ * data costs little more than a copy and the peer needs no changes.
+ */
 class DeflatePipe : public PipeProducer {
 	z_stream stream_;
+	int level_;
+	unsigned flush_ms_;
+	size_t flush_bytes_;
+	size_t unflushed_bytes_;
+	Action *flush_action_;
+	int probe_level_;
+	unsigned bypass_threshold_;
+	bool bypassing_;
+	size_t window_in_;
+	size_t window_out_;
+	intmax_t bypass_bytes_;
+	intmax_t bypass_count_;
+	intmax_t *bypass_bytesp_;
+	intmax_t *bypass_countp_;
 public:
-	DeflatePipe(int = 0);
+	DeflatePipe(int = 0, unsigned = 0, size_t = 0);
 	~DeflatePipe();
 
+	int level(void) const
+	{
+		return (level_);
+	}
+
+	intmax_t bypass_bytes(void) const
+	{
+		return (bypass_bytes_);
+	}
+
+	intmax_t bypass_count(void) const
+	{
+		return (bypass_count_);
+	}
+
+	bool set_level(int);
+	void set_bypass(unsigned, intmax_t * = NULL, intmax_t * = NULL);
+
 private:
 	void consume(Buffer *);
+
+	bool adapt(Buffer *);
+	bool change_level(Buffer *, int);
+	bool deflate_buffer(Buffer *, Buffer *, int);
+
+	void flush_cancel(void);
+	void flush_timeout(void);
 };
 
 #endif /* !ZLIB_DEFLATE_PIPE_H */
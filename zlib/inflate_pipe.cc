@@ -29,8 +29,6 @@
 
 #include <zlib/inflate_pipe.h>
 
-#define	INFLATE_CHUNK_SIZE	65536
-
 InflatePipe::InflatePipe(void)
 : PipeProducer("/zlib/inflate_pipe"),
   stream_()
@@ -58,30 +56,35 @@ void
 InflatePipe::consume(Buffer *in)
 {
 	Buffer out;
-	uint8_t outbuf[INFLATE_CHUNK_SIZE];
+	BufferSegment *seg = BufferSegment::create();
 	bool first = true;
 
-	stream_.avail_out = sizeof outbuf;
-	stream_.next_out = outbuf;
+	/*
+	 * Inflate directly into BufferSegments; a segment is passed on as
+	 * soon as it fills, and any partial segment is passed on when we
+	 * flush.
+	 */
+	stream_.avail_out = BUFFER_SEGMENT_SIZE;
+	stream_.next_out = seg->tail();
 
 	for (;;) {
 		Buffer::SegmentIterator iter = in->segments();
-		const BufferSegment *seg;
+		const BufferSegment *iseg;
 		int flush;
 
 		if (iter.end()) {
-			seg = NULL;
+			iseg = NULL;
 			flush = first ? Z_FINISH : Z_SYNC_FLUSH;
 
 			stream_.avail_in = 0;
 			stream_.next_in = Z_NULL;
 		} else {
-			seg = *iter;
+			iseg = *iter;
 			flush = Z_NO_FLUSH;
 			first = false;
 
-			stream_.avail_in = seg->length();
-			stream_.next_in = (Bytef *)(uintptr_t)seg->data();
+			stream_.avail_in = iseg->length();
+			stream_.next_in = (Bytef *)(uintptr_t)iseg->data();
 		}
 
 		for (;;) {
@@ -92,22 +95,30 @@ InflatePipe::consume(Buffer *in)
 			if (error == Z_NEED_DICT || error == Z_DATA_ERROR ||
 			    error == Z_MEM_ERROR) {
 				ERROR(log_) << "inflate(): " << zError(error);
+				seg->unref();
 				produce_error();
 				return;
 			}
 
 			if (flush != Z_NO_FLUSH && error == Z_BUF_ERROR &&
-			    stream_.avail_out == sizeof outbuf)
+			    stream_.avail_out == BUFFER_SEGMENT_SIZE)
 				error = Z_OK;
 
-			if (stream_.avail_out != sizeof outbuf)
-				out.append(outbuf, sizeof outbuf - stream_.avail_out);
-			stream_.avail_out = sizeof outbuf;
-			stream_.next_out = outbuf;
+			if (stream_.avail_out != BUFFER_SEGMENT_SIZE) {
+				seg->set_length(BUFFER_SEGMENT_SIZE - stream_.avail_out);
+				out.append(seg);
+				seg->unref();
+
+				seg = BufferSegment::create();
+			}
+			stream_.avail_out = BUFFER_SEGMENT_SIZE;
+			stream_.next_out = seg->tail();
 
 			if (flush == Z_NO_FLUSH)
 				break;
 			if (error == Z_OK || error == Z_STREAM_END) {
+				seg->unref();
+
 				if (flush == Z_FINISH && error == Z_STREAM_END) {
 					produce_eos(&out);
 				} else {
@@ -129,8 +140,8 @@ InflatePipe::consume(Buffer *in)
 			/* More data to output.  */
 		}
 
-		if (seg != NULL)
-			in->skip(seg->length() - stream_.avail_in);
+		if (iseg != NULL)
+			in->skip(iseg->length() - stream_.avail_in);
 	}
 	NOTREACHED(log_);
 }
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <common/test.h>
+
+#include <event/event_callback.h>
+#include <event/event_main.h>
+#include <event/event_system.h>
+
+#include <io/pipe/pipe.h>
+
+#include <zlib/deflate_pipe.h>
+#include <zlib/inflate_pipe.h>
+
+#define	BYPASS_THRESHOLD	(10)
+#define	BYPASS_CHUNK		(4096)
+#define	BYPASS_RANDOM_LENGTH	(2 * DEFLATE_PROBE_BYTES)
+#define	BYPASS_TEXT_LENGTH	(2 * DEFLATE_BYPASS_BYTES)
+
+/*
+ * Feeds random data and then text through a DeflatePipe with bypass enabled
+ * and on through an InflatePipe.  The random data should send the DeflatePipe
+ * into bypass, once, and the text bring it back out at the next probe; what
+ * comes out of the InflatePipe must be what went in either way.
+ */
+class Tester {
+	LogHandle log_;
+	TestGroup group_;
+	DeflatePipe deflate_;
+	InflatePipe inflate_;
+	intmax_t bypass_bytes_;
+	intmax_t bypass_count_;
+	Buffer data_;
+	Buffer input_;
+	Buffer output_;
+	size_t wire_bytes_;
+	Action *input_action_;
+	Action *deflate_action_;
+	Action *inflate_input_action_;
+	Action *inflate_action_;
+	bool input_eos_;
+	bool deflate_eos_;
+	bool inflate_eos_;
+	bool eos_;
+public:
+	Tester(void)
+	: log_("/test/zlib/deflate/bypass1"),
+	  group_("/test/zlib/deflate/bypass1", "DeflatePipe bypass #1"),
+	  deflate_(6),
+	  inflate_(),
+	  bypass_bytes_(0),
+	  bypass_count_(0),
+	  data_(),
+	  input_(),
+	  output_(),
+	  wire_bytes_(0),
+	  input_action_(NULL),
+	  deflate_action_(NULL),
+	  inflate_input_action_(NULL),
+	  inflate_action_(NULL),
+	  input_eos_(false),
+	  deflate_eos_(false),
+	  inflate_eos_(false),
+	  eos_(false)
+	{
+		unsigned i;
+
+		for (i = 0; i < BYPASS_RANDOM_LENGTH; i++)
+			data_.append((uint8_t)random());
+		while (data_.length() < BYPASS_RANDOM_LENGTH + BYPASS_TEXT_LENGTH)
+			data_.append("The quick brown fox jumps over the lazy dog.\n");
+		data_.truncate(BYPASS_RANDOM_LENGTH + BYPASS_TEXT_LENGTH);
+		input_ = data_;
+
+		deflate_.set_bypass(BYPASS_THRESHOLD, &bypass_bytes_, &bypass_count_);
+
+		EventCallback *dcb = callback(this, &Tester::deflate_complete);
+		deflate_action_ = ((Pipe *)&deflate_)->output(dcb);
+
+		EventCallback *icb = callback(this, &Tester::inflate_complete);
+		inflate_action_ = ((Pipe *)&inflate_)->output(icb);
+
+		input();
+	}
+
+	~Tester()
+	{
+		{
+			Test _(group_, "No pending actions.", input_action_ == NULL && deflate_action_ == NULL && inflate_input_action_ == NULL && inflate_action_ == NULL);
+		}
+
+		{
+			Test _(group_, "Got EOS.", eos_);
+		}
+
+		{
+			Test _(group_, "Got the data that was sent.", output_.equal(&data_));
+		}
+
+		{
+			Test _(group_, "Bypassed once.", deflate_.bypass_count() == 1);
+		}
+
+		{
+			Test _(group_, "Bypassed no more than one window.", deflate_.bypass_bytes() > 0 && deflate_.bypass_bytes() <= DEFLATE_BYPASS_BYTES);
+		}
+
+		{
+			Test _(group_, "Shared counters match the pipe's.", bypass_bytes_ == deflate_.bypass_bytes() && bypass_count_ == deflate_.bypass_count());
+		}
+
+		{
+			Test _(group_, "Text after bypass compressed.", wire_bytes_ < BYPASS_RANDOM_LENGTH + DEFLATE_BYPASS_BYTES);
+		}
+	}
+
+private:
+	void input(void)
+	{
+		Buffer chunk;
+
+		if (input_.length() == BYPASS_TEXT_LENGTH) {
+			Test _(group_, "Random data bypassed.", deflate_.bypass_count() == 1 && deflate_.bypass_bytes() > 0);
+		}
+
+		if (input_.empty())
+			input_eos_ = true;
+		else
+			input_.moveout(&chunk, input_.length() < BYPASS_CHUNK ? input_.length() : BYPASS_CHUNK);
+
+		EventCallback *cb = callback(this, &Tester::input_complete);
+		input_action_ = ((Pipe *)&deflate_)->input(&chunk, cb);
+	}
+
+	void input_complete(Event e)
+	{
+		input_action_->cancel();
+		input_action_ = NULL;
+
+		if (e.type_ != Event::Done) {
+			Test _(group_, "Expected input event.", false);
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		if (input_eos_)
+			return;
+
+		if (input_.length() == BYPASS_RANDOM_LENGTH + BYPASS_TEXT_LENGTH - (DEFLATE_PROBE_BYTES - BYPASS_CHUNK)) {
+			Test _(group_, "Nothing bypassed before the first probe.", deflate_.bypass_count() == 0 && deflate_.bypass_bytes() == 0);
+		}
+
+		input();
+	}
+
+	void deflate_complete(Event e)
+	{
+		deflate_action_->cancel();
+		deflate_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+		case Event::EOS:
+			break;
+		default:
+			{
+				Test _(group_, "Expected deflate output event.", false);
+			}
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		if (e.type_ == Event::EOS)
+			deflate_eos_ = true;
+		wire_bytes_ += e.buffer_.length();
+		inflate_input(&e.buffer_);
+	}
+
+	/*
+	 * Pass deflate's output on, and after the last of it, EOS.
+	 */
+	void inflate_input(Buffer *buf)
+	{
+		if (buf->empty())
+			inflate_eos_ = true;
+
+		ASSERT(log_, inflate_input_action_ == NULL);
+		EventCallback *cb = callback(this, &Tester::inflate_input_complete);
+		inflate_input_action_ = ((Pipe *)&inflate_)->input(buf, cb);
+	}
+
+	void inflate_input_complete(Event e)
+	{
+		inflate_input_action_->cancel();
+		inflate_input_action_ = NULL;
+
+		if (e.type_ != Event::Done) {
+			Test _(group_, "Expected inflate input event.", false);
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		if (inflate_eos_)
+			return;
+
+		if (deflate_eos_) {
+			Buffer eos;
+			inflate_input(&eos);
+			return;
+		}
+
+		EventCallback *cb = callback(this, &Tester::deflate_complete);
+		deflate_action_ = ((Pipe *)&deflate_)->output(cb);
+	}
+
+	void inflate_complete(Event e)
+	{
+		inflate_action_->cancel();
+		inflate_action_ = NULL;
+
+		switch (e.type_) {
+		case Event::Done:
+			output_.append(e.buffer_);
+			break;
+		case Event::EOS:
+			output_.append(e.buffer_);
+			eos_ = true;
+			EventSystem::instance()->stop();
+			return;
+		default:
+			{
+				Test _(group_, "Expected inflate output event.", false);
+			}
+			EventSystem::instance()->stop();
+			return;
+		}
+
+		EventCallback *cb = callback(this, &Tester::inflate_complete);
+		inflate_action_ = ((Pipe *)&inflate_)->output(cb);
+	}
+};
+
+int
+main(void)
+{
+	Tester tester;
+	event_main();
+}
@@ -0,0 +1,7 @@
+VPATH+=	${TOPDIR}/zstd
+
+SRCS+=	zstd_compress_pipe.cc
+SRCS+=	zstd_decompress_pipe.cc
+SRCS+=	zstd_dictionary.cc
+
+LDADD+=	-lzstd
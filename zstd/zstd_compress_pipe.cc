@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+
+#include <zstd/zstd_compress_pipe.h>
+#include <zstd/zstd_dictionary.h>
+
+/*
+ * A streaming Zstandard compressor.  Each Buffer consumed is followed by a
+ * flush so that the peer can decode it without waiting for more data, and
+ * EOS ends the frame.
+ *
+ * A non-zero window log enables long-distance matching with a window of that
+ * size, which finds repeats far beyond the reach of deflate and so works
+ * well alongside XCodec.  The peer must allow a window at least that large.
+ *
+ * A dictionary is only referenced, not loaded, so that it is digested once
+ * for every flow.  Its compression parameters supersede those set here.
+ */
+
+ZstdCompressPipe::ZstdCompressPipe(int level, unsigned window_log, const ZstdDictionary *dictionary)
+: PipeProducer("/zstd/compress_pipe"),
+  cctx_(NULL)
+{
+	cctx_ = ZSTD_createCCtx();
+	if (cctx_ == NULL)
+		HALT(log_) << "Could not create compression context.";
+
+	size_t error = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+	if (ZSTD_isError(error))
+		HALT(log_) << "Could not set compression level: " << ZSTD_getErrorName(error);
+
+	if (window_log != 0) {
+		error = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_windowLog, window_log);
+		if (ZSTD_isError(error))
+			HALT(log_) << "Could not set window log: " << ZSTD_getErrorName(error);
+
+		error = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_enableLongDistanceMatching, 1);
+		if (ZSTD_isError(error))
+			HALT(log_) << "Could not enable long-distance matching: " << ZSTD_getErrorName(error);
+	}
+
+	if (dictionary != NULL) {
+		error = ZSTD_CCtx_refCDict(cctx_, dictionary->cdict());
+		if (ZSTD_isError(error))
+			HALT(log_) << "Could not use dictionary: " << ZSTD_getErrorName(error);
+	}
+}
+
+ZstdCompressPipe::~ZstdCompressPipe()
+{
+	if (cctx_ != NULL) {
+		ZSTD_freeCCtx(cctx_);
+		cctx_ = NULL;
+	}
+}
+
+void
+ZstdCompressPipe::consume(Buffer *in)
+{
+	Buffer out;
+
+	if (in->empty()) {
+		if (!compress(&out, NULL, ZSTD_e_end)) {
+			produce_error();
+			return;
+		}
+		produce_eos(&out);
+		return;
+	}
+
+	if (!compress(&out, in, ZSTD_e_flush)) {
+		produce_error();
+		return;
+	}
+
+	if (!out.empty())
+		produce(&out);
+}
+
+/*
+ * Feed all of in (which may be NULL) to the compressor and finish with the
+ * requested directive, writing output directly into BufferSegments.
+ */
+bool
+ZstdCompressPipe::compress(Buffer *out, Buffer *in, ZSTD_EndDirective mode)
+{
+	BufferSegment *seg = NULL;
+	ZSTD_outBuffer obuf;
+
+	for (;;) {
+		const BufferSegment *iseg;
+		ZSTD_EndDirective directive;
+		ZSTD_inBuffer ibuf;
+
+		if (in == NULL || in->empty()) {
+			iseg = NULL;
+			directive = mode;
+
+			ibuf.src = NULL;
+			ibuf.size = 0;
+		} else {
+			iseg = *in->segments();
+			directive = ZSTD_e_continue;
+
+			ibuf.src = iseg->data();
+			ibuf.size = iseg->length();
+		}
+		ibuf.pos = 0;
+
+		for (;;) {
+			if (seg == NULL) {
+				seg = BufferSegment::create();
+				obuf.dst = seg->tail();
+				obuf.size = BUFFER_SEGMENT_SIZE;
+				obuf.pos = 0;
+			}
+
+			size_t remaining = ZSTD_compressStream2(cctx_, &obuf, &ibuf, directive);
+			if (ZSTD_isError(remaining)) {
+				ERROR(log_) << "ZSTD_compressStream2(): " << ZSTD_getErrorName(remaining);
+				seg->unref();
+				return (false);
+			}
+
+			if (obuf.pos == obuf.size) {
+				seg->set_length(obuf.pos);
+				out->append(seg);
+				seg->unref();
+				seg = NULL;
+			}
+
+			if (directive == ZSTD_e_continue) {
+				if (ibuf.pos == ibuf.size)
+					break;
+				continue;
+			}
+
+			if (remaining == 0)
+				break;
+			/* More data to output.  */
+		}
+
+		if (iseg == NULL)
+			break;
+		in->skip(iseg->length());
+	}
+
+	if (seg != NULL) {
+		if (obuf.pos != 0) {
+			seg->set_length(obuf.pos);
+			out->append(seg);
+		}
+		seg->unref();
+	}
+
+	return (true);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <event/event_callback.h>
+
+#include <io/pipe/pipe.h>
+
+#include <zstd/zstd_decompress_pipe.h>
+#include <zstd/zstd_dictionary.h>
+
+ZstdDecompressPipe::ZstdDecompressPipe(unsigned window_log_max, const ZstdDictionary *dictionary)
+: PipeProducer("/zstd/decompress_pipe"),
+  dctx_(NULL),
+  frame_complete_(true)
+{
+	dctx_ = ZSTD_createDCtx();
+	if (dctx_ == NULL)
+		HALT(log_) << "Could not create decompression context.";
+
+	if (window_log_max != 0) {
+		size_t error = ZSTD_DCtx_setParameter(dctx_, ZSTD_d_windowLogMax, window_log_max);
+		if (ZSTD_isError(error))
+			HALT(log_) << "Could not set maximum window log: " << ZSTD_getErrorName(error);
+	}
+
+	if (dictionary != NULL) {
+		size_t error = ZSTD_DCtx_refDDict(dctx_, dictionary->ddict());
+		if (ZSTD_isError(error))
+			HALT(log_) << "Could not use dictionary: " << ZSTD_getErrorName(error);
+	}
+}
+
+ZstdDecompressPipe::~ZstdDecompressPipe()
+{
+	if (dctx_ != NULL) {
+		ZSTD_freeDCtx(dctx_);
+		dctx_ = NULL;
+	}
+}
+
+void
+ZstdDecompressPipe::consume(Buffer *in)
+{
+	if (in->empty()) {
+		if (!frame_complete_) {
+			ERROR(log_) << "Stream ended in the middle of a frame.";
+			produce_error();
+			return;
+		}
+		produce_eos();
+		return;
+	}
+
+	Buffer out;
+	BufferSegment *seg = BufferSegment::create();
+	ZSTD_outBuffer obuf;
+
+	obuf.dst = seg->tail();
+	obuf.size = BUFFER_SEGMENT_SIZE;
+	obuf.pos = 0;
+
+	while (!in->empty()) {
+		const BufferSegment *iseg = *in->segments();
+		ZSTD_inBuffer ibuf;
+
+		ibuf.src = iseg->data();
+		ibuf.size = iseg->length();
+		ibuf.pos = 0;
+
+		for (;;) {
+			size_t hint = ZSTD_decompressStream(dctx_, &obuf, &ibuf);
+			if (ZSTD_isError(hint)) {
+				ERROR(log_) << "ZSTD_decompressStream(): " << ZSTD_getErrorName(hint);
+				seg->unref();
+				produce_error();
+				return;
+			}
+			frame_complete_ = hint == 0;
+
+			/*
+			 * If the output segment filled up there may be more
+			 * output buffered in the decompressor even when all of
+			 * the input has been consumed.
+			 */
+			if (obuf.pos == obuf.size) {
+				seg->set_length(obuf.pos);
+				out.append(seg);
+				seg->unref();
+
+				seg = BufferSegment::create();
+				obuf.dst = seg->tail();
+				obuf.pos = 0;
+				continue;
+			}
+
+			if (ibuf.pos == ibuf.size)
+				break;
+		}
+
+		in->skip(iseg->length());
+	}
+
+	if (obuf.pos != 0) {
+		seg->set_length(obuf.pos);
+		out.append(seg);
+	}
+	seg->unref();
+
+	if (!out.empty())
+		produce(&out);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include <common/buffer.h>
+
+#include <zstd/zstd_dictionary.h>
+
+ZstdDictionary::ZstdDictionary(void)
+: log_("/zstd/dictionary"),
+  cdict_(NULL),
+  ddict_(NULL)
+{ }
+
+ZstdDictionary::~ZstdDictionary()
+{
+	if (cdict_ != NULL) {
+		ZSTD_freeCDict(cdict_);
+		cdict_ = NULL;
+	}
+
+	if (ddict_ != NULL) {
+		ZSTD_freeDDict(ddict_);
+		ddict_ = NULL;
+	}
+}
+
+/*
+ * Both dictionaries copy what they need, so the data may go once they are
+ * made.  Returns NULL if either can not be made.
+ */
+ZstdDictionary *
+ZstdDictionary::create(const Buffer *data, int level)
+{
+	ASSERT("/zstd/dictionary", !data->empty());
+
+	std::vector<uint8_t> dict(data->length());
+	data->copyout(&dict[0], dict.size());
+
+	ZstdDictionary *dictionary = new ZstdDictionary();
+
+	dictionary->cdict_ = ZSTD_createCDict(&dict[0], dict.size(), level);
+	if (dictionary->cdict_ == NULL) {
+		ERROR(dictionary->log_) << "Could not digest dictionary for compression.";
+		delete dictionary;
+		return (NULL);
+	}
+
+	dictionary->ddict_ = ZSTD_createDDict(&dict[0], dict.size());
+	if (dictionary->ddict_ == NULL) {
+		ERROR(dictionary->log_) << "Could not digest dictionary for decompression.";
+		delete dictionary;
+		return (NULL);
+	}
+
+	return (dictionary);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	ZSTD_ZSTD_DICTIONARY_H
+#define	ZSTD_ZSTD_DICTIONARY_H
+
+#include <zstd.h>
+
+/*
+ * A dictionary digested once, for compression at a given level and for
+ * decompression, and shared by every pipe that uses it.  It must outlive
+ * those pipes.
+ */
+class ZstdDictionary {
+	LogHandle log_;
+	ZSTD_CDict *cdict_;
+	ZSTD_DDict *ddict_;
+
+	ZstdDictionary(void);
+public:
+	~ZstdDictionary();
+
+	const ZSTD_CDict *cdict(void) const
+	{
+		return (cdict_);
+	}
+
+	const ZSTD_DDict *ddict(void) const
+	{
+		return (ddict_);
+	}
+
+	static ZstdDictionary *create(const Buffer *, int);
+};
+
+#endif /* !ZSTD_ZSTD_DICTIONARY_H */